@@ -5,13 +5,13 @@ Captures video, detects hands using MediaPipe, and sends data to SteamVR driver.
 import cv2
 import mediapipe as mp
 import json
-import time
 import sys
 from typing import List, Tuple, Optional
 from hand_data import HandData
 from gesture_detector import GestureDetector
 from utils.camera_utils import CameraCapture
 from utils.socket_client import SocketClient
+from utils.shm_client import SharedMemoryClient
 
 
 class HandTracker:
@@ -57,10 +57,26 @@ class HandTracker:
         
         # Initialize socket client
         net_config = self.config['network']
-        self.socket_client = SocketClient(
-            host=net_config['host'],
-            port=net_config['port']
-        )
+        self.net_config = net_config
+        self.transport = net_config.get('transport', 'tcp')
+        
+        # Wire protocol: "text" (human readable) or "binary" (compact fixed frames).
+        # The shared memory ring only carries binary frames.
+        self.protocol = 'binary' if self.transport == 'shm' else net_config.get('protocol', 'text')
+        
+        if self.transport == 'shm':
+            self.socket_client = SharedMemoryClient(name=net_config.get('shm_name', 'handcameradriver'))
+        else:
+            self.socket_client = SocketClient(
+                host=net_config['host'],
+                port=net_config['port'],
+                transport=self.transport,
+                protocol=self.protocol
+            )
+        
+        # Per hand sample counters, so the driver can spot lost and reordered samples
+        self.sequence = {'left': 0, 'right': 0}
+        self.frame_number = 0
         
         # Debug settings
         self.debug = self.config['debug']
@@ -74,7 +90,7 @@ class HandTracker:
         print("HandTracker initialized")
         print(f"Camera: {cam_config['width']}x{cam_config['height']} @ {cam_config['fps']}fps")
         print(f"Tracking: max {self.config['tracking']['max_hands']} hands")
-        print(f"Network: {net_config['host']}:{net_config['port']}")
+        print(f"Network: {net_config['host']}:{net_config['port']} ({self.transport}, {self.protocol} protocol)")
     
     def load_config(self, config_path: str) -> dict:
         """
@@ -98,7 +114,7 @@ class HandTracker:
             return {
                 "camera": {"device_id": 0, "width": 640, "height": 480, "fps": 60, "flip_horizontal": True},
                 "tracking": {"max_hands": 2, "detection_confidence": 0.7, "tracking_confidence": 0.5, "model_complexity": 1},
-                "network": {"host": "127.0.0.1", "port": 65432},
+                "network": {"host": "127.0.0.1", "port": 65432, "protocol": "text", "transport": "tcp"},
                 "gestures": {"pinch_threshold": 0.05, "finger_extended_threshold": 0.6},
                 "calibration": {"position_offset": [0.0, 0.0, 0.0], "scale": 1.0},
                 "debug": {"show_video": True, "show_landmarks": True, "show_fps": True, "log_gestures": False}
@@ -243,7 +259,19 @@ class HandTracker:
         # Connect to driver
         print("Connecting to SteamVR driver...")
         if not self.socket_client.connect():
-            print("Warning: Could not connect to driver. Will keep trying...")
+            if self.transport == 'shm':
+                # Driver not running yet, or not on Linux: use loopback TCP instead
+                print("Shared memory ring not available, falling back to TCP")
+                self.transport = 'tcp'
+                self.socket_client = SocketClient(
+                    host=self.net_config['host'],
+                    port=self.net_config['port'],
+                    protocol=self.protocol
+                )
+                if not self.socket_client.connect():
+                    print("Warning: Could not connect to driver. Will keep trying...")
+            else:
+                print("Warning: Could not connect to driver. Will keep trying...")
         
         print("\nHand tracking active!")
         print("Press 'q' to quit\n")
@@ -256,6 +284,10 @@ class HandTracker:
                     print("Failed to read frame")
                     break
                 
+                # Taken before hand detection, so the driver can see how long that takes.
+                # On the driver's clock once the socket client has synced to it.
+                capture_time_us = self.socket_client.now_us()
+                
                 # Convert to RGB for MediaPipe
                 frame_rgb = cv2.cvtColor(frame, cv2.COLOR_BGR2RGB)
                 
@@ -286,10 +318,21 @@ class HandTracker:
                             print(f"{hand_data.hand_type}: {hand_data.gesture} "
                                   f"T:{hand_data.trigger_value:.2f} G:{hand_data.grip_value:.2f}")
                 
-                # Send data to driver
+                # Send data to driver, all hands of this frame in one message
                 for hand_data in hands_data:
-                    protocol_string = hand_data.to_protocol_string()
-                    self.socket_client.send(protocol_string)
+                    hand_data.sequence = self.sequence[hand_data.hand_type]
+                    hand_data.capture_time_us = capture_time_us
+                    self.sequence[hand_data.hand_type] += 1
+                
+                if hands_data:
+                    if self.transport == 'shm':
+                        # The ring holds single hand frames
+                        self.socket_client.send_frame([hand.to_binary_frame() for hand in hands_data])
+                    else:
+                        self.socket_client.send(HandData.to_batch(hands_data, self.frame_number, capture_time_us,
+                                                                  self.socket_client.now_us(),
+                                                                  binary=self.protocol == 'binary'))
+                self.frame_number += 1
                 
                 # Draw info overlay
                 if self.debug['show_video']:
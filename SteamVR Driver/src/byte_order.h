@@ -0,0 +1,56 @@
+//============ Copyright (c) Valve Corporation, All rights reserved. ============
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+
+// Little endian reads and writes of the wire formats' fields (binary hand frames, capture files), whatever the
+// byte order of the machine. The pointers needn't be aligned. Internal to the driver, not part of any protocol.
+
+inline uint16_t ReadU16( const uint8_t *bytes )
+{
+	return static_cast< uint16_t >( bytes[ 0 ] | ( bytes[ 1 ] << 8 ) );
+}
+
+inline uint32_t ReadU32( const uint8_t *bytes )
+{
+	return static_cast< uint32_t >( bytes[ 0 ] ) | ( static_cast< uint32_t >( bytes[ 1 ] ) << 8 ) | ( static_cast< uint32_t >( bytes[ 2 ] ) << 16 ) | ( static_cast< uint32_t >( bytes[ 3 ] ) << 24 );
+}
+
+inline uint64_t ReadU64( const uint8_t *bytes )
+{
+	return static_cast< uint64_t >( ReadU32( bytes ) ) | ( static_cast< uint64_t >( ReadU32( bytes + 4 ) ) << 32 );
+}
+
+inline float ReadF32( const uint8_t *bytes )
+{
+	const uint32_t bits = ReadU32( bytes );
+	float value;
+	memcpy( &value, &bits, sizeof( value ) );
+	return value;
+}
+
+inline void WriteU16( uint8_t *bytes, uint16_t value )
+{
+	bytes[ 0 ] = static_cast< uint8_t >( value );
+	bytes[ 1 ] = static_cast< uint8_t >( value >> 8 );
+}
+
+inline void WriteU32( uint8_t *bytes, uint32_t value )
+{
+	for ( int i = 0; i < 4; i++ )
+		bytes[ i ] = static_cast< uint8_t >( value >> ( i * 8 ) );
+}
+
+inline void WriteU64( uint8_t *bytes, uint64_t value )
+{
+	WriteU32( bytes, static_cast< uint32_t >( value ) );
+	WriteU32( bytes + 4, static_cast< uint32_t >( value >> 32 ) );
+}
+
+inline void WriteF32( uint8_t *bytes, float value )
+{
+	uint32_t bits;
+	memcpy( &bits, &value, sizeof( bits ) );
+	WriteU32( bytes, bits );
+}
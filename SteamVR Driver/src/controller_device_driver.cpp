@@ -1,22 +1,45 @@
 //============ Copyright (c) Valve Corporation, All rights reserved. ============
 #include "controller_device_driver.h"
 
+#include "driver_clock.h"
 #include "driverlog.h"
 #include "vrmath.h"
 
+#include <cstdio>
+#include <cstring>
+
 // Let's create some variables for strings used in getting settings.
 // This is the section where all of the settings we want are stored. A section name can be anything,
 // but if you want to store driver specific settings, it's best to namespace the section with the driver identifier
 // ie "<my_driver>_<section>" to avoid collisions
-static const char *my_controller_main_settings_section = "driver_simplecontroller";
+static const char *my_controller_main_settings_section = "driver_hand_camera_tracking";
 
 // Individual right/left hand settings sections
-static const char *my_controller_right_settings_section = "driver_simplecontroller_left_controller";
-static const char *my_controller_left_settings_section = "driver_simplecontroller_right_controller";
+static const char *my_controller_right_settings_section = "driver_hand_camera_tracking_right_hand";
+static const char *my_controller_left_settings_section = "driver_hand_camera_tracking_left_hand";
 
 // These are the keys we want to retrieve the values for in the settings
-static const char *my_controller_settings_key_model_number = "mycontroller_model_number";
-static const char *my_controller_settings_key_serial_number = "mycontroller_serial_number";
+static const char *my_controller_settings_key_model_number = "model_number";
+static const char *my_controller_settings_key_serial_number = "serial_number";
+
+// Producer timestamps further in the past than this are taken to be from a clock other than ours
+static constexpr int64_t k_unMaxCaptureAgeUs = 1000000;
+
+// Beyond this age the hand has stopped updating, extrapolating it any further would only make it drift away
+static constexpr int64_t k_unMaxPredictionAgeUs = 150000;
+
+// How often MyRunFrame() logs the pipeline latencies
+static constexpr int64_t k_unLatencyLogIntervalUs = 10000000;
+
+static const char *const k_pchLatencyStageNames[ LatencyStage_MAX ] = { "capture->send", "send->receive", "receive->submit", "capture->submit" };
+
+// A producer timestamp on the driver clock, or 0 if it can't be one.
+// Producers on this machine use the same monotonic clock, remote ones sync theirs to it with the clock ping.
+static int64_t DriverTimeFromProducer( uint64_t unTimeUs, int64_t nNowUs )
+{
+	const int64_t time_us = static_cast< int64_t >( unTimeUs );
+	return time_us > 0 && time_us <= nNowUs && nNowUs - time_us < k_unMaxCaptureAgeUs ? time_us : 0;
+}
 
 
 MyControllerDeviceDriver::MyControllerDeviceDriver( vr::ETrackedControllerRole role )
@@ -24,6 +47,13 @@ MyControllerDeviceDriver::MyControllerDeviceDriver( vr::ETrackedControllerRole r
 	// Set a member to keep track of whether we've activated yet or not
 	is_active_ = false;
 
+	// Submit on a fixed 5 ms tick until told otherwise
+	pose_submit_mode_ = PoseSubmitMode_Fixed;
+	pose_period_ = std::chrono::milliseconds( 5 );
+	pose_keepalive_period_ = std::chrono::milliseconds( 50 );
+	pose_scheduler_ = nullptr;
+	pose_scheduler_slot_ = 0;
+
 	// The constructor takes a role argument, that gives us information about if our controller is a left or right hand.
 	// Let's store it for later use. We'll need it.
 	my_controller_role_ = role;
@@ -42,15 +72,19 @@ MyControllerDeviceDriver::MyControllerDeviceDriver( vr::ETrackedControllerRole r
 	my_controller_serial_number_ = serial_number;
 
 	// Initialize hand tracking data with neutral values
-	hand_position_x_ = 0.0f;
-	hand_position_y_ = 0.0f;
-	hand_position_z_ = 0.0f;
-	hand_rotation_qw_ = 1.0f;  // Identity quaternion
-	hand_rotation_qx_ = 0.0f;
-	hand_rotation_qy_ = 0.0f;
-	hand_rotation_qz_ = 0.0f;
-	trigger_value_ = 0.0f;
-	grip_value_ = 0.0f;
+	hand_state_written_ = {};
+	hand_state_written_.rotation[ 0 ] = 1.0f; // Identity quaternion
+	hand_state_written_.sample_time_us = DriverClockUs();
+	hand_state_.Store( hand_state_written_ );
+
+	pose_submit_count_ = 0;
+	is_idle_ = false;
+	input_shadow_ = {};
+	event_dispatch_table_ = nullptr;
+	pipeline_stats_ = nullptr;
+	hand_stats_ = nullptr;
+	latency_recorded_receive_time_us_ = 0;
+	latency_log_time_us_ = DriverClockUs();
 
 	// Here's an example of how to use our logging wrapper around IVRDriverLog
 	// In SteamVR logs (SteamVR Hamburger Menu > Developer Settings > Web console) drivers have a prefix of
@@ -118,7 +152,20 @@ vr::EVRInitError MyControllerDeviceDriver::Activate( uint32_t unObjectId )
 	// These are global across the device, and you can only have one per device.
 	vr::VRDriverInput()->CreateHapticComponent( container, "/output/haptic", &input_handles_[ MyComponent_haptic ] );
 
-	my_pose_update_thread_ = std::thread( &MyControllerDeviceDriver::MyPoseUpdateThread, this );
+	// From now on the device provider hands us the events for our device index and our haptic component
+	if ( event_dispatch_table_ != nullptr )
+	{
+		event_dispatch_table_->AddDevice( unObjectId, this );
+		event_dispatch_table_->AddComponent( input_handles_[ MyComponent_haptic ], this );
+	}
+
+	// Nothing has been sent for the new handles yet, MyRunFrame() sends every component once
+	for ( InputShadow &shadow : input_shadow_ )
+	{
+		shadow.is_sent = false;
+	}
+
+	// Our poses are submitted by the device provider's pose scheduler from now on, see SubmitScheduledPose()
 
 	// We've activated everything successfully!
 	// Let's tell SteamVR that by saying we don't have any errors.
@@ -139,11 +186,22 @@ void *MyControllerDeviceDriver::GetComponent( const char *pchComponentNameAndVer
 //-----------------------------------------------------------------------------
 // Purpose: This is called by vrserver when a debug request has been made from an application to the driver.
 // What is in the response and request is up to the application and driver to figure out themselves.
+// "stats" returns a JSON snapshot of the hand tracking pipeline (see PipelineStats), anything else an empty string.
 //-----------------------------------------------------------------------------
 void MyControllerDeviceDriver::DebugRequest( const char *pchRequest, char *pchResponseBuffer, uint32_t unResponseBufferSize )
 {
-	if ( unResponseBufferSize >= 1 )
-		pchResponseBuffer[ 0 ] = 0;
+	if ( unResponseBufferSize < 1 )
+		return;
+
+	pchResponseBuffer[ 0 ] = 0;
+
+	if ( strcmp( pchRequest, "stats" ) == 0 && pipeline_stats_ != nullptr )
+	{
+		if ( !pipeline_stats_->FormatJson( pchResponseBuffer, unResponseBufferSize ) )
+		{
+			snprintf( pchResponseBuffer, unResponseBufferSize, "{\"error\":\"response buffer too small\"}" );
+		}
+	}
 }
 
 //-----------------------------------------------------------------------------
@@ -153,77 +211,184 @@ void MyControllerDeviceDriver::DebugRequest( const char *pchRequest, char *pchRe
 vr::DriverPose_t MyControllerDeviceDriver::GetPose()
 {
 	// Let's retrieve the Hmd pose to base our controller pose off.
+	// The pose scheduler has one from its last tick, only ask the host if it hasn't run yet.
+	HmdPose hmd_pose = {};
+	if ( pose_scheduler_ != nullptr )
+	{
+		hmd_pose = pose_scheduler_->GetHmdPoseCache().Latest();
+	}
+	if ( hmd_pose.time_us == 0 )
+	{
+		hmd_pose = FetchHmdPose();
+	}
+
+	// One consistent snapshot of the latest hand tracking sample
+	return BuildPose( hand_state_.Load(), hmd_pose );
+}
 
+vr::DriverPose_t MyControllerDeviceDriver::BuildPose( const HandState &hand_state, const HmdPose &hmd_pose )
+{
 	// First, initialize the struct that we'll be submitting to the runtime to tell it we've updated our pose.
-	vr::DriverPose_t pose = { 0 };
+	vr::DriverPose_t pose = {};
 
 	// These need to be set to be valid quaternions. The device won't appear otherwise.
 	pose.qWorldFromDriverRotation.w = 1.f;
 	pose.qDriverFromHeadRotation.w = 1.f;
 
-	vr::TrackedDevicePose_t hmd_pose{};
+	// The hand was seen relative to where the head was when the camera took the picture, not where it is now.
+	// As long as the sample is recent enough to predict from, we put it together with the hmd pose of that moment,
+	// otherwise every head movement since then would drag the hand along with it.
+	const int64_t sample_age_us = DriverClockUs() - hand_state.sample_time_us;
+	const bool predict = sample_age_us >= 0 && sample_age_us <= k_unMaxPredictionAgeUs;
 
-	// GetRawTrackedDevicePoses expects an array.
-	// We only want the hmd pose, which is at index 0 of the array so we can just pass the struct in directly, instead of in an array
-	vr::VRServerDriverHost()->GetRawTrackedDevicePoses( 0.f, &hmd_pose, 1 );
+	HmdPose capture_hmd_pose;
+	const bool at_capture_time = predict && pose_scheduler_ != nullptr && pose_scheduler_->GetHmdPoseCache().PoseAt( hand_state.sample_time_us, capture_hmd_pose );
 
-	// Get the position of the hmd from the 3x4 matrix GetRawTrackedDevicePoses returns
-	const vr::HmdVector3_t hmd_position = HmdVector3_From34Matrix( hmd_pose.mDeviceToAbsoluteTracking );
-	// Get the orientation of the hmd from the 3x4 matrix GetRawTrackedDevicePoses returns
-	const vr::HmdQuaternion_t hmd_orientation = HmdQuaternion_FromMatrix( hmd_pose.mDeviceToAbsoluteTracking );
+	// The position and orientation of the hmd, already decoded from the 3x4 matrix GetRawTrackedDevicePoses returns
+	const HmdPose &head_pose = at_capture_time ? capture_hmd_pose : hmd_pose;
+	const vr::HmdVector3_t &hmd_position = head_pose.position;
+	const vr::HmdQuaternion_t &hmd_orientation = head_pose.orientation;
 
 	// Use hand tracking rotation if available, otherwise use default orientation
 	vr::HmdQuaternion_t hand_rotation;
-	hand_rotation.w = hand_rotation_qw_.load();
-	hand_rotation.x = hand_rotation_qx_.load();
-	hand_rotation.y = hand_rotation_qy_.load();
-	hand_rotation.z = hand_rotation_qz_.load();
+	hand_rotation.w = hand_state.rotation[ 0 ];
+	hand_rotation.x = hand_state.rotation[ 1 ];
+	hand_rotation.y = hand_state.rotation[ 2 ];
+	hand_rotation.z = hand_state.rotation[ 3 ];
 
 	// Apply hand rotation to the HMD orientation
 	pose.qRotation = hmd_orientation * hand_rotation;
 
 	// Use hand tracking position if available
 	const vr::HmdVector3_t offset_position = {
-		hand_position_x_.load(),
-		hand_position_y_.load(),
-		hand_position_z_.load()
+		hand_state.position[ 0 ],
+		hand_state.position[ 1 ],
+		hand_state.position[ 2 ]
 	};
 
 	// Rotate our offset by the hmd quaternion (so the controllers are always facing towards us), and add then add the position of the hmd to put it into position.
-	const vr::HmdVector3_t position = hmd_position + ( offset_position * hmd_orientation );
+	const vr::HmdVector3_t rotated_offset = offset_position * hmd_orientation;
+	const vr::HmdVector3_t position = hmd_position + rotated_offset;
 
 	// copy our position to our pose
 	pose.vecPosition[ 0 ] = position.v[ 0 ];
 	pose.vecPosition[ 1 ] = position.v[ 1 ];
 	pose.vecPosition[ 2 ] = position.v[ 2 ];
 
-	// The pose we provided is valid.
-	// This should be set is
-	pose.poseIsValid = true;
+	// Tell SteamVR how old the hand data is and how it's moving, so it can extrapolate to when the frame is displayed.
+	if ( predict )
+	{
+		vr::HmdVector3_t velocity = vr::HmdVector3_t{ hand_state.velocity[ 0 ], hand_state.velocity[ 1 ], hand_state.velocity[ 2 ] } * hmd_orientation;
+		vr::HmdVector3_t angular_velocity = vr::HmdVector3_t{ hand_state.angular_velocity[ 0 ], hand_state.angular_velocity[ 1 ], hand_state.angular_velocity[ 2 ] } * hmd_orientation;
+
+		// With the head pose from capture time, the head's own motion since then has to be predicted as well:
+		// the hand is carried along by the head's velocity and swung around by its rotation.
+		// With the current head pose only the hand's motion relative to it needs predicting.
+		if ( at_capture_time )
+		{
+			const vr::HmdVector3_t &head_angular_velocity = head_pose.angular_velocity;
+			const vr::HmdVector3_t swing = {
+				head_angular_velocity.v[ 1 ] * rotated_offset.v[ 2 ] - head_angular_velocity.v[ 2 ] * rotated_offset.v[ 1 ],
+				head_angular_velocity.v[ 2 ] * rotated_offset.v[ 0 ] - head_angular_velocity.v[ 0 ] * rotated_offset.v[ 2 ],
+				head_angular_velocity.v[ 0 ] * rotated_offset.v[ 1 ] - head_angular_velocity.v[ 1 ] * rotated_offset.v[ 0 ]
+			};
+			velocity = velocity + head_pose.velocity + swing;
+			angular_velocity = angular_velocity + head_angular_velocity;
+		}
+
+		for ( int i = 0; i < 3; i++ )
+		{
+			pose.vecVelocity[ i ] = velocity.v[ i ];
+			pose.vecAngularVelocity[ i ] = angular_velocity.v[ i ];
+		}
+
+		// Negative, the pose is from the past
+		pose.poseTimeOffset = -static_cast< double >( sample_age_us ) * 1e-6;
+	}
+
+	// The pose we provided is valid, unless the pose scheduler has parked us for lack of hand data.
+	pose.poseIsValid = !is_idle_;
 
 	// Our device is always connected.
 	// In reality with physical devices, when they get disconnected,
 	// set this to false and icons in SteamVR will be updated to show the device is disconnected
 	pose.deviceIsConnected = true;
 
-	// The state of our tracking. For our virtual device, it's always going to be ok,
-	// but this can get set differently to inform the runtime about the state of the device's tracking
-	// and update the icons to inform the user accordingly.
-	pose.result = vr::TrackingResult_Running_OK;
+	// The state of our tracking. While we get hand data it's ok, while the pose scheduler is parked the hand
+	// is out of view (or nothing is sending), and SteamVR shows the controller as not tracking
+	// instead of a pose frozen where the hand was last seen.
+	pose.result = is_idle_ ? vr::TrackingResult_Running_OutOfRange : vr::TrackingResult_Running_OK;
 
 	return pose;
 }
 
-void MyControllerDeviceDriver::MyPoseUpdateThread()
+//-----------------------------------------------------------------------------
+// Purpose: Called by the pose scheduler whenever our pose is due, with the hmd pose of this tick.
+// It's not part of the ITrackedDeviceServerDriver interface, the scheduler runs every device from one thread.
+//-----------------------------------------------------------------------------
+void MyControllerDeviceDriver::SubmitScheduledPose( const HmdPose &hmd_pose, int64_t nLateUs )
 {
-	while ( is_active_ )
+	if ( !is_active_ )
 	{
-		// Inform the vrserver that our tracked device's pose has updated, giving it the pose returned by our GetPose().
-		vr::VRServerDriverHost()->TrackedDevicePoseUpdated( my_controller_index_, GetPose(), sizeof( vr::DriverPose_t ) );
+		return;
+	}
+
+	is_idle_ = false;
+
+	// Counted before the hand data is read, anything updated after this goes out with the next pose
+	pose_submit_count_.fetch_add( 1, std::memory_order_release );
 
-		// Update our pose every five milliseconds.
-		// In reality, you should update the pose whenever you have new data from your device.
-		std::this_thread::sleep_for( std::chrono::milliseconds( 5 ) );
+	// Inform the vrserver that our tracked device's pose has updated
+	const HandState hand_state = hand_state_.Load();
+	vr::VRServerDriverHost()->TrackedDevicePoseUpdated( my_controller_index_, BuildPose( hand_state, hmd_pose ), sizeof( vr::DriverPose_t ) );
+	RecordLatency( hand_state, DriverClockUs() );
+
+	if ( hand_stats_ != nullptr )
+	{
+		hand_stats_->submit_jitter_us.Record( nLateUs );
+	}
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Called by the pose scheduler right before it parks. Our last pose until there's hand data
+// again says we're not tracking.
+//-----------------------------------------------------------------------------
+void MyControllerDeviceDriver::SubmitIdlePose( const HmdPose &hmd_pose )
+{
+	is_idle_ = true;
+
+	if ( !is_active_ )
+	{
+		return;
+	}
+
+	vr::VRServerDriverHost()->TrackedDevicePoseUpdated( my_controller_index_, BuildPose( hand_state_.Load(), hmd_pose ), sizeof( vr::DriverPose_t ) );
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Adds the stages of the sample that was just submitted to the latency histograms, the first time it goes out.
+// Only called from the scheduler thread.
+//-----------------------------------------------------------------------------
+void MyControllerDeviceDriver::RecordLatency( const HandState &hand_state, int64_t nSubmitTimeUs )
+{
+	if ( hand_stats_ == nullptr || hand_state.receive_time_us == 0 || hand_state.receive_time_us == latency_recorded_receive_time_us_ )
+	{
+		return;
+	}
+	latency_recorded_receive_time_us_ = hand_state.receive_time_us;
+
+	if ( hand_state.capture_time_us != 0 && hand_state.send_time_us != 0 )
+	{
+		hand_stats_->latency_us[ LatencyStage_CaptureToSend ].Record( hand_state.send_time_us - hand_state.capture_time_us );
+	}
+	if ( hand_state.send_time_us != 0 )
+	{
+		hand_stats_->latency_us[ LatencyStage_SendToReceive ].Record( hand_state.receive_time_us - hand_state.send_time_us );
+	}
+	hand_stats_->latency_us[ LatencyStage_ReceiveToSubmit ].Record( nSubmitTimeUs - hand_state.receive_time_us );
+	if ( hand_state.capture_time_us != 0 )
+	{
+		hand_stats_->latency_us[ LatencyStage_CaptureToSubmit ].Record( nSubmitTimeUs - hand_state.capture_time_us );
 	}
 }
 
@@ -244,12 +409,13 @@ void MyControllerDeviceDriver::EnterStandby()
 //-----------------------------------------------------------------------------
 void MyControllerDeviceDriver::Deactivate()
 {
-	// Let's join our pose thread that's running
-	// by first checking then setting is_active_ to false to break out
-	// of the while loop, if it's running, then call .join() on the thread
-	if ( is_active_.exchange( false ) )
+	// The pose scheduler skips us from now on
+	is_active_ = false;
+
+	// And no more events are routed to us
+	if ( event_dispatch_table_ != nullptr )
 	{
-		my_pose_update_thread_.join();
+		event_dispatch_table_->RemoveDevice( this );
 	}
 
 	// unassign our controller index (we don't want to be calling vrserver anymore after Deactivate() has been called
@@ -264,22 +430,90 @@ void MyControllerDeviceDriver::Deactivate()
 void MyControllerDeviceDriver::MyRunFrame()
 {
 	// Update our inputs here with data from hand tracking
-	float trigger_val = trigger_value_.load();
-	float grip_val = grip_value_.load();
+	const HandState hand_state = hand_state_.Load();
+	float trigger_val = hand_state.trigger;
+	float grip_val = hand_state.grip;
+
+	// The values changed when the camera saw the hand, tell SteamVR how long ago that was (negative, in the past).
+	// Without a capture time we only know when the sample arrived.
+	const int64_t now_us = DriverClockUs();
+	const int64_t sample_age_us = now_us - ( hand_state.capture_time_us != 0 ? hand_state.capture_time_us : hand_state.receive_time_us );
+	const double time_offset = sample_age_us >= 0 && sample_age_us < k_unMaxCaptureAgeUs ? -static_cast< double >( sample_age_us ) * 1e-6 : 0.0;
 
 	// Update trigger
-	vr::VRDriverInput()->UpdateScalarComponent( input_handles_[ MyComponent_trigger_value ], trigger_val, 0 );
-	vr::VRDriverInput()->UpdateBooleanComponent( input_handles_[ MyComponent_trigger_click ], trigger_val > 0.5f, 0 );
+	UpdateScalarInput( MyComponent_trigger_value, trigger_val, time_offset );
+	UpdateBooleanInput( MyComponent_trigger_click, trigger_val > 0.5f, time_offset );
 
 	// Update grip
-	vr::VRDriverInput()->UpdateScalarComponent( input_handles_[ MyComponent_grip_value ], grip_val, 0 );
+	UpdateScalarInput( MyComponent_grip_value, grip_val, time_offset );
 
 	// Update A button based on gesture (you could map specific gestures here)
-	vr::VRDriverInput()->UpdateBooleanComponent( input_handles_[ MyComponent_a_click ], false, 0 );
-	vr::VRDriverInput()->UpdateBooleanComponent( input_handles_[ MyComponent_a_touch ], false, 0 );
+	UpdateBooleanInput( MyComponent_a_click, false, time_offset );
+	UpdateBooleanInput( MyComponent_a_touch, false, time_offset );
+
+	// Every now and then, log where the time between camera and pose goes
+	if ( hand_stats_ != nullptr && now_us - latency_log_time_us_ >= k_unLatencyLogIntervalUs && hand_stats_->latency_us[ LatencyStage_ReceiveToSubmit ].Count() > 0 )
+	{
+		latency_log_time_us_ = now_us;
+
+		for ( int stage = 0; stage < LatencyStage_MAX; stage++ )
+		{
+			char summary[ 128 ];
+			hand_stats_->latency_us[ stage ].Format( summary, sizeof( summary ), "us" );
+			DriverLog( "%s hand latency %s: %s (%llu samples)", my_controller_role_ == vr::TrackedControllerRole_LeftHand ? "Left" : "Right", k_pchLatencyStageNames[ stage ], summary,
+				static_cast< unsigned long long >( hand_stats_->latency_us[ stage ].Count() ) );
+		}
+	}
 }
 
 
+//-----------------------------------------------------------------------------
+// Purpose: Sends a scalar input to SteamVR, unless it's what we sent last time.
+// Only called from vrserver's RunFrame thread.
+//-----------------------------------------------------------------------------
+void MyControllerDeviceDriver::UpdateScalarInput( MyComponent component, float fValue, double fTimeOffset )
+{
+	InputShadow &shadow = input_shadow_[ component ];
+	if ( shadow.is_sent && shadow.value == fValue )
+	{
+		CountInputUpdate( false );
+		return;
+	}
+
+	shadow.is_sent = true;
+	shadow.value = fValue;
+	vr::VRDriverInput()->UpdateScalarComponent( input_handles_[ component ], fValue, fTimeOffset );
+	CountInputUpdate( true );
+}
+
+void MyControllerDeviceDriver::UpdateBooleanInput( MyComponent component, bool bValue, double fTimeOffset )
+{
+	InputShadow &shadow = input_shadow_[ component ];
+	const float value = bValue ? 1.f : 0.f;
+	if ( shadow.is_sent && shadow.value == value )
+	{
+		CountInputUpdate( false );
+		return;
+	}
+
+	shadow.is_sent = true;
+	shadow.value = value;
+	vr::VRDriverInput()->UpdateBooleanComponent( input_handles_[ component ], bValue, fTimeOffset );
+	CountInputUpdate( true );
+}
+
+void MyControllerDeviceDriver::CountInputUpdate( bool bSent )
+{
+	if ( hand_stats_ == nullptr )
+	{
+		return;
+	}
+
+	// We're the only writer, no need for a read-modify-write
+	std::atomic< uint64_t > &counter = bSent ? hand_stats_->input_updates : hand_stats_->input_updates_suppressed;
+	counter.store( counter.load( std::memory_order_relaxed ) + 1, std::memory_order_relaxed );
+}
+
 //-----------------------------------------------------------------------------
 // Purpose: This is called by our IServerTrackedDeviceProvider when it pops an event off the event queue.
 // It's not part of the ITrackedDeviceServerDriver interface, we created it ourselves.
@@ -291,22 +525,17 @@ void MyControllerDeviceDriver::MyProcessEvent( const vr::VREvent_t &vrevent )
 		// Listen for haptic events
 		case vr::VREvent_Input_HapticVibration:
 		{
-			// We now need to make sure that the event was intended for this device.
-			// So let's compare handles of the event and our haptic component
-
-			if ( vrevent.data.hapticVibration.componentHandle == input_handles_[ MyComponent_haptic ] )
-			{
-				// The event was intended for us!
-				// To convert the data to a pulse, see the docs.
-				// For this driver, we'll just print the values.
-
-				float duration = vrevent.data.hapticVibration.fDurationSeconds;
-				float frequency = vrevent.data.hapticVibration.fFrequency;
-				float amplitude = vrevent.data.hapticVibration.fAmplitude;
-
-				DriverLog( "Haptic event triggered for %s hand. Duration: %.2f, Frequency: %.2f, Amplitude: %.2f", my_controller_role_ == vr::TrackedControllerRole_LeftHand ? "left" : "right",
-					duration, frequency, amplitude );
-			}
+			// The device provider's dispatch table only hands us events for our own haptic component,
+			// so the event was intended for us!
+			// To convert the data to a pulse, see the docs.
+			// For this driver, we'll just print the values.
+
+			float duration = vrevent.data.hapticVibration.fDurationSeconds;
+			float frequency = vrevent.data.hapticVibration.fFrequency;
+			float amplitude = vrevent.data.hapticVibration.fAmplitude;
+
+			DriverLog( "Haptic event triggered for %s hand. Duration: %.2f, Frequency: %.2f, Amplitude: %.2f", my_controller_role_ == vr::TrackedControllerRole_LeftHand ? "left" : "right",
+				duration, frequency, amplitude );
 			break;
 		}
 		default:
@@ -324,38 +553,121 @@ const std::string &MyControllerDeviceDriver::MyGetSerialNumber()
 }
 
 //-----------------------------------------------------------------------------
-// Purpose: Update hand position from hand tracking data
+// Purpose: Our IServerTrackedDeviceProvider passes the pose submission settings on to us.
+// It's not part of the ITrackedDeviceServerDriver interface, we created it ourselves.
+//-----------------------------------------------------------------------------
+void MyControllerDeviceDriver::MySetPoseSubmitMode( PoseSubmitMode mode, float fKeepAliveHz )
+{
+	pose_submit_mode_ = mode;
+
+	if ( fKeepAliveHz > 0.f )
+	{
+		pose_keepalive_period_ = std::chrono::microseconds( static_cast< int64_t >( 1000000.f / fKeepAliveHz ) );
+	}
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Our IServerTrackedDeviceProvider sets how often the pose scheduler submits us in PoseSubmitMode_Fixed.
+// It's not part of the ITrackedDeviceServerDriver interface, we created it ourselves.
+//-----------------------------------------------------------------------------
+void MyControllerDeviceDriver::MySetPoseRate( float fRateHz )
+{
+	if ( fRateHz > 0.f )
+	{
+		pose_period_ = std::chrono::microseconds( static_cast< int64_t >( 1000000.f / fRateHz ) );
+	}
+}
+
+int64_t MyControllerDeviceDriver::MyGetPoseSubmitPeriodUs() const
+{
+	return pose_submit_mode_ == PoseSubmitMode_OnSample ? pose_keepalive_period_.count() : pose_period_.count();
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Our IServerTrackedDeviceProvider tells us which scheduler slot is ours, so new samples can ask for a submit.
+// It's not part of the ITrackedDeviceServerDriver interface, we created it ourselves.
 //-----------------------------------------------------------------------------
-void MyControllerDeviceDriver::UpdateHandPosition( float x, float y, float z )
+void MyControllerDeviceDriver::MySetPoseScheduler( PoseScheduler *scheduler, size_t unSlot )
 {
-	hand_position_x_.store( x );
-	hand_position_y_.store( y );
-	hand_position_z_.store( z );
+	pose_scheduler_ = scheduler;
+	pose_scheduler_slot_ = unSlot;
 }
 
 //-----------------------------------------------------------------------------
-// Purpose: Update hand rotation from hand tracking data
+// Purpose: Our IServerTrackedDeviceProvider gives us the statistics the whole pipeline shares.
+// It's not part of the ITrackedDeviceServerDriver interface, we created it ourselves.
 //-----------------------------------------------------------------------------
-void MyControllerDeviceDriver::UpdateHandRotation( float qw, float qx, float qy, float qz )
+void MyControllerDeviceDriver::MySetPipelineStats( PipelineStats *stats )
 {
-	hand_rotation_qw_.store( qw );
-	hand_rotation_qx_.store( qx );
-	hand_rotation_qy_.store( qy );
-	hand_rotation_qz_.store( qz );
+	pipeline_stats_ = stats;
+	hand_stats_ = stats != nullptr ? &stats->Hand( my_controller_role_ == vr::TrackedControllerRole_LeftHand ? HandId_Left : HandId_Right ) : nullptr;
 }
 
 //-----------------------------------------------------------------------------
-// Purpose: Update trigger value from gesture detection
+// Purpose: Our IServerTrackedDeviceProvider routes events to us through this table, we add ourselves to it when activated.
+// It's not part of the ITrackedDeviceServerDriver interface, we created it ourselves.
 //-----------------------------------------------------------------------------
-void MyControllerDeviceDriver::UpdateTriggerValue( float value )
+void MyControllerDeviceDriver::MySetEventDispatchTable( EventDispatchTable *table )
 {
-	trigger_value_.store( value );
+	event_dispatch_table_ = table;
 }
 
 //-----------------------------------------------------------------------------
-// Purpose: Update grip value from gesture detection
+// Purpose: Update hand tracking data from a sample the listener received.
+// Merged into our own copy first and then published in one go, the pose scheduler never waits on us.
 //-----------------------------------------------------------------------------
-void MyControllerDeviceDriver::UpdateGripValue( float value )
+void MyControllerDeviceDriver::UpdateHandSample( const HandSample &sample )
 {
-	grip_value_.store( value );
-}
\ No newline at end of file
+	if ( sample.fields & HandSampleField_Position )
+	{
+		memcpy( hand_state_written_.position, sample.position, sizeof( hand_state_written_.position ) );
+	}
+
+	if ( sample.fields & HandSampleField_Rotation )
+	{
+		memcpy( hand_state_written_.rotation, sample.rotation, sizeof( hand_state_written_.rotation ) );
+	}
+
+	if ( sample.fields & HandSampleField_Trigger )
+	{
+		hand_state_written_.trigger = sample.trigger;
+	}
+
+	if ( sample.fields & HandSampleField_Grip )
+	{
+		hand_state_written_.grip = sample.grip;
+	}
+
+	const int64_t now_us = DriverClockUs();
+	hand_state_written_.capture_time_us = ( sample.fields & HandSampleField_CaptureTime ) ? DriverTimeFromProducer( sample.capture_time_us, now_us ) : 0;
+	hand_state_written_.send_time_us = ( sample.fields & HandSampleField_SendTime ) ? DriverTimeFromProducer( sample.send_time_us, now_us ) : 0;
+	hand_state_written_.receive_time_us = sample.receive_time_us != 0 ? sample.receive_time_us : now_us;
+
+	if ( sample.fields & ( HandSampleField_Position | HandSampleField_Rotation ) )
+	{
+		// Anything without a usable capture time is treated as captured when it arrived
+		const int64_t sample_time_us = hand_state_written_.capture_time_us != 0 ? hand_state_written_.capture_time_us : hand_state_written_.receive_time_us;
+
+		motion_estimator_.AddSample( sample_time_us, hand_state_written_.position, hand_state_written_.rotation );
+		motion_estimator_.Estimate( hand_state_written_.velocity, hand_state_written_.angular_velocity );
+		hand_state_written_.sample_time_us = sample_time_us;
+	}
+
+	hand_state_.Store( hand_state_written_ );
+
+	if ( pose_scheduler_ != nullptr )
+	{
+		// Resumes the scheduler if it parked while there was no hand data
+		pose_scheduler_->NotifyActivity();
+
+		if ( pose_submit_mode_ == PoseSubmitMode_OnSample )
+		{
+			pose_scheduler_->RequestSubmit( pose_scheduler_slot_ );
+		}
+	}
+}
+
+uint64_t MyControllerDeviceDriver::GetPoseSubmitCount() const
+{
+	return pose_submit_count_.load( std::memory_order_acquire );
+}
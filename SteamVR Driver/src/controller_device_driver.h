@@ -6,7 +6,14 @@
 
 #include "openvr_driver.h"
 #include <atomic>
-#include <thread>
+#include <chrono>
+
+#include "event_dispatch_table.h"
+#include "hand_motion_estimator.h"
+#include "hand_protocol.h"
+#include "pipeline_stats.h"
+#include "pose_scheduler.h"
+#include "seqlock.h"
 
 enum MyComponent
 {
@@ -23,12 +30,19 @@ enum MyComponent
 	MyComponent_MAX
 };
 
+// When the pose scheduler hands a new pose to vrserver
+enum PoseSubmitMode
+{
+	PoseSubmitMode_Fixed,	 // At the pose rate (every 5 ms by default), whether there is new hand data or not
+	PoseSubmitMode_OnSample, // As soon as a new sample arrives, and at least at the keep-alive rate
+};
+
 //-----------------------------------------------------------------------------
 // Purpose: Represents a single tracked device in the system.
 // What this device actually is (controller, hmd) depends on the
 // properties you set within the device (see implementation of Activate)
 //-----------------------------------------------------------------------------
-class MyControllerDeviceDriver : public vr::ITrackedDeviceServerDriver
+class MyControllerDeviceDriver : public vr::ITrackedDeviceServerDriver, public IScheduledPoseDevice
 {
 public:
 	MyControllerDeviceDriver( vr::ETrackedControllerRole role );
@@ -49,16 +63,35 @@ public:
 
 	const std::string &MyGetSerialNumber();
 
+	// Call before the device is added to the pose scheduler
+	void MySetPoseSubmitMode( PoseSubmitMode mode, float fKeepAliveHz );
+	void MySetPoseRate( float fRateHz );
+
+	// How often the pose scheduler has to submit us: the pose rate, or the keep-alive rate with PoseSubmitMode_OnSample
+	int64_t MyGetPoseSubmitPeriodUs() const;
+
+	// Call before the device is activated. With PoseSubmitMode_OnSample, new samples ask scheduler to submit slot.
+	void MySetPoseScheduler( PoseScheduler *scheduler, size_t unSlot );
+
+	// Call before the device is activated. The scheduler thread records this hand's latencies into stats.
+	void MySetPipelineStats( PipelineStats *stats );
+
+	// Call before the device is activated. We add our device index and haptic component to table when activated.
+	void MySetEventDispatchTable( EventDispatchTable *table );
+
 	void MyRunFrame();
 	void MyProcessEvent( const vr::VREvent_t &vrevent );
 
-	void MyPoseUpdateThread();
+	// Called by the pose scheduler
+	void SubmitScheduledPose( const HmdPose &hmd_pose, int64_t nLateUs ) override;
+	void SubmitIdlePose( const HmdPose &hmd_pose ) override;
+
+	// Hand tracking data update, only ever called from the listener thread.
+	// Values the sample doesn't carry keep their previous state.
+	void UpdateHandSample( const HandSample &sample );
 
-	// Hand tracking data update methods
-	void UpdateHandPosition( float x, float y, float z );
-	void UpdateHandRotation( float qw, float qx, float qy, float qz );
-	void UpdateTriggerValue( float value );
-	void UpdateGripValue( float value );
+	// Number of poses the scheduler has started building, so the listener can tell whether its last update was picked up
+	uint64_t GetPoseSubmitCount() const;
 
 private:
 	std::atomic< vr::TrackedDeviceIndex_t > my_controller_index_;
@@ -70,17 +103,73 @@ private:
 
 	std::array< vr::VRInputComponentHandle_t, MyComponent_MAX > input_handles_;
 
+	// What MyRunFrame() last sent for each component, so unchanged values aren't sent again.
+	// Booleans are kept as 0 or 1. Only touched by vrserver's RunFrame thread.
+	struct InputShadow
+	{
+		bool is_sent;
+		float value;
+	};
+	std::array< InputShadow, MyComponent_MAX > input_shadow_;
+
+	// Owned by the device provider
+	EventDispatchTable *event_dispatch_table_;
+
 	std::atomic< bool > is_active_;
-	std::thread my_pose_update_thread_;
-
-	// Hand tracking data
-	std::atomic< float > hand_position_x_;
-	std::atomic< float > hand_position_y_;
-	std::atomic< float > hand_position_z_;
-	std::atomic< float > hand_rotation_qw_;
-	std::atomic< float > hand_rotation_qx_;
-	std::atomic< float > hand_rotation_qy_;
-	std::atomic< float > hand_rotation_qz_;
-	std::atomic< float > trigger_value_;
-	std::atomic< float > grip_value_;
+
+	PoseSubmitMode pose_submit_mode_;
+	std::chrono::microseconds pose_period_;
+	std::chrono::microseconds pose_keepalive_period_;
+
+	// PoseSubmitMode_OnSample: UpdateHandSample() asks the scheduler to submit our slot
+	PoseScheduler *pose_scheduler_;
+	size_t pose_scheduler_slot_;
+
+	// Hand tracking data, published as a whole so a pose is never built from parts of two samples
+	struct HandState
+	{
+		float position[ 3 ];
+		float rotation[ 4 ]; // w, x, y, z
+		float trigger;
+		float grip;
+
+		// Estimated motion of the hand relative to the hmd, m/s and rad/s
+		float velocity[ 3 ];
+		float angular_velocity[ 3 ];
+
+		// When the camera saw the hand, microseconds on the driver clock (driver_clock.h).
+		// The receive time stands in when the producer didn't send a usable capture time.
+		int64_t sample_time_us;
+
+		// Pipeline timestamps of the newest sample on the driver clock, 0 where the producer didn't send one
+		int64_t capture_time_us;
+		int64_t send_time_us;
+		int64_t receive_time_us;
+	};
+
+	void UpdateScalarInput( MyComponent component, float fValue, double fTimeOffset );
+	void UpdateBooleanInput( MyComponent component, bool bValue, double fTimeOffset );
+	void CountInputUpdate( bool bSent );
+
+	vr::DriverPose_t BuildPose( const HandState &hand_state, const HmdPose &hmd_pose );
+	void RecordLatency( const HandState &hand_state, int64_t nSubmitTimeUs );
+
+	Seqlock< HandState > hand_state_;
+
+	// The listener thread's copy of the last published state, partial updates are merged into it
+	HandState hand_state_written_;
+	HandMotionEstimator motion_estimator_;
+
+	std::atomic< uint64_t > pose_submit_count_;
+
+	// Set while the pose scheduler is parked, our poses then say we're out of range
+	std::atomic< bool > is_idle_;
+
+	// Shared with the listener, owned by the device provider. Our part is only recorded by the scheduler thread.
+	PipelineStats *pipeline_stats_;
+	HandPipelineStats *hand_stats_;
+	int64_t latency_recorded_receive_time_us_;
+
+	// When MyRunFrame() last logged the latencies
+	int64_t latency_log_time_us_;
 };
\ No newline at end of file
@@ -3,6 +3,78 @@
 
 #include "driverlog.h"
 
+#include <cstring>
+
+// Settings for how we receive hand tracking data, stored in resources/settings/default.vrsettings
+static const char *hand_tracking_settings_section = "driver_hand_camera_tracking";
+static const char *hand_tracking_settings_key_port = "port";
+static const char *hand_tracking_settings_key_transport = "transport";
+static const char *hand_tracking_settings_key_shm_name = "shm_name";
+static const char *hand_tracking_settings_key_shm_spin_wait = "shm_spin_wait";
+static const char *hand_tracking_settings_key_receive_backend = "receive_backend";
+static const char *hand_tracking_settings_key_pose_submit_mode = "pose_submit_mode";
+static const char *hand_tracking_settings_key_pose_keepalive_hz = "pose_keepalive_hz";
+static const char *hand_tracking_settings_key_pose_rate_hz = "pose_rate_hz";
+static const char *hand_tracking_settings_key_pose_align_to_vsync = "pose_align_to_vsync";
+static const char *hand_tracking_settings_key_pose_vsync_offset_ms = "pose_vsync_offset_ms";
+static const char *hand_tracking_settings_key_listener_thread_cpu = "listener_thread_cpu";
+static const char *hand_tracking_settings_key_listener_thread_priority = "listener_thread_priority";
+static const char *hand_tracking_settings_key_pose_thread_cpu = "pose_thread_cpu";
+static const char *hand_tracking_settings_key_pose_thread_priority = "pose_thread_priority";
+static const char *hand_tracking_settings_key_idle_timeout_s = "idle_timeout_s";
+static const char *hand_tracking_settings_key_capture_file = "capture_file";
+
+// Per hand sections, settings in them override the ones above for that hand
+static const char *hand_tracking_left_hand_settings_section = "driver_hand_camera_tracking_left_hand";
+static const char *hand_tracking_right_hand_settings_section = "driver_hand_camera_tracking_right_hand";
+
+// Pose rate of a hand: its own pose_rate_hz if it has one, otherwise the shared one
+static float GetPoseRateHz( const char *pchHandSection )
+{
+	vr::EVRSettingsError settings_error = vr::VRSettingsError_None;
+	const float hand_rate_hz = vr::VRSettings()->GetFloat( pchHandSection, hand_tracking_settings_key_pose_rate_hz, &settings_error );
+	if ( settings_error == vr::VRSettingsError_None && hand_rate_hz > 0.f )
+	{
+		return hand_rate_hz;
+	}
+
+	return vr::VRSettings()->GetFloat( hand_tracking_settings_section, hand_tracking_settings_key_pose_rate_hz );
+}
+
+// Core and priority of one of our threads. Missing settings leave the thread to the OS at normal priority.
+static ThreadTuning GetThreadTuning( const char *pchCpuKey, const char *pchPriorityKey )
+{
+	ThreadTuning tuning;
+
+	vr::EVRSettingsError settings_error = vr::VRSettingsError_None;
+	const int32_t cpu_core = vr::VRSettings()->GetInt32( hand_tracking_settings_section, pchCpuKey, &settings_error );
+	if ( settings_error == vr::VRSettingsError_None )
+	{
+		tuning.cpu_core = cpu_core;
+	}
+
+	const int32_t priority = vr::VRSettings()->GetInt32( hand_tracking_settings_section, pchPriorityKey, &settings_error );
+	if ( settings_error == vr::VRSettingsError_None )
+	{
+		tuning.priority = priority;
+	}
+
+	return tuning;
+}
+
+// How long without hand data before the driver goes idle, 5 s unless set. 0 never goes idle.
+static int64_t GetIdleTimeoutUs()
+{
+	vr::EVRSettingsError settings_error = vr::VRSettingsError_None;
+	const float idle_timeout_s = vr::VRSettings()->GetFloat( hand_tracking_settings_section, hand_tracking_settings_key_idle_timeout_s, &settings_error );
+	if ( settings_error != vr::VRSettingsError_None || idle_timeout_s < 0.f )
+	{
+		return 5000000;
+	}
+
+	return static_cast< int64_t >( idle_timeout_s * 1e6 );
+}
+
 //-----------------------------------------------------------------------------
 // Purpose: This is called by vrserver after it receives a pointer back from HmdDriverFactory.
 // You should do your resources allocations here (**not** in the constructor).
@@ -19,6 +91,45 @@ vr::EVRInitError MyDeviceProvider::Init( vr::IVRDriverContext *pDriverContext )
 	my_left_controller_device_ = std::make_unique< MyControllerDeviceDriver >( vr::TrackedControllerRole_LeftHand );
 	my_right_controller_device_ = std::make_unique< MyControllerDeviceDriver >( vr::TrackedControllerRole_RightHand );
 
+	// Every thread of the pipeline records into these, DebugRequest( "stats" ) on either controller reads them
+	pipeline_stats_ = std::make_unique< PipelineStats >();
+	my_left_controller_device_->MySetPipelineStats( pipeline_stats_.get() );
+	my_right_controller_device_->MySetPipelineStats( pipeline_stats_.get() );
+
+	my_left_controller_device_->MySetEventDispatchTable( &event_dispatch_table_ );
+	my_right_controller_device_->MySetEventDispatchTable( &event_dispatch_table_ );
+
+	// "fixed" (default) submits poses every 5 ms, "on_sample" as soon as hand data arrives
+	char pose_submit_mode[ 16 ] = {};
+	vr::VRSettings()->GetString( hand_tracking_settings_section, hand_tracking_settings_key_pose_submit_mode, pose_submit_mode, sizeof( pose_submit_mode ) );
+	const bool submit_on_sample = strcmp( pose_submit_mode, "on_sample" ) == 0;
+	if ( submit_on_sample )
+	{
+		const float keepalive_hz = vr::VRSettings()->GetFloat( hand_tracking_settings_section, hand_tracking_settings_key_pose_keepalive_hz );
+		my_left_controller_device_->MySetPoseSubmitMode( PoseSubmitMode_OnSample, keepalive_hz );
+		my_right_controller_device_->MySetPoseSubmitMode( PoseSubmitMode_OnSample, keepalive_hz );
+	}
+
+	// Poses per second in "fixed" mode, 200 unless set
+	my_left_controller_device_->MySetPoseRate( GetPoseRateHz( hand_tracking_left_hand_settings_section ) );
+	my_right_controller_device_->MySetPoseRate( GetPoseRateHz( hand_tracking_right_hand_settings_section ) );
+
+	// One thread submits the poses of every device, each at its own rate.
+	// The devices need their slot before they're activated, which can happen as soon as they're added.
+	pose_scheduler_ = std::make_unique< PoseScheduler >();
+	pose_scheduler_->SetPipelineStats( pipeline_stats_.get() );
+	pose_scheduler_->SetThreadTuning( GetThreadTuning( hand_tracking_settings_key_pose_thread_cpu, hand_tracking_settings_key_pose_thread_priority ) );
+	pose_scheduler_->SetIdleTimeout( GetIdleTimeoutUs() );
+	my_left_controller_device_->MySetPoseScheduler(
+		pose_scheduler_.get(), pose_scheduler_->AddDevice( my_left_controller_device_.get(), my_left_controller_device_->MyGetPoseSubmitPeriodUs(), submit_on_sample ) );
+	my_right_controller_device_->MySetPoseScheduler(
+		pose_scheduler_.get(), pose_scheduler_->AddDevice( my_right_controller_device_.get(), my_right_controller_device_->MyGetPoseSubmitPeriodUs(), submit_on_sample ) );
+
+	// Lay the pose deadlines on the headset's vsync, pose_vsync_offset_ms after it. Off unless turned on, it rounds pose_rate_hz
+	// to the display (200 Hz becomes 180 Hz on a 90 Hz headset).
+	const bool align_to_vsync = vr::VRSettings()->GetBool( hand_tracking_settings_section, hand_tracking_settings_key_pose_align_to_vsync );
+	pose_scheduler_->SetDisplayAlignment( align_to_vsync, vr::VRSettings()->GetFloat( hand_tracking_settings_section, hand_tracking_settings_key_pose_vsync_offset_ms ) );
+
 	// Now we need to tell vrserver about our controllers.
 	// The first argument is the serial number of the device, which must be unique across all devices.
 	// We get it from our driver settings when we instantiate,
@@ -44,9 +155,56 @@ vr::EVRInitError MyDeviceProvider::Init( vr::IVRDriverContext *pDriverContext )
 		return vr::VRInitError_Driver_Unknown;
 	}
 
+	pose_scheduler_->Start();
+
 	// Start hand tracking listener
+	vr::EVRSettingsError settings_error = vr::VRSettingsError_None;
+	int32_t port = vr::VRSettings()->GetInt32( hand_tracking_settings_section, hand_tracking_settings_key_port, &settings_error );
+	if ( settings_error != vr::VRSettingsError_None || port <= 0 )
+	{
+		port = 65432;
+	}
+
+	// "tcp" (default), "udp" or "shm"
+	char transport[ 16 ] = {};
+	vr::VRSettings()->GetString( hand_tracking_settings_section, hand_tracking_settings_key_transport, transport, sizeof( transport ) );
+
+	HandTransport hand_transport = HandTransport_Tcp;
+	if ( strcmp( transport, "udp" ) == 0 )
+	{
+		hand_transport = HandTransport_Udp;
+	}
+	else if ( strcmp( transport, "shm" ) == 0 )
+	{
+		hand_transport = HandTransport_SharedMemory;
+	}
+
 	hand_tracking_listener_ = std::make_unique<HandTrackingListener>( my_left_controller_device_.get(), my_right_controller_device_.get() );
-	if ( !hand_tracking_listener_->Start( 65432 ) )
+	hand_tracking_listener_->SetPipelineStats( pipeline_stats_.get() );
+	hand_tracking_listener_->SetThreadTuning( GetThreadTuning( hand_tracking_settings_key_listener_thread_cpu, hand_tracking_settings_key_listener_thread_priority ) );
+	hand_tracking_listener_->SetIdleTimeout( GetIdleTimeoutUs() );
+
+	char shm_name[ 64 ] = {};
+	vr::VRSettings()->GetString( hand_tracking_settings_section, hand_tracking_settings_key_shm_name, shm_name, sizeof( shm_name ) );
+	if ( shm_name[ 0 ] != '\0' )
+	{
+		hand_tracking_listener_->SetSharedMemoryOptions( shm_name, vr::VRSettings()->GetBool( hand_tracking_settings_section, hand_tracking_settings_key_shm_spin_wait ) );
+	}
+
+	// "socket" (default) or "io_uring"
+	char receive_backend[ 16 ] = {};
+	vr::VRSettings()->GetString( hand_tracking_settings_section, hand_tracking_settings_key_receive_backend, receive_backend, sizeof( receive_backend ) );
+	if ( strcmp( receive_backend, "io_uring" ) == 0 )
+	{
+		hand_tracking_listener_->SetReceiveBackend( HandReceiveBackend_IoUring );
+	}
+
+	// Records the received hand messages for tools/hand_replay, empty (default) doesn't record
+	char capture_file[ 1024 ] = {};
+	vr::VRSettings()->GetString( hand_tracking_settings_section, hand_tracking_settings_key_capture_file, capture_file, sizeof( capture_file ) );
+	hand_tracking_listener_->SetCaptureFile( capture_file );
+
+	if ( !hand_tracking_listener_->Start( port, hand_transport ) )
 	{
 		DriverLog( "Warning: Failed to start hand tracking listener. Hand tracking data will not be received." );
 		// Don't fail initialization, just log the warning
@@ -91,17 +249,14 @@ void MyDeviceProvider::RunFrame()
 	}
 
 	//Now, process events that were submitted for this frame.
+	// Each goes straight to the device it's for, events that aren't for one of our devices are dropped.
 	vr::VREvent_t vrevent{};
 	while ( vr::VRServerDriverHost()->PollNextEvent( &vrevent, sizeof( vr::VREvent_t ) ) )
 	{
-		if ( my_left_controller_device_ != nullptr )
-		{
-			my_left_controller_device_->MyProcessEvent( vrevent );
-		}
-
-		if ( my_right_controller_device_ != nullptr )
+		MyControllerDeviceDriver *device = event_dispatch_table_.Find( vrevent );
+		if ( device != nullptr )
 		{
-			my_right_controller_device_->MyProcessEvent( vrevent );
+			device->MyProcessEvent( vrevent );
 		}
 	}
 }
@@ -112,6 +267,11 @@ void MyDeviceProvider::RunFrame()
 //-----------------------------------------------------------------------------
 void MyDeviceProvider::EnterStandby()
 {
+	// Nobody is looking at the hands, stop submitting poses until SteamVR wakes up
+	if ( pose_scheduler_ != nullptr )
+	{
+		pose_scheduler_->SetStandby( true );
+	}
 }
 
 //-----------------------------------------------------------------------------
@@ -120,6 +280,10 @@ void MyDeviceProvider::EnterStandby()
 //-----------------------------------------------------------------------------
 void MyDeviceProvider::LeaveStandby()
 {
+	if ( pose_scheduler_ != nullptr )
+	{
+		pose_scheduler_->SetStandby( false );
+	}
 }
 
 //-----------------------------------------------------------------------------
@@ -132,7 +296,20 @@ void MyDeviceProvider::Cleanup()
 	// Stop hand tracking listener first
 	hand_tracking_listener_ = nullptr;
 
+	// Then the pose scheduler, nothing calls into the devices after this
+	pose_scheduler_ = nullptr;
+
 	// Our controller devices will have already deactivated. Let's now destroy them.
 	my_left_controller_device_ = nullptr;
 	my_right_controller_device_ = nullptr;
-}
\ No newline at end of file
+	pipeline_stats_ = nullptr;
+}
+PipelineStats *MyDeviceProvider::MyGetPipelineStats()
+{
+	return pipeline_stats_.get();
+}
+
+const HandTrackingListener *MyDeviceProvider::MyGetHandTrackingListener() const
+{
+	return hand_tracking_listener_.get();
+}
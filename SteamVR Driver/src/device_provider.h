@@ -4,7 +4,10 @@
 #include <memory>
 
 #include "controller_device_driver.h"
+#include "event_dispatch_table.h"
 #include "hand_tracking_listener.h"
+#include "pipeline_stats.h"
+#include "pose_scheduler.h"
 #include "openvr_driver.h"
 
 // make sure your class is publicly inheriting vr::IServerTrackedDeviceProvider!
@@ -22,8 +25,19 @@ public:
 
 	void Cleanup() override;
 
+	// For tools that host the driver in-process (see tools/), nullptr before Init() and after Cleanup()
+	PipelineStats *MyGetPipelineStats();
+	const HandTrackingListener *MyGetHandTrackingListener() const;
+
 private:
 	std::unique_ptr<MyControllerDeviceDriver> my_left_controller_device_;
 	std::unique_ptr<MyControllerDeviceDriver> my_right_controller_device_;
 	std::unique_ptr<HandTrackingListener> hand_tracking_listener_;
+	std::unique_ptr<PoseScheduler> pose_scheduler_;
+
+	// Shared by the listener and both controllers, so it has to outlive them
+	std::unique_ptr<PipelineStats> pipeline_stats_;
+
+	// Which device each polled event goes to, the controllers fill it in as they're activated
+	EventDispatchTable event_dispatch_table_;
 };
\ No newline at end of file
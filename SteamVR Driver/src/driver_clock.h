@@ -0,0 +1,19 @@
+//============ Copyright (c) Valve Corporation, All rights reserved. ============
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+
+// Microseconds on the driver's monotonic clock (std::chrono::steady_clock, CLOCK_MONOTONIC on Linux).
+// Every timestamp the driver keeps is on this clock. Producers line their own clock up with it through
+// the clock ping (see hand_protocol.h), so their capture and send times can be compared with ours.
+inline int64_t DriverClockUs()
+{
+	return std::chrono::duration_cast< std::chrono::microseconds >( std::chrono::steady_clock::now().time_since_epoch() ).count();
+}
+
+// Nanoseconds on the same clock, for timing short stretches of our own code
+inline int64_t DriverClockNs()
+{
+	return std::chrono::duration_cast< std::chrono::nanoseconds >( std::chrono::steady_clock::now().time_since_epoch() ).count();
+}
@@ -0,0 +1,56 @@
+//============ Copyright (c) Valve Corporation, All rights reserved. ============
+#include "event_dispatch_table.h"
+
+#include <iterator>
+
+EventDispatchTable::EventDispatchTable()
+{
+	devices_.fill( nullptr );
+}
+
+void EventDispatchTable::AddDevice( vr::TrackedDeviceIndex_t unDeviceIndex, MyControllerDeviceDriver *device )
+{
+	if ( unDeviceIndex < devices_.size() )
+	{
+		devices_[ unDeviceIndex ] = device;
+	}
+}
+
+void EventDispatchTable::AddComponent( vr::VRInputComponentHandle_t ulHandle, MyControllerDeviceDriver *device )
+{
+	if ( ulHandle != vr::k_ulInvalidInputComponentHandle )
+	{
+		components_[ ulHandle ] = device;
+	}
+}
+
+void EventDispatchTable::RemoveDevice( MyControllerDeviceDriver *device )
+{
+	for ( MyControllerDeviceDriver *&entry : devices_ )
+	{
+		if ( entry == device )
+		{
+			entry = nullptr;
+		}
+	}
+
+	for ( auto it = components_.begin(); it != components_.end(); )
+	{
+		it = it->second == device ? components_.erase( it ) : std::next( it );
+	}
+}
+
+MyControllerDeviceDriver *EventDispatchTable::Find( const vr::VREvent_t &vrevent ) const
+{
+	switch ( vrevent.eventType )
+	{
+		// Addressed to a component, the device index isn't what tells us whose it is
+		case vr::VREvent_Input_HapticVibration:
+		{
+			const auto it = components_.find( vrevent.data.hapticVibration.componentHandle );
+			return it != components_.end() ? it->second : nullptr;
+		}
+		default:
+			return vrevent.trackedDeviceIndex < devices_.size() ? devices_[ vrevent.trackedDeviceIndex ] : nullptr;
+	}
+}
@@ -0,0 +1,36 @@
+//============ Copyright (c) Valve Corporation, All rights reserved. ============
+#pragma once
+
+#include <array>
+#include <unordered_map>
+
+#include "openvr_driver.h"
+
+class MyControllerDeviceDriver;
+
+//-----------------------------------------------------------------------------
+// Purpose: Finds the device an event polled in RunFrame() belongs to, in constant time however many
+// devices there are. Input events (haptics) are looked up by the component handle they name,
+// everything else by the device index the event carries.
+// Devices add themselves as they're activated. Only touched from vrserver's RunFrame thread, which
+// is also the one that activates and deactivates devices.
+//-----------------------------------------------------------------------------
+class EventDispatchTable
+{
+public:
+	EventDispatchTable();
+
+	// unDeviceIndex is the object id the device was activated with
+	void AddDevice( vr::TrackedDeviceIndex_t unDeviceIndex, MyControllerDeviceDriver *device );
+	void AddComponent( vr::VRInputComponentHandle_t ulHandle, MyControllerDeviceDriver *device );
+
+	// Forgets the device and every component it added
+	void RemoveDevice( MyControllerDeviceDriver *device );
+
+	// The device vrevent is for, nullptr if it's for none of ours
+	MyControllerDeviceDriver *Find( const vr::VREvent_t &vrevent ) const;
+
+private:
+	std::array< MyControllerDeviceDriver *, vr::k_unMaxTrackedDeviceCount > devices_;
+	std::unordered_map< vr::VRInputComponentHandle_t, MyControllerDeviceDriver * > components_;
+};
@@ -0,0 +1,181 @@
+//============ Copyright (c) Valve Corporation, All rights reserved. ============
+#include "hand_capture.h"
+
+#include "byte_order.h"
+#include "driver_clock.h"
+#include "driverlog.h"
+
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+
+static const uint8_t k_pchHandCaptureMagic[ 4 ] = { 'H', 'C', 'A', 'P' };
+
+// Size of the stdio buffer between the listener and the file
+static constexpr size_t k_unWriteBufferSize = 256 * 1024;
+
+// Top bit of a record's size field
+static constexpr uint32_t k_unBinaryRecordFlag = 0x80000000u;
+
+HandCaptureWriter::HandCaptureWriter()
+	: file_( nullptr )
+	, record_count_( 0 )
+{
+}
+
+HandCaptureWriter::~HandCaptureWriter()
+{
+	Close();
+}
+
+bool HandCaptureWriter::Open( const char *pchPath )
+{
+	Close();
+
+	file_ = fopen( pchPath, "wb" );
+	if ( file_ == nullptr )
+	{
+		DriverLog( "HandCapture: Can't create %s (%s), not recording", pchPath, strerror( errno ) );
+		return false;
+	}
+
+	if ( buffer_ == nullptr )
+	{
+		buffer_ = std::make_unique< char[] >( k_unWriteBufferSize );
+	}
+	setvbuf( file_, buffer_.get(), _IOFBF, k_unWriteBufferSize );
+
+	const int64_t unix_time_us = std::chrono::duration_cast< std::chrono::microseconds >( std::chrono::system_clock::now().time_since_epoch() ).count();
+
+	uint8_t header[ k_unHandCaptureHeaderSize ];
+	memcpy( header, k_pchHandCaptureMagic, sizeof( k_pchHandCaptureMagic ) );
+	WriteU16( header + 4, k_unHandCaptureVersion );
+	WriteU16( header + 6, static_cast< uint16_t >( k_unHandCaptureHeaderSize ) );
+	WriteU64( header + 8, static_cast< uint64_t >( DriverClockUs() ) );
+	WriteU64( header + 16, static_cast< uint64_t >( unix_time_us ) );
+	if ( fwrite( header, sizeof( header ), 1, file_ ) != 1 )
+	{
+		DriverLog( "HandCapture: Can't write %s (%s), not recording", pchPath, strerror( errno ) );
+		fclose( file_ );
+		file_ = nullptr;
+		return false;
+	}
+
+	record_count_ = 0;
+	DriverLog( "HandCapture: Recording received hand messages to %s", pchPath );
+	return true;
+}
+
+void HandCaptureWriter::Close()
+{
+	if ( file_ == nullptr )
+	{
+		return;
+	}
+
+	if ( fclose( file_ ) != 0 )
+	{
+		DriverLog( "HandCapture: Failed to finish the capture (%s), it may be cut short", strerror( errno ) );
+	}
+	file_ = nullptr;
+
+	DriverLog( "HandCapture: Recorded %llu messages", static_cast< unsigned long long >( record_count_ ) );
+}
+
+void HandCaptureWriter::Append( int64_t nReceiveTimeUs, HandCaptureFormat format, std::string_view message )
+{
+	if ( file_ == nullptr || message.size() >= k_unBinaryRecordFlag )
+	{
+		return;
+	}
+
+	uint8_t record_header[ k_unHandCaptureRecordHeaderSize ];
+	WriteU64( record_header, static_cast< uint64_t >( nReceiveTimeUs ) );
+	WriteU32( record_header + 8, static_cast< uint32_t >( message.size() ) | ( format == HandCaptureFormat_Binary ? k_unBinaryRecordFlag : 0 ) );
+
+	if ( fwrite( record_header, sizeof( record_header ), 1, file_ ) != 1 || fwrite( message.data(), 1, message.size(), file_ ) != message.size() )
+	{
+		DriverLog( "HandCapture: Can't write the capture (%s), stopped recording", strerror( errno ) );
+		Close();
+		return;
+	}
+
+	record_count_++;
+}
+
+HandCaptureReader::HandCaptureReader()
+	: data_( nullptr )
+	, size_( 0 )
+	, header_size_( 0 )
+	, offset_( 0 )
+	, start_time_us_( 0 )
+	, start_unix_time_us_( 0 )
+{
+}
+
+bool HandCaptureReader::Init( const void *pData, size_t unSize )
+{
+	const uint8_t *data = static_cast< const uint8_t * >( pData );
+	if ( data == nullptr || unSize < k_unHandCaptureHeaderSize || memcmp( data, k_pchHandCaptureMagic, sizeof( k_pchHandCaptureMagic ) ) != 0 ||
+		 ReadU16( data + 4 ) != k_unHandCaptureVersion )
+	{
+		return false;
+	}
+
+	// Later versions may grow the header, the records still start after it
+	const size_t header_size = ReadU16( data + 6 );
+	if ( header_size < k_unHandCaptureHeaderSize || header_size > unSize )
+	{
+		return false;
+	}
+
+	data_ = data;
+	size_ = unSize;
+	header_size_ = header_size;
+	offset_ = header_size;
+	start_time_us_ = static_cast< int64_t >( ReadU64( data + 8 ) );
+	start_unix_time_us_ = static_cast< int64_t >( ReadU64( data + 16 ) );
+	return true;
+}
+
+int64_t HandCaptureReader::GetStartTimeUs() const
+{
+	return start_time_us_;
+}
+
+int64_t HandCaptureReader::GetStartUnixTimeUs() const
+{
+	return start_unix_time_us_;
+}
+
+bool HandCaptureReader::Next( HandCaptureRecord &record )
+{
+	if ( size_ - offset_ < k_unHandCaptureRecordHeaderSize )
+	{
+		return false;
+	}
+
+	const uint8_t *record_header = data_ + offset_;
+	const uint32_t size_field = ReadU32( record_header + 8 );
+	const size_t message_size = size_field & ~k_unBinaryRecordFlag;
+	if ( size_ - offset_ - k_unHandCaptureRecordHeaderSize < message_size )
+	{
+		return false;
+	}
+
+	record.receive_time_us = static_cast< int64_t >( ReadU64( record_header ) );
+	record.format = ( size_field & k_unBinaryRecordFlag ) ? HandCaptureFormat_Binary : HandCaptureFormat_Text;
+	record.message = std::string_view( reinterpret_cast< const char * >( record_header + k_unHandCaptureRecordHeaderSize ), message_size );
+	offset_ += k_unHandCaptureRecordHeaderSize + message_size;
+	return true;
+}
+
+bool HandCaptureReader::IsTruncated() const
+{
+	return offset_ != size_;
+}
+
+void HandCaptureReader::Rewind()
+{
+	offset_ = header_size_;
+}
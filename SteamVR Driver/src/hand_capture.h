@@ -0,0 +1,99 @@
+//============ Copyright (c) Valve Corporation, All rights reserved. ============
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <string_view>
+
+// Captures of the hand messages the listener received, to replay a session without cameras.
+//
+// A capture is a header followed by one record per message, little endian, written append-only:
+//
+//   header  offset  size  field
+//                0     4  magic "HCAP"
+//                4     2  version (k_unHandCaptureVersion)
+//                6     2  header size in bytes
+//                8     8  when recording started, driver clock microseconds
+//               16     8  when recording started, microseconds since the Unix epoch
+//
+//   record  offset  size  field
+//                0     8  receive time, driver clock microseconds
+//                8     4  message size in bytes, the top bit set for binary messages
+//               12     n  the message: a text line without its newline, or one binary frame or batch
+//
+// Clock pings aren't recorded, shared memory samples are recorded as binary frames.
+static constexpr uint16_t k_unHandCaptureVersion = 1;
+static constexpr size_t k_unHandCaptureHeaderSize = 24;
+static constexpr size_t k_unHandCaptureRecordHeaderSize = 12;
+
+enum HandCaptureFormat
+{
+	HandCaptureFormat_Text,
+	HandCaptureFormat_Binary,
+};
+
+struct HandCaptureRecord
+{
+	int64_t receive_time_us;
+	HandCaptureFormat format;
+	std::string_view message;
+};
+
+//-----------------------------------------------------------------------------
+// Purpose: Appends received messages to a capture file. Writes go through a large stdio buffer, so the
+// listener thread only makes a syscall every few hundred kilobytes. Only touched by the listener thread.
+//-----------------------------------------------------------------------------
+class HandCaptureWriter
+{
+public:
+	HandCaptureWriter();
+	~HandCaptureWriter();
+
+	// Replaces whatever is at pchPath with a new capture
+	bool Open( const char *pchPath );
+	void Close();
+
+	bool IsOpen() const
+	{
+		return file_ != nullptr;
+	}
+
+	// Stops recording (and logs why) if the file can't be written
+	void Append( int64_t nReceiveTimeUs, HandCaptureFormat format, std::string_view message );
+
+private:
+	FILE *file_;
+	std::unique_ptr< char[] > buffer_;
+	uint64_t record_count_;
+};
+
+//-----------------------------------------------------------------------------
+// Purpose: Walks the records of a capture held in memory, e.g. a mapped file
+//-----------------------------------------------------------------------------
+class HandCaptureReader
+{
+public:
+	HandCaptureReader();
+
+	// pData has to stay valid while the reader is used. Returns false if it doesn't start with a capture header.
+	bool Init( const void *pData, size_t unSize );
+
+	int64_t GetStartTimeUs() const;
+	int64_t GetStartUnixTimeUs() const;
+
+	// False at the end, or at a record cut short because recording was interrupted (see IsTruncated())
+	bool Next( HandCaptureRecord &record );
+	bool IsTruncated() const;
+
+	void Rewind();
+
+private:
+	const uint8_t *data_;
+	size_t size_;
+	size_t header_size_;
+	size_t offset_;
+	int64_t start_time_us_;
+	int64_t start_unix_time_us_;
+};
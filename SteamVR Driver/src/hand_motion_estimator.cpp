@@ -0,0 +1,147 @@
+//============ Copyright (c) Valve Corporation, All rights reserved. ============
+#include "hand_motion_estimator.h"
+
+#include <cmath>
+#include <cstring>
+
+// Only samples this close to the newest one take part in the estimate
+static constexpr int64_t k_unVelocityWindowUs = 100000;
+
+// A gap this long means the hand was lost, what it did before doesn't tell us anything about now
+static constexpr int64_t k_unHistoryResetGapUs = 250000;
+
+HandMotionEstimator::HandMotionEstimator()
+	: history_{}
+	, count_( 0 )
+	, next_( 0 )
+{
+}
+
+void HandMotionEstimator::Reset()
+{
+	count_ = 0;
+	next_ = 0;
+}
+
+const HandMotionEstimator::Entry &HandMotionEstimator::Newest( size_t i ) const
+{
+	return history_[ ( next_ + k_unHistorySize - 1 - i ) % k_unHistorySize ];
+}
+
+void HandMotionEstimator::AddSample( int64_t unTimeUs, const float position[ 3 ], const float rotation[ 4 ] )
+{
+	if ( count_ > 0 )
+	{
+		const int64_t gap_us = unTimeUs - Newest( 0 ).time_us;
+
+		// Two samples from the same capture can't tell us a velocity, keep the first
+		if ( gap_us <= 0 && gap_us > -k_unHistoryResetGapUs )
+		{
+			return;
+		}
+
+		if ( gap_us > k_unHistoryResetGapUs || gap_us <= -k_unHistoryResetGapUs )
+		{
+			Reset();
+		}
+	}
+
+	Entry &entry = history_[ next_ ];
+	entry.time_us = unTimeUs;
+	memcpy( entry.position, position, sizeof( entry.position ) );
+	memcpy( entry.rotation, rotation, sizeof( entry.rotation ) );
+
+	next_ = ( next_ + 1 ) % k_unHistorySize;
+	if ( count_ < k_unHistorySize )
+	{
+		count_++;
+	}
+}
+
+bool HandMotionEstimator::Estimate( float velocity[ 3 ], float angular_velocity[ 3 ] ) const
+{
+	for ( int i = 0; i < 3; i++ )
+	{
+		velocity[ i ] = 0.f;
+		angular_velocity[ i ] = 0.f;
+	}
+
+	// Samples inside the window, newest first
+	size_t window = 0;
+	while ( window < count_ && Newest( 0 ).time_us - Newest( window ).time_us <= k_unVelocityWindowUs )
+	{
+		window++;
+	}
+
+	if ( window < 2 )
+	{
+		return false;
+	}
+
+	// Least squares slope of each position axis over time. Times are relative to the newest sample to keep precision.
+	const int64_t newest_time_us = Newest( 0 ).time_us;
+	double mean_t = 0.0;
+	double mean_p[ 3 ] = { 0.0, 0.0, 0.0 };
+	for ( size_t i = 0; i < window; i++ )
+	{
+		const Entry &entry = Newest( i );
+		mean_t += ( entry.time_us - newest_time_us ) * 1e-6;
+		for ( int axis = 0; axis < 3; axis++ )
+		{
+			mean_p[ axis ] += entry.position[ axis ];
+		}
+	}
+	mean_t /= window;
+	for ( int axis = 0; axis < 3; axis++ )
+	{
+		mean_p[ axis ] /= window;
+	}
+
+	double variance_t = 0.0;
+	double covariance[ 3 ] = { 0.0, 0.0, 0.0 };
+	for ( size_t i = 0; i < window; i++ )
+	{
+		const Entry &entry = Newest( i );
+		const double dt = ( entry.time_us - newest_time_us ) * 1e-6 - mean_t;
+		variance_t += dt * dt;
+		for ( int axis = 0; axis < 3; axis++ )
+		{
+			covariance[ axis ] += dt * ( entry.position[ axis ] - mean_p[ axis ] );
+		}
+	}
+
+	for ( int axis = 0; axis < 3; axis++ )
+	{
+		velocity[ axis ] = static_cast< float >( covariance[ axis ] / variance_t );
+	}
+
+	// Rotation from the oldest to the newest sample, q_delta = q_new * conj( q_old )
+	const float *q_new = Newest( 0 ).rotation;
+	const float *q_old = Newest( window - 1 ).rotation;
+	float dw = q_new[ 0 ] * q_old[ 0 ] + q_new[ 1 ] * q_old[ 1 ] + q_new[ 2 ] * q_old[ 2 ] + q_new[ 3 ] * q_old[ 3 ];
+	float dx = -q_new[ 0 ] * q_old[ 1 ] + q_new[ 1 ] * q_old[ 0 ] - q_new[ 2 ] * q_old[ 3 ] + q_new[ 3 ] * q_old[ 2 ];
+	float dy = -q_new[ 0 ] * q_old[ 2 ] + q_new[ 1 ] * q_old[ 3 ] + q_new[ 2 ] * q_old[ 0 ] - q_new[ 3 ] * q_old[ 1 ];
+	float dz = -q_new[ 0 ] * q_old[ 3 ] - q_new[ 1 ] * q_old[ 2 ] + q_new[ 2 ] * q_old[ 1 ] + q_new[ 3 ] * q_old[ 0 ];
+
+	// q and -q are the same rotation, take the short way round
+	if ( dw < 0.f )
+	{
+		dw = -dw;
+		dx = -dx;
+		dy = -dy;
+		dz = -dz;
+	}
+
+	// Quaternion log: the delta is a rotation of angle around (dx, dy, dz) / sin( angle / 2 )
+	const float sin_half_angle = std::sqrt( dx * dx + dy * dy + dz * dz );
+	const float angle = 2.f * std::atan2( sin_half_angle, dw );
+	const float dt = static_cast< float >( ( Newest( 0 ).time_us - Newest( window - 1 ).time_us ) * 1e-6 );
+
+	// Near zero the axis is undefined, but angle / sin( angle / 2 ) tends to 2
+	const float scale = ( sin_half_angle > 1e-6f ? angle / sin_half_angle : 2.f ) / dt;
+	angular_velocity[ 0 ] = dx * scale;
+	angular_velocity[ 1 ] = dy * scale;
+	angular_velocity[ 2 ] = dz * scale;
+
+	return true;
+}
@@ -0,0 +1,43 @@
+//============ Copyright (c) Valve Corporation, All rights reserved. ============
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+//-----------------------------------------------------------------------------
+// Purpose: Estimates how fast a hand is moving and turning from its last few timestamped samples,
+// so SteamVR can extrapolate the pose from when the camera saw the hand to when the frame is displayed.
+// Linear velocity is a least squares fit over the window, angular velocity comes from the
+// rotation between the oldest and newest sample in it. Only used by one thread.
+//-----------------------------------------------------------------------------
+class HandMotionEstimator
+{
+public:
+	HandMotionEstimator();
+
+	// Adds a sample taken at unTimeUs (any microsecond clock, only differences matter).
+	// rotation is w, x, y, z.
+	void AddSample( int64_t unTimeUs, const float position[ 3 ], const float rotation[ 4 ] );
+	void Reset();
+
+	// Velocity in m/s and angular velocity in rad/s (axis * angle), in the frame the samples are in.
+	// Returns false (and zeroes) while there isn't enough recent history.
+	bool Estimate( float velocity[ 3 ], float angular_velocity[ 3 ] ) const;
+
+private:
+	struct Entry
+	{
+		int64_t time_us;
+		float position[ 3 ];
+		float rotation[ 4 ];
+	};
+
+	static constexpr size_t k_unHistorySize = 8;
+
+	// Newest first, i = 0 is the latest sample
+	const Entry &Newest( size_t i ) const;
+
+	Entry history_[ k_unHistorySize ];
+	size_t count_;
+	size_t next_;
+};
@@ -0,0 +1,599 @@
+//============ Copyright (c) Valve Corporation, All rights reserved. ============
+#include "hand_protocol.h"
+
+#include "byte_order.h"
+
+#include <charconv>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+
+// Bits for the individual keys of the text protocol, used to only accept a group (position, rotation)
+// once every one of its components has been seen.
+enum TextKey
+{
+	TextKey_X = 1 << 0,
+	TextKey_Y = 1 << 1,
+	TextKey_Z = 1 << 2,
+	TextKey_QW = 1 << 3,
+	TextKey_QX = 1 << 4,
+	TextKey_QY = 1 << 5,
+	TextKey_QZ = 1 << 6,
+
+	TextKey_Position = TextKey_X | TextKey_Y | TextKey_Z,
+	TextKey_Rotation = TextKey_QW | TextKey_QX | TextKey_QY | TextKey_QZ,
+};
+
+static std::string_view TrimWhitespace( std::string_view text )
+{
+	while ( !text.empty() && ( text.front() == ' ' || text.front() == '\t' || text.front() == '\r' ) )
+		text.remove_prefix( 1 );
+	while ( !text.empty() && ( text.back() == ' ' || text.back() == '\t' || text.back() == '\r' ) )
+		text.remove_suffix( 1 );
+	return text;
+}
+
+static bool ParseFloat( std::string_view text, float &value )
+{
+	const char *first = text.data();
+	const char *last = text.data() + text.size();
+
+	// from_chars doesn't accept an explicit plus sign, but it's valid in the protocol.
+	if ( first != last && *first == '+' )
+		++first;
+
+	// from_chars also reads "nan" and "inf", which would go straight into the pose. Those leave value alone.
+	float parsed = 0.f;
+	const std::from_chars_result result = std::from_chars( first, last, parsed );
+	if ( result.ec != std::errc() || result.ptr != last || !std::isfinite( parsed ) )
+		return false;
+
+	value = parsed;
+	return true;
+}
+
+static bool AreFinite( const float *values, int nCount )
+{
+	for ( int i = 0; i < nCount; i++ )
+	{
+		if ( !std::isfinite( values[ i ] ) )
+			return false;
+	}
+	return true;
+}
+
+template < typename T >
+static bool ParseInteger( std::string_view text, T &value )
+{
+	const char *last = text.data() + text.size();
+	const std::from_chars_result result = std::from_chars( text.data(), last, value );
+	return result.ec == std::errc() && result.ptr == last;
+}
+
+HandGesture HandGestureFromName( std::string_view name )
+{
+	if ( name == "OPEN" )
+		return HandGesture_Open;
+	if ( name == "FIST" )
+		return HandGesture_Fist;
+	if ( name == "POINT" )
+		return HandGesture_Point;
+	if ( name == "THUMBS_UP" )
+		return HandGesture_ThumbsUp;
+	if ( name == "PEACE" )
+		return HandGesture_Peace;
+	if ( name == "PINCH" )
+		return HandGesture_Pinch;
+	return HandGesture_Unknown;
+}
+
+const char *HandGestureName( HandGesture gesture )
+{
+	switch ( gesture )
+	{
+	case HandGesture_Open:
+		return "OPEN";
+	case HandGesture_Fist:
+		return "FIST";
+	case HandGesture_Point:
+		return "POINT";
+	case HandGesture_ThumbsUp:
+		return "THUMBS_UP";
+	case HandGesture_Peace:
+		return "PEACE";
+	case HandGesture_Pinch:
+		return "PINCH";
+	default:
+		return "UNKNOWN";
+	}
+}
+
+bool ParseHandSampleText( std::string_view line, HandSample &sample )
+{
+	bool has_hand = false;
+	uint32_t keys = 0;
+
+	sample.fields = 0;
+
+	while ( !line.empty() )
+	{
+		// Split off the next "KEY:VALUE" token
+		const size_t comma_pos = line.find( ',' );
+		std::string_view token = line.substr( 0, comma_pos );
+		line = comma_pos == std::string_view::npos ? std::string_view() : line.substr( comma_pos + 1 );
+
+		const size_t colon_pos = token.find( ':' );
+		if ( colon_pos == std::string_view::npos )
+			continue;
+
+		const std::string_view key = TrimWhitespace( token.substr( 0, colon_pos ) );
+		const std::string_view value = TrimWhitespace( token.substr( colon_pos + 1 ) );
+
+		if ( key == "HAND" )
+		{
+			if ( value == "LEFT" )
+			{
+				sample.hand = HandId_Left;
+				has_hand = true;
+			}
+			else if ( value == "RIGHT" )
+			{
+				sample.hand = HandId_Right;
+				has_hand = true;
+			}
+		}
+		else if ( key == "SEQ" )
+		{
+			if ( ParseInteger( value, sample.sequence ) )
+				sample.fields |= HandSampleField_Sequence;
+		}
+		else if ( key == "TS" )
+		{
+			if ( ParseInteger( value, sample.capture_time_us ) )
+				sample.fields |= HandSampleField_CaptureTime;
+		}
+		else if ( key == "SENT" )
+		{
+			if ( ParseInteger( value, sample.send_time_us ) )
+				sample.fields |= HandSampleField_SendTime;
+		}
+		else if ( key == "GESTURE" )
+		{
+			sample.gesture = HandGestureFromName( value );
+			sample.fields |= HandSampleField_Gesture;
+		}
+		else
+		{
+			float *target = nullptr;
+			uint32_t key_bit = 0;
+
+			if ( key == "X" )
+			{
+				target = &sample.position[ 0 ];
+				key_bit = TextKey_X;
+			}
+			else if ( key == "Y" )
+			{
+				target = &sample.position[ 1 ];
+				key_bit = TextKey_Y;
+			}
+			else if ( key == "Z" )
+			{
+				target = &sample.position[ 2 ];
+				key_bit = TextKey_Z;
+			}
+			else if ( key == "QW" )
+			{
+				target = &sample.rotation[ 0 ];
+				key_bit = TextKey_QW;
+			}
+			else if ( key == "QX" )
+			{
+				target = &sample.rotation[ 1 ];
+				key_bit = TextKey_QX;
+			}
+			else if ( key == "QY" )
+			{
+				target = &sample.rotation[ 2 ];
+				key_bit = TextKey_QY;
+			}
+			else if ( key == "QZ" )
+			{
+				target = &sample.rotation[ 3 ];
+				key_bit = TextKey_QZ;
+			}
+			else if ( key == "TRIGGER" )
+			{
+				if ( ParseFloat( value, sample.trigger ) )
+					sample.fields |= HandSampleField_Trigger;
+			}
+			else if ( key == "GRIP" )
+			{
+				if ( ParseFloat( value, sample.grip ) )
+					sample.fields |= HandSampleField_Grip;
+			}
+
+			if ( target != nullptr && ParseFloat( value, *target ) )
+			{
+				keys |= key_bit;
+			}
+		}
+	}
+
+	// Position and rotation are only meaningful as a whole.
+	if ( ( keys & TextKey_Position ) == TextKey_Position )
+		sample.fields |= HandSampleField_Position;
+	if ( ( keys & TextKey_Rotation ) == TextKey_Rotation )
+		sample.fields |= HandSampleField_Rotation;
+
+	return has_hand;
+}
+
+HandFrameResult DecodeHandSampleBinary( std::string_view data, HandSample &sample, size_t &frame_size )
+{
+	if ( data.size() < k_unHandFrameHeaderSize )
+		return HandFrameResult_Incomplete;
+
+	const uint8_t *bytes = reinterpret_cast< const uint8_t * >( data.data() );
+
+	// Any version >= 1 starts with the version 1 layout, so we only need to reject frames too short to hold it.
+	if ( ReadU16( bytes ) != k_unHandFrameMagic || bytes[ 2 ] < 1 || bytes[ 3 ] < k_unHandFrameSize )
+		return HandFrameResult_Invalid;
+
+	frame_size = bytes[ 3 ];
+	if ( data.size() < frame_size )
+		return HandFrameResult_Incomplete;
+
+	// A hand we don't have is a corrupt frame, it mustn't end up driving one of ours
+	if ( bytes[ 4 ] >= HandId_MAX )
+		return HandFrameResult_Invalid;
+
+	sample.hand = static_cast< HandId >( bytes[ 4 ] );
+	sample.fields = ( ReadU16( bytes + 6 ) & k_unHandFrameFields ) | HandSampleField_Sequence | HandSampleField_CaptureTime;
+	sample.sequence = ReadU32( bytes + 8 );
+	sample.capture_time_us = ReadU64( bytes + 12 );
+
+	// A gesture from a newer producer we have no name for keeps the one we had
+	sample.gesture = HandGesture_Unknown;
+	if ( bytes[ 5 ] < HandGesture_MAX )
+		sample.gesture = static_cast< HandGesture >( bytes[ 5 ] );
+	else
+		sample.fields &= ~HandSampleField_Gesture;
+
+	for ( int i = 0; i < 3; i++ )
+		sample.position[ i ] = ReadF32( bytes + 20 + i * 4 );
+	for ( int i = 0; i < 4; i++ )
+		sample.rotation[ i ] = ReadF32( bytes + 32 + i * 4 );
+
+	sample.trigger = ReadF32( bytes + 48 );
+	sample.grip = ReadF32( bytes + 52 );
+
+	// Like the text protocol, values that aren't finite count as missing
+	if ( !AreFinite( sample.position, 3 ) )
+		sample.fields &= ~HandSampleField_Position;
+	if ( !AreFinite( sample.rotation, 4 ) )
+		sample.fields &= ~HandSampleField_Rotation;
+	if ( !AreFinite( &sample.trigger, 1 ) )
+		sample.fields &= ~HandSampleField_Trigger;
+	if ( !AreFinite( &sample.grip, 1 ) )
+		sample.fields &= ~HandSampleField_Grip;
+
+	return HandFrameResult_Ok;
+}
+
+void EncodeHandSampleBinary( const HandSample &sample, uint8_t *frame )
+{
+	WriteU16( frame, k_unHandFrameMagic );
+	frame[ 2 ] = k_unHandFrameVersion;
+	frame[ 3 ] = static_cast< uint8_t >( k_unHandFrameSize );
+	frame[ 4 ] = static_cast< uint8_t >( sample.hand );
+	frame[ 5 ] = static_cast< uint8_t >( sample.gesture );
+	WriteU16( frame + 6, static_cast< uint16_t >( sample.fields & k_unHandFrameFields ) );
+	WriteU32( frame + 8, sample.sequence );
+	WriteU64( frame + 12, sample.capture_time_us );
+
+	for ( int i = 0; i < 3; i++ )
+		WriteF32( frame + 20 + i * 4, sample.position[ i ] );
+	for ( int i = 0; i < 4; i++ )
+		WriteF32( frame + 32 + i * 4, sample.rotation[ i ] );
+
+	WriteF32( frame + 48, sample.trigger );
+	WriteF32( frame + 52, sample.grip );
+}
+
+bool ParseHandMessageText( std::string_view line, HandSampleBatch &batch )
+{
+	batch.frame = 0;
+	batch.hand_count = 0;
+
+	static constexpr std::string_view k_BatchPrefix = "FRAME:";
+	if ( line.substr( 0, k_BatchPrefix.size() ) != k_BatchPrefix )
+	{
+		if ( !ParseHandSampleText( line, batch.hands[ 0 ] ) )
+			return false;
+
+		batch.hand_count = 1;
+		return true;
+	}
+
+	// Batch header, up to the first ';'
+	const size_t header_end = line.find( ';' );
+	std::string_view header = line.substr( 0, header_end );
+	line = header_end == std::string_view::npos ? std::string_view() : line.substr( header_end + 1 );
+
+	bool has_capture_time = false;
+	uint64_t capture_time_us = 0;
+	bool has_send_time = false;
+	uint64_t send_time_us = 0;
+
+	while ( !header.empty() )
+	{
+		const size_t comma_pos = header.find( ',' );
+		const std::string_view token = header.substr( 0, comma_pos );
+		header = comma_pos == std::string_view::npos ? std::string_view() : header.substr( comma_pos + 1 );
+
+		const size_t colon_pos = token.find( ':' );
+		if ( colon_pos == std::string_view::npos )
+			continue;
+
+		const std::string_view key = TrimWhitespace( token.substr( 0, colon_pos ) );
+		const std::string_view value = TrimWhitespace( token.substr( colon_pos + 1 ) );
+
+		if ( key == "FRAME" )
+			ParseInteger( value, batch.frame );
+		else if ( key == "TS" )
+			has_capture_time = ParseInteger( value, capture_time_us );
+		else if ( key == "SENT" )
+			has_send_time = ParseInteger( value, send_time_us );
+	}
+
+	// One hand sample per ';' separated segment
+	while ( !line.empty() && batch.hand_count < k_unHandBatchMaxHands )
+	{
+		const size_t separator_pos = line.find( ';' );
+		const std::string_view segment = line.substr( 0, separator_pos );
+		line = separator_pos == std::string_view::npos ? std::string_view() : line.substr( separator_pos + 1 );
+
+		HandSample &sample = batch.hands[ batch.hand_count ];
+		if ( !ParseHandSampleText( segment, sample ) )
+			continue;
+
+		if ( has_capture_time && !( sample.fields & HandSampleField_CaptureTime ) )
+		{
+			sample.capture_time_us = capture_time_us;
+			sample.fields |= HandSampleField_CaptureTime;
+		}
+
+		if ( has_send_time && !( sample.fields & HandSampleField_SendTime ) )
+		{
+			sample.send_time_us = send_time_us;
+			sample.fields |= HandSampleField_SendTime;
+		}
+
+		batch.hand_count++;
+	}
+
+	return batch.hand_count > 0;
+}
+
+HandFrameResult DecodeHandMessageBinary( std::string_view data, HandSampleBatch &batch, size_t &message_size )
+{
+	if ( data.size() < 2 )
+		return HandFrameResult_Incomplete;
+
+	const uint8_t *bytes = reinterpret_cast< const uint8_t * >( data.data() );
+
+	if ( ReadU16( bytes ) != k_unHandBatchMagic )
+	{
+		batch.frame = 0;
+		batch.hand_count = 1;
+		return DecodeHandSampleBinary( data, batch.hands[ 0 ], message_size );
+	}
+
+	if ( data.size() < k_unHandBatchMinHeaderSize )
+		return HandFrameResult_Incomplete;
+
+	// Like frames, newer versions may only grow the header
+	const size_t header_size = bytes[ 3 ];
+	if ( bytes[ 2 ] < 1 || header_size < k_unHandBatchMinHeaderSize )
+		return HandFrameResult_Invalid;
+	if ( data.size() < header_size )
+		return HandFrameResult_Incomplete;
+
+	const uint32_t hand_count = bytes[ 8 ];
+
+	// Make sure the whole batch is here before decoding any of it, so it's always handled as one
+	size_t offset = header_size;
+	for ( uint32_t i = 0; i < hand_count; i++ )
+	{
+		if ( data.size() < offset + k_unHandFrameHeaderSize )
+			return HandFrameResult_Incomplete;
+		if ( ReadU16( bytes + offset ) != k_unHandFrameMagic || bytes[ offset + 3 ] < k_unHandFrameSize )
+			return HandFrameResult_Invalid;
+		offset += bytes[ offset + 3 ];
+	}
+	if ( data.size() < offset )
+		return HandFrameResult_Incomplete;
+
+	batch.frame = ReadU32( bytes + 4 );
+	batch.hand_count = 0;
+
+	const bool has_send_time = header_size >= k_unHandBatchHeaderSize;
+	const uint64_t send_time_us = has_send_time ? ReadU64( bytes + 12 ) : 0;
+
+	offset = header_size;
+	for ( uint32_t i = 0; i < hand_count; i++ )
+	{
+		size_t frame_size = 0;
+		if ( batch.hand_count < k_unHandBatchMaxHands )
+		{
+			HandSample &sample = batch.hands[ batch.hand_count ];
+			if ( DecodeHandSampleBinary( data.substr( offset ), sample, frame_size ) != HandFrameResult_Ok )
+				return HandFrameResult_Invalid;
+
+			if ( has_send_time )
+			{
+				sample.send_time_us = send_time_us;
+				sample.fields |= HandSampleField_SendTime;
+			}
+			batch.hand_count++;
+		}
+		else
+		{
+			frame_size = bytes[ offset + 3 ];
+		}
+		offset += frame_size;
+	}
+
+	message_size = offset;
+	return HandFrameResult_Ok;
+}
+
+size_t EncodeHandSampleBatchBinary( const HandSampleBatch &batch, uint8_t *buffer )
+{
+	const uint32_t hand_count = batch.hand_count < k_unHandBatchMaxHands ? batch.hand_count : static_cast< uint32_t >( k_unHandBatchMaxHands );
+
+	WriteU16( buffer, k_unHandBatchMagic );
+	buffer[ 2 ] = k_unHandFrameVersion;
+	buffer[ 3 ] = static_cast< uint8_t >( k_unHandBatchHeaderSize );
+	WriteU32( buffer + 4, batch.frame );
+	buffer[ 8 ] = static_cast< uint8_t >( hand_count );
+	buffer[ 9 ] = buffer[ 10 ] = buffer[ 11 ] = 0;
+
+	// Every hand of a batch is sent at once, the first one's send time stands for all of them
+	WriteU64( buffer + 12, hand_count > 0 ? batch.hands[ 0 ].send_time_us : 0 );
+
+	size_t offset = k_unHandBatchHeaderSize;
+	for ( uint32_t i = 0; i < hand_count; i++ )
+	{
+		EncodeHandSampleBinary( batch.hands[ i ], buffer + offset );
+		offset += k_unHandFrameSize;
+	}
+
+	return offset;
+}
+
+size_t FormatHandMessageText( const HandSampleBatch &batch, char *pchBuffer, size_t unBufferSize )
+{
+	const uint32_t hand_count = batch.hand_count < k_unHandBatchMaxHands ? batch.hand_count : static_cast< uint32_t >( k_unHandBatchMaxHands );
+	const HandSample *first = hand_count > 0 ? &batch.hands[ 0 ] : nullptr;
+
+	size_t length = 0;
+	auto Append = [ & ]( const char *pchFormat, auto... args )
+	{
+		if ( length >= unBufferSize )
+			return;
+		const int written = snprintf( pchBuffer + length, unBufferSize - length, pchFormat, args... );
+		length = written >= 0 ? length + static_cast< size_t >( written ) : unBufferSize;
+	};
+
+	Append( "FRAME:%u", batch.frame );
+	if ( first != nullptr && ( first->fields & HandSampleField_CaptureTime ) )
+		Append( ",TS:%llu", static_cast< unsigned long long >( first->capture_time_us ) );
+	if ( first != nullptr && ( first->fields & HandSampleField_SendTime ) )
+		Append( ",SENT:%llu", static_cast< unsigned long long >( first->send_time_us ) );
+
+	for ( uint32_t i = 0; i < hand_count; i++ )
+	{
+		const HandSample &sample = batch.hands[ i ];
+		Append( ";HAND:%s", sample.hand == HandId_Left ? "LEFT" : "RIGHT" );
+		if ( sample.fields & HandSampleField_Position )
+			Append( ",X:%.4f,Y:%.4f,Z:%.4f", sample.position[ 0 ], sample.position[ 1 ], sample.position[ 2 ] );
+		if ( sample.fields & HandSampleField_Rotation )
+			Append( ",QW:%.4f,QX:%.4f,QY:%.4f,QZ:%.4f", sample.rotation[ 0 ], sample.rotation[ 1 ], sample.rotation[ 2 ], sample.rotation[ 3 ] );
+		if ( sample.fields & HandSampleField_Trigger )
+			Append( ",TRIGGER:%.2f", sample.trigger );
+		if ( sample.fields & HandSampleField_Grip )
+			Append( ",GRIP:%.2f", sample.grip );
+		if ( sample.fields & HandSampleField_Gesture )
+			Append( ",GESTURE:%s", HandGestureName( sample.gesture ) );
+		if ( sample.fields & HandSampleField_Sequence )
+			Append( ",SEQ:%u", sample.sequence );
+
+		// Only hands stamped differently from the first need their own times
+		if ( ( sample.fields & HandSampleField_CaptureTime ) && sample.capture_time_us != first->capture_time_us )
+			Append( ",TS:%llu", static_cast< unsigned long long >( sample.capture_time_us ) );
+		if ( ( sample.fields & HandSampleField_SendTime ) && sample.send_time_us != first->send_time_us )
+			Append( ",SENT:%llu", static_cast< unsigned long long >( sample.send_time_us ) );
+	}
+	Append( "%c", '\n' );
+
+	return length < unBufferSize ? length : 0;
+}
+
+bool ParseClockPingText( std::string_view line, HandClockPing &ping )
+{
+	static constexpr std::string_view k_PingPrefix = "PING:";
+	if ( line.substr( 0, k_PingPrefix.size() ) != k_PingPrefix )
+		return false;
+
+	ping = {};
+	bool has_time = false;
+	bool has_id = false;
+
+	while ( !line.empty() )
+	{
+		const size_t comma_pos = line.find( ',' );
+		const std::string_view token = line.substr( 0, comma_pos );
+		line = comma_pos == std::string_view::npos ? std::string_view() : line.substr( comma_pos + 1 );
+
+		const size_t colon_pos = token.find( ':' );
+		if ( colon_pos == std::string_view::npos )
+			continue;
+
+		const std::string_view key = TrimWhitespace( token.substr( 0, colon_pos ) );
+		const std::string_view value = TrimWhitespace( token.substr( colon_pos + 1 ) );
+
+		if ( key == "PING" )
+			has_id = ParseInteger( value, ping.id );
+		else if ( key == "T" )
+			has_time = ParseInteger( value, ping.producer_time_us );
+	}
+
+	return has_id && has_time;
+}
+
+size_t FormatClockPongText( const HandClockPing &ping, char *pchBuffer, size_t unBufferSize )
+{
+	const int length = snprintf( pchBuffer, unBufferSize, "PONG:%u,T:%llu,RX:%llu,TX:%llu\n", ping.id, static_cast< unsigned long long >( ping.producer_time_us ),
+		static_cast< unsigned long long >( ping.driver_receive_time_us ), static_cast< unsigned long long >( ping.driver_send_time_us ) );
+
+	return length > 0 && static_cast< size_t >( length ) < unBufferSize ? static_cast< size_t >( length ) : 0;
+}
+
+bool IsClockPingBinary( std::string_view data )
+{
+	return data.size() >= 2 && ReadU16( reinterpret_cast< const uint8_t * >( data.data() ) ) == k_unClockPingMagic;
+}
+
+HandFrameResult DecodeClockPingBinary( std::string_view data, HandClockPing &ping, size_t &message_size )
+{
+	if ( data.size() < k_unHandFrameHeaderSize )
+		return HandFrameResult_Incomplete;
+
+	const uint8_t *bytes = reinterpret_cast< const uint8_t * >( data.data() );
+	if ( ReadU16( bytes ) != k_unClockPingMagic || bytes[ 2 ] < 1 || bytes[ 3 ] < k_unClockPingSize )
+		return HandFrameResult_Invalid;
+
+	message_size = bytes[ 3 ];
+	if ( data.size() < message_size )
+		return HandFrameResult_Incomplete;
+
+	ping.id = ReadU32( bytes + 4 );
+	ping.producer_time_us = ReadU64( bytes + 8 );
+	ping.driver_receive_time_us = ReadU64( bytes + 16 );
+	ping.driver_send_time_us = ReadU64( bytes + 24 );
+
+	return HandFrameResult_Ok;
+}
+
+void EncodeClockPingBinary( const HandClockPing &ping, uint8_t *record )
+{
+	WriteU16( record, k_unClockPingMagic );
+	record[ 2 ] = k_unHandFrameVersion;
+	record[ 3 ] = static_cast< uint8_t >( k_unClockPingSize );
+	WriteU32( record + 4, ping.id );
+	WriteU64( record + 8, ping.producer_time_us );
+	WriteU64( record + 16, ping.driver_receive_time_us );
+	WriteU64( record + 24, ping.driver_send_time_us );
+}
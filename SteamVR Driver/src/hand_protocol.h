@@ -0,0 +1,213 @@
+//============ Copyright (c) Valve Corporation, All rights reserved. ============
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+
+enum HandId
+{
+	HandId_Left,
+	HandId_Right,
+
+	HandId_MAX
+};
+
+// Gestures reported by gesture_detector.py
+enum HandGesture
+{
+	HandGesture_Unknown,
+	HandGesture_Open,
+	HandGesture_Fist,
+	HandGesture_Point,
+	HandGesture_ThumbsUp,
+	HandGesture_Peace,
+	HandGesture_Pinch,
+
+	HandGesture_MAX
+};
+
+// Bits set in HandSample::fields for every group of values that was present in the message
+enum HandSampleField
+{
+	HandSampleField_Position = 1 << 0,
+	HandSampleField_Rotation = 1 << 1,
+	HandSampleField_Trigger = 1 << 2,
+	HandSampleField_Grip = 1 << 3,
+	HandSampleField_Gesture = 1 << 4,
+	HandSampleField_Sequence = 1 << 5,
+	HandSampleField_CaptureTime = 1 << 6,
+	HandSampleField_SendTime = 1 << 7,
+};
+
+//-----------------------------------------------------------------------------
+// Purpose: One decoded hand tracking sample.
+// Fixed size and trivially copyable so it can be filled in place by the parsers
+// and handed between threads without touching the heap.
+//-----------------------------------------------------------------------------
+struct HandSample
+{
+	HandId hand;
+	uint32_t fields;
+
+	// Producer frame counter, and when the camera captured the frame and the producer sent it
+	// (microseconds on the producer's monotonic clock, the driver's once the producer has synced to it)
+	uint32_t sequence;
+	uint64_t capture_time_us;
+	uint64_t send_time_us;
+
+	// When the listener received the sample, on the driver clock. Not part of the wire format.
+	int64_t receive_time_us;
+
+	float position[ 3 ];
+	float rotation[ 4 ]; // w, x, y, z
+	float trigger;
+	float grip;
+	HandGesture gesture;
+};
+
+HandGesture HandGestureFromName( std::string_view name );
+
+// The name the text protocol uses for gesture, "UNKNOWN" for anything it has no name for
+const char *HandGestureName( HandGesture gesture );
+
+// Parses one line of the text protocol:
+// HAND:LEFT,X:0.5,Y:0.3,Z:-0.2,QW:1.0,QX:0.0,QY:0.0,QZ:0.0,TRIGGER:0.8,GRIP:0.0,GESTURE:POINT
+// optionally followed by ,SEQ:<sequence>,TS:<capture time in microseconds>,SENT:<send time in microseconds>
+// Values that don't parse, or aren't finite numbers ("nan", "inf"), count as missing, so their group isn't set.
+// Returns false if the line doesn't name a hand. Never allocates.
+bool ParseHandSampleText( std::string_view line, HandSample &sample );
+
+// Binary protocol.
+// Every frame is a fixed layout, little-endian record:
+//
+//   offset  size  field
+//        0     2  magic (k_unHandFrameMagic)
+//        2     1  version (k_unHandFrameVersion)
+//        3     1  frame size in bytes, including this header
+//        4     1  hand (HandId)
+//        5     1  gesture (HandGesture)
+//        6     2  fields (k_unHandFrameFields bits)
+//        8     4  sequence
+//       12     8  capture time, microseconds
+//       20    12  position x, y, z (float)
+//       32    16  rotation w, x, y, z (float)
+//       48     4  trigger (float)
+//       52     4  grip (float)
+//
+// Newer versions may only append to the record. The size byte lets older readers skip what they don't know.
+// The first magic byte can never start a text line, so the listener uses it to tell the two protocols apart.
+static constexpr uint16_t k_unHandFrameMagic = 0xB1C5;
+static constexpr uint8_t k_unHandFrameMagicFirstByte = 0xC5;
+static constexpr uint8_t k_unHandFrameVersion = 1;
+static constexpr size_t k_unHandFrameHeaderSize = 4;
+static constexpr size_t k_unHandFrameSize = 56;
+
+// The HandSampleField bits a frame's fields word can carry. Every frame has a sequence and capture time, and the
+// send time only comes in a batch header, so their bits are never read from or written to a frame.
+static constexpr uint16_t k_unHandFrameFields = HandSampleField_Position | HandSampleField_Rotation | HandSampleField_Trigger | HandSampleField_Grip | HandSampleField_Gesture;
+
+enum HandFrameResult
+{
+	HandFrameResult_Ok,
+	HandFrameResult_Incomplete, // Need more bytes before the frame can be decoded
+	HandFrameResult_Invalid,	// Not a frame we understand, the stream can't be resynchronised
+};
+
+// Decodes the frame at the start of data. On HandFrameResult_Ok, frame_size is set to the number of bytes it used.
+// A hand byte other than HandId_Left or HandId_Right makes the frame invalid. An unknown gesture code, or values that
+// aren't finite, clear their HandSampleField bit instead, like a missing key in the text protocol. Bits outside
+// k_unHandFrameFields are ignored, a frame never sets HandSampleField_SendTime.
+HandFrameResult DecodeHandSampleBinary( std::string_view data, HandSample &sample, size_t &frame_size );
+
+// Writes sample as a k_unHandFrameSize byte frame. Only the k_unHandFrameFields bits of sample.fields are written.
+void EncodeHandSampleBinary( const HandSample &sample, uint8_t *frame );
+
+// Batches carry every hand seen in one camera frame as a single message.
+//
+// Text, one line, hand samples separated by ';':
+// FRAME:12,TS:1234567,SENT:1251234;HAND:LEFT,X:0.5,...,SEQ:40;HAND:RIGHT,X:-0.2,...,SEQ:38
+// A hand sample without a TS: or SENT: of its own takes the batch's.
+//
+// Binary, a header followed by hand_count binary frames:
+//
+//   offset  size  field
+//        0     2  magic (k_unHandBatchMagic)
+//        2     1  version (k_unHandFrameVersion)
+//        3     1  header size in bytes
+//        4     4  camera frame number
+//        8     1  hand count
+//        9     3  reserved
+//       12     8  send time, microseconds (headers of at least 20 bytes)
+//
+// Its first byte is the same as a frame's, so the listener sees one binary protocol with two message types.
+static constexpr uint16_t k_unHandBatchMagic = 0xB2C5;
+static constexpr size_t k_unHandBatchHeaderSize = 20;
+static constexpr size_t k_unHandBatchMinHeaderSize = 12; // Headers without the send time
+static constexpr size_t k_unHandBatchMaxHands = 8;
+
+struct HandSampleBatch
+{
+	uint32_t frame;
+	uint32_t hand_count;
+	HandSample hands[ k_unHandBatchMaxHands ];
+};
+
+// Parses a text line holding either a single hand sample or a batch. A single sample is returned as a batch of one, with frame 0.
+// Returns false if the line holds no hand.
+bool ParseHandMessageText( std::string_view line, HandSampleBatch &batch );
+
+// Decodes the binary frame or batch at the start of data as a batch. On HandFrameResult_Ok,
+// message_size is set to the number of bytes it used. Hands beyond k_unHandBatchMaxHands are skipped.
+HandFrameResult DecodeHandMessageBinary( std::string_view data, HandSampleBatch &batch, size_t &message_size );
+
+// Writes batch as a header plus one frame per hand. buffer must hold k_unHandBatchHeaderSize + hand_count * k_unHandFrameSize bytes.
+// Returns the number of bytes written.
+size_t EncodeHandSampleBatchBinary( const HandSampleBatch &batch, uint8_t *buffer );
+
+// Writes batch as one text line, newline included, the way Camera.py sends it: the first hand's TS: and SENT:
+// go in the FRAME: header, and each hand only carries the values its fields say it has.
+// Returns the length, or 0 if it doesn't fit in pchBuffer.
+size_t FormatHandMessageText( const HandSampleBatch &batch, char *pchBuffer, size_t unBufferSize );
+
+// Clock sync. A producer sends a ping stamped with its own clock and the listener answers it straight away,
+// adding when it received and answered it on the driver clock (driver_clock.h). From the round trip the producer
+// works out the offset between the two clocks, NTP style, and stamps its capture and send times on the driver clock.
+//
+// Text, one line each way:
+// PING:<id>,T:<producer time>   answered with   PONG:<id>,T:<producer time>,RX:<driver receive time>,TX:<driver send time>
+//
+// Binary, a record that is sent back with the driver's times filled in:
+//
+//   offset  size  field
+//        0     2  magic (k_unClockPingMagic)
+//        2     1  version (k_unHandFrameVersion)
+//        3     1  record size in bytes
+//        4     4  ping id
+//        8     8  producer time, microseconds
+//       16     8  driver receive time, microseconds
+//       24     8  driver send time, microseconds
+static constexpr uint16_t k_unClockPingMagic = 0xB3C5;
+static constexpr size_t k_unClockPingSize = 32;
+
+struct HandClockPing
+{
+	uint32_t id;
+	uint64_t producer_time_us;
+	uint64_t driver_receive_time_us;
+	uint64_t driver_send_time_us;
+};
+
+// Returns false if line isn't a PING
+bool ParseClockPingText( std::string_view line, HandClockPing &ping );
+
+// Writes the PONG line, newline included, and returns its length. 0 if it doesn't fit.
+size_t FormatClockPongText( const HandClockPing &ping, char *pchBuffer, size_t unBufferSize );
+
+// Whether the binary message at the start of data is a clock ping rather than a frame or batch
+bool IsClockPingBinary( std::string_view data );
+
+HandFrameResult DecodeClockPingBinary( std::string_view data, HandClockPing &ping, size_t &message_size );
+
+// Writes ping as a k_unClockPingSize byte record
+void EncodeClockPingBinary( const HandClockPing &ping, uint8_t *record );
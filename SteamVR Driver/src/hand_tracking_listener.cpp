@@ -1,17 +1,87 @@
 //============ Copyright (c) Valve Corporation, All rights reserved. ============
 #include "hand_tracking_listener.h"
 #include "controller_device_driver.h"
+#include "driver_clock.h"
 #include "driverlog.h"
 
+#include <algorithm>
+#include <cerrno>
 #include <cstring>
+#include <iterator>
+
+#ifdef _WIN32
+#define poll WSAPoll
+#elif defined( __linux__ )
+#include <fcntl.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#else
+#include <fcntl.h>
+#include <poll.h>
+#endif
+
+// Most producer connections we serve at once
+static constexpr size_t k_unMaxClients = 8;
+
+// io_uring user_data of the datagram socket's receive, clients are numbered from 1
+static constexpr uint64_t k_unDatagramReceiveId = 0;
+
+// Futex wait timeout of the shared memory reader while idle. Only matters if a wakeup is lost.
+static constexpr uint32_t k_unShmIdleWaitMs = 1000;
+
+// Send times further back than this are from a producer that hasn't synced its clock to ours yet
+static constexpr int64_t k_unMaxWakeLateUs = 1000000;
+
+// How long a numbered stream has to be quiet before a sample from behind it is taken for a restarted producer
+static constexpr int64_t k_unProducerRestartGapUs = 250000;
+
+// Answering a producer must never raise SIGPIPE if it has just gone away
+#ifdef MSG_NOSIGNAL
+static constexpr int k_nSendFlags = MSG_NOSIGNAL;
+#else
+static constexpr int k_nSendFlags = 0;
+#endif
+
+static bool SetNonBlocking( SOCKET socket )
+{
+#ifdef _WIN32
+	u_long non_blocking = 1;
+	return ioctlsocket( socket, FIONBIO, &non_blocking ) == 0;
+#else
+	const int flags = fcntl( socket, F_GETFL, 0 );
+	return flags >= 0 && fcntl( socket, F_SETFL, flags | O_NONBLOCK ) == 0;
+#endif
+}
+
+// Whether the last failed socket call only failed because there was nothing to do yet
+static bool SocketWouldBlock()
+{
+#ifdef _WIN32
+	return WSAGetLastError() == WSAEWOULDBLOCK;
+#else
+	return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;
+#endif
+}
 
 HandTrackingListener::HandTrackingListener( MyControllerDeviceDriver *left_controller, MyControllerDeviceDriver *right_controller )
 	: left_controller_( left_controller )
 	, right_controller_( right_controller )
+	, batch_{}
+	, pipeline_stats_( nullptr )
+	, idle_timeout_us_( 0 )
+	, wake_time_us_( 0 )
 	, is_running_( false )
 	, server_socket_( INVALID_SOCKET )
-	, client_socket_( INVALID_SOCKET )
+#ifdef __linux__
+	, epoll_fd_( -1 )
+	, wake_fd_( -1 )
+#endif
+	, receive_backend_( HandReceiveBackend_Socket )
+	, next_client_id_( k_unDatagramReceiveId + 1 )
 	, port_( 65432 )
+	, transport_( HandTransport_Tcp )
+	, shm_name_( "handcameradriver" )
+	, shm_spin_wait_( false )
 {
 }
 
@@ -20,9 +90,58 @@ HandTrackingListener::~HandTrackingListener()
 	Stop();
 }
 
-bool HandTrackingListener::Start( int port )
+void HandTrackingListener::SetSharedMemoryOptions( const char *pchName, bool bSpinWait )
+{
+	shm_name_ = pchName;
+	shm_spin_wait_ = bSpinWait;
+}
+
+void HandTrackingListener::SetReceiveBackend( HandReceiveBackend backend )
+{
+	receive_backend_ = backend;
+}
+
+void HandTrackingListener::SetPipelineStats( PipelineStats *stats )
+{
+	pipeline_stats_ = stats;
+}
+
+void HandTrackingListener::SetThreadTuning( const ThreadTuning &tuning )
+{
+	thread_tuning_ = tuning;
+}
+
+void HandTrackingListener::SetIdleTimeout( int64_t nIdleTimeoutUs )
+{
+	idle_timeout_us_ = nIdleTimeoutUs;
+}
+
+void HandTrackingListener::SetCaptureFile( const char *pchPath )
+{
+	capture_path_ = pchPath;
+}
+
+bool HandTrackingListener::Start( int port, HandTransport transport )
 {
 	port_ = port;
+	transport_ = transport;
+	ResetSequences();
+
+	if ( transport_ == HandTransport_SharedMemory )
+	{
+		// We own the ring, so (re)create it. The producer attaches to it when it starts.
+		if ( shm_ring_.Open( shm_name_.c_str(), true ) )
+		{
+			DriverLog( "HandTrackingListener: Reading shared memory ring /dev/shm/%s (%s)", shm_name_.c_str(), shm_spin_wait_ ? "spin" : "futex wait" );
+
+			is_running_ = true;
+			listen_thread_ = std::thread( &HandTrackingListener::SharedMemoryThread, this );
+			return true;
+		}
+
+		DriverLog( "HandTrackingListener: Failed to create shared memory ring /dev/shm/%s, falling back to TCP", shm_name_.c_str() );
+		transport_ = HandTransport_Tcp;
+	}
 
 #ifdef _WIN32
 	// Initialize Winsock
@@ -35,7 +154,7 @@ bool HandTrackingListener::Start( int port )
 #endif
 
 	// Create socket
-	server_socket_ = socket( AF_INET, SOCK_STREAM, 0 );
+	server_socket_ = socket( AF_INET, transport_ == HandTransport_Udp ? SOCK_DGRAM : SOCK_STREAM, 0 );
 	if ( server_socket_ == INVALID_SOCKET )
 	{
 		DriverLog( "HandTrackingListener: Failed to create socket" );
@@ -70,8 +189,8 @@ bool HandTrackingListener::Start( int port )
 		return false;
 	}
 
-	// Listen
-	if ( listen( server_socket_, 3 ) == SOCKET_ERROR )
+	// Listen (datagram sockets are ready to receive once bound)
+	if ( transport_ == HandTransport_Tcp && listen( server_socket_, 3 ) == SOCKET_ERROR )
 	{
 		DriverLog( "HandTrackingListener: Failed to listen on socket" );
 		closesocket( server_socket_ );
@@ -81,29 +200,134 @@ bool HandTrackingListener::Start( int port )
 		return false;
 	}
 
-	DriverLog( "HandTrackingListener: Listening on port %d", port_ );
+	// The event loop never blocks on a single socket
+	if ( !SetNonBlocking( server_socket_ ) || !CreateEventLoop() )
+	{
+		DriverLog( "HandTrackingListener: Failed to set up the event loop" );
+		CloseSockets();
+#ifdef _WIN32
+		WSACleanup();
+#endif
+		return false;
+	}
+
+#ifdef __linux__
+	const bool using_io_uring = uring_.IsActive();
+#else
+	const bool using_io_uring = false;
+#endif
+	DriverLog( "HandTrackingListener: Listening on %s port %d (%s)", transport_ == HandTransport_Udp ? "UDP" : "TCP", port_, using_io_uring ? "io_uring" : "sockets" );
 
 	// Start listening thread
 	is_running_ = true;
-	listen_thread_ = std::thread( &HandTrackingListener::ListenThread, this );
+	listen_thread_ = std::thread( &HandTrackingListener::EventLoopThread, this );
+
+	return true;
+}
+
+bool HandTrackingListener::CreateEventLoop()
+{
+#ifdef __linux__
+	epoll_fd_ = epoll_create1( EPOLL_CLOEXEC );
+	wake_fd_ = eventfd( 0, EFD_NONBLOCK | EFD_CLOEXEC );
+	if ( epoll_fd_ < 0 || wake_fd_ < 0 )
+	{
+		return false;
+	}
+
+	if ( receive_backend_ == HandReceiveBackend_IoUring && !uring_.Init() )
+	{
+		DriverLog( "HandTrackingListener: io_uring isn't available, receiving with sockets" );
+	}
 
+	// The listening (or datagram) socket, the io_uring and Stop()'s wakeup are told apart by their data pointers,
+	// every other registration points at a ClientConnection.
+	epoll_event event{};
+	event.events = EPOLLIN;
+	event.data.ptr = &wake_fd_;
+	if ( epoll_ctl( epoll_fd_, EPOLL_CTL_ADD, wake_fd_, &event ) != 0 )
+	{
+		return false;
+	}
+
+	if ( uring_.IsActive() )
+	{
+		// Receives complete into the ring, which is readable while there are completions to reap
+		event.data.ptr = &uring_;
+		if ( epoll_ctl( epoll_fd_, EPOLL_CTL_ADD, uring_.RingFd(), &event ) != 0 )
+		{
+			return false;
+		}
+
+		// The datagram socket is then only read through the ring, with the senders' addresses so clock pings can be answered
+		if ( transport_ == HandTransport_Udp )
+		{
+			return uring_.StartReceiveFrom( server_socket_, k_unDatagramReceiveId );
+		}
+	}
+
+	event.data.ptr = &server_socket_;
+	if ( epoll_ctl( epoll_fd_, EPOLL_CTL_ADD, server_socket_, &event ) != 0 )
+	{
+		return false;
+	}
+#endif
 	return true;
 }
 
+void HandTrackingListener::CloseSockets()
+{
+	for ( const std::unique_ptr< ClientConnection > &client : clients_ )
+	{
+		closesocket( client->socket );
+	}
+	clients_.clear();
+
+#ifdef __linux__
+	// Cancels the receives still queued on the sockets
+	uring_.Shutdown();
+#endif
+
+	if ( server_socket_ != INVALID_SOCKET )
+	{
+		closesocket( server_socket_ );
+		server_socket_ = INVALID_SOCKET;
+	}
+
+#ifdef __linux__
+	if ( epoll_fd_ >= 0 )
+	{
+		close( epoll_fd_ );
+		epoll_fd_ = -1;
+	}
+	if ( wake_fd_ >= 0 )
+	{
+		close( wake_fd_ );
+		wake_fd_ = -1;
+	}
+#endif
+}
+
 void HandTrackingListener::Stop()
 {
 	if ( is_running_.exchange( false ) )
 	{
-		// Close sockets
-		if ( client_socket_ != INVALID_SOCKET )
+#ifdef __linux__
+		// Wake the event loop, it sees is_running_ is false and returns
+		if ( wake_fd_ >= 0 )
 		{
-			closesocket( client_socket_ );
-			client_socket_ = INVALID_SOCKET;
+			const uint64_t wake = 1;
+			if ( write( wake_fd_, &wake, sizeof( wake ) ) < 0 )
+			{
+				DriverLog( "HandTrackingListener: Failed to wake the event loop" );
+			}
 		}
-		if ( server_socket_ != INVALID_SOCKET )
+#endif
+
+		// Wake the shared memory reader if it's asleep
+		if ( shm_ring_.IsOpen() )
 		{
-			closesocket( server_socket_ );
-			server_socket_ = INVALID_SOCKET;
+			shm_ring_.Wake();
 		}
 
 		// Wait for thread to finish
@@ -112,6 +336,10 @@ void HandTrackingListener::Stop()
 			listen_thread_.join();
 		}
 
+		// Only now that the thread is gone, nothing else touches the sockets
+		CloseSockets();
+		shm_ring_.Close();
+
 #ifdef _WIN32
 		WSACleanup();
 #endif
@@ -120,151 +348,862 @@ void HandTrackingListener::Stop()
 	}
 }
 
-void HandTrackingListener::ListenThread()
+//-----------------------------------------------------------------------------
+// Purpose: Serves the listening socket and every connected producer from one thread.
+// All sockets are non-blocking, so a slow or stalled peer never holds up the others.
+//-----------------------------------------------------------------------------
+void HandTrackingListener::EventLoopThread()
 {
 	DriverLog( "HandTrackingListener: Thread started" );
+	ApplyThreadTuning( "HandTrackingListener", thread_tuning_ );
+
+	if ( !capture_path_.empty() )
+	{
+		capture_.Open( capture_path_.c_str() );
+	}
+
+#ifdef __linux__
+	epoll_event events[ k_unMaxClients + 2 ];
 
 	while ( is_running_ )
 	{
-		// Accept connection
-		DriverLog( "HandTrackingListener: Waiting for client connection..." );
+		const int event_count = epoll_wait( epoll_fd_, events, static_cast< int >( std::size( events ) ), -1 );
+		if ( event_count < 0 )
+		{
+			if ( errno == EINTR )
+			{
+				continue;
+			}
+
+			DriverLog( "HandTrackingListener: epoll_wait failed" );
+			break;
+		}
+		wake_time_us_ = DriverClockUs();
+
+		for ( int i = 0; i < event_count && is_running_; i++ )
+		{
+			void *source = events[ i ].data.ptr;
+			if ( source == &wake_fd_ )
+			{
+				// Stop() was called, the loop condition takes care of it
+				continue;
+			}
+
+			if ( source == &server_socket_ )
+			{
+				ServerSocketReadable();
+				continue;
+			}
+
+			if ( source == &uring_ )
+			{
+				ReapReceives();
+				continue;
+			}
+
+			ClientConnection *client = static_cast< ClientConnection * >( source );
+			if ( !ReadClient( *client ) )
+			{
+				CloseClient( client );
+			}
+		}
+
+		FlushHandSamples();
+	}
+#else
+	// No epoll here. poll() with a timeout, so Stop() is noticed within one timeout.
+	std::vector< pollfd > poll_fds;
+	poll_fds.reserve( k_unMaxClients + 1 );
+
+	while ( is_running_ )
+	{
+		poll_fds.clear();
+		poll_fds.push_back( { server_socket_, POLLIN, 0 } );
+		for ( const std::unique_ptr< ClientConnection > &client : clients_ )
+		{
+			poll_fds.push_back( { client->socket, POLLIN, 0 } );
+		}
+
+		if ( poll( poll_fds.data(), static_cast< unsigned long >( poll_fds.size() ), 100 ) <= 0 )
+		{
+			continue;
+		}
+		wake_time_us_ = DriverClockUs();
+
+		// Clients first, from the back, so closing one doesn't shift the ones still to be visited
+		for ( size_t i = poll_fds.size() - 1; i > 0; i-- )
+		{
+			if ( poll_fds[ i ].revents != 0 && !ReadClient( *clients_[ i - 1 ] ) )
+			{
+				CloseClient( clients_[ i - 1 ].get() );
+			}
+		}
+
+		if ( poll_fds[ 0 ].revents != 0 )
+		{
+			ServerSocketReadable();
+		}
+
+		FlushHandSamples();
+	}
+#endif
+
+	capture_.Close();
+	DriverLog( "HandTrackingListener: Thread stopped" );
+}
+
+void HandTrackingListener::ServerSocketReadable()
+{
+	if ( transport_ == HandTransport_Udp )
+	{
+		ReadDatagrams();
+	}
+	else
+	{
+		AcceptClients();
+	}
+}
+
+void HandTrackingListener::AcceptClients()
+{
+	for ( ;; )
+	{
 		struct sockaddr_in client_addr;
 		socklen_t client_addr_len = sizeof( client_addr );
-		client_socket_ = accept( server_socket_, (struct sockaddr *)&client_addr, &client_addr_len );
+		SOCKET client_socket = accept( server_socket_, (struct sockaddr *)&client_addr, &client_addr_len );
 
-		if ( client_socket_ == INVALID_SOCKET )
+		if ( client_socket == INVALID_SOCKET )
 		{
-			if ( is_running_ )
+			if ( !SocketWouldBlock() )
 			{
 				DriverLog( "HandTrackingListener: Failed to accept connection" );
 			}
-			break;
+			return;
 		}
 
-		DriverLog( "HandTrackingListener: Client connected" );
+		if ( clients_.size() >= k_unMaxClients || !SetNonBlocking( client_socket ) )
+		{
+			DriverLog( "HandTrackingListener: Refusing client, %zu already connected", clients_.size() );
+			closesocket( client_socket );
+			continue;
+		}
+
+		std::unique_ptr< ClientConnection > client = std::make_unique< ClientConnection >();
+		client->socket = client_socket;
+		client->id = next_client_id_++;
+		client->format = StreamFormat_Unknown;
+
+#ifdef __linux__
+		bool watching;
+		if ( uring_.IsActive() )
+		{
+			watching = uring_.StartReceive( client_socket, client->id );
+		}
+		else
+		{
+			epoll_event event{};
+			event.events = EPOLLIN | EPOLLRDHUP;
+			event.data.ptr = client.get();
+			watching = epoll_ctl( epoll_fd_, EPOLL_CTL_ADD, client_socket, &event ) == 0;
+		}
+
+		if ( !watching )
+		{
+			DriverLog( "HandTrackingListener: Failed to watch client" );
+			closesocket( client_socket );
+			continue;
+		}
+#endif
+
+		clients_.push_back( std::move( client ) );
+		DriverLog( "HandTrackingListener: Client connected (%zu connected)", clients_.size() );
+	}
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Takes whatever the client has sent and hands complete messages to the parsers.
+// Returns false when the client should be disconnected.
+//-----------------------------------------------------------------------------
+bool HandTrackingListener::ReadClient( ClientConnection &client )
+{
+	// Bounded, so one busy producer can't starve the others
+	for ( int reads = 0; reads < 4; reads++ )
+	{
+		// Receive straight into the framer, taking as much as is available in one call,
+		// so a burst of messages costs a single recv rather than one per line.
+		char *write_begin = client.framer.WriteBegin();
+		const size_t capacity = client.framer.WriteCapacity();
+		int recv_size = recv( client.socket, write_begin, static_cast< int >( capacity ), 0 );
 
-		// Receive data
-		char buffer[ 2048 ];
-		while ( is_running_ )
+		if ( recv_size > 0 )
 		{
-			memset( buffer, 0, sizeof( buffer ) );
-			int recv_size = recv( client_socket_, buffer, sizeof( buffer ) - 1, 0 );
+			client.framer.CommitWrite( recv_size );
 
-			if ( recv_size > 0 )
+			if ( !ProcessReceivedData( client ) )
 			{
-				buffer[ recv_size ] = '\0';
-				std::string data( buffer );
+				DriverLog( "HandTrackingListener: Invalid binary frame, dropping client" );
+				return false;
+			}
 
-				// Split by newlines in case multiple messages were sent
-				size_t pos = 0;
-				while ( ( pos = data.find( '\n' ) ) != std::string::npos )
-				{
-					std::string line = data.substr( 0, pos );
-					if ( !line.empty() )
-					{
-						ProcessHandData( line );
-					}
-					data.erase( 0, pos + 1 );
-				}
-				// Process remaining data if any
-				if ( !data.empty() )
+			// A short read means the socket is drained, no need to spend a syscall finding that out
+			if ( static_cast< size_t >( recv_size ) < capacity )
+			{
+				return true;
+			}
+		}
+		else if ( recv_size == 0 )
+		{
+			DriverLog( "HandTrackingListener: Client disconnected" );
+			return false;
+		}
+		else
+		{
+			if ( SocketWouldBlock() )
+			{
+				return true;
+			}
+
+			DriverLog( "HandTrackingListener: Receive error" );
+			return false;
+		}
+	}
+
+	return true;
+}
+
+void HandTrackingListener::CloseClient( ClientConnection *client )
+{
+#ifdef __linux__
+	if ( uring_.IsActive() )
+	{
+		uring_.CancelReceive( client->id );
+	}
+	else
+	{
+		epoll_ctl( epoll_fd_, EPOLL_CTL_DEL, client->socket, nullptr );
+	}
+#endif
+	closesocket( client->socket );
+
+	clients_.erase( std::find_if( clients_.begin(), clients_.end(), [ client ]( const std::unique_ptr< ClientConnection > &other ) { return other.get() == client; } ) );
+}
+
+void HandTrackingListener::ReadDatagrams()
+{
+	// Drain everything queued, every datagram holds all of the hands seen in one camera frame
+	for ( ;; )
+	{
+		struct sockaddr_in source;
+		socklen_t source_len = sizeof( source );
+		int recv_size = recvfrom( server_socket_, datagram_, sizeof( datagram_ ), 0, (struct sockaddr *)&source, &source_len );
+
+		if ( recv_size > 0 )
+		{
+			ProcessDatagram( std::string_view( datagram_, recv_size ), (struct sockaddr *)&source );
+		}
+		else
+		{
+			if ( recv_size < 0 && !SocketWouldBlock() )
+			{
+				DriverLog( "HandTrackingListener: Receive error" );
+			}
+			return;
+		}
+	}
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Handles every receive the io_uring completed since the last call.
+// A burst of samples costs the one epoll_wait that reported the ring readable, no recv per message.
+//-----------------------------------------------------------------------------
+void HandTrackingListener::ReapReceives()
+{
+#ifdef __linux__
+	uring_.ReapCompletions( [ this ]( uint64_t user_data, int result, const char *data, bool more, const struct sockaddr *source )
+	{
+		if ( user_data == k_unDatagramReceiveId )
+		{
+			if ( result > 0 )
+			{
+				ProcessDatagram( std::string_view( data, result ), source );
+			}
+			else if ( result < 0 && result != -ENOBUFS )
+			{
+				DriverLog( "HandTrackingListener: Receive error" );
+			}
+
+			// The kernel ends a multishot receive when it errors or runs out of buffers, keep it going
+			if ( !more && is_running_ && !uring_.StartReceiveFrom( server_socket_, k_unDatagramReceiveId ) )
+			{
+				DriverLog( "HandTrackingListener: Failed to restart receiving" );
+			}
+			return;
+		}
+
+		// Completions can still arrive for a client that was just closed
+		auto it = std::find_if( clients_.begin(), clients_.end(), [ user_data ]( const std::unique_ptr< ClientConnection > &client ) { return client->id == user_data; } );
+		if ( it == clients_.end() )
+		{
+			return;
+		}
+		ClientConnection *client = it->get();
+
+		if ( result > 0 )
+		{
+			if ( !ReceiveBuffered( *client, data, result ) )
+			{
+				CloseClient( client );
+			}
+			else if ( !more && !uring_.StartReceive( client->socket, client->id ) )
+			{
+				DriverLog( "HandTrackingListener: Failed to restart receiving" );
+				CloseClient( client );
+			}
+			return;
+		}
+
+		// Out of buffers, ours are being handed back as we go so simply start over
+		if ( result == -ENOBUFS && !more && uring_.StartReceive( client->socket, client->id ) )
+		{
+			return;
+		}
+
+		DriverLog( result == 0 ? "HandTrackingListener: Client disconnected" : "HandTrackingListener: Receive error" );
+		CloseClient( client );
+	} );
+#endif
+}
+
+// Feeds bytes the io_uring received for client through its framer. Returns false when the client should be disconnected.
+bool HandTrackingListener::ReceiveBuffered( ClientConnection &client, const char *data, size_t size )
+{
+	while ( size > 0 )
+	{
+		char *write_begin = client.framer.WriteBegin();
+		const size_t chunk_size = std::min( size, client.framer.WriteCapacity() );
+		memcpy( write_begin, data, chunk_size );
+		client.framer.CommitWrite( chunk_size );
+
+		data += chunk_size;
+		size -= chunk_size;
+
+		if ( !ProcessReceivedData( client ) )
+		{
+			DriverLog( "HandTrackingListener: Invalid binary frame, dropping client" );
+			return false;
+		}
+	}
+
+	return true;
+}
+
+void HandTrackingListener::SharedMemoryThread()
+{
+	DriverLog( "HandTrackingListener: Thread started" );
+	ApplyThreadTuning( "HandTrackingListener", thread_tuning_ );
+
+	if ( !capture_path_.empty() )
+	{
+		capture_.Open( capture_path_.c_str() );
+	}
+
+	int64_t sample_time_us = DriverClockUs();
+	bool is_idle = false;
+
+	while ( is_running_ )
+	{
+		wake_time_us_ = DriverClockUs();
+
+		// Samples are decoded straight out of the mapping, no syscalls while data keeps arriving
+		bool got_sample = false;
+		int64_t parse_start_ns = DriverClockNs();
+		while ( shm_ring_.Read( batch_.hands[ 0 ] ) )
+		{
+			RecordParseTime( parse_start_ns );
+			got_sample = true;
+			if ( capture_.IsOpen() )
+			{
+				// Recorded as the binary frame a socket producer would have sent, which has no send time either
+				uint8_t frame[ k_unHandFrameSize ];
+				EncodeHandSampleBinary( batch_.hands[ 0 ], frame );
+				capture_.Append( wake_time_us_, HandCaptureFormat_Binary, std::string_view( reinterpret_cast< const char * >( frame ), sizeof( frame ) ) );
+			}
+			if ( AcceptSequence( batch_.hands[ 0 ], single_producer_sequences_.hands[ batch_.hands[ 0 ].hand ] ) )
+			{
+				QueueHandSample( batch_.hands[ 0 ] );
+			}
+			parse_start_ns = DriverClockNs();
+		}
+
+		if ( got_sample )
+		{
+			FlushHandSamples();
+			sample_time_us = wake_time_us_;
+			if ( is_idle )
+			{
+				DriverLog( "HandTrackingListener: Producer is back" );
+				is_idle = false;
+			}
+			continue;
+		}
+
+		if ( !is_idle && idle_timeout_us_ > 0 && wake_time_us_ - sample_time_us >= idle_timeout_us_ )
+		{
+			DriverLog( "HandTrackingListener: No samples for %.1f s, waiting for the producer", idle_timeout_us_ * 1e-6 );
+			is_idle = true;
+		}
+
+		if ( shm_spin_wait_ && !is_idle )
+		{
+			std::this_thread::yield();
+		}
+		else
+		{
+			// The timeout only matters if a wakeup is lost, the producer wakes us on every sample
+			shm_ring_.Wait( is_idle ? k_unShmIdleWaitMs : 100 );
+		}
+	}
+
+	capture_.Close();
+	DriverLog( "HandTrackingListener: Thread stopped (%llu samples overrun)", static_cast< unsigned long long >( shm_ring_.OverrunCount() ) );
+}
+
+void HandTrackingListener::ProcessDatagram( std::string_view datagram, const struct sockaddr *source )
+{
+	ProducerSequences &sequences = DatagramSequences( source );
+
+	if ( static_cast< uint8_t >( datagram[ 0 ] ) == k_unHandFrameMagicFirstByte )
+	{
+		// Back to back binary frames, batches or clock pings
+		size_t message_size = 0;
+		for ( ;; )
+		{
+			if ( IsClockPingBinary( datagram ) )
+			{
+				HandClockPing ping;
+				if ( DecodeClockPingBinary( datagram, ping, message_size ) != HandFrameResult_Ok )
 				{
-					ProcessHandData( data );
+					return;
 				}
+				AnswerClockPing( ping, true, server_socket_, source );
 			}
-			else if ( recv_size == 0 )
+			else
 			{
-				DriverLog( "HandTrackingListener: Client disconnected" );
-				break;
+				const int64_t parse_start_ns = DriverClockNs();
+				if ( DecodeHandMessageBinary( datagram, batch_, message_size ) != HandFrameResult_Ok )
+				{
+					return;
+				}
+				RecordParseTime( parse_start_ns );
+				capture_.Append( wake_time_us_, HandCaptureFormat_Binary, datagram.substr( 0, message_size ) );
+				QueueHandSamples( batch_, sequences );
 			}
-			else
+			datagram.remove_prefix( message_size );
+		}
+	}
+
+	// Newline separated text lines
+	while ( !datagram.empty() )
+	{
+		const size_t newline_pos = datagram.find( '\n' );
+		ProcessHandData( datagram.substr( 0, newline_pos ), sequences, server_socket_, source );
+		datagram = newline_pos == std::string_view::npos ? std::string_view() : datagram.substr( newline_pos + 1 );
+	}
+}
+
+bool HandTrackingListener::ProcessReceivedData( ClientConnection &client )
+{
+	// The first byte of a connection tells us which protocol the client speaks
+	if ( client.format == StreamFormat_Unknown )
+	{
+		const std::string_view pending = client.framer.Pending();
+		if ( pending.empty() )
+		{
+			return true;
+		}
+
+		client.format = static_cast< uint8_t >( pending[ 0 ] ) == k_unHandFrameMagicFirstByte ? StreamFormat_Binary : StreamFormat_Text;
+		DriverLog( "HandTrackingListener: Client is using the %s protocol", client.format == StreamFormat_Binary ? "binary" : "text" );
+	}
+
+	if ( client.format == StreamFormat_Binary )
+	{
+		// Decode every complete frame or batch, a partial one at the end is kept until the rest of it arrives
+		for ( ;; )
+		{
+			size_t message_size = 0;
+
+			if ( IsClockPingBinary( client.framer.Pending() ) )
 			{
-				if ( is_running_ )
+				HandClockPing ping;
+				const HandFrameResult result = DecodeClockPingBinary( client.framer.Pending(), ping, message_size );
+				if ( result != HandFrameResult_Ok )
 				{
-					DriverLog( "HandTrackingListener: Receive error" );
+					return result == HandFrameResult_Incomplete;
 				}
-				break;
+
+				client.framer.Consume( message_size );
+				AnswerClockPing( ping, true, client.socket, nullptr );
+				continue;
+			}
+
+			const int64_t parse_start_ns = DriverClockNs();
+			const HandFrameResult result = DecodeHandMessageBinary( client.framer.Pending(), batch_, message_size );
+			if ( result == HandFrameResult_Incomplete )
+			{
+				return true;
+			}
+			if ( result == HandFrameResult_Invalid )
+			{
+				return false;
 			}
+
+			RecordParseTime( parse_start_ns );
+			capture_.Append( wake_time_us_, HandCaptureFormat_Binary, client.framer.Pending().substr( 0, message_size ) );
+			client.framer.Consume( message_size );
+			QueueHandSamples( batch_, client.sequences );
 		}
+	}
 
-		closesocket( client_socket_ );
-		client_socket_ = INVALID_SOCKET;
+	// Only complete lines are processed, a partial line at the end is kept until the rest of it arrives
+	std::string_view line;
+	while ( client.framer.NextLine( line ) )
+	{
+		ProcessHandData( line, client.sequences, client.socket, nullptr );
 	}
 
-	DriverLog( "HandTrackingListener: Thread stopped" );
+	return true;
 }
 
-void HandTrackingListener::ProcessHandData( const std::string &data )
+void HandTrackingListener::ProcessHandData( std::string_view data, ProducerSequences &sequences, SOCKET reply_socket, const struct sockaddr *reply_address )
 {
 	// Parse protocol string: HAND:LEFT,X:0.5,Y:0.3,Z:-0.2,QW:1.0,QX:0.0,QY:0.0,QZ:0.0,TRIGGER:0.8,GRIP:0.0,GESTURE:POINT
-	std::map<std::string, std::string> params = ParseProtocolString( data );
+	// or a FRAME: batch of them
+	const int64_t parse_start_ns = DriverClockNs();
+	if ( ParseHandMessageText( data, batch_ ) )
+	{
+		RecordParseTime( parse_start_ns );
+		capture_.Append( wake_time_us_, HandCaptureFormat_Text, data );
+		QueueHandSamples( batch_, sequences );
+		return;
+	}
+
+	HandClockPing ping;
+	if ( ParseClockPingText( data, ping ) )
+	{
+		AnswerClockPing( ping, false, reply_socket, reply_address );
+	}
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Runs a message from a capture through the same parse, sequence and flush steps a received one goes
+// through, with the receive time it was recorded with. Clock pings were never recorded, so there's nothing to answer.
+//-----------------------------------------------------------------------------
+bool HandTrackingListener::ReplayMessage( HandCaptureFormat format, std::string_view message, int64_t nReceiveTimeUs )
+{
+	if ( is_running_ )
+	{
+		return false;
+	}
+
+	wake_time_us_ = nReceiveTimeUs;
+
+	const int64_t parse_start_ns = DriverClockNs();
+	if ( format == HandCaptureFormat_Text )
+	{
+		if ( !ParseHandMessageText( message, batch_ ) )
+		{
+			return false;
+		}
+	}
+	else
+	{
+		size_t message_size = 0;
+		if ( DecodeHandMessageBinary( message, batch_, message_size ) != HandFrameResult_Ok )
+		{
+			return false;
+		}
+	}
+	RecordParseTime( parse_start_ns );
+	QueueHandSamples( batch_, single_producer_sequences_ );
+
+	for ( HandStreamState &state : stream_state_ )
+	{
+		if ( state.has_pending )
+		{
+			state.pending.receive_time_us = nReceiveTimeUs;
+		}
+	}
+	FlushHandSamples();
+	return true;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Answers a producer's clock ping with our receive and send times, in the protocol it used.
+// Stream replies go back over the connection, datagram replies to reply_address.
+//-----------------------------------------------------------------------------
+void HandTrackingListener::AnswerClockPing( HandClockPing &ping, bool bBinary, SOCKET reply_socket, const struct sockaddr *reply_address )
+{
+	// Nowhere to send it
+	if ( transport_ == HandTransport_Udp && reply_address == nullptr )
+	{
+		return;
+	}
+
+	// Answered as soon as it's decoded, so the two times are close. They're still kept apart,
+	// the producer takes the time between them out of the round trip.
+	ping.driver_receive_time_us = static_cast< uint64_t >( DriverClockUs() );
+
+	char reply[ 64 ];
+	size_t reply_size = k_unClockPingSize;
+	ping.driver_send_time_us = static_cast< uint64_t >( DriverClockUs() );
+	if ( bBinary )
+	{
+		EncodeClockPingBinary( ping, reinterpret_cast< uint8_t * >( reply ) );
+	}
+	else
+	{
+		reply_size = FormatClockPongText( ping, reply, sizeof( reply ) );
+	}
 
-	// Determine which hand this is for
-	MyControllerDeviceDriver *controller = nullptr;
-	if ( params[ "HAND" ] == "LEFT" )
+	// Non-blocking, a reply that doesn't fit in the socket buffer is dropped and the producer simply pings again
+	if ( reply_address != nullptr )
 	{
-		controller = left_controller_;
+		sendto( reply_socket, reply, static_cast< int >( reply_size ), k_nSendFlags, reply_address, sizeof( struct sockaddr_in ) );
 	}
-	else if ( params[ "HAND" ] == "RIGHT" )
+	else
+	{
+		send( reply_socket, reply, static_cast< int >( reply_size ), k_nSendFlags );
+	}
+}
+
+void HandTrackingListener::QueueHandSamples( const HandSampleBatch &batch, ProducerSequences &sequences )
+{
+	for ( uint32_t i = 0; i < batch.hand_count; i++ )
 	{
-		controller = right_controller_;
+		if ( AcceptSequence( batch.hands[ i ], sequences.hands[ batch.hands[ i ].hand ] ) )
+		{
+			QueueHandSample( batch.hands[ i ] );
+		}
 	}
+}
 
-	if ( controller == nullptr )
+//-----------------------------------------------------------------------------
+// Purpose: Holds on to the newest sample of each hand until FlushHandSamples().
+// A sample that arrives while an older one is still held is merged over it, so a message
+// carrying only some of the values doesn't lose the rest.
+//-----------------------------------------------------------------------------
+void HandTrackingListener::QueueHandSample( const HandSample &sample )
+{
+	HandStreamState &state = stream_state_[ sample.hand ];
+
+	if ( !state.has_pending )
 	{
+		state.pending = sample;
+		state.pending.receive_time_us = DriverClockUs();
+		state.has_pending = true;
 		return;
 	}
 
-	// Update position
-	if ( params.count( "X" ) && params.count( "Y" ) && params.count( "Z" ) )
+	// Never reached the controller
+	state.coalesced.fetch_add( 1, std::memory_order_relaxed );
+
+	HandSample &pending = state.pending;
+	if ( sample.fields & HandSampleField_Position )
+	{
+		memcpy( pending.position, sample.position, sizeof( pending.position ) );
+	}
+	if ( sample.fields & HandSampleField_Rotation )
+	{
+		memcpy( pending.rotation, sample.rotation, sizeof( pending.rotation ) );
+	}
+	if ( sample.fields & HandSampleField_Trigger )
+	{
+		pending.trigger = sample.trigger;
+	}
+	if ( sample.fields & HandSampleField_Grip )
+	{
+		pending.grip = sample.grip;
+	}
+	if ( sample.fields & HandSampleField_Gesture )
+	{
+		pending.gesture = sample.gesture;
+	}
+	if ( sample.fields & HandSampleField_Sequence )
+	{
+		pending.sequence = sample.sequence;
+	}
+	if ( sample.fields & HandSampleField_CaptureTime )
+	{
+		pending.capture_time_us = sample.capture_time_us;
+	}
+	if ( sample.fields & HandSampleField_SendTime )
+	{
+		pending.send_time_us = sample.send_time_us;
+	}
+	pending.fields |= sample.fields;
+	pending.receive_time_us = DriverClockUs();
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Hands the held samples to the controllers, once per batch of reads.
+// Producers sending faster than poses are submitted only cost us one controller update per hand and wakeup.
+//-----------------------------------------------------------------------------
+void HandTrackingListener::FlushHandSamples()
+{
+	for ( int hand = 0; hand < HandId_MAX; hand++ )
+	{
+		HandStreamState &state = stream_state_[ hand ];
+		if ( !state.has_pending )
+		{
+			continue;
+		}
+		state.has_pending = false;
+
+		MyControllerDeviceDriver *controller = hand == HandId_Left ? left_controller_ : right_controller_;
+		if ( controller == nullptr )
+		{
+			continue;
+		}
+
+		// If no pose was submitted since the last update, the sample it carried is replaced before anyone saw it
+		const uint64_t submit_count = controller->GetPoseSubmitCount();
+		if ( state.has_applied && state.applied_submit_count == submit_count )
+		{
+			state.coalesced.fetch_add( 1, std::memory_order_relaxed );
+		}
+		state.applied_submit_count = submit_count;
+		state.has_applied = true;
+
+		controller->UpdateHandSample( state.pending );
+	}
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Updates the loss/reorder counters of the sample's hand and decides whether it should be applied.
+// Only the newest sample matters for a pose, so anything older than what we've already applied from the same
+// producer is dropped.
+//-----------------------------------------------------------------------------
+bool HandTrackingListener::AcceptSequence( const HandSample &sample, SequenceState &sequence )
+{
+	HandStreamState &state = stream_state_[ sample.hand ];
+	state.received.fetch_add( 1, std::memory_order_relaxed );
+
+	if ( pipeline_stats_ != nullptr )
 	{
-		float x = std::stof( params[ "X" ] );
-		float y = std::stof( params[ "Y" ] );
-		float z = std::stof( params[ "Z" ] );
-		controller->UpdateHandPosition( x, y, z );
+		// We're the only writer, no need for a read-modify-write
+		std::atomic< uint64_t > &samples = pipeline_stats_->Hand( sample.hand ).samples;
+		samples.store( samples.load( std::memory_order_relaxed ) + 1, std::memory_order_relaxed );
+
+		// How long after the producer sent it we were awake to read it. Only for producers on our clock, see hand_protocol.h.
+		const int64_t send_time_us = static_cast< int64_t >( sample.send_time_us );
+		if ( ( sample.fields & HandSampleField_SendTime ) && send_time_us > 0 && send_time_us <= wake_time_us_ && wake_time_us_ - send_time_us < k_unMaxWakeLateUs )
+		{
+			pipeline_stats_->ListenerWakeLateUs().Record( wake_time_us_ - send_time_us );
+		}
 	}
 
-	// Update rotation
-	if ( params.count( "QW" ) && params.count( "QX" ) && params.count( "QY" ) && params.count( "QZ" ) )
+	// Producers that don't number their samples are applied in arrival order
+	if ( !( sample.fields & HandSampleField_Sequence ) )
 	{
-		float qw = std::stof( params[ "QW" ] );
-		float qx = std::stof( params[ "QX" ] );
-		float qy = std::stof( params[ "QY" ] );
-		float qz = std::stof( params[ "QZ" ] );
-		controller->UpdateHandRotation( qw, qx, qy, qz );
+		return true;
 	}
 
-	// Update trigger
-	if ( params.count( "TRIGGER" ) )
+	if ( sequence.has_sequence )
 	{
-		float trigger = std::stof( params[ "TRIGGER" ] );
-		controller->UpdateTriggerValue( trigger );
+		// Signed distance, so the comparison survives the counter wrapping around
+		const int32_t delta = static_cast< int32_t >( sample.sequence - sequence.last_sequence );
+
+		// Late samples turn up within a few frames of the newer ones. Going back after the stream was quiet
+		// means the producer was restarted and counts from its start again, however close that is to where it was.
+		const bool restarted = delta <= 0 && wake_time_us_ - sequence.sequence_time_us >= k_unProducerRestartGapUs;
+
+		if ( delta == 0 && !restarted )
+		{
+			state.duplicates.fetch_add( 1, std::memory_order_relaxed );
+			return false;
+		}
+
+		// A big jump backwards means the producer was restarted too, so start counting again from there
+		static constexpr int32_t k_nProducerRestartDistance = 1024;
+		if ( delta < 0 && delta > -k_nProducerRestartDistance && !restarted )
+		{
+			state.reordered.fetch_add( 1, std::memory_order_relaxed );
+			return false;
+		}
+
+		if ( delta > 1 )
+		{
+			state.lost.fetch_add( delta - 1, std::memory_order_relaxed );
+		}
 	}
 
-	// Update grip
-	if ( params.count( "GRIP" ) )
+	sequence.has_sequence = true;
+	sequence.last_sequence = sample.sequence;
+	sequence.sequence_time_us = wake_time_us_;
+	return true;
+}
+
+// Adds the time since nStartNs to the parse time histogram, once a message has been parsed or decoded
+void HandTrackingListener::RecordParseTime( int64_t nStartNs )
+{
+	if ( pipeline_stats_ != nullptr )
 	{
-		float grip = std::stof( params[ "GRIP" ] );
-		controller->UpdateGripValue( grip );
+		pipeline_stats_->ParseTimeNs().Record( DriverClockNs() - nStartNs );
 	}
 }
 
-std::map<std::string, std::string> HandTrackingListener::ParseProtocolString( const std::string &data )
+//-----------------------------------------------------------------------------
+// Purpose: The sequence state of the producer sending from source. One we haven't heard from before takes the slot
+// of the one that was quiet the longest, and starts counting from scratch.
+//-----------------------------------------------------------------------------
+HandTrackingListener::ProducerSequences &HandTrackingListener::DatagramSequences( const struct sockaddr *source )
 {
-	std::map<std::string, std::string> params;
-	std::istringstream stream( data );
-	std::string token;
+	uint32_t address = 0;
+	uint16_t port = 0;
+	if ( source != nullptr && source->sa_family == AF_INET )
+	{
+		const struct sockaddr_in *source_in = reinterpret_cast< const struct sockaddr_in * >( source );
+		address = source_in->sin_addr.s_addr;
+		port = source_in->sin_port;
+	}
 
-	while ( std::getline( stream, token, ',' ) )
+	DatagramSource *oldest = &datagram_sources_[ 0 ];
+	for ( DatagramSource &datagram_source : datagram_sources_ )
 	{
-		size_t colon_pos = token.find( ':' );
-		if ( colon_pos != std::string::npos )
+		if ( datagram_source.last_seen_us != 0 && datagram_source.address == address && datagram_source.port == port )
 		{
-			std::string key = token.substr( 0, colon_pos );
-			std::string value = token.substr( colon_pos + 1 );
-			params[ key ] = value;
+			datagram_source.last_seen_us = std::max< int64_t >( wake_time_us_, 1 );
+			return datagram_source.sequences;
+		}
+		if ( datagram_source.last_seen_us < oldest->last_seen_us )
+		{
+			oldest = &datagram_source;
 		}
 	}
 
-	return params;
-}
\ No newline at end of file
+	*oldest = DatagramSource();
+	oldest->address = address;
+	oldest->port = port;
+	oldest->last_seen_us = std::max< int64_t >( wake_time_us_, 1 );
+	return oldest->sequences;
+}
+
+void HandTrackingListener::ResetSequences()
+{
+	std::fill( std::begin( datagram_sources_ ), std::end( datagram_sources_ ), DatagramSource() );
+	single_producer_sequences_ = ProducerSequences();
+}
+
+HandStreamCounters HandTrackingListener::GetStreamCounters( HandId hand ) const
+{
+	const HandStreamState &state = stream_state_[ hand ];
+
+	HandStreamCounters counters;
+	counters.received = state.received.load( std::memory_order_relaxed );
+	counters.lost = state.lost.load( std::memory_order_relaxed );
+	counters.reordered = state.reordered.load( std::memory_order_relaxed );
+	counters.duplicates = state.duplicates.load( std::memory_order_relaxed );
+	counters.coalesced = state.coalesced.load( std::memory_order_relaxed );
+	return counters;
+}
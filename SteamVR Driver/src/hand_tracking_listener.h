@@ -3,9 +3,18 @@
 
 #include <thread>
 #include <atomic>
+#include <memory>
 #include <string>
-#include <sstream>
-#include <map>
+#include <string_view>
+#include <vector>
+
+#include "hand_capture.h"
+#include "hand_protocol.h"
+#include "io_uring_receiver.h"
+#include "line_framer.h"
+#include "pipeline_stats.h"
+#include "shared_memory_ring.h"
+#include "thread_tuning.h"
 
 #ifdef _WIN32
 #include <winsock2.h>
@@ -20,12 +29,38 @@
 #define INVALID_SOCKET -1
 #define SOCKET_ERROR -1
 #define closesocket close
+#define SD_BOTH SHUT_RDWR
 #endif
 
 class MyControllerDeviceDriver;
 
+enum HandTransport
+{
+	HandTransport_Tcp, // One stream connection, every sample is applied in order
+	HandTransport_Udp, // One datagram per camera frame, stale and duplicate samples are dropped
+	HandTransport_SharedMemory, // Seqlock ring under /dev/shm, falls back to TCP where that isn't available
+};
+
+// How stream and datagram sockets are read
+enum HandReceiveBackend
+{
+	HandReceiveBackend_Socket,	// recv() whenever the event loop reports a socket readable
+	HandReceiveBackend_IoUring, // Multishot io_uring receives (Linux), falls back to HandReceiveBackend_Socket where that isn't available
+};
+
+// Per hand sequence accounting, a snapshot of HandTrackingListener's counters
+struct HandStreamCounters
+{
+	uint64_t received;
+	uint64_t lost;		 // Samples skipped over by a gap in the sequence
+	uint64_t reordered;	 // Samples that arrived after a newer one and were dropped
+	uint64_t duplicates; // Samples with the same sequence as the last accepted one
+	uint64_t coalesced;	 // Samples replaced by a newer one before a pose was submitted with them
+};
+
 //-----------------------------------------------------------------------------
-// Purpose: Listens for hand tracking data from the Python script via socket
+// Purpose: Listens for hand tracking data from the Python script via socket.
+// One event loop thread (epoll on Linux, poll elsewhere) serves every connected producer.
 //-----------------------------------------------------------------------------
 class HandTrackingListener
 {
@@ -33,21 +68,165 @@ public:
 	HandTrackingListener( MyControllerDeviceDriver *left_controller, MyControllerDeviceDriver *right_controller );
 	~HandTrackingListener();
 
-	bool Start( int port = 65432 );
+	// Only used with HandTransport_SharedMemory, call before Start().
+	// With bSpinWait the thread polls the ring instead of sleeping on a futex between samples.
+	void SetSharedMemoryOptions( const char *pchName, bool bSpinWait );
+
+	// Call before Start()
+	void SetReceiveBackend( HandReceiveBackend backend );
+
+	// Call before Start(). The listen thread records parse times and sample counts into stats.
+	void SetPipelineStats( PipelineStats *stats );
+
+	// Call before Start(). Core pinning and priority for the listen thread.
+	void SetThreadTuning( const ThreadTuning &tuning );
+
+	// Call before Start(). After nIdleTimeoutUs without a sample the shared memory reader stops spinning
+	// and sleeps on the futex until the producer is back. The socket event loop always blocks while idle.
+	void SetIdleTimeout( int64_t nIdleTimeoutUs );
+
+	// Call before Start(). Every hand message received from then on is recorded to pchPath, replacing what was there.
+	// An empty path doesn't record.
+	void SetCaptureFile( const char *pchPath );
+
+	bool Start( int port = 65432, HandTransport transport = HandTransport_Tcp );
 	void Stop();
 
+	// Feeds one recorded message to the controllers as if it had been received at nReceiveTimeUs.
+	// For replaying captures without sockets, only call while the listener isn't started. False if it wasn't hand data.
+	bool ReplayMessage( HandCaptureFormat format, std::string_view message, int64_t nReceiveTimeUs );
+
+	HandStreamCounters GetStreamCounters( HandId hand ) const;
+
 private:
-	void ListenThread();
-	void ProcessHandData( const std::string &data );
-	std::map<std::string, std::string> ParseProtocolString( const std::string &data );
+	enum StreamFormat
+	{
+		StreamFormat_Unknown,
+		StreamFormat_Text,
+		StreamFormat_Binary,
+	};
+
+	// Where one producer's numbering of a hand left off
+	struct SequenceState
+	{
+		bool has_sequence = false;
+		uint32_t last_sequence = 0;
+		int64_t sequence_time_us = 0; // When last_sequence was received
+	};
+
+	// Kept per producer, so two of them sending at once don't take each other's samples for late ones.
+	// Only touched by the listen thread.
+	struct ProducerSequences
+	{
+		SequenceState hands[ HandId_MAX ];
+	};
+
+	struct HandStreamState
+	{
+		std::atomic< uint64_t > received{ 0 };
+		std::atomic< uint64_t > lost{ 0 };
+		std::atomic< uint64_t > reordered{ 0 };
+		std::atomic< uint64_t > duplicates{ 0 };
+		std::atomic< uint64_t > coalesced{ 0 };
+
+		// Newest accepted sample, held until the end of the current batch of reads
+		HandSample pending{};
+		bool has_pending = false;
+
+		// The controller's pose submit count when we last updated it
+		uint64_t applied_submit_count = 0;
+		bool has_applied = false;
+	};
+
+	// A connected stream producer, only touched by the listen thread
+	struct ClientConnection
+	{
+		SOCKET socket;
+		uint64_t id; // Identifies the client's io_uring completions, which can outlive the connection
+		StreamFormat format;
+
+		// Splits the received stream into lines (or binary frames)
+		LineFramer framer;
+
+		// A new connection counts from wherever its producer starts
+		ProducerSequences sequences;
+	};
+
+	// A datagram producer, told apart by the address it sends from. Only touched by the listen thread.
+	struct DatagramSource
+	{
+		uint32_t address = 0; // Both in network byte order, as in sockaddr_in
+		uint16_t port = 0;
+		int64_t last_seen_us = 0; // 0 for an unused slot
+		ProducerSequences sequences;
+	};
+	static constexpr size_t k_unMaxDatagramSources = 8;
+
+	bool CreateEventLoop();
+	void CloseSockets();
+	void EventLoopThread();
+	void ServerSocketReadable();
+	void AcceptClients();
+	bool ReadClient( ClientConnection &client );
+	void CloseClient( ClientConnection *client );
+	void ReadDatagrams();
+	void ReapReceives();
+	bool ReceiveBuffered( ClientConnection &client, const char *data, size_t size );
+	void SharedMemoryThread();
+	bool ProcessReceivedData( ClientConnection &client );
+	void ProcessDatagram( std::string_view datagram, const struct sockaddr *source );
+	void ProcessHandData( std::string_view data, ProducerSequences &sequences, SOCKET reply_socket, const struct sockaddr *reply_address );
+	void AnswerClockPing( HandClockPing &ping, bool bBinary, SOCKET reply_socket, const struct sockaddr *reply_address );
+	void QueueHandSamples( const HandSampleBatch &batch, ProducerSequences &sequences );
+	void QueueHandSample( const HandSample &sample );
+	void FlushHandSamples();
+	bool AcceptSequence( const HandSample &sample, SequenceState &sequence );
+	ProducerSequences &DatagramSequences( const struct sockaddr *source );
+	void RecordParseTime( int64_t nStartNs );
+	void ResetSequences();
 
 	MyControllerDeviceDriver *left_controller_;
 	MyControllerDeviceDriver *right_controller_;
 
+	// Scratch batch the parsers write into, only touched by the listen thread
+	HandSampleBatch batch_;
+
+	// Datagram receive buffer, only touched by the listen thread
+	char datagram_[ 2048 ];
+
+	HandStreamState stream_state_[ HandId_MAX ];
+
+	// Stream producers keep theirs in their ClientConnection. Shared memory and replayed captures only have one producer.
+	DatagramSource datagram_sources_[ k_unMaxDatagramSources ];
+	ProducerSequences single_producer_sequences_;
+
+	PipelineStats *pipeline_stats_;
+	ThreadTuning thread_tuning_;
+	int64_t idle_timeout_us_;
+
+	// When the listen thread last woke up to read, only touched by the listen thread
+	int64_t wake_time_us_;
+
 	std::atomic<bool> is_running_;
 	std::thread listen_thread_;
 	
 	SOCKET server_socket_;
-	SOCKET client_socket_;
+	std::vector< std::unique_ptr< ClientConnection > > clients_;
+#ifdef __linux__
+	int epoll_fd_;
+	int wake_fd_; // eventfd Stop() writes to, to wake the event loop
+	IoUringReceiver uring_;
+#endif
+	HandReceiveBackend receive_backend_;
+	uint64_t next_client_id_;
 	int port_;
+	HandTransport transport_;
+
+	// Only touched by the listen thread, which opens and closes it
+	HandCaptureWriter capture_;
+	std::string capture_path_;
+
+	SharedMemoryRing shm_ring_;
+	std::string shm_name_;
+	bool shm_spin_wait_;
 };
\ No newline at end of file
@@ -0,0 +1,159 @@
+//============ Copyright (c) Valve Corporation, All rights reserved. ============
+#include "hmd_pose_cache.h"
+
+#include "driver_clock.h"
+#include "vrmath.h"
+
+#include <cmath>
+
+static vr::HmdVector3_t Lerp( const vr::HmdVector3_t &a, const vr::HmdVector3_t &b, double fT )
+{
+	vr::HmdVector3_t result;
+	for ( int i = 0; i < 3; i++ )
+	{
+		result.v[ i ] = static_cast< float >( a.v[ i ] + ( b.v[ i ] - a.v[ i ] ) * fT );
+	}
+	return result;
+}
+
+static vr::HmdQuaternion_t Slerp( const vr::HmdQuaternion_t &a, vr::HmdQuaternion_t b, double fT )
+{
+	// q and -q are the same rotation, take the short way round
+	double cos_angle = a.w * b.w + a.x * b.x + a.y * b.y + a.z * b.z;
+	if ( cos_angle < 0.0 )
+	{
+		cos_angle = -cos_angle;
+		b = { -b.w, -b.x, -b.y, -b.z };
+	}
+
+	// Nearly the same rotation (always the case 5 ms apart), a normalized lerp is just as good and can't divide by 0
+	double weight_a = 1.0 - fT;
+	double weight_b = fT;
+	if ( cos_angle < 0.9995 )
+	{
+		const double angle = std::acos( cos_angle );
+		const double sin_angle = std::sin( angle );
+		weight_a = std::sin( ( 1.0 - fT ) * angle ) / sin_angle;
+		weight_b = std::sin( fT * angle ) / sin_angle;
+	}
+
+	vr::HmdQuaternion_t result = { weight_a * a.w + weight_b * b.w, weight_a * a.x + weight_b * b.x, weight_a * a.y + weight_b * b.y, weight_a * a.z + weight_b * b.z };
+	const double length = std::sqrt( result.w * result.w + result.x * result.x + result.y * result.y + result.z * result.z );
+	result.w /= length;
+	result.x /= length;
+	result.y /= length;
+	result.z /= length;
+	return result;
+}
+
+HmdPose HmdPoseFromTrackedDevicePose( const vr::TrackedDevicePose_t &tracked_pose, int64_t nTimeUs )
+{
+	HmdPose hmd_pose = {};
+
+	// Get the position and orientation of the hmd from the 3x4 matrix GetRawTrackedDevicePoses returns
+	hmd_pose.position = HmdVector3_From34Matrix( tracked_pose.mDeviceToAbsoluteTracking );
+	hmd_pose.orientation = HmdQuaternion_FromMatrix( tracked_pose.mDeviceToAbsoluteTracking );
+	hmd_pose.velocity = tracked_pose.vVelocity;
+	hmd_pose.angular_velocity = tracked_pose.vAngularVelocity;
+	hmd_pose.time_us = nTimeUs;
+	hmd_pose.is_valid = tracked_pose.bPoseIsValid;
+	return hmd_pose;
+}
+
+HmdPose FetchHmdPose()
+{
+	vr::TrackedDevicePose_t tracked_pose{};
+
+	// GetRawTrackedDevicePoses expects an array.
+	// We only want the hmd pose, which is at index 0 of the array so we can just pass the struct in directly, instead of in an array
+	vr::VRServerDriverHost()->GetRawTrackedDevicePoses( 0.f, &tracked_pose, 1 );
+
+	return HmdPoseFromTrackedDevicePose( tracked_pose, DriverClockUs() );
+}
+
+HmdPose HmdPoseInterpolate( const HmdPose &a, const HmdPose &b, double fT )
+{
+	HmdPose result;
+	result.position = Lerp( a.position, b.position, fT );
+	result.orientation = Slerp( a.orientation, b.orientation, fT );
+	result.velocity = Lerp( a.velocity, b.velocity, fT );
+	result.angular_velocity = Lerp( a.angular_velocity, b.angular_velocity, fT );
+	result.time_us = a.time_us + static_cast< int64_t >( ( b.time_us - a.time_us ) * fT );
+	result.is_valid = a.is_valid && b.is_valid;
+	return result;
+}
+
+HmdPoseCache::HmdPoseCache()
+	: refreshed_{}
+	, refresh_count_( 0 )
+{
+	refreshed_.orientation.w = 1.0;
+}
+
+const HmdPose &HmdPoseCache::Refresh()
+{
+	refreshed_ = FetchHmdPose();
+
+	// Published after the slot is written, readers never look at a slot past refresh_count_
+	const uint64_t count = refresh_count_.load( std::memory_order_relaxed );
+	history_[ count % k_unHistorySize ].Store( refreshed_ );
+	refresh_count_.store( count + 1, std::memory_order_release );
+	return refreshed_;
+}
+
+HmdPose HmdPoseCache::Latest() const
+{
+	const uint64_t count = refresh_count_.load( std::memory_order_acquire );
+	if ( count == 0 )
+	{
+		HmdPose identity = {};
+		identity.orientation.w = 1.0;
+		return identity;
+	}
+
+	return history_[ ( count - 1 ) % k_unHistorySize ].Load();
+}
+
+bool HmdPoseCache::PoseAt( int64_t nTimeUs, HmdPose &hmd_pose ) const
+{
+	const uint64_t count = refresh_count_.load( std::memory_order_acquire );
+	if ( count == 0 )
+	{
+		return false;
+	}
+
+	HmdPose newer = history_[ ( count - 1 ) % k_unHistorySize ].Load();
+	if ( nTimeUs >= newer.time_us )
+	{
+		hmd_pose = newer;
+		return true;
+	}
+
+	// Walk back from the newest refresh. The oldest slot is left out, the writer may be overwriting it right now.
+	const uint64_t oldest = count >= k_unHistorySize ? count - k_unHistorySize + 1 : 0;
+	for ( uint64_t index = count - 1; index-- > oldest; )
+	{
+		const HmdPose older = history_[ index % k_unHistorySize ].Load();
+
+		// Out of order means the writer lapped us and this slot holds a newer refresh, the history is gone
+		if ( older.time_us >= newer.time_us )
+		{
+			return false;
+		}
+
+		if ( older.time_us <= nTimeUs )
+		{
+			hmd_pose = HmdPoseInterpolate( older, newer, static_cast< double >( nTimeUs - older.time_us ) / static_cast< double >( newer.time_us - older.time_us ) );
+			return true;
+		}
+
+		newer = older;
+	}
+
+	return false;
+}
+
+uint64_t HmdPoseCache::GetRefreshCount() const
+{
+	return refresh_count_.load( std::memory_order_relaxed );
+}
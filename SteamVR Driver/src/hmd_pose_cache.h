@@ -0,0 +1,69 @@
+//============ Copyright (c) Valve Corporation, All rights reserved. ============
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+#include "openvr_driver.h"
+#include "seqlock.h"
+
+// The hmd pose the way the controllers use it, decoded from the host's 3x4 matrix
+struct HmdPose
+{
+	vr::HmdVector3_t position;
+	vr::HmdQuaternion_t orientation;
+
+	// In the same space, m/s and rad/s
+	vr::HmdVector3_t velocity;
+	vr::HmdVector3_t angular_velocity;
+
+	// When it was fetched, microseconds on the driver clock (driver_clock.h). 0 if it never was.
+	int64_t time_us;
+
+	bool is_valid;
+};
+
+// Decodes a pose GetRawTrackedDevicePoses returned
+HmdPose HmdPoseFromTrackedDevicePose( const vr::TrackedDevicePose_t &tracked_pose, int64_t nTimeUs );
+
+// Fetches and decodes the hmd pose right now
+HmdPose FetchHmdPose();
+
+// Pose between a and b, fT 0 is a and 1 is b. Positions and velocities are interpolated linearly, the orientation spherically.
+HmdPose HmdPoseInterpolate( const HmdPose &a, const HmdPose &b, double fT );
+
+//-----------------------------------------------------------------------------
+// Purpose: The latest hmd pose, fetched from the host and decoded once per pose tick and shared by every controller.
+// The last refreshes are kept in a fixed size ring, so a hand sample can be put together with the head pose
+// from when the camera saw it. One thread refreshes it (the pose scheduler), any thread may read it.
+//-----------------------------------------------------------------------------
+class HmdPoseCache
+{
+public:
+	HmdPoseCache();
+
+	// Fetches and decodes the hmd pose, returns it. Only called by the refreshing thread.
+	const HmdPose &Refresh();
+
+	// The pose of the last Refresh(), time_us is 0 before the first one
+	HmdPose Latest() const;
+
+	// The hmd pose at nTimeUs (driver clock), interpolated between the two refreshes around it.
+	// Times after the last refresh get the last pose. Returns false if the history doesn't go back that far.
+	bool PoseAt( int64_t nTimeUs, HmdPose &hmd_pose ) const;
+
+	// How often the host has been asked for the hmd pose
+	uint64_t GetRefreshCount() const;
+
+private:
+	// 640 ms at the default pose rate of 200 Hz, well past the age we still predict hand poses from
+	static constexpr size_t k_unHistorySize = 128;
+
+	// The refreshing thread's copy of the latest pose
+	HmdPose refreshed_;
+
+	// Refresh n is in history_[ n % k_unHistorySize ], refresh_count_ says how many were written
+	Seqlock< HmdPose > history_[ k_unHistorySize ];
+	std::atomic< uint64_t > refresh_count_;
+};
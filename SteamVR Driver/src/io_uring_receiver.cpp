@@ -0,0 +1,453 @@
+//============ Copyright (c) Valve Corporation, All rights reserved. ============
+#include "io_uring_receiver.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+
+#ifdef __linux__
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#ifdef __linux__
+// Raw syscalls, so the driver doesn't need liburing at build or run time
+static int IoUringSetup( uint32_t unEntries, struct io_uring_params *pParams )
+{
+	return static_cast< int >( syscall( __NR_io_uring_setup, unEntries, pParams ) );
+}
+
+static int IoUringEnter( int ring_fd, uint32_t unToSubmit, uint32_t unMinComplete, uint32_t unFlags )
+{
+	return static_cast< int >( syscall( __NR_io_uring_enter, ring_fd, unToSubmit, unMinComplete, unFlags, nullptr, 0 ) );
+}
+
+static int IoUringRegister( int ring_fd, uint32_t unOpcode, void *pArg, uint32_t unArgs )
+{
+	return static_cast< int >( syscall( __NR_io_uring_register, ring_fd, unOpcode, pArg, unArgs ) );
+}
+
+template < typename T >
+static T LoadAcquire( const T *p )
+{
+	return __atomic_load_n( p, __ATOMIC_ACQUIRE );
+}
+
+template < typename T >
+static void StoreRelease( T *p, T value )
+{
+	__atomic_store_n( p, value, __ATOMIC_RELEASE );
+}
+
+// The buffer ring is an array of io_uring_buf whose first entry's resv field doubles as the ring tail (see io_uring_buf_ring).
+// The header's flexible array member doesn't land at offset 0 when compiled as C++, so the ring is indexed by hand.
+static uint16_t *BufferRingTail( struct io_uring_buf *pRing )
+{
+	return &pRing[ 0 ].resv;
+}
+
+static constexpr uint32_t k_unSubmissionEntries = 64;
+static constexpr uint32_t k_unCompletionEntries = 1024;
+static constexpr uint16_t k_unBufferGroup = 0;
+
+// Set in the user_data of StartReceiveFrom()'s receive, so its completions are known to hold a recvmsg header
+static constexpr uint64_t k_unReceiveFromFlag = uint64_t( 1 ) << 62;
+#endif
+
+IoUringReceiver::IoUringReceiver()
+	: ring_fd_( -1 )
+	, sq_mapping_( nullptr )
+	, sq_mapping_size_( 0 )
+	, sqes_( nullptr )
+	, sqes_size_( 0 )
+	, sq_tail_( nullptr )
+	, sq_mask_( nullptr )
+	, sq_array_( nullptr )
+	, pending_submissions_( 0 )
+	, cq_mapping_( nullptr )
+	, cq_mapping_size_( 0 )
+	, cq_head_( nullptr )
+	, cq_tail_( nullptr )
+	, cq_mask_( nullptr )
+	, cqes_( nullptr )
+	, buffer_ring_( nullptr )
+	, buffer_ring_size_( 0 )
+	, buffers_( nullptr )
+	, buffer_count_( 0 )
+	, buffer_size_( 0 )
+{
+#ifdef __linux__
+	memset( &receive_message_, 0, sizeof( receive_message_ ) );
+#endif
+}
+
+IoUringReceiver::~IoUringReceiver()
+{
+	Shutdown();
+}
+
+bool IoUringReceiver::Init( uint32_t unBufferCount, uint32_t unBufferSize )
+{
+#ifdef __linux__
+	Shutdown();
+
+	// The buffer ring size has to be a power of two, buffer ids are 16 bit
+	if ( unBufferCount == 0 || ( unBufferCount & ( unBufferCount - 1 ) ) != 0 || unBufferCount > 32768 || unBufferSize == 0 )
+	{
+		return false;
+	}
+
+	struct io_uring_params params;
+	memset( &params, 0, sizeof( params ) );
+	params.flags = IORING_SETUP_CQSIZE;
+	params.cq_entries = k_unCompletionEntries;
+
+	// Fails with ENOSYS on old kernels and EPERM where io_uring is disabled (eg. kernel.io_uring_disabled, seccomp)
+	ring_fd_ = IoUringSetup( k_unSubmissionEntries, &params );
+	if ( ring_fd_ < 0 )
+	{
+		ring_fd_ = -1;
+		return false;
+	}
+
+	sq_mapping_size_ = params.sq_off.array + params.sq_entries * sizeof( uint32_t );
+	cq_mapping_size_ = params.cq_off.cqes + params.cq_entries * sizeof( struct io_uring_cqe );
+
+	const bool single_mapping = ( params.features & IORING_FEAT_SINGLE_MMAP ) != 0;
+	if ( single_mapping )
+	{
+		sq_mapping_size_ = cq_mapping_size_ = ( sq_mapping_size_ > cq_mapping_size_ ) ? sq_mapping_size_ : cq_mapping_size_;
+	}
+
+	void *sq_mapping = mmap( nullptr, sq_mapping_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd_, IORING_OFF_SQ_RING );
+	if ( sq_mapping == MAP_FAILED )
+	{
+		Shutdown();
+		return false;
+	}
+	sq_mapping_ = sq_mapping;
+
+	if ( single_mapping )
+	{
+		cq_mapping_ = sq_mapping_;
+	}
+	else
+	{
+		void *cq_mapping = mmap( nullptr, cq_mapping_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd_, IORING_OFF_CQ_RING );
+		if ( cq_mapping == MAP_FAILED )
+		{
+			Shutdown();
+			return false;
+		}
+		cq_mapping_ = cq_mapping;
+	}
+
+	sqes_size_ = params.sq_entries * sizeof( struct io_uring_sqe );
+	void *sqes = mmap( nullptr, sqes_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd_, IORING_OFF_SQES );
+	if ( sqes == MAP_FAILED )
+	{
+		Shutdown();
+		return false;
+	}
+	sqes_ = static_cast< struct io_uring_sqe * >( sqes );
+
+	uint8_t *sq = static_cast< uint8_t * >( sq_mapping_ );
+	sq_tail_ = reinterpret_cast< uint32_t * >( sq + params.sq_off.tail );
+	sq_mask_ = reinterpret_cast< uint32_t * >( sq + params.sq_off.ring_mask );
+	sq_array_ = reinterpret_cast< uint32_t * >( sq + params.sq_off.array );
+
+	uint8_t *cq = static_cast< uint8_t * >( cq_mapping_ );
+	cq_head_ = reinterpret_cast< uint32_t * >( cq + params.cq_off.head );
+	cq_tail_ = reinterpret_cast< uint32_t * >( cq + params.cq_off.tail );
+	cq_mask_ = reinterpret_cast< uint32_t * >( cq + params.cq_off.ring_mask );
+	cqes_ = reinterpret_cast< struct io_uring_cqe * >( cq + params.cq_off.cqes );
+
+	// Provided buffer ring, the kernel picks a free buffer for every completion and we hand it back once it's been consumed
+	buffer_count_ = unBufferCount;
+	buffer_size_ = unBufferSize;
+	buffer_ring_size_ = unBufferCount * sizeof( struct io_uring_buf );
+
+	void *buffer_ring = mmap( nullptr, buffer_ring_size_, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0 );
+	if ( buffer_ring == MAP_FAILED )
+	{
+		Shutdown();
+		return false;
+	}
+	buffer_ring_ = static_cast< struct io_uring_buf * >( buffer_ring );
+
+	void *buffers = mmap( nullptr, static_cast< size_t >( unBufferCount ) * unBufferSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0 );
+	if ( buffers == MAP_FAILED )
+	{
+		Shutdown();
+		return false;
+	}
+	buffers_ = static_cast< char * >( buffers );
+
+	struct io_uring_buf_reg buffer_reg;
+	memset( &buffer_reg, 0, sizeof( buffer_reg ) );
+	buffer_reg.ring_addr = reinterpret_cast< uint64_t >( buffer_ring_ );
+	buffer_reg.ring_entries = unBufferCount;
+	buffer_reg.bgid = k_unBufferGroup;
+
+	// EINVAL before 5.19, where there are no buffer rings
+	if ( IoUringRegister( ring_fd_, IORING_REGISTER_PBUF_RING, &buffer_reg, 1 ) != 0 )
+	{
+		Shutdown();
+		return false;
+	}
+
+	for ( uint32_t i = 0; i < unBufferCount; i++ )
+	{
+		struct io_uring_buf &buf = buffer_ring_[ i ];
+		buf.addr = reinterpret_cast< uint64_t >( buffers_ + static_cast< size_t >( i ) * unBufferSize );
+		buf.len = unBufferSize;
+		buf.bid = static_cast< uint16_t >( i );
+	}
+	StoreRelease( BufferRingTail( buffer_ring_ ), static_cast< uint16_t >( unBufferCount ) );
+
+	return true;
+#else
+	// Only implemented for Linux, callers fall back to sockets
+	return false;
+#endif
+}
+
+void IoUringReceiver::Shutdown()
+{
+#ifdef __linux__
+	// Closing the ring cancels whatever is still in flight
+	if ( ring_fd_ >= 0 )
+	{
+		close( ring_fd_ );
+	}
+
+	if ( sqes_ != nullptr )
+	{
+		munmap( sqes_, sqes_size_ );
+	}
+
+	if ( cq_mapping_ != nullptr && cq_mapping_ != sq_mapping_ )
+	{
+		munmap( cq_mapping_, cq_mapping_size_ );
+	}
+
+	if ( sq_mapping_ != nullptr )
+	{
+		munmap( sq_mapping_, sq_mapping_size_ );
+	}
+
+	if ( buffer_ring_ != nullptr )
+	{
+		munmap( buffer_ring_, buffer_ring_size_ );
+	}
+
+	if ( buffers_ != nullptr )
+	{
+		munmap( buffers_, static_cast< size_t >( buffer_count_ ) * buffer_size_ );
+	}
+#endif
+	ring_fd_ = -1;
+	sq_mapping_ = nullptr;
+	cq_mapping_ = nullptr;
+	sqes_ = nullptr;
+	buffer_ring_ = nullptr;
+	buffers_ = nullptr;
+	pending_submissions_ = 0;
+}
+
+struct io_uring_sqe *IoUringReceiver::NextSqe()
+{
+#ifdef __linux__
+	// Only this thread produces submissions and every one is submitted right away, so the queue always has room
+	const uint32_t tail = *sq_tail_ + pending_submissions_;
+	const uint32_t index = tail & *sq_mask_;
+
+	struct io_uring_sqe *sqe = &sqes_[ index ];
+	memset( sqe, 0, sizeof( *sqe ) );
+	sq_array_[ index ] = index;
+	pending_submissions_++;
+	return sqe;
+#else
+	return nullptr;
+#endif
+}
+
+bool IoUringReceiver::Submit()
+{
+#ifdef __linux__
+	const uint32_t count = pending_submissions_;
+	StoreRelease( sq_tail_, *sq_tail_ + count );
+	pending_submissions_ = 0;
+
+	int submitted;
+	do
+	{
+		submitted = IoUringEnter( ring_fd_, count, 0, 0 );
+	} while ( submitted < 0 && errno == EINTR );
+
+	return submitted == static_cast< int >( count );
+#else
+	return false;
+#endif
+}
+
+bool IoUringReceiver::StartReceive( int socket, uint64_t user_data )
+{
+#ifdef __linux__
+	if ( ring_fd_ < 0 )
+	{
+		return false;
+	}
+
+	struct io_uring_sqe *sqe = NextSqe();
+	sqe->opcode = IORING_OP_RECV;
+	sqe->fd = socket;
+	sqe->ioprio = IORING_RECV_MULTISHOT;
+	sqe->flags = IOSQE_BUFFER_SELECT;
+	sqe->buf_group = k_unBufferGroup;
+	sqe->user_data = user_data;
+
+	return Submit();
+#else
+	return false;
+#endif
+}
+
+bool IoUringReceiver::StartReceiveFrom( int socket, uint64_t user_data )
+{
+#ifdef __linux__
+	if ( ring_fd_ < 0 )
+	{
+		return false;
+	}
+
+	// Multishot recvmsg only looks at the name and control lengths, the kernel reserves that much
+	// room at the start of every buffer and writes the sender's address there
+	memset( &receive_message_, 0, sizeof( receive_message_ ) );
+	receive_message_.msg_namelen = sizeof( struct sockaddr_storage );
+
+	struct io_uring_sqe *sqe = NextSqe();
+	sqe->opcode = IORING_OP_RECVMSG;
+	sqe->fd = socket;
+	sqe->addr = reinterpret_cast< uint64_t >( &receive_message_ );
+	sqe->len = 1;
+	sqe->ioprio = IORING_RECV_MULTISHOT;
+	sqe->flags = IOSQE_BUFFER_SELECT;
+	sqe->buf_group = k_unBufferGroup;
+	sqe->user_data = user_data | k_unReceiveFromFlag;
+
+	return Submit();
+#else
+	return false;
+#endif
+}
+
+void IoUringReceiver::CancelReceive( uint64_t user_data )
+{
+#ifdef __linux__
+	if ( ring_fd_ < 0 )
+	{
+		return;
+	}
+
+	// We don't track which kind of receive user_data was started with, so cancel both.
+	// The cancels post completions of their own, tagged so ReapCompletions() can drop them.
+	for ( const uint64_t target : { user_data, user_data | k_unReceiveFromFlag } )
+	{
+		struct io_uring_sqe *sqe = NextSqe();
+		sqe->opcode = IORING_OP_ASYNC_CANCEL;
+		sqe->fd = -1;
+		sqe->addr = target;
+		sqe->user_data = UINT64_MAX;
+	}
+
+	Submit();
+#endif
+}
+
+void IoUringReceiver::RecycleBuffer( uint16_t unBufferId )
+{
+#ifdef __linux__
+	uint16_t *tail_ptr = BufferRingTail( buffer_ring_ );
+	const uint16_t tail = *tail_ptr;
+
+	struct io_uring_buf &buf = buffer_ring_[ tail & ( buffer_count_ - 1 ) ];
+	buf.addr = reinterpret_cast< uint64_t >( buffers_ + static_cast< size_t >( unBufferId ) * buffer_size_ );
+	buf.len = buffer_size_;
+	buf.bid = unBufferId;
+
+	StoreRelease( tail_ptr, static_cast< uint16_t >( tail + 1 ) );
+#endif
+}
+
+size_t IoUringReceiver::ReapCompletions( const CompletionHandler &handler )
+{
+#ifdef __linux__
+	if ( ring_fd_ < 0 )
+	{
+		return 0;
+	}
+
+	size_t count = 0;
+	uint32_t head = *cq_head_;
+	const uint32_t tail = LoadAcquire( cq_tail_ );
+
+	for ( ; head != tail; head++ )
+	{
+		const struct io_uring_cqe &cqe = cqes_[ head & *cq_mask_ ];
+		uint64_t user_data = cqe.user_data;
+		const int result = cqe.res;
+		const uint32_t flags = cqe.flags;
+
+		count++;
+
+		if ( user_data == UINT64_MAX )
+		{
+			// Completion of a CancelReceive()
+			continue;
+		}
+
+		const bool more = ( flags & IORING_CQE_F_MORE ) != 0;
+		const bool receive_from = ( user_data & k_unReceiveFromFlag ) != 0;
+		user_data &= ~k_unReceiveFromFlag;
+
+		if ( flags & IORING_CQE_F_BUFFER )
+		{
+			const uint16_t buffer_id = static_cast< uint16_t >( flags >> IORING_CQE_BUFFER_SHIFT );
+			const char *data = buffers_ + static_cast< size_t >( buffer_id ) * buffer_size_;
+			const struct sockaddr *source = nullptr;
+			int size = result;
+
+			if ( receive_from && result >= 0 )
+			{
+				// A recvmsg buffer holds a header, the source address (and control data), then the payload
+				const struct io_uring_recvmsg_out *out = reinterpret_cast< const struct io_uring_recvmsg_out * >( data );
+				const int payload_offset = static_cast< int >( sizeof( *out ) + receive_message_.msg_namelen + receive_message_.msg_controllen );
+
+				size = 0;
+				if ( result >= payload_offset )
+				{
+					source = out->namelen > 0 ? reinterpret_cast< const struct sockaddr * >( data + sizeof( *out ) ) : nullptr;
+					size = std::min( static_cast< int >( out->payloadlen ), result - payload_offset );
+				}
+				data += payload_offset;
+			}
+
+			handler( user_data, size, data, more, source );
+			RecycleBuffer( buffer_id );
+		}
+		else
+		{
+			handler( user_data, result > 0 ? 0 : result, nullptr, more, nullptr );
+		}
+	}
+
+	StoreRelease( cq_head_, head );
+	return count;
+#else
+	return 0;
+#endif
+}
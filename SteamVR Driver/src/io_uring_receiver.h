@@ -0,0 +1,89 @@
+//============ Copyright (c) Valve Corporation, All rights reserved. ============
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+
+#ifdef __linux__
+#include <sys/socket.h>
+#endif
+
+struct sockaddr;
+struct io_uring_sqe;
+struct io_uring_cqe;
+struct io_uring_buf;
+
+//-----------------------------------------------------------------------------
+// Purpose: Receives from sockets through io_uring (Linux 6.0+).
+// Every socket gets one multishot receive that keeps completing into buffers picked from a
+// registered buffer ring, so bursts of samples are collected without a syscall per message.
+// Init() fails cleanly where io_uring isn't available, callers then use plain recv().
+//-----------------------------------------------------------------------------
+class IoUringReceiver
+{
+public:
+	// Called for every completion. result > 0 is the number of bytes at data, 0 is end of stream, < 0 a negated errno.
+	// When more is false the receive has finished and has to be re-armed with StartReceive() to keep receiving.
+	// source is the sender's address for receives started with StartReceiveFrom(), otherwise nullptr.
+	using CompletionHandler = std::function< void( uint64_t user_data, int result, const char *data, bool more, const struct sockaddr *source ) >;
+
+	IoUringReceiver();
+	~IoUringReceiver();
+
+	bool Init( uint32_t unBufferCount = 128, uint32_t unBufferSize = 2048 );
+	void Shutdown();
+	bool IsActive() const { return ring_fd_ >= 0; }
+
+	// The ring's file descriptor, readable while completions are waiting. Meant to be added to an epoll set.
+	int RingFd() const { return ring_fd_; }
+
+	// Queues a multishot receive on socket. user_data is handed back with every completion, it must be below 2^62.
+	bool StartReceive( int socket, uint64_t user_data );
+
+	// Like StartReceive(), for datagram sockets whose senders need answering. Only one may be active at a time.
+	bool StartReceiveFrom( int socket, uint64_t user_data );
+
+	// Cancels the receive started with user_data, before its socket is closed
+	void CancelReceive( uint64_t user_data );
+
+	// Hands every waiting completion to handler and returns their buffers to the ring
+	size_t ReapCompletions( const CompletionHandler &handler );
+
+private:
+	struct io_uring_sqe *NextSqe();
+	bool Submit();
+	void RecycleBuffer( uint16_t unBufferId );
+
+	int ring_fd_;
+
+	// Submission queue
+	void *sq_mapping_;
+	size_t sq_mapping_size_;
+	struct io_uring_sqe *sqes_;
+	size_t sqes_size_;
+	uint32_t *sq_tail_;
+	uint32_t *sq_mask_;
+	uint32_t *sq_array_;
+	uint32_t pending_submissions_;
+
+	// Completion queue
+	void *cq_mapping_;
+	size_t cq_mapping_size_;
+	uint32_t *cq_head_;
+	uint32_t *cq_tail_;
+	uint32_t *cq_mask_;
+	struct io_uring_cqe *cqes_;
+
+	// Provided buffer ring
+	struct io_uring_buf *buffer_ring_;
+	size_t buffer_ring_size_;
+	char *buffers_;
+	uint32_t buffer_count_;
+	uint32_t buffer_size_;
+
+#ifdef __linux__
+	// StartReceiveFrom()'s message header, it sets aside room for the source address in every buffer
+	struct msghdr receive_message_;
+#endif
+};
@@ -0,0 +1,131 @@
+//============ Copyright (c) Valve Corporation, All rights reserved. ============
+#include "latency_histogram.h"
+
+#include <cstdio>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+// Index of the highest set bit, unValue must not be 0
+static inline int HighestBit( uint64_t unValue )
+{
+#ifdef _MSC_VER
+	unsigned long index;
+	_BitScanReverse64( &index, unValue );
+	return static_cast< int >( index );
+#else
+	return 63 - __builtin_clzll( unValue );
+#endif
+}
+
+LatencyHistogram::LatencyHistogram()
+	: count_( 0 )
+	, sum_( 0 )
+	, max_( 0 )
+{
+	for ( std::atomic< uint64_t > &bucket : buckets_ )
+	{
+		bucket.store( 0, std::memory_order_relaxed );
+	}
+}
+
+size_t LatencyHistogram::BucketIndex( uint64_t unValue )
+{
+	if ( unValue < k_unSubBucketCount )
+	{
+		return static_cast< size_t >( unValue );
+	}
+
+	if ( unValue >= ( uint64_t( 1 ) << k_nMaxValueBits ) )
+	{
+		unValue = ( uint64_t( 1 ) << k_nMaxValueBits ) - 1;
+	}
+
+	// The top k_nSubBucketBits + 1 bits pick the bucket, everything below them is the resolution we give up
+	const int shift = HighestBit( unValue ) - k_nSubBucketBits;
+	return ( shift + 1 ) * k_unSubBucketCount + static_cast< size_t >( ( unValue >> shift ) - k_unSubBucketCount );
+}
+
+int64_t LatencyHistogram::BucketHighestValue( size_t unIndex )
+{
+	if ( unIndex < k_unSubBucketCount )
+	{
+		return static_cast< int64_t >( unIndex );
+	}
+
+	const int shift = static_cast< int >( unIndex / k_unSubBucketCount ) - 1;
+	const uint64_t lowest = ( k_unSubBucketCount + unIndex % k_unSubBucketCount ) << shift;
+	return static_cast< int64_t >( lowest + ( uint64_t( 1 ) << shift ) - 1 );
+}
+
+void LatencyHistogram::Record( int64_t nValue )
+{
+	if ( nValue < 0 )
+	{
+		nValue = 0;
+	}
+
+	std::atomic< uint64_t > &bucket = buckets_[ BucketIndex( static_cast< uint64_t >( nValue ) ) ];
+
+	// Single writer, so plain load + store is enough and cheaper than read-modify-write
+	bucket.store( bucket.load( std::memory_order_relaxed ) + 1, std::memory_order_relaxed );
+	sum_.store( sum_.load( std::memory_order_relaxed ) + nValue, std::memory_order_relaxed );
+	if ( nValue > max_.load( std::memory_order_relaxed ) )
+	{
+		max_.store( nValue, std::memory_order_relaxed );
+	}
+	count_.store( count_.load( std::memory_order_relaxed ) + 1, std::memory_order_relaxed );
+}
+
+uint64_t LatencyHistogram::Count() const
+{
+	return count_.load( std::memory_order_relaxed );
+}
+
+int64_t LatencyHistogram::Max() const
+{
+	return max_.load( std::memory_order_relaxed );
+}
+
+double LatencyHistogram::Mean() const
+{
+	const uint64_t count = Count();
+	return count > 0 ? static_cast< double >( sum_.load( std::memory_order_relaxed ) ) / count : 0.0;
+}
+
+int64_t LatencyHistogram::Percentile( double fQuantile ) const
+{
+	uint64_t total = 0;
+	for ( const std::atomic< uint64_t > &bucket : buckets_ )
+	{
+		total += bucket.load( std::memory_order_relaxed );
+	}
+
+	if ( total == 0 )
+	{
+		return 0;
+	}
+
+	const uint64_t rank = static_cast< uint64_t >( fQuantile * ( total - 1 ) ) + 1;
+	const int64_t max = Max();
+	uint64_t seen = 0;
+	for ( size_t i = 0; i < k_unBucketCount; i++ )
+	{
+		seen += buckets_[ i ].load( std::memory_order_relaxed );
+		if ( seen >= rank )
+		{
+			// Nothing in a bucket is larger than the largest value recorded
+			const int64_t highest = BucketHighestValue( i );
+			return highest < max ? highest : max;
+		}
+	}
+
+	return max;
+}
+
+void LatencyHistogram::Format( char *pchBuffer, size_t unBufferSize, const char *pchUnit ) const
+{
+	snprintf( pchBuffer, unBufferSize, "p50 %lld %s, p99 %lld %s, p99.9 %lld %s, max %lld %s", static_cast< long long >( Percentile( 0.5 ) ), pchUnit,
+		static_cast< long long >( Percentile( 0.99 ) ), pchUnit, static_cast< long long >( Percentile( 0.999 ) ), pchUnit, static_cast< long long >( Max() ), pchUnit );
+}
@@ -0,0 +1,50 @@
+//============ Copyright (c) Valve Corporation, All rights reserved. ============
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+//-----------------------------------------------------------------------------
+// Purpose: HDR style distribution of a latency (or any other non-negative value, the unit is up to the caller).
+// Every power of two is split into 32 linear sub-buckets, so percentiles are within 3% of the real value
+// from 0 up to 2^40. Recording is a bit scan and a few relaxed stores, cheap enough to leave on all the time.
+//
+// Exactly one thread records into a histogram, any thread may read. That's what keeps Record() lock-free
+// without read-modify-write instructions: give each thread its own histograms rather than sharing one.
+// Reads are not a consistent snapshot across buckets, which is fine for statistics.
+//-----------------------------------------------------------------------------
+class LatencyHistogram
+{
+public:
+	LatencyHistogram();
+
+	// Negative values (clocks that are slightly off) are counted as 0, values past the range as the largest bucket
+	void Record( int64_t nValue );
+
+	uint64_t Count() const;
+	int64_t Max() const;
+	double Mean() const;
+
+	// Highest value in the bucket the given quantile (0 - 1) falls into, 0 while nothing has been recorded
+	int64_t Percentile( double fQuantile ) const;
+
+	// Writes "p50 <n> <unit>, p99 <n> <unit>, p99.9 <n> <unit>, max <n> <unit>" into buffer
+	void Format( char *pchBuffer, size_t unBufferSize, const char *pchUnit ) const;
+
+private:
+	static constexpr int k_nSubBucketBits = 5;
+	static constexpr size_t k_unSubBucketCount = size_t( 1 ) << k_nSubBucketBits;
+	static constexpr int k_nMaxValueBits = 40;
+
+	// Values below k_unSubBucketCount get a bucket each, then k_unSubBucketCount buckets per power of two
+	static constexpr size_t k_unBucketCount = ( k_nMaxValueBits - k_nSubBucketBits + 1 ) * k_unSubBucketCount;
+
+	static size_t BucketIndex( uint64_t unValue );
+	static int64_t BucketHighestValue( size_t unIndex );
+
+	std::atomic< uint64_t > buckets_[ k_unBucketCount ];
+	std::atomic< uint64_t > count_;
+	std::atomic< int64_t > sum_;
+	std::atomic< int64_t > max_;
+};
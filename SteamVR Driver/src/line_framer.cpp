@@ -0,0 +1,113 @@
+//============ Copyright (c) Valve Corporation, All rights reserved. ============
+#include "line_framer.h"
+
+#include <cstring>
+
+LineFramer::LineFramer()
+	: read_pos_( 0 )
+	, scan_pos_( 0 )
+	, write_pos_( 0 )
+	, discarding_( false )
+	, overflow_count_( 0 )
+{
+}
+
+char *LineFramer::WriteBegin()
+{
+	// Move the partial line we're holding over to the front, so the free space is contiguous.
+	// This only ever copies the tail of one line, not whole messages.
+	if ( read_pos_ > 0 )
+	{
+		const size_t pending = write_pos_ - read_pos_;
+		if ( pending > 0 )
+		{
+			memmove( buffer_, buffer_ + read_pos_, pending );
+		}
+		scan_pos_ -= read_pos_;
+		write_pos_ = pending;
+		read_pos_ = 0;
+	}
+
+	// A single line that fills the whole buffer can never be completed. Throw it away and resync on the next newline.
+	if ( write_pos_ == k_unBufferSize )
+	{
+		overflow_count_++;
+		Reset();
+		discarding_ = true;
+	}
+
+	return buffer_ + write_pos_;
+}
+
+size_t LineFramer::WriteCapacity()
+{
+	return k_unBufferSize - write_pos_;
+}
+
+void LineFramer::CommitWrite( size_t unBytes )
+{
+	write_pos_ += unBytes;
+}
+
+bool LineFramer::NextLine( std::string_view &line )
+{
+	while ( scan_pos_ < write_pos_ )
+	{
+		const char *newline = static_cast< const char * >( memchr( buffer_ + scan_pos_, '\n', write_pos_ - scan_pos_ ) );
+		if ( newline == nullptr )
+		{
+			// Nothing more to hand out until the rest of this line arrives
+			scan_pos_ = write_pos_;
+			return false;
+		}
+
+		const size_t line_begin = read_pos_;
+		size_t line_end = newline - buffer_;
+
+		read_pos_ = line_end + 1;
+		scan_pos_ = read_pos_;
+
+		// The rest of a line we had to throw away
+		if ( discarding_ )
+		{
+			discarding_ = false;
+			continue;
+		}
+
+		if ( line_end > line_begin && buffer_[ line_end - 1 ] == '\r' )
+		{
+			line_end--;
+		}
+
+		// Skip blank lines
+		if ( line_end > line_begin )
+		{
+			line = std::string_view( buffer_ + line_begin, line_end - line_begin );
+			return true;
+		}
+	}
+
+	return false;
+}
+
+std::string_view LineFramer::Pending() const
+{
+	return std::string_view( buffer_ + read_pos_, write_pos_ - read_pos_ );
+}
+
+void LineFramer::Consume( size_t unBytes )
+{
+	read_pos_ += unBytes;
+	if ( scan_pos_ < read_pos_ )
+	{
+		scan_pos_ = read_pos_;
+	}
+}
+
+void LineFramer::Reset()
+{
+	read_pos_ = 0;
+	scan_pos_ = 0;
+	write_pos_ = 0;
+	discarding_ = false;
+}
@@ -0,0 +1,54 @@
+//============ Copyright (c) Valve Corporation, All rights reserved. ============
+#pragma once
+
+#include <cstddef>
+#include <string_view>
+
+//-----------------------------------------------------------------------------
+// Purpose: Splits a byte stream into newline terminated lines.
+// Data is received straight into the framer's buffer, lines are handed out as views into it,
+// and an incomplete trailing line is kept over to be completed by the next receive.
+//-----------------------------------------------------------------------------
+class LineFramer
+{
+public:
+	static constexpr size_t k_unBufferSize = 16384;
+
+	LineFramer();
+
+	// Where the next receive should write to, and how much it may write
+	char *WriteBegin();
+	size_t WriteCapacity();
+
+	// Marks unBytes written at WriteBegin() as received
+	void CommitWrite( size_t unBytes );
+
+	// Returns the next complete line (without its '\n' or '\r\n') in line.
+	// The view is valid until the next call to WriteBegin() or Reset().
+	bool NextLine( std::string_view &line );
+
+	// Raw access for fixed-size binary frames, which share the same carry-over buffer.
+	// Pending() returns everything received but not yet consumed, Consume() drops unBytes from its front.
+	std::string_view Pending() const;
+	void Consume( size_t unBytes );
+
+	// Drops any buffered data, eg. when a client disconnects
+	void Reset();
+
+	// Number of partial lines thrown away because they didn't fit in the buffer
+	size_t OverflowCount() const { return overflow_count_; }
+
+private:
+	char buffer_[ k_unBufferSize ];
+
+	// buffer_[ read_pos_, write_pos_ ) holds received data that hasn't been handed out yet.
+	// Everything before scan_pos_ in that range is known not to contain a '\n'.
+	size_t read_pos_;
+	size_t scan_pos_;
+	size_t write_pos_;
+
+	// Set after an overflow until the newline ending the dropped line has been seen
+	bool discarding_;
+
+	size_t overflow_count_;
+};
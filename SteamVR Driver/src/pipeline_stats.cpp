@@ -0,0 +1,160 @@
+//============ Copyright (c) Valve Corporation, All rights reserved. ============
+#include "pipeline_stats.h"
+
+#include "driver_clock.h"
+
+#include <cstdio>
+#include <cstring>
+
+// Sample rates are averaged over at least this long, so back to back requests still see a meaningful rate
+static constexpr int64_t k_unRateWindowUs = 1000000;
+
+static const char *const k_pchLatencyStageKeys[ LatencyStage_MAX ] = { "capture_to_send_us", "send_to_receive_us", "queue_age_us", "capture_to_submit_us" };
+
+// Appends "<key>":{"n":..,"p50":..,"p99":..,"p999":..,"max":..} at offset, returns the new offset
+static size_t AppendHistogramJson( char *pchBuffer, size_t unBufferSize, size_t unOffset, const char *pchKey, const LatencyHistogram &histogram )
+{
+	if ( unOffset >= unBufferSize )
+	{
+		return unOffset;
+	}
+
+	const int written = snprintf( pchBuffer + unOffset, unBufferSize - unOffset, "\"%s\":{\"n\":%llu,\"p50\":%lld,\"p99\":%lld,\"p999\":%lld,\"max\":%lld}", pchKey,
+		static_cast< unsigned long long >( histogram.Count() ), static_cast< long long >( histogram.Percentile( 0.5 ) ), static_cast< long long >( histogram.Percentile( 0.99 ) ),
+		static_cast< long long >( histogram.Percentile( 0.999 ) ), static_cast< long long >( histogram.Max() ) );
+	return written < 0 ? unBufferSize : unOffset + written;
+}
+
+// Appends text at offset, returns the new offset
+static size_t AppendJson( char *pchBuffer, size_t unBufferSize, size_t unOffset, const char *pchText )
+{
+	if ( unOffset >= unBufferSize )
+	{
+		return unOffset;
+	}
+
+	const int written = snprintf( pchBuffer + unOffset, unBufferSize - unOffset, "%s", pchText );
+	return written < 0 ? unBufferSize : unOffset + written;
+}
+
+PipelineStats::PipelineStats()
+	: scheduler_frame_period_us_( 0 )
+	, start_time_us_( DriverClockUs() )
+	, rate_window_time_us_( start_time_us_ )
+	, rate_window_samples_{}
+	, samples_per_sec_{}
+{
+}
+
+HandPipelineStats &PipelineStats::Hand( HandId hand )
+{
+	return hands_[ hand ];
+}
+
+const HandPipelineStats &PipelineStats::Hand( HandId hand ) const
+{
+	return hands_[ hand ];
+}
+
+LatencyHistogram &PipelineStats::ParseTimeNs()
+{
+	return parse_time_ns_;
+}
+
+LatencyHistogram &PipelineStats::ListenerWakeLateUs()
+{
+	return listener_wake_late_us_;
+}
+
+LatencyHistogram &PipelineStats::SchedulerWakeLateUs()
+{
+	return scheduler_wake_late_us_;
+}
+
+std::atomic< int64_t > &PipelineStats::SchedulerFramePeriodUs()
+{
+	return scheduler_frame_period_us_;
+}
+
+bool PipelineStats::FormatJson( char *pchBuffer, size_t unBufferSize )
+{
+	if ( unBufferSize == 0 )
+	{
+		return false;
+	}
+
+	const int64_t now_us = DriverClockUs();
+
+	double samples_per_sec[ HandId_MAX ];
+	{
+		std::lock_guard< std::mutex > lock( rate_mutex_ );
+
+		// Until a full window has passed, the rate is over everything since the window started
+		const int64_t elapsed_us = now_us - rate_window_time_us_;
+		if ( elapsed_us > 0 )
+		{
+			for ( int hand = 0; hand < HandId_MAX; hand++ )
+			{
+				const uint64_t samples = hands_[ hand ].samples.load( std::memory_order_relaxed );
+				if ( elapsed_us >= k_unRateWindowUs || rate_window_time_us_ == start_time_us_ )
+				{
+					samples_per_sec_[ hand ] = static_cast< double >( samples - rate_window_samples_[ hand ] ) * 1e6 / elapsed_us;
+				}
+				if ( elapsed_us >= k_unRateWindowUs )
+				{
+					rate_window_samples_[ hand ] = samples;
+				}
+			}
+			if ( elapsed_us >= k_unRateWindowUs )
+			{
+				rate_window_time_us_ = now_us;
+			}
+		}
+		memcpy( samples_per_sec, samples_per_sec_, sizeof( samples_per_sec ) );
+	}
+
+	char header[ 64 ];
+	snprintf( header, sizeof( header ), "{\"uptime_s\":%.1f,", ( now_us - start_time_us_ ) * 1e-6 );
+
+	size_t offset = AppendJson( pchBuffer, unBufferSize, 0, header );
+	offset = AppendHistogramJson( pchBuffer, unBufferSize, offset, "parse_ns", parse_time_ns_ );
+
+	for ( int hand = 0; hand < HandId_MAX; hand++ )
+	{
+		const HandPipelineStats &stats = hands_[ hand ];
+
+		char hand_header[ 160 ];
+		snprintf( hand_header, sizeof( hand_header ), ",\"%s\":{\"samples_per_sec\":%.1f,\"input_updates\":%llu,\"input_updates_suppressed\":%llu,", hand == HandId_Left ? "left" : "right",
+			samples_per_sec[ hand ], static_cast< unsigned long long >( stats.input_updates.load( std::memory_order_relaxed ) ),
+			static_cast< unsigned long long >( stats.input_updates_suppressed.load( std::memory_order_relaxed ) ) );
+		offset = AppendJson( pchBuffer, unBufferSize, offset, hand_header );
+
+		for ( int stage = 0; stage < LatencyStage_MAX; stage++ )
+		{
+			offset = AppendHistogramJson( pchBuffer, unBufferSize, offset, k_pchLatencyStageKeys[ stage ], stats.latency_us[ stage ] );
+			offset = AppendJson( pchBuffer, unBufferSize, offset, "," );
+		}
+		offset = AppendHistogramJson( pchBuffer, unBufferSize, offset, "submit_jitter_us", stats.submit_jitter_us );
+		offset = AppendJson( pchBuffer, unBufferSize, offset, "}" );
+	}
+
+	offset = AppendJson( pchBuffer, unBufferSize, offset, ",\"listener\":{" );
+	offset = AppendHistogramJson( pchBuffer, unBufferSize, offset, "wake_late_us", listener_wake_late_us_ );
+	offset = AppendJson( pchBuffer, unBufferSize, offset, "}" );
+
+	char scheduler_header[ 64 ];
+	snprintf( scheduler_header, sizeof( scheduler_header ), ",\"scheduler\":{\"frame_period_us\":%lld,",
+		static_cast< long long >( scheduler_frame_period_us_.load( std::memory_order_relaxed ) ) );
+	offset = AppendJson( pchBuffer, unBufferSize, offset, scheduler_header );
+	offset = AppendHistogramJson( pchBuffer, unBufferSize, offset, "wake_late_us", scheduler_wake_late_us_ );
+	offset = AppendJson( pchBuffer, unBufferSize, offset, "}}" );
+
+	// snprintf stops at the end of the buffer, a cut off snapshot isn't valid JSON
+	if ( offset >= unBufferSize )
+	{
+		pchBuffer[ 0 ] = '\0';
+		return false;
+	}
+
+	return true;
+}
@@ -0,0 +1,83 @@
+//============ Copyright (c) Valve Corporation, All rights reserved. ============
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+
+#include "hand_protocol.h"
+#include "latency_histogram.h"
+
+// Stages of the camera to pose pipeline whose latency we track, for the samples that made it into a pose
+enum LatencyStage
+{
+	LatencyStage_CaptureToSend,	  // Hand detection in the producer
+	LatencyStage_SendToReceive,	  // Transport, until the listener has the sample
+	LatencyStage_ReceiveToSubmit, // Queue age: until the pose scheduler first submits a pose with it
+	LatencyStage_CaptureToSubmit, // End to end
+
+	LatencyStage_MAX
+};
+
+// What one hand's threads record. Every member has a single writer thread, noted next to it.
+struct HandPipelineStats
+{
+	// Listener thread: samples received for this hand
+	std::atomic< uint64_t > samples{ 0 };
+
+	// vrserver's RunFrame thread: input component updates sent to SteamVR, and the ones skipped because the value hadn't changed
+	std::atomic< uint64_t > input_updates{ 0 };
+	std::atomic< uint64_t > input_updates_suppressed{ 0 };
+
+	// Pose scheduler thread, microseconds
+	LatencyHistogram latency_us[ LatencyStage_MAX ];
+
+	// Pose scheduler thread: how much later than its deadline (or submit request) this hand was submitted, microseconds
+	LatencyHistogram submit_jitter_us;
+};
+
+//-----------------------------------------------------------------------------
+// Purpose: Runtime statistics of the whole hand tracking pipeline, shared by the listener and the controllers.
+// The threads record into their own histograms without locks, readers put them together into one
+// snapshot for DebugRequest( "stats" ).
+//-----------------------------------------------------------------------------
+class PipelineStats
+{
+public:
+	PipelineStats();
+
+	HandPipelineStats &Hand( HandId hand );
+	const HandPipelineStats &Hand( HandId hand ) const;
+
+	// Listener thread: time to parse or decode one message, nanoseconds
+	LatencyHistogram &ParseTimeNs();
+
+	// Listener thread: how long after a sample was sent the thread woke up to read it, microseconds
+	LatencyHistogram &ListenerWakeLateUs();
+
+	// Pose scheduler thread: how much later than its deadline the thread woke up, microseconds
+	LatencyHistogram &SchedulerWakeLateUs();
+
+	// Pose scheduler thread: the display frame period the deadlines are aligned to, 0 while not aligned
+	std::atomic< int64_t > &SchedulerFramePeriodUs();
+
+	// Writes a compact JSON snapshot, samples/sec is averaged over at least the last second.
+	// Returns false (and an empty string) when it doesn't fit. Any thread.
+	bool FormatJson( char *pchBuffer, size_t unBufferSize );
+
+private:
+	LatencyHistogram parse_time_ns_;
+	HandPipelineStats hands_[ HandId_MAX ];
+	LatencyHistogram listener_wake_late_us_;
+	LatencyHistogram scheduler_wake_late_us_;
+	std::atomic< int64_t > scheduler_frame_period_us_;
+
+	const int64_t start_time_us_;
+
+	// Sample rate window, FormatJson() may be called from more than one thread
+	std::mutex rate_mutex_;
+	int64_t rate_window_time_us_;
+	uint64_t rate_window_samples_[ HandId_MAX ];
+	double samples_per_sec_[ HandId_MAX ];
+};
@@ -0,0 +1,392 @@
+//============ Copyright (c) Valve Corporation, All rights reserved. ============
+#include "pose_scheduler.h"
+
+#include "driver_clock.h"
+#include "driverlog.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cmath>
+
+#ifdef __linux__
+#include <time.h>
+#endif
+
+// Longest the thread sleeps without a device being due, so Stop() is never held up for long if a wakeup gets lost
+static constexpr int64_t k_unMaxSleepUs = 100000;
+
+// How often the display frequency is checked and the vsync grid re-anchored, which also corrects any drift between the clocks
+static constexpr int64_t k_unDisplayCheckIntervalUs = 1000000;
+
+PoseScheduler::PoseScheduler()
+	: is_running_( false )
+	, wake_pending_( false )
+	, has_request_devices_( false )
+	, align_to_display_( false )
+	, display_phase_offset_us_( 0.0 )
+	, frame_period_us_( 0.0 )
+	, vsync_time_us_( 0.0 )
+	, display_check_time_us_( 0 )
+	, pipeline_stats_( nullptr )
+	, idle_timeout_us_( 0 )
+	, activity_time_us_( 0 )
+	, is_standby_( false )
+	, is_parked_( false )
+	, wakeup_count_( 0 )
+{
+}
+
+PoseScheduler::~PoseScheduler()
+{
+	Stop();
+}
+
+size_t PoseScheduler::AddDevice( IScheduledPoseDevice *device, int64_t nPeriodUs, bool bSubmitOnRequest )
+{
+	std::unique_ptr< ScheduledDevice > scheduled = std::make_unique< ScheduledDevice >();
+	scheduled->device = device;
+	scheduled->requested_period_us = std::max< int64_t >( nPeriodUs, 1 );
+	scheduled->period_us = static_cast< double >( scheduled->requested_period_us );
+	scheduled->next_due_us = 0.0;
+
+	has_request_devices_ |= bSubmitOnRequest;
+
+	devices_.push_back( std::move( scheduled ) );
+	return devices_.size() - 1;
+}
+
+void PoseScheduler::SetDisplayAlignment( bool bEnable, float fPhaseOffsetMs )
+{
+	align_to_display_ = bEnable;
+	display_phase_offset_us_ = fPhaseOffsetMs * 1000.0;
+}
+
+void PoseScheduler::SetPipelineStats( PipelineStats *stats )
+{
+	pipeline_stats_ = stats;
+}
+
+void PoseScheduler::SetThreadTuning( const ThreadTuning &tuning )
+{
+	thread_tuning_ = tuning;
+}
+
+void PoseScheduler::SetIdleTimeout( int64_t nIdleTimeoutUs )
+{
+	idle_timeout_us_ = nIdleTimeoutUs;
+}
+
+void PoseScheduler::Start()
+{
+	if ( is_running_.exchange( true ) )
+	{
+		return;
+	}
+
+	// The idle timeout counts from now, the producer gets that long to start sending
+	activity_time_us_ = DriverClockUs();
+
+	scheduler_thread_ = std::thread( &PoseScheduler::SchedulerThread, this );
+}
+
+void PoseScheduler::Stop()
+{
+	if ( !is_running_.exchange( false ) )
+	{
+		return;
+	}
+
+	{
+		std::lock_guard< std::mutex > lock( wake_mutex_ );
+		wake_pending_ = true;
+	}
+	wake_cv_.notify_one();
+	scheduler_thread_.join();
+
+	DriverLog( "PoseScheduler: Stopped after %llu wakeups, %llu hmd pose fetches", static_cast< unsigned long long >( GetWakeupCount() ),
+		static_cast< unsigned long long >( hmd_pose_cache_.GetRefreshCount() ) );
+}
+
+void PoseScheduler::RequestSubmit( size_t unSlot )
+{
+	// Only the first request since the last submit counts, that's the one the submit is late for
+	int64_t no_request = 0;
+	devices_[ unSlot ]->request_time_us.compare_exchange_strong( no_request, DriverClockUs(), std::memory_order_relaxed );
+
+	{
+		std::lock_guard< std::mutex > lock( wake_mutex_ );
+		wake_pending_ = true;
+	}
+	wake_cv_.notify_one();
+}
+
+void PoseScheduler::NotifyActivity()
+{
+	activity_time_us_ = DriverClockUs();
+
+	if ( is_parked_ )
+	{
+		{
+			std::lock_guard< std::mutex > lock( wake_mutex_ );
+			wake_pending_ = true;
+		}
+		wake_cv_.notify_one();
+	}
+}
+
+void PoseScheduler::SetStandby( bool bStandby )
+{
+	is_standby_ = bStandby;
+
+	if ( !bStandby )
+	{
+		// Leaving standby counts as activity, the producer gets a full idle timeout to resume sending
+		activity_time_us_ = DriverClockUs();
+
+		{
+			std::lock_guard< std::mutex > lock( wake_mutex_ );
+			wake_pending_ = true;
+		}
+		wake_cv_.notify_one();
+	}
+}
+
+bool PoseScheduler::IsParked() const
+{
+	return is_parked_;
+}
+
+uint64_t PoseScheduler::GetWakeupCount() const
+{
+	return wakeup_count_.load( std::memory_order_relaxed );
+}
+
+const HmdPoseCache &PoseScheduler::GetHmdPoseCache() const
+{
+	return hmd_pose_cache_;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Looks up the hmd's refresh rate and last vsync, and lays every device's deadlines on that grid.
+// Periods shorter than a frame become a whole fraction of it, longer ones a whole number of frames.
+//-----------------------------------------------------------------------------
+void PoseScheduler::UpdateDisplayAlignment( int64_t nNowUs )
+{
+	if ( !align_to_display_ || nNowUs - display_check_time_us_ < k_unDisplayCheckIntervalUs )
+	{
+		return;
+	}
+	display_check_time_us_ = nNowUs;
+
+	vr::ETrackedPropertyError property_error = vr::TrackedProp_Success;
+	const vr::PropertyContainerHandle_t hmd_container = vr::VRProperties()->TrackedDeviceToPropertyContainer( vr::k_unTrackedDeviceIndex_Hmd );
+	const float display_frequency = vr::VRProperties()->GetFloatProperty( hmd_container, vr::Prop_DisplayFrequency_Float, &property_error );
+
+	vr::Compositor_FrameTiming frame_timing{};
+	frame_timing.m_nSize = sizeof( vr::Compositor_FrameTiming );
+	if ( property_error != vr::TrackedProp_Success || display_frequency <= 0.f || vr::VRServerDriverHost()->GetFrameTimings( &frame_timing, 1 ) == 0 )
+	{
+		// No hmd (yet), keep whatever we had
+		return;
+	}
+
+	// The newest frame's system time is the vsync it started from, on the same monotonic clock as the driver's.
+	// Anything further away than that isn't a clock we can line up with.
+	const double vsync_time_us = frame_timing.m_flSystemTimeInSeconds * 1000000.0;
+	if ( std::abs( nNowUs - vsync_time_us ) > k_unDisplayCheckIntervalUs )
+	{
+		return;
+	}
+
+	const double frame_period_us = 1000000.0 / display_frequency;
+	if ( frame_period_us != frame_period_us_ )
+	{
+		DriverLog( "PoseScheduler: Aligning poses to the %.1f Hz display, %.2f ms after vsync", display_frequency, display_phase_offset_us_ / 1000.0 );
+	}
+	frame_period_us_ = frame_period_us;
+	vsync_time_us_ = vsync_time_us;
+
+	if ( pipeline_stats_ != nullptr )
+	{
+		pipeline_stats_->SchedulerFramePeriodUs().store( static_cast< int64_t >( frame_period_us ), std::memory_order_relaxed );
+	}
+
+	const double grid_origin_us = vsync_time_us_ + display_phase_offset_us_;
+	for ( std::unique_ptr< ScheduledDevice > &scheduled : devices_ )
+	{
+		const double requested_period_us = static_cast< double >( scheduled->requested_period_us );
+		if ( requested_period_us <= frame_period_us )
+		{
+			scheduled->period_us = frame_period_us / std::max( 1.0, std::round( frame_period_us / requested_period_us ) );
+		}
+		else
+		{
+			scheduled->period_us = frame_period_us * std::round( requested_period_us / frame_period_us );
+		}
+
+		// Snap the next deadline to the nearest grid point, never into the past
+		scheduled->next_due_us = grid_origin_us + std::round( ( scheduled->next_due_us - grid_origin_us ) / scheduled->period_us ) * scheduled->period_us;
+		while ( scheduled->next_due_us <= nNowUs )
+		{
+			scheduled->next_due_us += scheduled->period_us;
+		}
+	}
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Sleeps until the absolute time nWakeTimeUs on the driver clock.
+// Returns true if RequestSubmit() (or Stop()) woke us before that.
+//-----------------------------------------------------------------------------
+bool PoseScheduler::WaitUntil( int64_t nWakeTimeUs )
+{
+	if ( !has_request_devices_ )
+	{
+		// Nothing will wake us early, sleep to the absolute deadline so the time spent in the loop doesn't add up
+#ifdef __linux__
+		struct timespec wake_time;
+		wake_time.tv_sec = static_cast< time_t >( nWakeTimeUs / 1000000 );
+		wake_time.tv_nsec = static_cast< long >( ( nWakeTimeUs % 1000000 ) * 1000 );
+		while ( clock_nanosleep( CLOCK_MONOTONIC, TIMER_ABSTIME, &wake_time, nullptr ) == EINTR )
+		{
+		}
+#else
+		std::this_thread::sleep_until( std::chrono::steady_clock::time_point( std::chrono::microseconds( nWakeTimeUs ) ) );
+#endif
+		return false;
+	}
+
+	// Also an absolute deadline, a steady_clock wait_until is a CLOCK_MONOTONIC timed wait
+	std::unique_lock< std::mutex > lock( wake_mutex_ );
+	const bool woken = wake_cv_.wait_until( lock, std::chrono::steady_clock::time_point( std::chrono::microseconds( nWakeTimeUs ) ), [ this ] { return wake_pending_; } );
+	wake_pending_ = false;
+	return woken;
+}
+
+bool PoseScheduler::ShouldPark( int64_t nNowUs ) const
+{
+	return is_standby_ || ( idle_timeout_us_ > 0 && nNowUs - activity_time_us_ >= idle_timeout_us_ );
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Tells every device it's idle and sleeps, without a deadline, until there's hand data again,
+// standby ends or Stop() is called.
+//-----------------------------------------------------------------------------
+void PoseScheduler::Park()
+{
+	const HmdPose &hmd_pose = hmd_pose_cache_.Refresh();
+	for ( std::unique_ptr< ScheduledDevice > &scheduled : devices_ )
+	{
+		scheduled->device->SubmitIdlePose( hmd_pose );
+	}
+
+	DriverLog( "PoseScheduler: Parked (%s)", is_standby_ ? "standby" : "no hand data" );
+
+	{
+		std::unique_lock< std::mutex > lock( wake_mutex_ );
+		is_parked_ = true;
+		wake_cv_.wait( lock, [ this ] { return !is_running_ || !ShouldPark( DriverClockUs() ); } );
+		wake_pending_ = false;
+		is_parked_ = false;
+	}
+
+	if ( !is_running_ )
+	{
+		return;
+	}
+
+	// Start over from now instead of catching up on every deadline we slept through, and re-align to the display
+	const int64_t now_us = DriverClockUs();
+	for ( std::unique_ptr< ScheduledDevice > &scheduled : devices_ )
+	{
+		scheduled->next_due_us = static_cast< double >( now_us );
+		scheduled->request_time_us.store( 0, std::memory_order_relaxed );
+	}
+	display_check_time_us_ = 0;
+
+	DriverLog( "PoseScheduler: Resumed" );
+}
+
+void PoseScheduler::SchedulerThread()
+{
+	DriverLog( "PoseScheduler: Thread started for %zu devices", devices_.size() );
+	ApplyThreadTuning( "PoseScheduler", thread_tuning_ );
+
+	const int64_t start_us = DriverClockUs();
+	for ( std::unique_ptr< ScheduledDevice > &scheduled : devices_ )
+	{
+		scheduled->next_due_us = static_cast< double >( start_us );
+	}
+
+	while ( is_running_ )
+	{
+		if ( ShouldPark( DriverClockUs() ) )
+		{
+			Park();
+			continue;
+		}
+
+		const int64_t now_us = DriverClockUs();
+		UpdateDisplayAlignment( now_us );
+
+		double wake_time_us = static_cast< double >( now_us + k_unMaxSleepUs );
+		const HmdPose *hmd_pose = nullptr;
+
+		for ( std::unique_ptr< ScheduledDevice > &scheduled : devices_ )
+		{
+			const int64_t request_time_us = scheduled->request_time_us.exchange( 0, std::memory_order_relaxed );
+			const bool deadline_passed = now_us >= scheduled->next_due_us;
+
+			if ( deadline_passed || request_time_us != 0 )
+			{
+				// Fetched for the first device that's due, every other one this tick gets the same pose
+				if ( hmd_pose == nullptr )
+				{
+					hmd_pose = &hmd_pose_cache_.Refresh();
+				}
+
+				const double target_time_us = request_time_us != 0 && ( !deadline_passed || request_time_us < scheduled->next_due_us ) ? request_time_us : scheduled->next_due_us;
+				scheduled->device->SubmitScheduledPose( *hmd_pose, static_cast< int64_t >( now_us - target_time_us ) );
+
+				if ( deadline_passed )
+				{
+					// Absolute deadlines, so the rate doesn't drift by however long each tick took
+					scheduled->next_due_us += scheduled->period_us;
+				}
+				else if ( frame_period_us_ > 0.0 )
+				{
+					// Submitted early on request. Skip the grid points that are less than a period away, but stay on the grid.
+					while ( scheduled->next_due_us < now_us + scheduled->period_us )
+					{
+						scheduled->next_due_us += scheduled->period_us;
+					}
+				}
+				else
+				{
+					// Submitted early on request, the next one is only needed a full period later
+					scheduled->next_due_us = now_us + scheduled->period_us;
+				}
+
+				// Skip ahead if we fell more than a period behind, rather than submitting a burst to catch up
+				while ( scheduled->next_due_us <= now_us )
+				{
+					scheduled->next_due_us += scheduled->period_us;
+				}
+			}
+
+			wake_time_us = std::min( wake_time_us, scheduled->next_due_us );
+		}
+
+		// Sleep until the next device is due, or a device asks to be submitted
+		const int64_t deadline_us = static_cast< int64_t >( std::ceil( wake_time_us ) );
+		const bool woken_early = WaitUntil( deadline_us );
+		wakeup_count_.fetch_add( 1, std::memory_order_relaxed );
+
+		if ( !woken_early && pipeline_stats_ != nullptr )
+		{
+			pipeline_stats_->SchedulerWakeLateUs().Record( DriverClockUs() - deadline_us );
+		}
+	}
+
+	DriverLog( "PoseScheduler: Thread stopped" );
+}
@@ -0,0 +1,140 @@
+//============ Copyright (c) Valve Corporation, All rights reserved. ============
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "hmd_pose_cache.h"
+#include "openvr_driver.h"
+#include "pipeline_stats.h"
+#include "thread_tuning.h"
+
+//-----------------------------------------------------------------------------
+// Purpose: A device whose poses the PoseScheduler submits.
+//-----------------------------------------------------------------------------
+class IScheduledPoseDevice
+{
+public:
+	// Called on the scheduler thread when the device is due. hmd_pose is fetched once per tick for every device,
+	// nLateUs is how much later than its deadline (or its submit request) the device got its turn.
+	virtual void SubmitScheduledPose( const HmdPose &hmd_pose, int64_t nLateUs ) = 0;
+
+	// Called on the scheduler thread right before it parks, the last pose until it resumes.
+	// The device should report itself as not tracking, rather than leave its last pose frozen in place.
+	virtual void SubmitIdlePose( const HmdPose &hmd_pose ) = 0;
+};
+
+//-----------------------------------------------------------------------------
+// Purpose: Submits the poses of every device from one thread. Each device has its own period and is paced
+// on absolute deadlines, the thread only wakes up when the next device is due or one asks to be submitted
+// right away. Whatever the devices share (the hmd pose) is fetched and decoded once per tick.
+//
+// With display alignment on, the deadlines are laid on the headset's refresh: periods are rounded to a whole
+// fraction or multiple of a frame, and every deadline falls a fixed phase after a vsync, so the compositor
+// always gets poses of the same age instead of ones that beat against its frames.
+//
+// Without new hand data for the idle timeout, or while SteamVR is in standby, the thread parks: it stops
+// ticking and fetching the hmd pose and sleeps until NotifyActivity() or SetStandby( false ) wakes it.
+//-----------------------------------------------------------------------------
+class PoseScheduler
+{
+public:
+	PoseScheduler();
+	~PoseScheduler();
+
+	// Call before Start(). The device is submitted every nPeriodUs, and, if bSubmitOnRequest, whenever
+	// RequestSubmit() asks for it. Returns the slot to pass to RequestSubmit().
+	size_t AddDevice( IScheduledPoseDevice *device, int64_t nPeriodUs, bool bSubmitOnRequest );
+
+	// Call before Start(). Aligns the deadlines to the hmd's vsync, fPhaseOffsetMs after it.
+	// Until the hmd reports its display frequency the requested periods are used as they are.
+	void SetDisplayAlignment( bool bEnable, float fPhaseOffsetMs );
+
+	// Call before Start(). The scheduler thread records its wake-up lateness into stats.
+	void SetPipelineStats( PipelineStats *stats );
+
+	// Call before Start(). Core pinning and priority for the scheduler thread.
+	void SetThreadTuning( const ThreadTuning &tuning );
+
+	// Call before Start(). Park after nIdleTimeoutUs without NotifyActivity(), 0 never parks for lack of data.
+	void SetIdleTimeout( int64_t nIdleTimeoutUs );
+
+	void Start();
+	void Stop();
+
+	// Any thread: submit the device's pose as soon as possible. Its next deadline is then a full period later.
+	void RequestSubmit( size_t unSlot );
+
+	// Any thread: new hand data arrived. Cheap unless the thread is parked, then it resumes.
+	void NotifyActivity();
+
+	// Any thread: SteamVR entered or left standby. Parks the thread while in standby.
+	void SetStandby( bool bStandby );
+
+	bool IsParked() const;
+
+	// Times the scheduler thread has woken up
+	uint64_t GetWakeupCount() const;
+
+	// Refreshed on every tick that submits a device, any thread may read it
+	const HmdPoseCache &GetHmdPoseCache() const;
+
+private:
+	struct ScheduledDevice
+	{
+		IScheduledPoseDevice *device;
+		int64_t requested_period_us;
+
+		// Only touched by the scheduler thread. Fractional, so display aligned deadlines stay on the vsync grid.
+		double period_us;
+		double next_due_us;
+
+		// When RequestSubmit() was first called since the last submit, 0 if it wasn't
+		std::atomic< int64_t > request_time_us{ 0 };
+	};
+
+	void SchedulerThread();
+	void UpdateDisplayAlignment( int64_t nNowUs );
+	bool WaitUntil( int64_t nWakeTimeUs );
+	bool ShouldPark( int64_t nNowUs ) const;
+	void Park();
+
+	std::vector< std::unique_ptr< ScheduledDevice > > devices_;
+
+	HmdPoseCache hmd_pose_cache_;
+
+	std::atomic< bool > is_running_;
+	std::thread scheduler_thread_;
+
+	// RequestSubmit() wakes the scheduler thread through these.
+	// Without any device that submits on request, the thread sleeps on absolute deadlines with clock_nanosleep instead.
+	std::mutex wake_mutex_;
+	std::condition_variable wake_cv_;
+	bool wake_pending_;
+	bool has_request_devices_;
+
+	// Display alignment, only touched by the scheduler thread after Start()
+	bool align_to_display_;
+	double display_phase_offset_us_;
+	double frame_period_us_;  // 0 while not aligned
+	double vsync_time_us_;	  // A vsync on the driver clock
+	int64_t display_check_time_us_;
+
+	PipelineStats *pipeline_stats_;
+	ThreadTuning thread_tuning_;
+
+	// Parking. NotifyActivity() writes the activity time and then checks is_parked_, Park() sets is_parked_ and
+	// then checks the activity time, both sequentially consistent, so one of them always sees the other.
+	int64_t idle_timeout_us_;
+	std::atomic< int64_t > activity_time_us_;
+	std::atomic< bool > is_standby_;
+	std::atomic< bool > is_parked_;
+
+	std::atomic< uint64_t > wakeup_count_;
+};
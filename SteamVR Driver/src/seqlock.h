@@ -0,0 +1,86 @@
+//============ Copyright (c) Valve Corporation, All rights reserved. ============
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+
+//-----------------------------------------------------------------------------
+// Purpose: Publishes a small trivially copyable value from one writer thread to any number of readers.
+// The writer never waits. A reader that overlaps a write retries, so it always gets one complete value,
+// never a mix of two. The value is kept in relaxed atomic words, so concurrent access is well defined.
+//-----------------------------------------------------------------------------
+template < typename T >
+class alignas( 64 ) Seqlock
+{
+	static_assert( std::is_trivially_copyable< T >::value, "Seqlock values are copied word by word" );
+	static_assert( sizeof( T ) % sizeof( uint32_t ) == 0, "Seqlock values must be a whole number of words" );
+
+public:
+	explicit Seqlock( const T &initial = T() )
+		: sequence_( 0 )
+	{
+		StoreWords( initial );
+	}
+
+	// Only one thread may call Store()
+	void Store( const T &value )
+	{
+		const uint32_t sequence = sequence_.load( std::memory_order_relaxed );
+
+		// Odd while writing
+		sequence_.store( sequence + 1, std::memory_order_relaxed );
+		std::atomic_thread_fence( std::memory_order_release );
+
+		StoreWords( value );
+
+		sequence_.store( sequence + 2, std::memory_order_release );
+	}
+
+	T Load() const
+	{
+		uint32_t words[ k_unWordCount ];
+
+		for ( ;; )
+		{
+			const uint32_t sequence_before = sequence_.load( std::memory_order_acquire );
+			if ( sequence_before & 1 )
+			{
+				continue;
+			}
+
+			for ( size_t i = 0; i < k_unWordCount; i++ )
+			{
+				words[ i ] = words_[ i ].load( std::memory_order_relaxed );
+			}
+
+			std::atomic_thread_fence( std::memory_order_acquire );
+			if ( sequence_.load( std::memory_order_relaxed ) == sequence_before )
+			{
+				break;
+			}
+		}
+
+		T value;
+		memcpy( &value, words, sizeof( value ) );
+		return value;
+	}
+
+private:
+	static constexpr size_t k_unWordCount = sizeof( T ) / sizeof( uint32_t );
+
+	void StoreWords( const T &value )
+	{
+		uint32_t words[ k_unWordCount ];
+		memcpy( words, &value, sizeof( value ) );
+
+		for ( size_t i = 0; i < k_unWordCount; i++ )
+		{
+			words_[ i ].store( words[ i ], std::memory_order_relaxed );
+		}
+	}
+
+	std::atomic< uint32_t > sequence_;
+	std::atomic< uint32_t > words_[ k_unWordCount ];
+};
@@ -0,0 +1,225 @@
+//============ Copyright (c) Valve Corporation, All rights reserved. ============
+#include "shared_memory_ring.h"
+
+#include <cstddef>
+#include <cstring>
+#include <string>
+
+#ifdef __linux__
+#include <fcntl.h>
+#include <linux/futex.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+#endif
+
+static_assert( sizeof( std::atomic< uint32_t > ) == 4 && sizeof( std::atomic< uint64_t > ) == 8, "Shared memory atomics must be plain words" );
+
+// The seqlock value of a slot once sample unIndex has been completely written to it.
+// Encoding the index lets the reader tell an up to date slot from one the writer has lapped.
+static uint32_t SlotSequenceForIndex( uint64_t unIndex )
+{
+	return static_cast< uint32_t >( unIndex * 2 + 2 );
+}
+
+SharedMemoryRing::SharedMemoryRing()
+	: header_( nullptr )
+	, slots_( nullptr )
+	, mapping_size_( 0 )
+	, read_index_( 0 )
+	, overrun_count_( 0 )
+{
+	static_assert( offsetof( Header, write_index ) == 16 && offsetof( Header, wake_word ) == 24, "Header layout doesn't match shm_client.py" );
+	static_assert( sizeof( Header ) <= k_unShmRingHeaderSize, "Header doesn't fit" );
+	static_assert( sizeof( Slot ) == k_unShmRingSlotSize, "Slot layout doesn't match shm_client.py" );
+}
+
+SharedMemoryRing::~SharedMemoryRing()
+{
+	Close();
+}
+
+bool SharedMemoryRing::Open( const char *pchName, bool bCreate )
+{
+#ifdef __linux__
+	Close();
+
+	const std::string path = std::string( "/dev/shm/" ) + pchName;
+	const size_t size = k_unShmRingHeaderSize + k_unShmRingSlotCount * k_unShmRingSlotSize;
+
+	int fd = open( path.c_str(), bCreate ? ( O_RDWR | O_CREAT ) : O_RDWR, 0600 );
+	if ( fd < 0 )
+	{
+		return false;
+	}
+
+	if ( bCreate && ftruncate( fd, static_cast< off_t >( size ) ) != 0 )
+	{
+		close( fd );
+		return false;
+	}
+
+	struct stat file_stat;
+	if ( fstat( fd, &file_stat ) != 0 || static_cast< size_t >( file_stat.st_size ) < size )
+	{
+		close( fd );
+		return false;
+	}
+
+	void *mapping = mmap( nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0 );
+	close( fd );
+	if ( mapping == MAP_FAILED )
+	{
+		return false;
+	}
+
+	Header *header = static_cast< Header * >( mapping );
+
+	if ( bCreate )
+	{
+		// Start from a clean ring. The magic goes in last, so a writer attaching meanwhile doesn't use a half set up header.
+		memset( mapping, 0, size );
+		header->version = k_unShmRingVersion;
+		header->slot_size = k_unShmRingSlotSize;
+		header->slot_count = k_unShmRingSlotCount;
+		std::atomic_thread_fence( std::memory_order_release );
+		header->magic = k_unShmRingMagic;
+	}
+	else if ( header->magic != k_unShmRingMagic || header->version != k_unShmRingVersion || header->slot_size != k_unShmRingSlotSize || header->slot_count != k_unShmRingSlotCount )
+	{
+		munmap( mapping, size );
+		return false;
+	}
+
+	header_ = header;
+	slots_ = reinterpret_cast< Slot * >( static_cast< uint8_t * >( mapping ) + k_unShmRingHeaderSize );
+	mapping_size_ = size;
+	read_index_ = header_->write_index.load( std::memory_order_acquire );
+	overrun_count_ = 0;
+	return true;
+#else
+	// Only implemented for Linux, callers fall back to sockets
+	return false;
+#endif
+}
+
+void SharedMemoryRing::Close()
+{
+#ifdef __linux__
+	if ( header_ != nullptr )
+	{
+		munmap( header_, mapping_size_ );
+	}
+#endif
+	header_ = nullptr;
+	slots_ = nullptr;
+	mapping_size_ = 0;
+}
+
+bool SharedMemoryRing::Read( HandSample &sample )
+{
+	for ( ;; )
+	{
+		const uint64_t write_index = header_->write_index.load( std::memory_order_acquire );
+		if ( read_index_ == write_index )
+		{
+			return false;
+		}
+
+		// If the writer lapped us, skip to the oldest slot it can't be writing to right now
+		if ( write_index - read_index_ >= k_unShmRingSlotCount )
+		{
+			const uint64_t skip_to = write_index - k_unShmRingSlotCount + 1;
+			overrun_count_ += skip_to - read_index_;
+			read_index_ = skip_to;
+		}
+
+		const Slot &slot = slots_[ read_index_ % k_unShmRingSlotCount ];
+		const uint32_t expected_sequence = SlotSequenceForIndex( read_index_ );
+
+		const uint32_t sequence_before = slot.sequence.load( std::memory_order_acquire );
+
+		size_t frame_size = 0;
+		const bool decoded = sequence_before == expected_sequence
+			&& DecodeHandSampleBinary( std::string_view( reinterpret_cast< const char * >( slot.frame ), sizeof( slot.frame ) ), sample, frame_size ) == HandFrameResult_Ok;
+
+		std::atomic_thread_fence( std::memory_order_acquire );
+		const uint32_t sequence_after = slot.sequence.load( std::memory_order_relaxed );
+
+		read_index_++;
+
+		// The writer got to this slot while we were reading it, the sample is gone
+		if ( !decoded || sequence_after != sequence_before )
+		{
+			overrun_count_++;
+			continue;
+		}
+
+		// The frame doesn't carry it, don't leave whatever the caller's sample held
+		sample.send_time_us = 0;
+		return true;
+	}
+}
+
+void SharedMemoryRing::Wait( uint32_t unTimeoutMs )
+{
+#ifdef __linux__
+	const uint32_t wake_word = header_->wake_word.load( std::memory_order_acquire );
+
+	header_->reader_waiting.store( 1, std::memory_order_seq_cst );
+
+	// Re-check after announcing ourselves, a publish before this point would otherwise be missed until the timeout
+	if ( header_->write_index.load( std::memory_order_seq_cst ) == read_index_ )
+	{
+		struct timespec timeout;
+		timeout.tv_sec = unTimeoutMs / 1000;
+		timeout.tv_nsec = static_cast< long >( unTimeoutMs % 1000 ) * 1000000;
+
+		// Not FUTEX_PRIVATE_FLAG, the writer is another process
+		syscall( SYS_futex, reinterpret_cast< uint32_t * >( &header_->wake_word ), FUTEX_WAIT, wake_word, &timeout, nullptr, 0 );
+	}
+
+	header_->reader_waiting.store( 0, std::memory_order_relaxed );
+#endif
+}
+
+void SharedMemoryRing::Wake()
+{
+#ifdef __linux__
+	if ( header_ == nullptr )
+	{
+		return;
+	}
+
+	header_->wake_word.fetch_add( 1, std::memory_order_release );
+	syscall( SYS_futex, reinterpret_cast< uint32_t * >( &header_->wake_word ), FUTEX_WAKE, 1, nullptr, nullptr, 0 );
+#endif
+}
+
+void SharedMemoryRing::Write( const HandSample &sample )
+{
+	const uint64_t index = header_->write_index.load( std::memory_order_relaxed );
+	Slot &slot = slots_[ index % k_unShmRingSlotCount ];
+
+	// Odd while writing
+	slot.sequence.store( SlotSequenceForIndex( index ) - 1, std::memory_order_relaxed );
+	std::atomic_thread_fence( std::memory_order_release );
+
+	// Only writes the frame's own field bits, HandSampleField_SendTime never reaches the reader
+	EncodeHandSampleBinary( sample, slot.frame );
+
+	slot.sequence.store( SlotSequenceForIndex( index ), std::memory_order_release );
+	header_->write_index.store( index + 1, std::memory_order_seq_cst );
+
+	// Only pay for the syscall when the reader is actually asleep
+	if ( header_->reader_waiting.load( std::memory_order_seq_cst ) )
+	{
+		Wake();
+	}
+	else
+	{
+		header_->wake_word.fetch_add( 1, std::memory_order_release );
+	}
+}
@@ -0,0 +1,85 @@
+//============ Copyright (c) Valve Corporation, All rights reserved. ============
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+
+#include "hand_protocol.h"
+
+// Shared memory layout, must match utils/shm_client.py:
+//
+//   header (64 bytes)
+//        0     4  magic (k_unShmRingMagic)
+//        4     2  version
+//        6     2  slot size in bytes
+//        8     4  slot count
+//       12     4  reader waiting flag, set while the reader sleeps on the wake word
+//       16     8  write index, number of samples ever published
+//       24     4  wake word, bumped by the writer after every publish (futex)
+//   slots (slot count * 64 bytes), sample n lives in slot n % slot count
+//        0     4  seqlock counter, odd while the slot is being written
+//        4    56  binary hand frame (see hand_protocol.h)
+// A frame has no send time and the slot has no room left for one, so samples go through the ring without it.
+static constexpr uint32_t k_unShmRingMagic = 0x4D534348; // "HCSM"
+static constexpr uint16_t k_unShmRingVersion = 1;
+static constexpr uint32_t k_unShmRingSlotCount = 64;
+static constexpr uint32_t k_unShmRingSlotSize = 64;
+static constexpr uint32_t k_unShmRingHeaderSize = 64;
+
+//-----------------------------------------------------------------------------
+// Purpose: A single producer, single consumer ring of hand samples in a file under /dev/shm.
+// Every slot is protected by its own seqlock, so the reader never blocks the writer
+// and a slot overwritten while it's being read is simply read again.
+//-----------------------------------------------------------------------------
+class SharedMemoryRing
+{
+public:
+	SharedMemoryRing();
+	~SharedMemoryRing();
+
+	// Maps /dev/shm/<name>. The reader creates (or reinitialises) it, writers only attach to an existing ring.
+	bool Open( const char *pchName, bool bCreate );
+	void Close();
+	bool IsOpen() const { return header_ != nullptr; }
+
+	// Reader: decodes the next unread sample into sample, never with a send time. Returns false when the reader has caught up.
+	bool Read( HandSample &sample );
+
+	// Reader: sleeps until the writer publishes or unTimeoutMs passes. Returns immediately if data is waiting.
+	void Wait( uint32_t unTimeoutMs );
+
+	// Wakes a reader sleeping in Wait(), eg. when shutting down
+	void Wake();
+
+	// Writer: publishes one sample. Its send time, if it has one, is dropped.
+	void Write( const HandSample &sample );
+
+	// Samples the reader missed because the writer lapped it
+	uint64_t OverrunCount() const { return overrun_count_; }
+
+private:
+	struct Header
+	{
+		uint32_t magic;
+		uint16_t version;
+		uint16_t slot_size;
+		uint32_t slot_count;
+		std::atomic< uint32_t > reader_waiting;
+		std::atomic< uint64_t > write_index;
+		std::atomic< uint32_t > wake_word;
+	};
+
+	struct alignas( 64 ) Slot
+	{
+		std::atomic< uint32_t > sequence;
+		uint8_t frame[ k_unHandFrameSize ];
+	};
+
+	Header *header_;
+	Slot *slots_;
+	size_t mapping_size_;
+
+	// Reader position, only touched by the reading thread
+	uint64_t read_index_;
+	uint64_t overrun_count_;
+};
@@ -0,0 +1,105 @@
+//============ Copyright (c) Valve Corporation, All rights reserved. ============
+#include "thread_tuning.h"
+
+#include "driverlog.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <pthread.h>
+#include <sched.h>
+#include <sys/resource.h>
+#include <unistd.h>
+#endif
+
+#ifdef __linux__
+#include <sys/syscall.h>
+#endif
+
+static void PinThread( const char *pchThreadName, int32_t nCore )
+{
+#ifdef _WIN32
+	if ( nCore >= 64 || SetThreadAffinityMask( GetCurrentThread(), DWORD_PTR( 1 ) << nCore ) == 0 )
+	{
+		DriverLog( "%s: Can't pin the thread to core %d, leaving it unpinned", pchThreadName, nCore );
+		return;
+	}
+#elif defined( __linux__ )
+	if ( nCore >= CPU_SETSIZE )
+	{
+		DriverLog( "%s: Can't pin the thread to core %d, leaving it unpinned", pchThreadName, nCore );
+		return;
+	}
+
+	cpu_set_t cpu_set;
+	CPU_ZERO( &cpu_set );
+	CPU_SET( nCore, &cpu_set );
+	const int error = pthread_setaffinity_np( pthread_self(), sizeof( cpu_set ), &cpu_set );
+	if ( error != 0 )
+	{
+		DriverLog( "%s: Can't pin the thread to core %d (%s), leaving it unpinned", pchThreadName, nCore, strerror( error ) );
+		return;
+	}
+#else
+	DriverLog( "%s: Pinning threads isn't supported here, leaving it unpinned", pchThreadName );
+	return;
+#endif
+
+	DriverLog( "%s: Pinned to core %d", pchThreadName, nCore );
+}
+
+static void RaisePriority( const char *pchThreadName, int32_t nPriority )
+{
+#ifdef _WIN32
+	const int thread_priority = nPriority >= 50 ? THREAD_PRIORITY_TIME_CRITICAL : THREAD_PRIORITY_HIGHEST;
+	if ( !SetThreadPriority( GetCurrentThread(), thread_priority ) )
+	{
+		DriverLog( "%s: Can't raise the thread priority, running at normal priority", pchThreadName );
+		return;
+	}
+
+	DriverLog( "%s: Running at %s priority", pchThreadName, thread_priority == THREAD_PRIORITY_TIME_CRITICAL ? "time critical" : "highest" );
+#else
+	sched_param param{};
+	param.sched_priority = std::clamp( static_cast< int >( nPriority ), sched_get_priority_min( SCHED_FIFO ), sched_get_priority_max( SCHED_FIFO ) );
+	const int error = pthread_setschedparam( pthread_self(), SCHED_FIFO, &param );
+	if ( error == 0 )
+	{
+		DriverLog( "%s: Running SCHED_FIFO at priority %d", pchThreadName, param.sched_priority );
+		return;
+	}
+
+#ifdef __linux__
+	// Without the rights for real-time scheduling we may still be allowed to lower our nice value (RLIMIT_NICE).
+	// On Linux that works per thread, through the thread id.
+	const id_t thread_id = static_cast< id_t >( syscall( SYS_gettid ) );
+	for ( int nice_value = -20; nice_value < 0; nice_value += 5 )
+	{
+		if ( setpriority( PRIO_PROCESS, thread_id, nice_value ) == 0 )
+		{
+			DriverLog( "%s: SCHED_FIFO not allowed (%s), running at nice %d instead", pchThreadName, strerror( error ), nice_value );
+			return;
+		}
+	}
+#endif
+
+	DriverLog( "%s: SCHED_FIFO not allowed (%s), running at normal priority", pchThreadName, strerror( error ) );
+#endif
+}
+
+void ApplyThreadTuning( const char *pchThreadName, const ThreadTuning &tuning )
+{
+	if ( tuning.cpu_core >= 0 )
+	{
+		PinThread( pchThreadName, tuning.cpu_core );
+	}
+
+	if ( tuning.priority > 0 )
+	{
+		RaisePriority( pchThreadName, tuning.priority );
+	}
+}
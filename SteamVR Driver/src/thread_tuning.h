@@ -0,0 +1,20 @@
+//============ Copyright (c) Valve Corporation, All rights reserved. ============
+#pragma once
+
+#include <cstdint>
+
+// How one of our threads should be scheduled, from the driver settings
+struct ThreadTuning
+{
+	// Core to pin the thread to, -1 leaves it to the OS
+	int32_t cpu_core = -1;
+
+	// 0 is normal priority. 1-99 asks for SCHED_FIFO at that priority on Linux, and for a raised
+	// thread priority on Windows (THREAD_PRIORITY_TIME_CRITICAL from 50 up, THREAD_PRIORITY_HIGHEST below).
+	int32_t priority = 0;
+};
+
+// Applies tuning to the calling thread. Whatever the OS doesn't allow (no CAP_SYS_NICE or RLIMIT_RTPRIO,
+// a core that doesn't exist) is logged and left as it was, the thread keeps running either way.
+// On Linux a refused SCHED_FIFO falls back to the lowest nice value we're allowed.
+void ApplyThreadTuning( const char *pchThreadName, const ThreadTuning &tuning );
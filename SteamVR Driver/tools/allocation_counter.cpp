@@ -0,0 +1,48 @@
+//============ Copyright (c) Valve Corporation, All rights reserved. ============
+#include "allocation_counter.h"
+
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+static std::atomic< uint64_t > g_unAllocationCount{ 0 };
+
+uint64_t AllocationCount()
+{
+	return g_unAllocationCount.load( std::memory_order_relaxed );
+}
+
+void *operator new( size_t unSize )
+{
+	g_unAllocationCount.fetch_add( 1, std::memory_order_relaxed );
+	if ( void *memory = malloc( unSize != 0 ? unSize : 1 ) )
+	{
+		return memory;
+	}
+	throw std::bad_alloc();
+}
+
+void *operator new[]( size_t unSize )
+{
+	return operator new( unSize );
+}
+
+void operator delete( void *memory ) noexcept
+{
+	free( memory );
+}
+
+void operator delete[]( void *memory ) noexcept
+{
+	free( memory );
+}
+
+void operator delete( void *memory, size_t ) noexcept
+{
+	free( memory );
+}
+
+void operator delete[]( void *memory, size_t ) noexcept
+{
+	free( memory );
+}
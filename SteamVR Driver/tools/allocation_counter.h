@@ -0,0 +1,11 @@
+//============ Copyright (c) Valve Corporation, All rights reserved. ============
+#pragma once
+
+#include <cstdint>
+
+// Replaces the global operator new and delete of whichever tool links allocation_counter.cpp, so every heap
+// allocation in the process is counted and a benchmark can tell what the code it measures allocates. Only the
+// benchmarks that report allocations link it, see CMakeLists.txt.
+
+// Heap allocations made so far, by any thread
+uint64_t AllocationCount();
@@ -0,0 +1,440 @@
+//============ Copyright (c) Valve Corporation, All rights reserved. ============
+// Runs the whole driver in-process against MockDriverContext, feeds HandTrackingListener from a synthetic
+// producer (SyntheticHandSource) over loopback or shared memory, and prints what that cost and how quickly
+// poses followed as one JSON object:
+//
+//	driver_benchmark [--transport tcp|udp|shm] [--protocol binary|text] [--rate-hz 200] [--hands 2]
+//		[--motion circle|random_walk|flick] [--seed 1] [--dropout-rate-hz 0] [--swap-interval-s 0]
+//		[--duration-s 10] [--warmup-s 1] [--report-s 0] [--submit-mode fixed|on_sample] [--pose-rate-hz 200]
+//		[--display-hz 90] [--port 65500] [--settings resources/settings/default.vrsettings] [--output benchmark.json] [--verbose]
+//
+// Each camera frame is one batch of --hands samples. The driver has two hands, so hands beyond
+// the second are extra samples of the same two in the same frame, which the listener has to coalesce.
+// Latencies are over the whole run, CPU time and allocations over the run after the warmup.
+// With --report-s it's a soak test: every that many seconds after the warmup, one JSON line on stderr with
+// the process's resident memory and the latencies of that interval, so leaks and drift show up over hours.
+// POSIX only, like the CI boxes it's meant for.
+
+#include "allocation_counter.h"
+#include "device_provider.h"
+#include "driver_clock.h"
+#include "hand_protocol.h"
+#include "hand_stream_sender.h"
+#include "mock_vr_host.h"
+#include "synthetic_hand_source.h"
+#include "tool_clock.h"
+#include "tool_options.h"
+
+#include <pthread.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <thread>
+
+// Our own ring, so a driver running on the same machine isn't disturbed
+static const char *benchmark_shm_name = "handcameradriver_benchmark";
+
+struct BenchmarkOptions
+{
+	HandTransport transport = HandTransport_Tcp;
+	HandStreamProtocol protocol = HandStreamProtocol_Binary;
+	double rate_hz = 200.0;
+	uint32_t hands = 2;
+	SyntheticMotion motion = SyntheticMotion_Circle;
+	uint64_t seed = 1;
+	double dropout_rate_hz = 0.0;
+	double swap_interval_s = 0.0;
+	double duration_s = 10.0;
+	double warmup_s = 1.0;
+	double report_s = 0.0; // 0 doesn't report until the end
+	const char *submit_mode = "fixed";
+	double pose_rate_hz = 0.0; // 0 leaves the settings file's
+	double display_hz = 90.0;
+	int port = 65500;
+	const char *settings_path = "resources/settings/default.vrsettings";
+	const char *output_path = nullptr;
+	bool is_verbose = false;
+};
+
+// What the producer sent, per hand
+struct ProducerCounters
+{
+	std::atomic< uint64_t > sent[ HandId_MAX ] = {};
+	std::atomic< uint64_t > send_failures{ 0 };
+};
+
+static void PrintUsage()
+{
+	fprintf( stderr,
+		"usage: driver_benchmark [--transport tcp|udp|shm] [--protocol binary|text] [--rate-hz 200] [--hands 2]\n"
+		"                        [--motion circle|random_walk|flick] [--seed 1] [--dropout-rate-hz 0] [--swap-interval-s 0]\n"
+		"                        [--duration-s 10] [--warmup-s 1] [--report-s 0] [--submit-mode fixed|on_sample]\n"
+		"                        [--pose-rate-hz 200] [--display-hz 90] [--port 65500]\n"
+		"                        [--settings resources/settings/default.vrsettings] [--output file] [--verbose]\n" );
+}
+
+static bool ParseOptions( int argc, char **argv, BenchmarkOptions &options )
+{
+	ToolOptionParser parser( "driver_benchmark", argc, argv );
+	while ( parser.Next() )
+	{
+		const char *name = nullptr;
+		if ( parser.Value( "--transport", name ) )
+		{
+			if ( name != nullptr && !HandTransportFromName( name, options.transport ) )
+			{
+				parser.Invalid( "tcp, udp or shm" );
+			}
+		}
+		else if ( parser.Value( "--protocol", name ) )
+		{
+			if ( name != nullptr && !HandStreamProtocolFromName( name, options.protocol ) )
+			{
+				parser.Invalid( "binary or text" );
+			}
+		}
+		else if ( parser.Value( "--motion", name ) )
+		{
+			if ( name != nullptr && !SyntheticMotionFromName( name, options.motion ) )
+			{
+				parser.Invalid( "circle, random_walk or flick" );
+			}
+		}
+		else if ( !parser.Flag( "--verbose", options.is_verbose ) && !parser.Value( "--rate-hz", options.rate_hz ) && !parser.Value( "--hands", options.hands ) &&
+				  !parser.Value( "--seed", options.seed ) && !parser.Value( "--dropout-rate-hz", options.dropout_rate_hz ) &&
+				  !parser.Value( "--swap-interval-s", options.swap_interval_s ) && !parser.Value( "--duration-s", options.duration_s ) &&
+				  !parser.Value( "--warmup-s", options.warmup_s ) && !parser.Value( "--report-s", options.report_s ) && !parser.Value( "--submit-mode", options.submit_mode ) &&
+				  !parser.Value( "--pose-rate-hz", options.pose_rate_hz ) && !parser.Value( "--display-hz", options.display_hz ) && !parser.Value( "--port", options.port ) &&
+				  !parser.Value( "--settings", options.settings_path ) && !parser.Value( "--output", options.output_path ) )
+		{
+			parser.Unknown();
+		}
+	}
+	if ( !parser.IsValid() )
+	{
+		return false;
+	}
+
+	if ( options.rate_hz <= 0.0 || options.rate_hz > 100000.0 || options.hands < 1 || options.hands > k_unHandBatchMaxHands || options.duration_s <= 0.0 ||
+		 options.warmup_s < 0.0 || options.warmup_s >= options.duration_s || options.report_s < 0.0 || options.port <= 0 || options.port > 65535 )
+	{
+		fprintf( stderr, "driver_benchmark: Rate, hands (1-%zu), duration, warmup (shorter than the duration), report interval or port out of range\n",
+			k_unHandBatchMaxHands );
+		return false;
+	}
+
+	// The ring only carries binary frames
+	if ( options.transport == HandTransport_SharedMemory )
+	{
+		options.protocol = HandStreamProtocol_Binary;
+	}
+	return true;
+}
+
+// Resident memory of this process, kilobytes. 0 where /proc isn't there.
+static long ResidentKb()
+{
+	long pages = 0;
+	long resident_pages = 0;
+	FILE *statm = fopen( "/proc/self/statm", "r" );
+	if ( statm == nullptr )
+	{
+		return 0;
+	}
+	if ( fscanf( statm, "%ld %ld", &pages, &resident_pages ) != 2 )
+	{
+		resident_pages = 0;
+	}
+	fclose( statm );
+	return resident_pages * ( sysconf( _SC_PAGESIZE ) / 1024 );
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: One camera frame of options.hands samples every 1 / rate_hz seconds on absolute deadlines,
+// until nEndTimeUs, from SyntheticHandSource. Stamped on the driver clock, as a producer that has synced its clock would.
+//-----------------------------------------------------------------------------
+static void RunProducer( HandStreamSender &sender, const BenchmarkOptions &options, int64_t nEndTimeUs, ProducerCounters &counters )
+{
+	SyntheticHandOptions source_options;
+	source_options.motion = options.motion;
+	source_options.seed = options.seed;
+	source_options.frame_rate_hz = options.rate_hz;
+	source_options.hand_count = options.hands;
+	source_options.dropout_rate_hz = options.dropout_rate_hz;
+	source_options.swap_interval_s = options.swap_interval_s;
+	SyntheticHandSource source( source_options );
+
+	const double period_us = 1000000.0 / options.rate_hz;
+	const int64_t start_time_us = DriverClockUs();
+	HandSampleBatch batch{};
+
+	for ( uint32_t frame = 0;; frame++ )
+	{
+		const int64_t due_time_us = start_time_us + static_cast< int64_t >( frame * period_us );
+		if ( due_time_us >= nEndTimeUs )
+		{
+			break;
+		}
+		SleepUntilUs( due_time_us );
+
+		source.Generate( frame, DriverClockUs(), batch );
+		if ( batch.hand_count == 0 )
+		{
+			continue;
+		}
+
+		if ( !sender.Send( batch ) )
+		{
+			counters.send_failures.fetch_add( 1, std::memory_order_relaxed );
+			continue;
+		}
+
+		for ( uint32_t i = 0; i < batch.hand_count; i++ )
+		{
+			counters.sent[ batch.hands[ i ].hand ].fetch_add( 1, std::memory_order_relaxed );
+		}
+	}
+}
+
+// Latency sums and counts at the last soak report, so the next one can tell the interval's means
+struct SoakSnapshot
+{
+	int64_t time_us;
+	uint64_t received;
+	uint64_t lost;
+	uint64_t latency_count[ HandId_MAX ][ LatencyStage_MAX ];
+	double latency_sum_us[ HandId_MAX ][ LatencyStage_MAX ];
+};
+
+static void TakeSoakSnapshot( PipelineStats &stats, const HandTrackingListener &listener, SoakSnapshot &snapshot )
+{
+	snapshot.time_us = DriverClockUs();
+	snapshot.received = 0;
+	snapshot.lost = 0;
+	for ( int hand = 0; hand < HandId_MAX; hand++ )
+	{
+		const HandStreamCounters counters = listener.GetStreamCounters( static_cast< HandId >( hand ) );
+		snapshot.received += counters.received;
+		snapshot.lost += counters.lost;
+
+		for ( int stage = 0; stage < LatencyStage_MAX; stage++ )
+		{
+			const LatencyHistogram &histogram = stats.Hand( static_cast< HandId >( hand ) ).latency_us[ stage ];
+			snapshot.latency_count[ hand ][ stage ] = histogram.Count();
+			snapshot.latency_sum_us[ hand ][ stage ] = histogram.Mean() * static_cast< double >( histogram.Count() );
+		}
+	}
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: One soak report line: memory, throughput and losses since the last report, per hand the mean latencies
+// of the interval and the p99 since the start. A mean that creeps up, or memory that keeps growing, is the finding.
+//-----------------------------------------------------------------------------
+static void PrintSoakReport( PipelineStats &stats, const HandTrackingListener &listener, int64_t nStartTimeUs, SoakSnapshot &last )
+{
+	SoakSnapshot now;
+	TakeSoakSnapshot( stats, listener, now );
+	const double interval_s = std::max( ( now.time_us - last.time_us ) * 1e-6, 1e-6 );
+
+	auto IntervalMeanUs = [ & ]( int hand, LatencyStage stage )
+	{
+		const uint64_t count = now.latency_count[ hand ][ stage ] - last.latency_count[ hand ][ stage ];
+		return count > 0 ? ( now.latency_sum_us[ hand ][ stage ] - last.latency_sum_us[ hand ][ stage ] ) / count : 0.0;
+	};
+
+	fprintf( stderr, "{\"t_s\":%.1f,\"rss_kb\":%ld,\"samples_per_sec\":%.1f,\"lost\":%llu", ( now.time_us - nStartTimeUs ) * 1e-6, ResidentKb(),
+		( now.received - last.received ) / interval_s, static_cast< unsigned long long >( now.lost - last.lost ) );
+	for ( int hand = 0; hand < HandId_MAX; hand++ )
+	{
+		const HandPipelineStats &hand_stats = stats.Hand( static_cast< HandId >( hand ) );
+		fprintf( stderr, ",\"%s\":{\"receive_to_submit_us\":%.1f,\"capture_to_submit_us\":%.1f,\"capture_to_submit_p99_us\":%lld}", hand == HandId_Left ? "left" : "right",
+			IntervalMeanUs( hand, LatencyStage_ReceiveToSubmit ), IntervalMeanUs( hand, LatencyStage_CaptureToSubmit ),
+			static_cast< long long >( hand_stats.latency_us[ LatencyStage_CaptureToSubmit ].Percentile( 0.99 ) ) );
+	}
+	fprintf( stderr, "}\n" );
+
+	last = now;
+}
+
+static void PrintHistogram( FILE *output, const char *pchKey, const LatencyHistogram &histogram )
+{
+	fprintf( output, "\"%s\":{\"n\":%llu,\"mean\":%.1f,\"p50\":%lld,\"p99\":%lld,\"p999\":%lld,\"max\":%lld}", pchKey,
+		static_cast< unsigned long long >( histogram.Count() ), histogram.Mean(), static_cast< long long >( histogram.Percentile( 0.5 ) ),
+		static_cast< long long >( histogram.Percentile( 0.99 ) ), static_cast< long long >( histogram.Percentile( 0.999 ) ), static_cast< long long >( histogram.Max() ) );
+}
+
+int main( int argc, char **argv )
+{
+	BenchmarkOptions options;
+	if ( !ParseOptions( argc, argv, options ) )
+	{
+		PrintUsage();
+		return 2;
+	}
+
+	MockDriverContext context;
+	context.GetDriverLog().SetEcho( options.is_verbose );
+	context.SetDisplayFrequency( static_cast< float >( options.display_hz ) );
+
+	MockSettings &settings = context.GetSettings();
+	if ( !LoadDriverSettings( "driver_benchmark", settings, options.settings_path ) )
+	{
+		return 1;
+	}
+	settings.SetInt32( driver_settings_section, "port", options.port );
+	settings.SetString( driver_settings_section, "transport", HandTransportName( options.transport ) );
+	settings.SetString( driver_settings_section, "shm_name", benchmark_shm_name );
+	settings.SetString( driver_settings_section, "pose_submit_mode", options.submit_mode );
+	if ( options.pose_rate_hz > 0.0 )
+	{
+		settings.SetFloat( driver_settings_section, "pose_rate_hz", static_cast< float >( options.pose_rate_hz ) );
+	}
+
+	MyDeviceProvider provider;
+	if ( provider.Init( &context ) != vr::VRInitError_None || provider.MyGetHandTrackingListener() == nullptr )
+	{
+		fprintf( stderr, "driver_benchmark: The driver failed to initialize\n" );
+		return 1;
+	}
+
+	RunFrameThread run_frame_thread( provider );
+
+	HandStreamSender sender;
+	if ( !sender.Open( options.transport, options.protocol, options.port, benchmark_shm_name, 1000 ) )
+	{
+		fprintf( stderr, "driver_benchmark: Can't connect to the listener (%s, port %d)\n", HandTransportName( options.transport ), options.port );
+		run_frame_thread.Stop();
+		context.GetServerDriverHost().DeactivateDevices();
+		provider.Cleanup();
+		return 1;
+	}
+
+	const HandTrackingListener &listener = *provider.MyGetHandTrackingListener();
+	auto ReceivedSamples = [ &listener ]()
+	{
+		return listener.GetStreamCounters( HandId_Left ).received + listener.GetStreamCounters( HandId_Right ).received;
+	};
+
+	ProducerCounters producer_counters;
+	const int64_t start_time_us = DriverClockUs();
+	const int64_t end_time_us = start_time_us + static_cast< int64_t >( options.duration_s * 1e6 );
+	std::thread producer_thread( [ & ]() { RunProducer( sender, options, end_time_us, producer_counters ); } );
+
+	clockid_t producer_clock;
+	pthread_getcpuclockid( producer_thread.native_handle(), &producer_clock );
+
+	// The measured window, everything but the producer and this thread is the driver (and the mock host's recording).
+	// Neither of them allocates in it, so every allocation counted is the driver's.
+	SleepUntilUs( start_time_us + static_cast< int64_t >( options.warmup_s * 1e6 ) );
+	const int64_t window_start_us = DriverClockUs();
+	const int64_t process_cpu_start_ns = CpuTimeNs( CLOCK_PROCESS_CPUTIME_ID );
+	const int64_t producer_cpu_start_ns = CpuTimeNs( producer_clock );
+	const int64_t main_cpu_start_ns = CpuTimeNs( CLOCK_THREAD_CPUTIME_ID );
+	const uint64_t allocations_start = AllocationCount();
+	const uint64_t received_start = ReceivedSamples();
+
+	PipelineStats &stats = *provider.MyGetPipelineStats();
+	if ( options.report_s > 0.0 )
+	{
+		SoakSnapshot last_report;
+		TakeSoakSnapshot( stats, listener, last_report );
+
+		const int64_t report_period_us = static_cast< int64_t >( options.report_s * 1e6 );
+		for ( int64_t report_time_us = window_start_us + report_period_us; report_time_us < end_time_us; report_time_us += report_period_us )
+		{
+			SleepUntilUs( report_time_us );
+			PrintSoakReport( stats, listener, start_time_us, last_report );
+		}
+	}
+
+	SleepUntilUs( end_time_us );
+	SleepUntilUs( end_time_us + k_unDrainTimeUs );
+
+	const int64_t window_end_us = DriverClockUs();
+	const int64_t process_cpu_ns = CpuTimeNs( CLOCK_PROCESS_CPUTIME_ID ) - process_cpu_start_ns;
+	const int64_t producer_cpu_ns = CpuTimeNs( producer_clock ) - producer_cpu_start_ns;
+	const int64_t main_cpu_ns = CpuTimeNs( CLOCK_THREAD_CPUTIME_ID ) - main_cpu_start_ns;
+	const uint64_t allocations = AllocationCount() - allocations_start;
+	const uint64_t window_samples = ReceivedSamples() - received_start;
+
+	producer_thread.join();
+	sender.Close();
+	run_frame_thread.Stop();
+
+	FILE *output = options.output_path != nullptr ? fopen( options.output_path, "w" ) : stdout;
+	if ( output == nullptr )
+	{
+		fprintf( stderr, "driver_benchmark: Can't write %s\n", options.output_path );
+		output = stdout;
+	}
+
+	const double window_s = ( window_end_us - window_start_us ) * 1e-6;
+	const double driver_cpu_ns = static_cast< double >( process_cpu_ns - producer_cpu_ns - main_cpu_ns );
+	const double sample_count = static_cast< double >( std::max< uint64_t >( window_samples, 1 ) );
+
+	fprintf( output,
+		"{\"config\":{\"transport\":\"%s\",\"protocol\":\"%s\",\"rate_hz\":%.1f,\"hands\":%u,\"motion\":\"%s\",\"seed\":%llu,\"dropout_rate_hz\":%.2f,"
+		"\"swap_interval_s\":%.1f,\"duration_s\":%.1f,\"warmup_s\":%.1f,\"submit_mode\":\"%s\",\"display_hz\":%.1f},",
+		HandTransportName( options.transport ), HandStreamProtocolName( options.protocol ), options.rate_hz, options.hands,
+		SyntheticMotionName( options.motion ), static_cast< unsigned long long >( options.seed ), options.dropout_rate_hz, options.swap_interval_s, options.duration_s,
+		options.warmup_s, options.submit_mode, options.display_hz );
+	fprintf( output, "\"cpu_ns_per_sample\":%.0f,\"cpu_percent\":%.2f,\"allocations_per_sample\":%.3f,\"send_failures\":%llu,", driver_cpu_ns / sample_count,
+		driver_cpu_ns / ( window_s * 1e7 ), allocations / sample_count, static_cast< unsigned long long >( producer_counters.send_failures.load() ) );
+
+	const MockRecordBuffer< MockPoseRecord > &poses = context.GetServerDriverHost().Poses();
+	for ( int hand = 0; hand < HandId_MAX; hand++ )
+	{
+		const HandStreamCounters counters = listener.GetStreamCounters( static_cast< HandId >( hand ) );
+		const uint64_t sent = producer_counters.sent[ hand ].load();
+		const vr::TrackedDeviceIndex_t device_index = hand == HandId_Left ? 1 : 2;
+
+		// Long runs wrap the host's pose record, the rate is over the part of the run it still holds
+		const int64_t pose_start_us = poses.Size() > 0 ? std::max( start_time_us, poses.At( 0 ).time_us ) : start_time_us;
+		uint64_t pose_count = 0;
+		for ( size_t i = 0; i < poses.Size(); i++ )
+		{
+			const MockPoseRecord &pose = poses.At( i );
+			pose_count += pose.device_index == device_index && pose.time_us >= pose_start_us && pose.time_us < end_time_us;
+		}
+		const double pose_span_s = std::max( ( end_time_us - pose_start_us ) * 1e-6, 1e-6 );
+
+		const HandPipelineStats &hand_stats = stats.Hand( static_cast< HandId >( hand ) );
+		fprintf( output,
+			"\"%s\":{\"sent\":%llu,\"received\":%llu,\"dropped\":%llu,\"lost\":%llu,\"reordered\":%llu,\"duplicates\":%llu,\"coalesced\":%llu,\"poses_per_sec\":%.1f,"
+			"\"input_updates\":%llu,\"input_updates_suppressed\":%llu,",
+			hand == HandId_Left ? "left" : "right", static_cast< unsigned long long >( sent ), static_cast< unsigned long long >( counters.received ),
+			static_cast< unsigned long long >( sent > counters.received ? sent - counters.received : 0 ), static_cast< unsigned long long >( counters.lost ),
+			static_cast< unsigned long long >( counters.reordered ), static_cast< unsigned long long >( counters.duplicates ),
+			static_cast< unsigned long long >( counters.coalesced ), pose_count / pose_span_s,
+			static_cast< unsigned long long >( hand_stats.input_updates.load() ), static_cast< unsigned long long >( hand_stats.input_updates_suppressed.load() ) );
+		PrintHistogram( output, "send_to_receive_us", hand_stats.latency_us[ LatencyStage_SendToReceive ] );
+		fputc( ',', output );
+		PrintHistogram( output, "receive_to_submit_us", hand_stats.latency_us[ LatencyStage_ReceiveToSubmit ] );
+		fputc( ',', output );
+		PrintHistogram( output, "capture_to_submit_us", hand_stats.latency_us[ LatencyStage_CaptureToSubmit ] );
+		fputc( ',', output );
+		PrintHistogram( output, "submit_jitter_us", hand_stats.submit_jitter_us );
+		fputs( "},", output );
+	}
+
+	// The driver's own snapshot, as DebugRequest( "stats" ) returns it
+	char driver_stats[ 8192 ];
+	if ( !stats.FormatJson( driver_stats, sizeof( driver_stats ) ) )
+	{
+		snprintf( driver_stats, sizeof( driver_stats ), "null" );
+	}
+	fprintf( output, "\"driver_stats\":%s}\n", driver_stats );
+
+	if ( output != stdout )
+	{
+		fclose( output );
+	}
+
+	context.GetServerDriverHost().DeactivateDevices();
+	provider.Cleanup();
+	return 0;
+}
@@ -0,0 +1,341 @@
+//============ Copyright (c) Valve Corporation, All rights reserved. ============
+// Floods events through MockDriverContext's event queue and times handing them to their devices, with the
+// EventDispatchTable against giving every event to every device like RunFrame() used to. Prints one JSON object:
+//
+//	event_benchmark [--devices 2,8,32] [--events 1000000] [--port 65508] [--settings resources/settings/default.vrsettings]
+//
+// Of every 64 events one is a haptic event for one of our devices and seven are other events for one of them; the
+// rest are haptic events for components and events for device indices that aren't ours, vrserver hands a driver
+// everyone's. A vendor specific event stands in for every event that isn't haptic. The events are queued with
+// QueueEvent() a queue full at a time and polled back with PollNextEvent().
+// For each device count, with that many controllers that were never activated:
+//
+//	dispatch_table  EventDispatchTable::Find(), then MyProcessEvent() on the device it found
+//	broadcast       every device looks at every event, and takes the haptic ones for its own component the way
+//	                MyProcessEvent() did before the table
+//
+// ns per event are less what polling the same events costs on its own. Then the whole driver runs with its two
+// controllers and the same flood goes through MyDeviceProvider::RunFrame(), less the cost of a RunFrame() without
+// events; every haptic event has to have been logged by the hand it was for.
+// Exits non-zero if an event reaches the wrong device or none, if the driver's hands log a different number of
+// haptic events than they were sent, or if from 16 devices on the table isn't quicker than the broadcast.
+//
+// POSIX only, like driver_benchmark.
+
+#include "controller_device_driver.h"
+#include "device_provider.h"
+#include "driver_clock.h"
+#include "event_dispatch_table.h"
+#include "mock_vr_host.h"
+#include "tool_options.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <memory>
+#include <string>
+#include <vector>
+
+// What the mock host's queue holds
+static constexpr uint32_t k_unQueueEvents = 256;
+
+// Most devices, vrserver has 64 tracked device slots and the foreign events use the top ones
+static constexpr uint32_t k_unMaxDevices = 32;
+static constexpr vr::TrackedDeviceIndex_t k_unForeignDeviceIndex = 48;
+
+// Stand-in controllers' haptic handles start here, handles nobody created from k_ulForeignHandle
+static constexpr vr::VRInputComponentHandle_t k_ulStandInHandle = 1000;
+static constexpr vr::VRInputComponentHandle_t k_ulForeignHandle = 5000;
+
+// From this many devices the table has to be quicker
+static constexpr uint32_t k_unMinDevicesTableQuicker = 16;
+
+struct EventTarget
+{
+	vr::TrackedDeviceIndex_t device_index;
+	vr::VRInputComponentHandle_t haptic_handle;
+};
+
+struct FloodResult
+{
+	double ns_per_event = 0.0;
+	uint64_t delivered = 0;
+	uint64_t misdelivered = 0;
+	uint64_t device_checks = 0;
+};
+
+//-----------------------------------------------------------------------------
+// Purpose: Event unIndex of the flood. Sets unTarget to the target it's for, or targets.size() if it's for none.
+//-----------------------------------------------------------------------------
+static vr::VREvent_t FloodEvent( uint64_t unIndex, const std::vector< EventTarget > &targets, size_t &unTarget )
+{
+	vr::VREvent_t vrevent{};
+	const uint32_t slot = static_cast< uint32_t >( unIndex % 64 );
+	const size_t target = static_cast< size_t >( ( unIndex / 64 * 7 + slot ) % targets.size() );
+
+	if ( slot == 0 )
+	{
+		vrevent.eventType = vr::VREvent_Input_HapticVibration;
+		vrevent.data.hapticVibration.componentHandle = targets[ target ].haptic_handle;
+		vrevent.data.hapticVibration.fDurationSeconds = 0.01f;
+		vrevent.data.hapticVibration.fFrequency = 160.f;
+		vrevent.data.hapticVibration.fAmplitude = 0.5f;
+		unTarget = target;
+	}
+	else if ( slot < 8 )
+	{
+		vrevent.eventType = vr::VREvent_VendorSpecific_Reserved_Start;
+		vrevent.trackedDeviceIndex = targets[ target ].device_index;
+		unTarget = target;
+	}
+	else if ( slot % 2 == 0 )
+	{
+		vrevent.eventType = vr::VREvent_Input_HapticVibration;
+		vrevent.data.hapticVibration.componentHandle = k_ulForeignHandle + slot;
+		unTarget = targets.size();
+	}
+	else
+	{
+		vrevent.eventType = vr::VREvent_VendorSpecific_Reserved_Start;
+		vrevent.trackedDeviceIndex = k_unForeignDeviceIndex + slot % 16;
+		unTarget = targets.size();
+	}
+	return vrevent;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Queues unEvents of the flood a queue full at a time and times dispatch( event, target ) on each
+// polled one. Returns the ns it took.
+//-----------------------------------------------------------------------------
+template < typename Dispatch >
+static int64_t Flood( MockServerDriverHost &host, const std::vector< EventTarget > &targets, uint64_t unEvents, Dispatch dispatch )
+{
+	std::vector< size_t > queued_targets( k_unQueueEvents );
+	int64_t elapsed_ns = 0;
+	for ( uint64_t first = 0; first < unEvents; first += k_unQueueEvents )
+	{
+		const uint32_t count = static_cast< uint32_t >( std::min< uint64_t >( k_unQueueEvents, unEvents - first ) );
+		for ( uint32_t i = 0; i < count; i++ )
+		{
+			host.QueueEvent( FloodEvent( first + i, targets, queued_targets[ i ] ) );
+		}
+
+		const int64_t start_ns = DriverClockNs();
+		vr::VREvent_t vrevent{};
+		for ( uint32_t i = 0; host.PollNextEvent( &vrevent, sizeof( vr::VREvent_t ) ); i++ )
+		{
+			dispatch( vrevent, queued_targets[ i ] );
+		}
+		elapsed_ns += DriverClockNs() - start_ns;
+	}
+	return elapsed_ns;
+}
+
+static void RunDeviceCount( MockDriverContext &context, uint32_t unDevices, uint64_t unEvents, FloodResult &table_result, FloodResult &broadcast_result )
+{
+	MockServerDriverHost &host = context.GetServerDriverHost();
+
+	std::vector< std::unique_ptr< MyControllerDeviceDriver > > devices;
+	std::vector< EventTarget > targets;
+	EventDispatchTable table;
+	for ( uint32_t i = 0; i < unDevices; i++ )
+	{
+		devices.push_back( std::make_unique< MyControllerDeviceDriver >( i % 2 == 0 ? vr::TrackedControllerRole_LeftHand : vr::TrackedControllerRole_RightHand ) );
+		targets.push_back( EventTarget{ i + 1, k_ulStandInHandle + i } );
+		table.AddDevice( targets[ i ].device_index, devices[ i ].get() );
+		table.AddComponent( targets[ i ].haptic_handle, devices[ i ].get() );
+	}
+
+	const int64_t poll_ns = Flood( host, targets, unEvents, []( const vr::VREvent_t &, size_t ) {} );
+
+	const int64_t table_ns = Flood( host, targets, unEvents, [ & ]( const vr::VREvent_t &vrevent, size_t unTarget )
+		{
+			MyControllerDeviceDriver *device = table.Find( vrevent );
+			table_result.device_checks++;
+			if ( device == nullptr )
+			{
+				table_result.misdelivered += unTarget != targets.size();
+				return;
+			}
+			table_result.delivered++;
+			table_result.misdelivered += unTarget == targets.size() || device != devices[ unTarget ].get();
+			device->MyProcessEvent( vrevent );
+		} );
+
+	const int64_t broadcast_ns = Flood( host, targets, unEvents, [ & ]( const vr::VREvent_t &vrevent, size_t unTarget )
+		{
+			for ( size_t i = 0; i < devices.size(); i++ )
+			{
+				broadcast_result.device_checks++;
+
+				// Each device's MyProcessEvent() as it was: only haptic events, and only for its own component
+				if ( vrevent.eventType == vr::VREvent_Input_HapticVibration && vrevent.data.hapticVibration.componentHandle == targets[ i ].haptic_handle )
+				{
+					broadcast_result.delivered++;
+					broadcast_result.misdelivered += unTarget != i;
+					devices[ i ]->MyProcessEvent( vrevent );
+				}
+			}
+		} );
+
+	table_result.ns_per_event = static_cast< double >( table_ns - poll_ns ) / unEvents;
+	broadcast_result.ns_per_event = static_cast< double >( broadcast_ns - poll_ns ) / unEvents;
+}
+
+static size_t CountLines( const MockDriverLog &log, const char *pchText )
+{
+	size_t count = 0;
+	for ( const std::string &line : log.GetLines() )
+	{
+		count += line.find( pchText ) != std::string::npos;
+	}
+	return count;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: The flood through the driver's own RunFrame(), with its two activated controllers
+//-----------------------------------------------------------------------------
+static bool RunDriver( const char *pchSettingsPath, int nPort, uint64_t unEvents, double &fNsPerEvent )
+{
+	MockDriverContext context;
+	MockSettings &settings = context.GetSettings();
+	if ( !LoadDriverSettings( "event_benchmark", settings, pchSettingsPath ) )
+	{
+		return false;
+	}
+	settings.SetInt32( driver_settings_section, "port", nPort );
+
+	MyDeviceProvider provider;
+	if ( provider.Init( &context ) != vr::VRInitError_None )
+	{
+		fprintf( stderr, "event_benchmark: The driver failed to initialize\n" );
+		return false;
+	}
+
+	// The mock hmd is device 0 and the left hand is added first
+	std::vector< EventTarget > targets;
+	for ( vr::TrackedDeviceIndex_t index = 1; index <= 2; index++ )
+	{
+		targets.push_back( EventTarget{ index, context.GetDriverInput().FindComponent( context.GetProperties().TrackedDeviceToPropertyContainer( index ), "/output/haptic" ) } );
+	}
+
+	MockServerDriverHost &host = context.GetServerDriverHost();
+	uint64_t haptic_count[ 2 ] = {};
+	int64_t run_frame_ns = 0;
+	int64_t empty_run_frame_ns = 0;
+	std::vector< size_t > queued_targets( k_unQueueEvents );
+	for ( uint64_t first = 0; first < unEvents; first += k_unQueueEvents )
+	{
+		const uint32_t count = static_cast< uint32_t >( std::min< uint64_t >( k_unQueueEvents, unEvents - first ) );
+		for ( uint32_t i = 0; i < count; i++ )
+		{
+			const vr::VREvent_t vrevent = FloodEvent( first + i, targets, queued_targets[ i ] );
+			host.QueueEvent( vrevent );
+			if ( vrevent.eventType == vr::VREvent_Input_HapticVibration && queued_targets[ i ] < targets.size() )
+			{
+				haptic_count[ queued_targets[ i ] ]++;
+			}
+		}
+
+		int64_t start_ns = DriverClockNs();
+		provider.RunFrame();
+		run_frame_ns += DriverClockNs() - start_ns;
+
+		start_ns = DriverClockNs();
+		provider.RunFrame();
+		empty_run_frame_ns += DriverClockNs() - start_ns;
+	}
+	fNsPerEvent = static_cast< double >( run_frame_ns - empty_run_frame_ns ) / unEvents;
+
+	context.GetServerDriverHost().DeactivateDevices();
+	provider.Cleanup();
+
+	const size_t left_logged = CountLines( context.GetDriverLog(), "Haptic event triggered for left hand" );
+	const size_t right_logged = CountLines( context.GetDriverLog(), "Haptic event triggered for right hand" );
+	if ( left_logged != haptic_count[ 0 ] || right_logged != haptic_count[ 1 ] )
+	{
+		fprintf( stderr, "event_benchmark: The driver's hands logged %zu and %zu haptic events, they were sent %llu and %llu\n", left_logged, right_logged,
+			static_cast< unsigned long long >( haptic_count[ 0 ] ), static_cast< unsigned long long >( haptic_count[ 1 ] ) );
+		return false;
+	}
+	return true;
+}
+
+static void PrintResult( const char *pchName, const FloodResult &result, uint64_t unEvents )
+{
+	printf( "\"%s\":{\"ns_per_event\":%.1f,\"delivered\":%llu,\"device_checks_per_event\":%.2f}", pchName, result.ns_per_event,
+		static_cast< unsigned long long >( result.delivered ), static_cast< double >( result.device_checks ) / unEvents );
+}
+
+int main( int argc, char **argv )
+{
+	std::vector< uint32_t > device_counts = { 2, 8, 32 };
+	uint64_t events = 1000000;
+	int port = 65508;
+	const char *settings_path = "resources/settings/default.vrsettings";
+	ToolOptionParser parser( "event_benchmark", argc, argv );
+	while ( parser.Next() )
+	{
+		const char *devices = nullptr;
+		if ( parser.Value( "--devices", devices ) )
+		{
+			if ( devices != nullptr && !ParseCountList( devices, k_unMaxDevices, device_counts ) )
+			{
+				parser.Invalid( "device counts from 1 to 32" );
+			}
+		}
+		else if ( !parser.Value( "--events", events ) && !parser.Value( "--port", port ) && !parser.Value( "--settings", settings_path ) )
+		{
+			parser.Unknown();
+		}
+	}
+	if ( !parser.IsValid() || events < k_unQueueEvents || port <= 0 || port > 65535 )
+	{
+		fprintf( stderr, "usage: event_benchmark [--devices 2,8,32] [--events 1000000] [--port 65508] [--settings resources/settings/default.vrsettings]\n" );
+		return 2;
+	}
+
+	bool passed = true;
+	printf( "{\"events\":%llu,\"results\":[", static_cast< unsigned long long >( events ) );
+	{
+		// The stand-in controllers read their settings and log through the driver context
+		MockDriverContext context;
+		vr::InitServerDriverContext( &context );
+
+		for ( size_t i = 0; i < device_counts.size(); i++ )
+		{
+			const uint32_t devices = device_counts[ i ];
+			FloodResult table;
+			FloodResult broadcast;
+			RunDeviceCount( context, devices, events, table, broadcast );
+
+			printf( "%s{\"devices\":%u,", i > 0 ? "," : "", devices );
+			PrintResult( "dispatch_table", table, events );
+			printf( "," );
+			PrintResult( "broadcast", broadcast, events );
+			printf( "}" );
+
+			// The first eight of every 64 events are for one of our devices, the broadcast only ever took the haptic ones
+			if ( table.misdelivered > 0 || broadcast.misdelivered > 0 || table.delivered != events / 64 * 8 + std::min< uint64_t >( events % 64, 8 ) )
+			{
+				fprintf( stderr, "event_benchmark: With %u devices the table delivered %llu events, %llu to the wrong device or none, the broadcast %llu to the wrong one\n",
+					devices, static_cast< unsigned long long >( table.delivered ), static_cast< unsigned long long >( table.misdelivered ),
+					static_cast< unsigned long long >( broadcast.misdelivered ) );
+				passed = false;
+			}
+			if ( devices >= k_unMinDevicesTableQuicker && table.ns_per_event >= broadcast.ns_per_event )
+			{
+				fprintf( stderr, "event_benchmark: With %u devices the table takes %.1f ns per event, the broadcast %.1f\n", devices, table.ns_per_event,
+					broadcast.ns_per_event );
+				passed = false;
+			}
+		}
+
+		vr::CleanupDriverContext();
+	}
+
+	double driver_ns_per_event = 0.0;
+	passed &= RunDriver( settings_path, port, events, driver_ns_per_event );
+	printf( "],\"driver_run_frame\":{\"devices\":2,\"ns_per_event\":%.1f}}\n", driver_ns_per_event );
+
+	return passed ? 0 : 1;
+}
@@ -0,0 +1,242 @@
+//============ Copyright (c) Valve Corporation, All rights reserved. ============
+// Stands in for Camera.py: streams synthetic hands (SyntheticHandSource) to a driver running on this machine,
+// for load tests and soak runs against the real vrserver:
+//
+//	hand_producer [--transport tcp|udp|shm] [--protocol binary|text] [--port 65432] [--shm-name handcameradriver]
+//		[--rate-hz 1000] [--hands 2] [--motion circle|random_walk|flick] [--seed 1] [--dropout-rate-hz 0]
+//		[--swap-interval-s 0] [--processing-ms 0] [--processing-jitter-ms 0] [--duration-s 0] [--report-s 10]
+//		[--watch-pid <vrserver pid>]
+//
+// Use the transport, port and shm_name the driver's settings have. Frames go out on absolute deadlines, so a
+// late frame doesn't push back the ones after it. --duration-s 0 runs until interrupted. Every --report-s seconds
+// one JSON line on stderr: frames sent and late, send failures, dropouts and swaps so far, and with --watch-pid
+// the resident memory of that process, so an hours-long run shows whether vrserver is growing. The driver's own
+// side of it is DebugRequest( "stats" ). Timestamps are CLOCK_MONOTONIC, the driver's clock, so no clock ping is needed.
+// POSIX only, like driver_benchmark.
+
+#include "driver_clock.h"
+#include "hand_protocol.h"
+#include "hand_stream_sender.h"
+#include "synthetic_hand_source.h"
+#include "tool_options.h"
+
+#include <signal.h>
+#include <time.h>
+
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+
+struct ProducerOptions
+{
+	HandTransport transport = HandTransport_Tcp;
+	HandStreamProtocol protocol = HandStreamProtocol_Binary;
+	int port = 65432;
+	const char *shm_name = "handcameradriver";
+	SyntheticHandOptions source;
+	double duration_s = 0.0; // 0 runs until interrupted
+	double report_s = 10.0;
+	long watch_pid = 0;
+};
+
+// Set by SIGINT and SIGTERM, the run stops after the frame it's on
+static volatile sig_atomic_t g_bIsStopping = 0;
+
+static void OnStopSignal( int )
+{
+	g_bIsStopping = 1;
+}
+
+static void PrintUsage()
+{
+	fprintf( stderr,
+		"usage: hand_producer [--transport tcp|udp|shm] [--protocol binary|text] [--port 65432] [--shm-name handcameradriver]\n"
+		"                     [--rate-hz 1000] [--hands 2] [--motion circle|random_walk|flick] [--seed 1] [--dropout-rate-hz 0]\n"
+		"                     [--swap-interval-s 0] [--processing-ms 0] [--processing-jitter-ms 0] [--duration-s 0] [--report-s 10]\n"
+		"                     [--watch-pid <pid>]\n" );
+}
+
+static bool ParseOptions( int argc, char **argv, ProducerOptions &options )
+{
+	options.source.frame_rate_hz = 1000.0;
+
+	ToolOptionParser parser( "hand_producer", argc, argv );
+	while ( parser.Next() )
+	{
+		const char *value = nullptr;
+		if ( parser.Value( "--transport", value ) )
+		{
+			if ( value != nullptr && !HandTransportFromName( value, options.transport ) )
+			{
+				parser.Invalid( "tcp, udp or shm" );
+			}
+		}
+		else if ( parser.Value( "--protocol", value ) )
+		{
+			if ( value != nullptr && !HandStreamProtocolFromName( value, options.protocol ) )
+			{
+				parser.Invalid( "binary or text" );
+			}
+		}
+		else if ( parser.Value( "--motion", value ) )
+		{
+			if ( value != nullptr && !SyntheticMotionFromName( value, options.source.motion ) )
+			{
+				parser.Invalid( "circle, random_walk or flick" );
+			}
+		}
+		else if ( parser.Value( "--watch-pid", value ) )
+		{
+			options.watch_pid = value != nullptr ? atol( value ) : options.watch_pid;
+		}
+		else if ( !parser.Value( "--port", options.port ) && !parser.Value( "--shm-name", options.shm_name ) && !parser.Value( "--rate-hz", options.source.frame_rate_hz ) &&
+				  !parser.Value( "--hands", options.source.hand_count ) && !parser.Value( "--seed", options.source.seed ) &&
+				  !parser.Value( "--dropout-rate-hz", options.source.dropout_rate_hz ) && !parser.Value( "--swap-interval-s", options.source.swap_interval_s ) &&
+				  !parser.Value( "--processing-ms", options.source.processing_ms ) && !parser.Value( "--processing-jitter-ms", options.source.processing_jitter_ms ) &&
+				  !parser.Value( "--duration-s", options.duration_s ) && !parser.Value( "--report-s", options.report_s ) )
+		{
+			parser.Unknown();
+		}
+	}
+	if ( !parser.IsValid() )
+	{
+		return false;
+	}
+
+	const SyntheticHandOptions &source = options.source;
+	if ( source.frame_rate_hz <= 0.0 || source.frame_rate_hz > 100000.0 || source.hand_count < 1 || source.hand_count > k_unHandBatchMaxHands ||
+		 source.dropout_rate_hz < 0.0 || source.swap_interval_s < 0.0 || source.processing_ms < 0.0 || source.processing_jitter_ms < 0.0 ||
+		 options.duration_s < 0.0 || options.report_s <= 0.0 || options.port <= 0 || options.port > 65535 )
+	{
+		fprintf( stderr, "hand_producer: Rate, hands (1-%zu), dropout, swap, processing, duration, report interval or port out of range\n",
+			k_unHandBatchMaxHands );
+		return false;
+	}
+	return true;
+}
+
+// SleepUntilUs(), except that SIGINT or SIGTERM cut the sleep short
+static void SleepUntilUsOrStopped( int64_t nWakeTimeUs )
+{
+	struct timespec wake_time;
+	wake_time.tv_sec = static_cast< time_t >( nWakeTimeUs / 1000000 );
+	wake_time.tv_nsec = static_cast< long >( ( nWakeTimeUs % 1000000 ) * 1000 );
+	while ( clock_nanosleep( CLOCK_MONOTONIC, TIMER_ABSTIME, &wake_time, nullptr ) == EINTR && !g_bIsStopping )
+	{
+	}
+}
+
+// VmRSS of process nPid, kilobytes. -1 if it's gone.
+static long ProcessResidentKb( long nPid )
+{
+	char path[ 64 ];
+	snprintf( path, sizeof( path ), "/proc/%ld/status", nPid );
+	FILE *status = fopen( path, "r" );
+	if ( status == nullptr )
+	{
+		return -1;
+	}
+
+	long resident_kb = -1;
+	char line[ 256 ];
+	while ( fgets( line, sizeof( line ), status ) != nullptr )
+	{
+		if ( sscanf( line, "VmRSS: %ld", &resident_kb ) == 1 )
+		{
+			break;
+		}
+	}
+	fclose( status );
+	return resident_kb;
+}
+
+struct ProducerTotals
+{
+	uint64_t frames;
+	uint64_t samples;
+	uint64_t late_frames; // Sent more than a frame period after their deadline
+	uint64_t send_failures;
+};
+
+static void PrintReport( const ProducerOptions &options, const SyntheticHandSource &source, const ProducerTotals &totals, double fElapsedS )
+{
+	fprintf( stderr, "{\"t_s\":%.1f,\"frames\":%llu,\"samples\":%llu,\"late_frames\":%llu,\"send_failures\":%llu,\"dropouts\":%llu,\"swaps\":%llu", fElapsedS,
+		static_cast< unsigned long long >( totals.frames ), static_cast< unsigned long long >( totals.samples ),
+		static_cast< unsigned long long >( totals.late_frames ), static_cast< unsigned long long >( totals.send_failures ),
+		static_cast< unsigned long long >( source.GetDropoutCount() ), static_cast< unsigned long long >( source.GetSwapCount() ) );
+	if ( options.watch_pid > 0 )
+	{
+		fprintf( stderr, ",\"watched_rss_kb\":%ld", ProcessResidentKb( options.watch_pid ) );
+	}
+	fprintf( stderr, "}\n" );
+}
+
+int main( int argc, char **argv )
+{
+	ProducerOptions options;
+	if ( !ParseOptions( argc, argv, options ) )
+	{
+		PrintUsage();
+		return 2;
+	}
+
+	HandStreamSender sender;
+	if ( !sender.Open( options.transport, options.protocol, options.port, options.shm_name, 5000 ) )
+	{
+		fprintf( stderr, "hand_producer: Can't reach the driver (%s, port %d, shm %s)\n", HandTransportName( options.transport ), options.port, options.shm_name );
+		return 1;
+	}
+
+	signal( SIGINT, OnStopSignal );
+	signal( SIGTERM, OnStopSignal );
+
+	SyntheticHandSource source( options.source );
+	HandSampleBatch batch{};
+	ProducerTotals totals{};
+
+	const double period_us = 1000000.0 / options.source.frame_rate_hz;
+	const int64_t report_period_us = static_cast< int64_t >( options.report_s * 1e6 );
+	const int64_t start_time_us = DriverClockUs();
+	const int64_t end_time_us = options.duration_s > 0.0 ? start_time_us + static_cast< int64_t >( options.duration_s * 1e6 ) : INT64_MAX;
+	int64_t report_time_us = start_time_us + report_period_us;
+
+	for ( uint32_t frame = 0; !g_bIsStopping; frame++ )
+	{
+		const int64_t due_time_us = start_time_us + static_cast< int64_t >( frame * period_us );
+		if ( due_time_us >= end_time_us )
+		{
+			break;
+		}
+		SleepUntilUsOrStopped( due_time_us );
+
+		const int64_t send_time_us = DriverClockUs();
+		if ( send_time_us - due_time_us > period_us )
+		{
+			totals.late_frames++;
+		}
+
+		source.Generate( frame, send_time_us, batch );
+		if ( batch.hand_count > 0 )
+		{
+			if ( sender.Send( batch ) )
+			{
+				totals.frames++;
+				totals.samples += batch.hand_count;
+			}
+			else
+			{
+				totals.send_failures++;
+			}
+		}
+
+		if ( send_time_us >= report_time_us )
+		{
+			PrintReport( options, source, totals, ( send_time_us - start_time_us ) * 1e-6 );
+			report_time_us += report_period_us;
+		}
+	}
+
+	PrintReport( options, source, totals, ( DriverClockUs() - start_time_us ) * 1e-6 );
+	sender.Close();
+	return 0;
+}
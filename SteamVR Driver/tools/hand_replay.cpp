@@ -0,0 +1,387 @@
+//============ Copyright (c) Valve Corporation, All rights reserved. ============
+// Plays a capture the listener recorded (the capture_file setting) back into the driver, against MockDriverContext:
+//
+//	hand_replay <capture> [--speed realtime|max] [--max-gap-ms 1000] [--port 65500] [--display-hz 90]
+//		[--settings resources/settings/default.vrsettings] [--verbose]
+//
+// realtime  Loads the whole driver and sends the recorded messages to its listener over loopback TCP, spaced the
+//           way they were received. Gaps longer than --max-gap-ms are shortened. Reproduces a session for debugging.
+// max       Runs the messages through the listener's parsers, the controllers' filters and pose building on one
+//           thread, as fast as it can, submitting poses for both hands after every message. There's no scheduler
+//           and no socket, so the result only depends on the capture: the printed checksum of every pose and input
+//           update is the same on every run. Prints the throughput as one JSON object.
+//
+// POSIX only, like driver_benchmark.
+
+#include "controller_device_driver.h"
+#include "device_provider.h"
+#include "driver_clock.h"
+#include "hand_capture.h"
+#include "hand_tracking_listener.h"
+#include "hmd_pose_cache.h"
+#include "mock_vr_host.h"
+#include "tool_clock.h"
+#include "tool_options.h"
+
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <thread>
+
+struct ReplayOptions
+{
+	const char *capture_path = nullptr;
+	bool is_max_speed = false;
+	int64_t max_gap_us = 1000000;
+	int port = 65500;
+	double display_hz = 90.0;
+	const char *settings_path = "resources/settings/default.vrsettings";
+	bool is_verbose = false;
+};
+
+static void PrintUsage()
+{
+	fprintf( stderr,
+		"usage: hand_replay <capture> [--speed realtime|max] [--max-gap-ms 1000] [--port 65500] [--display-hz 90]\n"
+		"                   [--settings resources/settings/default.vrsettings] [--verbose]\n" );
+}
+
+static bool ParseOptions( int argc, char **argv, ReplayOptions &options )
+{
+	double max_gap_ms = options.max_gap_us * 1e-3;
+	ToolOptionParser parser( "hand_replay", argc, argv );
+	while ( parser.Next() )
+	{
+		const char *value = nullptr;
+		if ( parser.Positional( value ) )
+		{
+			if ( options.capture_path != nullptr )
+			{
+				fprintf( stderr, "hand_replay: Only one capture at a time\n" );
+				return false;
+			}
+			options.capture_path = value;
+		}
+		else if ( parser.Value( "--speed", value ) )
+		{
+			if ( value != nullptr && strcmp( value, "max" ) == 0 )
+			{
+				options.is_max_speed = true;
+			}
+			else if ( value != nullptr && strcmp( value, "realtime" ) != 0 )
+			{
+				parser.Invalid( "realtime or max" );
+			}
+		}
+		else if ( !parser.Flag( "--verbose", options.is_verbose ) && !parser.Value( "--max-gap-ms", max_gap_ms ) && !parser.Value( "--port", options.port ) &&
+				  !parser.Value( "--display-hz", options.display_hz ) && !parser.Value( "--settings", options.settings_path ) )
+		{
+			parser.Unknown();
+		}
+	}
+	if ( !parser.IsValid() )
+	{
+		return false;
+	}
+	options.max_gap_us = static_cast< int64_t >( max_gap_ms * 1000.0 );
+
+	if ( options.capture_path == nullptr )
+	{
+		fprintf( stderr, "hand_replay: Which capture?\n" );
+		return false;
+	}
+	return true;
+}
+
+static int ConnectProducer( int nPort )
+{
+	const int producer_socket = socket( AF_INET, SOCK_STREAM, 0 );
+	if ( producer_socket < 0 )
+	{
+		return -1;
+	}
+
+	sockaddr_in address{};
+	address.sin_family = AF_INET;
+	address.sin_port = htons( static_cast< uint16_t >( nPort ) );
+	address.sin_addr.s_addr = htonl( INADDR_LOOPBACK );
+
+	// The listener thread may still be coming up
+	for ( int attempt = 0; attempt < 50; attempt++ )
+	{
+		if ( connect( producer_socket, reinterpret_cast< sockaddr * >( &address ), sizeof( address ) ) == 0 )
+		{
+			const int no_delay = 1;
+			setsockopt( producer_socket, IPPROTO_TCP, TCP_NODELAY, &no_delay, sizeof( no_delay ) );
+			return producer_socket;
+		}
+		std::this_thread::sleep_for( std::chrono::milliseconds( 20 ) );
+	}
+
+	close( producer_socket );
+	return -1;
+}
+
+static bool SendAll( int nSocket, const char *pData, size_t unSize )
+{
+	while ( unSize > 0 )
+	{
+		const ssize_t sent = send( nSocket, pData, unSize, MSG_NOSIGNAL );
+		if ( sent <= 0 )
+		{
+			return false;
+		}
+		pData += sent;
+		unSize -= static_cast< size_t >( sent );
+	}
+	return true;
+}
+
+// FNV-1a, over the bytes of whatever the driver handed the host
+static uint64_t HashBytes( uint64_t unHash, const void *pData, size_t unSize )
+{
+	const uint8_t *bytes = static_cast< const uint8_t * >( pData );
+	for ( size_t i = 0; i < unSize; i++ )
+	{
+		unHash = ( unHash ^ bytes[ i ] ) * 0x100000001b3ull;
+	}
+	return unHash;
+}
+
+static uint64_t TotalReceived( const HandTrackingListener &listener )
+{
+	return listener.GetStreamCounters( HandId_Left ).received + listener.GetStreamCounters( HandId_Right ).received;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Sends every record to the running driver at the pace it was received. The listener tells the protocols
+// apart by the first byte of a connection, so text and binary records each get their own connection.
+//-----------------------------------------------------------------------------
+static int ReplayRealtime( HandCaptureReader &reader, MockDriverContext &context, const ReplayOptions &options )
+{
+	MockSettings &settings = context.GetSettings();
+	settings.SetInt32( driver_settings_section, "port", options.port );
+	settings.SetString( driver_settings_section, "transport", "tcp" );
+	settings.SetString( driver_settings_section, "capture_file", "" );
+
+	MyDeviceProvider provider;
+	if ( provider.Init( &context ) != vr::VRInitError_None || provider.MyGetHandTrackingListener() == nullptr )
+	{
+		fprintf( stderr, "hand_replay: The driver failed to initialize\n" );
+		return 1;
+	}
+
+	RunFrameThread run_frame_thread( provider );
+
+	int sockets[ 2 ] = { -1, -1 };
+	uint64_t message_count = 0;
+	uint64_t send_failures = 0;
+	int64_t record_time_us = reader.GetStartTimeUs();
+	int64_t due_time_us = DriverClockUs();
+	const int64_t start_time_us = due_time_us;
+
+	HandCaptureRecord record;
+	while ( reader.Next( record ) )
+	{
+		due_time_us += std::min( std::max< int64_t >( record.receive_time_us - record_time_us, 0 ), options.max_gap_us );
+		record_time_us = record.receive_time_us;
+		SleepUntilUs( due_time_us );
+
+		int &producer_socket = sockets[ record.format ];
+		if ( producer_socket < 0 )
+		{
+			producer_socket = ConnectProducer( options.port );
+			if ( producer_socket < 0 )
+			{
+				fprintf( stderr, "hand_replay: Can't connect to the listener on port %d\n", options.port );
+				break;
+			}
+		}
+
+		bool is_sent = SendAll( producer_socket, record.message.data(), record.message.size() );
+		if ( record.format == HandCaptureFormat_Text )
+		{
+			is_sent = is_sent && SendAll( producer_socket, "\n", 1 );
+		}
+		if ( is_sent )
+		{
+			message_count++;
+		}
+		else
+		{
+			send_failures++;
+		}
+	}
+
+	SleepUntilUs( DriverClockUs() + k_unDrainTimeUs );
+	const int64_t elapsed_us = DriverClockUs() - start_time_us;
+
+	for ( int producer_socket : sockets )
+	{
+		if ( producer_socket >= 0 )
+		{
+			close( producer_socket );
+		}
+	}
+	run_frame_thread.Stop();
+
+	const uint64_t received = TotalReceived( *provider.MyGetHandTrackingListener() );
+	context.GetServerDriverHost().DeactivateDevices();
+	provider.Cleanup();
+
+	printf( "{\"speed\":\"realtime\",\"messages\":%llu,\"send_failures\":%llu,\"samples\":%llu,\"poses\":%llu,\"input_updates\":%llu,\"seconds\":%.3f}\n",
+		static_cast< unsigned long long >( message_count ), static_cast< unsigned long long >( send_failures ), static_cast< unsigned long long >( received ),
+		static_cast< unsigned long long >( context.GetServerDriverHost().Poses().Count() ), static_cast< unsigned long long >( context.GetDriverInput().Updates().Count() ),
+		elapsed_us * 1e-6 );
+	return 0;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Replays every record straight into a listener that was never started, then submits a pose for both hands
+// and runs their input updates, all on this thread. Nothing waits, so this measures parsing, sequencing, input
+// filtering and pose building per message.
+//-----------------------------------------------------------------------------
+static int ReplayMaxSpeed( HandCaptureReader &reader, MockDriverContext &context )
+{
+	vr::InitServerDriverContext( &context );
+
+	MyControllerDeviceDriver left_controller( vr::TrackedControllerRole_LeftHand );
+	MyControllerDeviceDriver right_controller( vr::TrackedControllerRole_RightHand );
+	PipelineStats stats;
+	left_controller.MySetPipelineStats( &stats );
+	right_controller.MySetPipelineStats( &stats );
+
+	MockServerDriverHost &host = context.GetServerDriverHost();
+	if ( !host.TrackedDeviceAdded( left_controller.MyGetSerialNumber().c_str(), vr::TrackedDeviceClass_Controller, &left_controller ) ||
+		 !host.TrackedDeviceAdded( right_controller.MyGetSerialNumber().c_str(), vr::TrackedDeviceClass_Controller, &right_controller ) )
+	{
+		fprintf( stderr, "hand_replay: The controllers failed to activate\n" );
+		vr::CleanupDriverContext();
+		return 1;
+	}
+
+	HandTrackingListener listener( &left_controller, &right_controller );
+	listener.SetPipelineStats( &stats );
+
+	// A still head, the same on every run
+	const HmdPose hmd_pose = HmdPoseFromTrackedDevicePose( MockStandingHmdPose( 1.7f ), 0 );
+
+	const MockRecordBuffer< MockPoseRecord > &poses = host.Poses();
+	const MockRecordBuffer< MockInputRecord > &inputs = context.GetDriverInput().Updates();
+	uint64_t checksum = 0xcbf29ce484222325ull;
+	uint64_t message_count = 0;
+	uint64_t rejected_count = 0;
+	uint64_t input_count = inputs.Count();
+
+	const int64_t start_time_ns = DriverClockNs();
+
+	HandCaptureRecord record;
+	while ( reader.Next( record ) )
+	{
+		if ( !listener.ReplayMessage( record.format, record.message, record.receive_time_us ) )
+		{
+			rejected_count++;
+			continue;
+		}
+		message_count++;
+
+		left_controller.SubmitScheduledPose( hmd_pose, 0 );
+		right_controller.SubmitScheduledPose( hmd_pose, 0 );
+		left_controller.MyRunFrame();
+		right_controller.MyRunFrame();
+
+		// The two poses just submitted, and whichever input updates got past the filter. Only the values:
+		// velocities and time offsets depend on how long ago the capture was recorded.
+		for ( size_t i = poses.Size() - 2; i < poses.Size(); i++ )
+		{
+			const vr::DriverPose_t &pose = poses.At( i ).pose;
+			checksum = HashBytes( checksum, pose.vecPosition, sizeof( pose.vecPosition ) );
+			checksum = HashBytes( checksum, &pose.qRotation, sizeof( pose.qRotation ) );
+		}
+		for ( ; input_count < inputs.Count(); input_count++ )
+		{
+			const MockInputRecord &input = inputs.At( inputs.Size() - static_cast< size_t >( inputs.Count() - input_count ) );
+			checksum = HashBytes( checksum, &input.component, sizeof( input.component ) );
+			checksum = HashBytes( checksum, &input.value, sizeof( input.value ) );
+		}
+	}
+
+	const int64_t elapsed_ns = std::max< int64_t >( DriverClockNs() - start_time_ns, 1 );
+	const uint64_t samples = TotalReceived( listener );
+	const LatencyHistogram &parse_time_ns = stats.ParseTimeNs();
+
+	printf( "{\"speed\":\"max\",\"messages\":%llu,\"rejected\":%llu,\"samples\":%llu,\"poses\":%llu,\"input_updates\":%llu,\"seconds\":%.3f,"
+			"\"messages_per_sec\":%.0f,\"samples_per_sec\":%.0f,\"ns_per_message\":%.0f,\"parse_ns_p50\":%lld,\"parse_ns_p99\":%lld,\"checksum\":\"%016llx\"}\n",
+		static_cast< unsigned long long >( message_count ), static_cast< unsigned long long >( rejected_count ), static_cast< unsigned long long >( samples ),
+		static_cast< unsigned long long >( poses.Count() ), static_cast< unsigned long long >( inputs.Count() ), elapsed_ns * 1e-9, message_count * 1e9 / elapsed_ns,
+		samples * 1e9 / elapsed_ns, static_cast< double >( elapsed_ns ) / std::max< uint64_t >( message_count, 1 ), static_cast< long long >( parse_time_ns.Percentile( 0.5 ) ),
+		static_cast< long long >( parse_time_ns.Percentile( 0.99 ) ), static_cast< unsigned long long >( checksum ) );
+
+	host.DeactivateDevices();
+	vr::CleanupDriverContext();
+	return 0;
+}
+
+int main( int argc, char **argv )
+{
+	ReplayOptions options;
+	if ( !ParseOptions( argc, argv, options ) )
+	{
+		PrintUsage();
+		return 2;
+	}
+
+	const int capture_fd = open( options.capture_path, O_RDONLY );
+	struct stat capture_stat;
+	if ( capture_fd < 0 || fstat( capture_fd, &capture_stat ) != 0 )
+	{
+		fprintf( stderr, "hand_replay: Can't open %s (%s)\n", options.capture_path, strerror( errno ) );
+		return 1;
+	}
+
+	// Records are read straight out of the mapping, nothing is copied
+	const size_t capture_size = static_cast< size_t >( capture_stat.st_size );
+	void *capture = capture_size > 0 ? mmap( nullptr, capture_size, PROT_READ, MAP_PRIVATE, capture_fd, 0 ) : MAP_FAILED;
+	close( capture_fd );
+
+	HandCaptureReader reader;
+	if ( capture == MAP_FAILED || !reader.Init( capture, capture_size ) )
+	{
+		fprintf( stderr, "hand_replay: %s isn't a hand capture\n", options.capture_path );
+		if ( capture != MAP_FAILED )
+		{
+			munmap( capture, capture_size );
+		}
+		return 1;
+	}
+	madvise( capture, capture_size, MADV_SEQUENTIAL );
+
+	MockDriverContext context;
+	context.GetDriverLog().SetEcho( options.is_verbose );
+	context.SetDisplayFrequency( static_cast< float >( options.display_hz ) );
+	if ( !LoadDriverSettings( "hand_replay", context.GetSettings(), options.settings_path ) )
+	{
+		munmap( capture, capture_size );
+		return 1;
+	}
+
+	const int result = options.is_max_speed ? ReplayMaxSpeed( reader, context ) : ReplayRealtime( reader, context, options );
+
+	if ( reader.IsTruncated() )
+	{
+		fprintf( stderr, "hand_replay: The capture ends in the middle of a record, recording was interrupted\n" );
+	}
+
+	munmap( capture, capture_size );
+	return result;
+}
@@ -0,0 +1,199 @@
+//============ Copyright (c) Valve Corporation, All rights reserved. ============
+#include "hand_stream_sender.h"
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <cstring>
+#include <thread>
+
+static constexpr uint32_t k_unRetryIntervalMs = 20;
+
+bool HandTransportFromName( const char *pchName, HandTransport &transport )
+{
+	if ( strcmp( pchName, "tcp" ) == 0 )
+	{
+		transport = HandTransport_Tcp;
+	}
+	else if ( strcmp( pchName, "udp" ) == 0 )
+	{
+		transport = HandTransport_Udp;
+	}
+	else if ( strcmp( pchName, "shm" ) == 0 )
+	{
+		transport = HandTransport_SharedMemory;
+	}
+	else
+	{
+		return false;
+	}
+	return true;
+}
+
+const char *HandTransportName( HandTransport transport )
+{
+	switch ( transport )
+	{
+	case HandTransport_Udp:
+		return "udp";
+	case HandTransport_SharedMemory:
+		return "shm";
+	default:
+		return "tcp";
+	}
+}
+
+bool HandStreamProtocolFromName( const char *pchName, HandStreamProtocol &protocol )
+{
+	if ( strcmp( pchName, "binary" ) == 0 )
+	{
+		protocol = HandStreamProtocol_Binary;
+	}
+	else if ( strcmp( pchName, "text" ) == 0 )
+	{
+		protocol = HandStreamProtocol_Text;
+	}
+	else
+	{
+		return false;
+	}
+	return true;
+}
+
+const char *HandStreamProtocolName( HandStreamProtocol protocol )
+{
+	return protocol == HandStreamProtocol_Text ? "text" : "binary";
+}
+
+HandStreamSender::HandStreamSender()
+	: transport_( HandTransport_Tcp )
+	, protocol_( HandStreamProtocol_Binary )
+	, socket_( -1 )
+	, buffer_{}
+{
+}
+
+HandStreamSender::~HandStreamSender()
+{
+	Close();
+}
+
+bool HandStreamSender::Open( HandTransport transport, HandStreamProtocol protocol, int nPort, const char *pchShmName, uint32_t unTimeoutMs )
+{
+	Close();
+	transport_ = transport;
+	protocol_ = transport == HandTransport_SharedMemory ? HandStreamProtocol_Binary : protocol;
+
+	const uint32_t attempts = unTimeoutMs / k_unRetryIntervalMs + 1;
+	if ( transport == HandTransport_SharedMemory )
+	{
+		// Only the listener creates the ring, we wait for it to be there
+		for ( uint32_t attempt = 0; attempt < attempts; attempt++ )
+		{
+			if ( ring_.Open( pchShmName, false ) )
+			{
+				return true;
+			}
+			std::this_thread::sleep_for( std::chrono::milliseconds( k_unRetryIntervalMs ) );
+		}
+		return false;
+	}
+
+	const bool is_udp = transport == HandTransport_Udp;
+	socket_ = socket( AF_INET, is_udp ? SOCK_DGRAM : SOCK_STREAM, 0 );
+	if ( socket_ < 0 )
+	{
+		return false;
+	}
+
+	sockaddr_in address{};
+	address.sin_family = AF_INET;
+	address.sin_port = htons( static_cast< uint16_t >( nPort ) );
+	address.sin_addr.s_addr = htonl( INADDR_LOOPBACK );
+
+	for ( uint32_t attempt = 0; attempt < attempts; attempt++ )
+	{
+		if ( connect( socket_, reinterpret_cast< sockaddr * >( &address ), sizeof( address ) ) == 0 )
+		{
+			if ( !is_udp )
+			{
+				const int no_delay = 1;
+				setsockopt( socket_, IPPROTO_TCP, TCP_NODELAY, &no_delay, sizeof( no_delay ) );
+			}
+			return true;
+		}
+		std::this_thread::sleep_for( std::chrono::milliseconds( k_unRetryIntervalMs ) );
+	}
+
+	Close();
+	return false;
+}
+
+void HandStreamSender::Close()
+{
+	if ( socket_ >= 0 )
+	{
+		close( socket_ );
+		socket_ = -1;
+	}
+	ring_.Close();
+}
+
+bool HandStreamSender::Send( const HandSampleBatch &batch )
+{
+	if ( transport_ == HandTransport_SharedMemory )
+	{
+		if ( !ring_.IsOpen() )
+		{
+			return false;
+		}
+		for ( uint32_t i = 0; i < batch.hand_count; i++ )
+		{
+			ring_.Write( batch.hands[ i ] );
+		}
+		return true;
+	}
+
+	if ( socket_ < 0 )
+	{
+		return false;
+	}
+
+	size_t message_size = 0;
+	if ( protocol_ == HandStreamProtocol_Text )
+	{
+		message_size = FormatHandMessageText( batch, buffer_, sizeof( buffer_ ) );
+	}
+	else
+	{
+		static_assert( sizeof( buffer_ ) >= k_unHandBatchHeaderSize + k_unHandBatchMaxHands * k_unHandFrameSize, "buffer_ can't hold a batch" );
+		message_size = EncodeHandSampleBatchBinary( batch, reinterpret_cast< uint8_t * >( buffer_ ) );
+	}
+
+	return message_size > 0 && SendAll( buffer_, message_size );
+}
+
+bool HandStreamSender::SendAll( const char *pData, size_t unSize )
+{
+	// A datagram goes out whole or not at all
+	if ( transport_ == HandTransport_Udp )
+	{
+		return send( socket_, pData, unSize, MSG_NOSIGNAL ) == static_cast< ssize_t >( unSize );
+	}
+
+	while ( unSize > 0 )
+	{
+		const ssize_t sent = send( socket_, pData, unSize, MSG_NOSIGNAL );
+		if ( sent <= 0 )
+		{
+			return false;
+		}
+		pData += sent;
+		unSize -= static_cast< size_t >( sent );
+	}
+	return true;
+}
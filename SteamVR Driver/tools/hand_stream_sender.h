@@ -0,0 +1,55 @@
+//============ Copyright (c) Valve Corporation, All rights reserved. ============
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include "hand_protocol.h"
+#include "hand_tracking_listener.h"
+#include "shared_memory_ring.h"
+
+// What the producer sends over a socket. Shared memory always carries binary frames.
+enum HandStreamProtocol
+{
+	HandStreamProtocol_Binary,
+	HandStreamProtocol_Text,
+};
+
+// "tcp", "udp" or "shm", the names the transport setting uses. False for anything else.
+bool HandTransportFromName( const char *pchName, HandTransport &transport );
+const char *HandTransportName( HandTransport transport );
+
+// "binary" or "text". False for anything else.
+bool HandStreamProtocolFromName( const char *pchName, HandStreamProtocol &protocol );
+const char *HandStreamProtocolName( HandStreamProtocol protocol );
+
+//-----------------------------------------------------------------------------
+// Purpose: The sending end of every transport the listener supports, for producers other than Camera.py.
+// One camera frame per Send(): a binary batch or FRAME: line over TCP or as one UDP datagram,
+// or one ring slot per hand with shared memory. Never allocates after Open().
+//-----------------------------------------------------------------------------
+class HandStreamSender
+{
+public:
+	HandStreamSender();
+	~HandStreamSender();
+
+	// Connects to the listener on loopback port nPort, or attaches to the ring the listener created at
+	// /dev/shm/<pchShmName>. Keeps trying for unTimeoutMs while the listener comes up.
+	bool Open( HandTransport transport, HandStreamProtocol protocol, int nPort, const char *pchShmName, uint32_t unTimeoutMs );
+	void Close();
+
+	// False if the frame couldn't be sent whole
+	bool Send( const HandSampleBatch &batch );
+
+private:
+	bool SendAll( const char *pData, size_t unSize );
+
+	HandTransport transport_;
+	HandStreamProtocol protocol_;
+	int socket_;
+	SharedMemoryRing ring_;
+
+	// Big enough for a full batch in either protocol
+	char buffer_[ 2048 ];
+};
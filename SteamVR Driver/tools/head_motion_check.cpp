@@ -0,0 +1,213 @@
+//============ Copyright (c) Valve Corporation, All rights reserved. ============
+// Moves the head while a hand holds still in the room and reports how far the controller pose lands from the hand,
+// composed with the hmd pose from when the camera saw it against the hmd pose at submit time. Prints one JSON object:
+//
+//	head_motion_check [--duration-s 4] [--camera-hz 30] [--latency-ms 45] [--min-reduction 0.3]
+//
+// MockDriverContext's hmd yaws +-0.8 rad at 0.7 Hz and sways +-0.3 m at 0.5 Hz, velocities included. The camera
+// sees the hand at a fixed point in the room relative to the head at --camera-hz, and each sample reaches both
+// controllers --latency-ms later with its capture time. capture_time has a PoseScheduler refreshing its hmd pose
+// history every 5 ms, like in the driver; submit_time has none, so GetPose() composes with the hmd pose of the
+// moment. Every 5 ms both poses are extrapolated by their velocity over their time offset, the way SteamVR does it
+// for a pose submitted now, and compared with the hand. Runs in real time, the driver clock is the real one.
+// Exits non-zero if the capture time pose doesn't take at least --min-reduction off the mean position error.
+//
+// POSIX only, like driver_benchmark.
+
+#include "controller_device_driver.h"
+#include "driver_clock.h"
+#include "mock_vr_host.h"
+#include "pose_scheduler.h"
+#include "tool_clock.h"
+#include "tool_options.h"
+#include "tool_stats.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <vector>
+
+// The pose scheduler's and the comparison's period, the driver's default pose rate
+static constexpr int64_t k_unPosePeriodUs = 5000;
+
+// The motion estimator needs a few frames before it estimates anything, and the hmd history a few ticks
+static constexpr int64_t k_unSettleUs = 500000;
+
+static constexpr double k_flPi = 3.14159265358979323846;
+
+// Where the hand is held, in the room
+static constexpr float k_rflHandPosition[ 3 ] = { 0.2f, 1.3f, -0.4f };
+
+struct HeadMotion
+{
+	double yaw;
+	double yaw_velocity;
+	double position[ 3 ];
+	double velocity[ 3 ];
+};
+
+static HeadMotion HeadMotionAt( double fTimeS )
+{
+	HeadMotion motion = {};
+	motion.yaw = 0.8 * std::sin( 2.0 * k_flPi * 0.7 * fTimeS );
+	motion.yaw_velocity = 0.8 * 2.0 * k_flPi * 0.7 * std::cos( 2.0 * k_flPi * 0.7 * fTimeS );
+	motion.position[ 0 ] = 0.3 * std::sin( 2.0 * k_flPi * 0.5 * fTimeS );
+	motion.position[ 1 ] = 1.7;
+	motion.velocity[ 0 ] = 0.3 * 2.0 * k_flPi * 0.5 * std::cos( 2.0 * k_flPi * 0.5 * fTimeS );
+	return motion;
+}
+
+static vr::TrackedDevicePose_t HmdPoseAt( double fTimeS )
+{
+	const HeadMotion motion = HeadMotionAt( fTimeS );
+	const float c = static_cast< float >( std::cos( motion.yaw ) );
+	const float s = static_cast< float >( std::sin( motion.yaw ) );
+
+	// Yaw about y
+	vr::TrackedDevicePose_t pose = MockStandingHmdPose( 0.f );
+	pose.mDeviceToAbsoluteTracking.m[ 0 ][ 0 ] = c;
+	pose.mDeviceToAbsoluteTracking.m[ 0 ][ 2 ] = s;
+	pose.mDeviceToAbsoluteTracking.m[ 2 ][ 0 ] = -s;
+	pose.mDeviceToAbsoluteTracking.m[ 2 ][ 2 ] = c;
+	for ( int i = 0; i < 3; i++ )
+	{
+		pose.mDeviceToAbsoluteTracking.m[ i ][ 3 ] = static_cast< float >( motion.position[ i ] );
+		pose.vVelocity.v[ i ] = static_cast< float >( motion.velocity[ i ] );
+	}
+	pose.vAngularVelocity.v[ 1 ] = static_cast< float >( motion.yaw_velocity );
+	return pose;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: What the camera sees at fTimeS: the hand relative to the head, rotated back by the head's yaw
+//-----------------------------------------------------------------------------
+static HandSample CameraSampleAt( double fTimeS, int64_t nCaptureTimeUs )
+{
+	const HeadMotion motion = HeadMotionAt( fTimeS );
+	const double c = std::cos( motion.yaw );
+	const double s = std::sin( motion.yaw );
+	const double dx = k_rflHandPosition[ 0 ] - motion.position[ 0 ];
+	const double dy = k_rflHandPosition[ 1 ] - motion.position[ 1 ];
+	const double dz = k_rflHandPosition[ 2 ] - motion.position[ 2 ];
+
+	HandSample sample = {};
+	sample.hand = HandId_Left;
+	sample.fields = HandSampleField_Position | HandSampleField_Rotation | HandSampleField_CaptureTime;
+	sample.capture_time_us = static_cast< uint64_t >( nCaptureTimeUs );
+	sample.position[ 0 ] = static_cast< float >( c * dx - s * dz );
+	sample.position[ 1 ] = static_cast< float >( dy );
+	sample.position[ 2 ] = static_cast< float >( s * dx + c * dz );
+
+	// The hand keeps its orientation in the room, so relative to the head it turns the other way
+	sample.rotation[ 0 ] = static_cast< float >( std::cos( motion.yaw / 2.0 ) );
+	sample.rotation[ 2 ] = static_cast< float >( -std::sin( motion.yaw / 2.0 ) );
+	return sample;
+}
+
+// Where SteamVR puts a pose submitted now: moved by its velocity from its time to now
+static double ErrorMm( const vr::DriverPose_t &pose )
+{
+	double squared = 0.0;
+	for ( int i = 0; i < 3; i++ )
+	{
+		const double position = pose.vecPosition[ i ] - pose.vecVelocity[ i ] * pose.poseTimeOffset;
+		squared += ( position - k_rflHandPosition[ i ] ) * ( position - k_rflHandPosition[ i ] );
+	}
+	return std::sqrt( squared ) * 1000.0;
+}
+
+static bool ParseOptions( int argc, char **argv, double &fDurationS, double &fCameraHz, double &fLatencyMs, double &fMinReduction )
+{
+	ToolOptionParser parser( "head_motion_check", argc, argv );
+	while ( parser.Next() )
+	{
+		if ( !parser.Value( "--duration-s", fDurationS ) && !parser.Value( "--camera-hz", fCameraHz ) && !parser.Value( "--latency-ms", fLatencyMs ) &&
+			 !parser.Value( "--min-reduction", fMinReduction ) )
+		{
+			parser.Unknown();
+		}
+	}
+	return parser.IsValid() && fDurationS > k_unSettleUs * 1e-6 && fCameraHz > 0.0 && fLatencyMs >= 0.0 && fMinReduction < 1.0;
+}
+
+int main( int argc, char **argv )
+{
+	double duration_s = 4.0;
+	double camera_hz = 30.0;
+	double latency_ms = 45.0;
+	double min_reduction = 0.3;
+	if ( !ParseOptions( argc, argv, duration_s, camera_hz, latency_ms, min_reduction ) )
+	{
+		fprintf( stderr, "usage: head_motion_check [--duration-s 4] [--camera-hz 30] [--latency-ms 45] [--min-reduction 0.3]\n" );
+		return 2;
+	}
+
+	// The head moves on the camera's clock, not the script time the host counts from when it was made
+	MockDriverContext context;
+	const int64_t start_us = DriverClockUs();
+	context.GetServerDriverHost().SetHmdScript( [ start_us ]( double ) { return HmdPoseAt( ( DriverClockUs() - start_us ) * 1e-6 ); } );
+	vr::InitServerDriverContext( &context );
+
+	std::vector< double > capture_time_mm;
+	std::vector< double > submit_time_mm;
+	{
+		MyControllerDeviceDriver capture_time( vr::TrackedControllerRole_LeftHand );
+		MyControllerDeviceDriver submit_time( vr::TrackedControllerRole_LeftHand );
+
+		// Never activated, so it submits nothing itself, but it refreshes the hmd history every tick
+		PoseScheduler scheduler;
+		capture_time.MySetPoseScheduler( &scheduler, scheduler.AddDevice( &capture_time, k_unPosePeriodUs, false ) );
+		scheduler.Start();
+
+		const double camera_period_us = 1e6 / camera_hz;
+		const int64_t latency_us = static_cast< int64_t >( latency_ms * 1e3 );
+		const int64_t end_us = start_us + static_cast< int64_t >( duration_s * 1e6 );
+		uint32_t frame = 0;
+		int64_t pose_time_us = start_us + k_unPosePeriodUs;
+		for ( ;; )
+		{
+			const int64_t capture_us = start_us + static_cast< int64_t >( frame * camera_period_us );
+			const int64_t arrival_us = capture_us + latency_us;
+			if ( std::min( arrival_us, pose_time_us ) >= end_us )
+			{
+				break;
+			}
+
+			if ( arrival_us <= pose_time_us )
+			{
+				SleepUntilUs( arrival_us );
+				const HandSample sample = CameraSampleAt( ( capture_us - start_us ) * 1e-6, capture_us );
+				capture_time.UpdateHandSample( sample );
+				submit_time.UpdateHandSample( sample );
+				frame++;
+				continue;
+			}
+
+			SleepUntilUs( pose_time_us );
+			if ( pose_time_us - start_us >= k_unSettleUs )
+			{
+				capture_time_mm.push_back( ErrorMm( capture_time.GetPose() ) );
+				submit_time_mm.push_back( ErrorMm( submit_time.GetPose() ) );
+			}
+			pose_time_us += k_unPosePeriodUs;
+		}
+
+		scheduler.Stop();
+	}
+	vr::CleanupDriverContext();
+
+	const double capture_time_mean = Mean( capture_time_mm );
+	const double submit_time_mean = Mean( submit_time_mm );
+	printf( "{\"duration_s\":%.1f,\"camera_hz\":%.1f,\"latency_ms\":%.1f,\"poses\":%zu,\"capture_time_mm\":{\"mean\":%.2f,\"p95\":%.2f,\"max\":%.2f},"
+			"\"submit_time_mm\":{\"mean\":%.2f,\"p95\":%.2f,\"max\":%.2f}}\n",
+		duration_s, camera_hz, latency_ms, capture_time_mm.size(), capture_time_mean, Percentile95( capture_time_mm ), Max( capture_time_mm ), submit_time_mean,
+		Percentile95( submit_time_mm ), Max( submit_time_mm ) );
+
+	if ( capture_time_mm.empty() || capture_time_mean > submit_time_mean * ( 1.0 - min_reduction ) )
+	{
+		fprintf( stderr, "head_motion_check: The pose composed at capture time is off by %.2f mm on average, at submit time by %.2f mm\n", capture_time_mean,
+			submit_time_mean );
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,176 @@
+//============ Copyright (c) Valve Corporation, All rights reserved. ============
+// Counts the hmd pose requests the controllers make of the host, with the hmd pose cache the pose scheduler
+// refreshes once per tick and with one fetch per hand per pose like before. Prints one JSON object:
+//
+//	hmd_pose_benchmark [--duration-s 2] [--port 65506] [--settings resources/settings/default.vrsettings]
+//
+// shared_cache runs the whole driver in-process against MockDriverContext, its settings from the file with
+// idle_timeout_s 0 so both hands keep submitting without a producer. per_hand_fetch is MyPoseUpdateThread as it
+// was: a thread per hand calling GetPose() on a controller with no pose scheduler, which fetches and decodes the
+// hmd pose itself, then TrackedDevicePoseUpdated() and sleep_for( 5 ms ). Every request is one decode of the 3x4
+// matrix as well. The host counts the requests (GetRawTrackedDevicePoses) and the poses.
+// Exits non-zero if the cache doesn't take at least 40% off the requests per pose.
+//
+// POSIX only, like driver_benchmark.
+
+#include "controller_device_driver.h"
+#include "device_provider.h"
+#include "driver_clock.h"
+#include "mock_vr_host.h"
+#include "tool_clock.h"
+#include "tool_options.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <thread>
+
+// How long the driver gets to start submitting before the counters are read
+static constexpr int64_t k_unWarmupUs = 200000;
+
+// MyPoseUpdateThread's period
+static constexpr auto k_PerHandFetchPeriod = std::chrono::milliseconds( 5 );
+
+struct HostCallResult
+{
+	double host_calls_per_sec = 0.0;
+	double poses_per_sec = 0.0;
+	double host_calls_per_pose = 0.0;
+};
+
+//-----------------------------------------------------------------------------
+// Purpose: Host requests and poses per second over fDurationS, after the warmup
+//-----------------------------------------------------------------------------
+static HostCallResult CountHostCalls( MockServerDriverHost &host, double fDurationS )
+{
+	SleepUntilUs( DriverClockUs() + k_unWarmupUs );
+
+	const uint64_t host_calls_start = host.GetRawPoseRequestCount();
+	const uint64_t poses_start = host.Poses().Count();
+	const int64_t start_us = DriverClockUs();
+
+	SleepUntilUs( start_us + static_cast< int64_t >( fDurationS * 1e6 ) );
+
+	const double elapsed_s = ( DriverClockUs() - start_us ) * 1e-6;
+	const uint64_t host_calls = host.GetRawPoseRequestCount() - host_calls_start;
+	const uint64_t poses = host.Poses().Count() - poses_start;
+
+	HostCallResult result;
+	result.host_calls_per_sec = host_calls / elapsed_s;
+	result.poses_per_sec = poses / elapsed_s;
+	result.host_calls_per_pose = poses > 0 ? static_cast< double >( host_calls ) / poses : 0.0;
+	return result;
+}
+
+static bool RunSharedCache( const char *pchSettingsPath, int nPort, double fDurationS, HostCallResult &result )
+{
+	MockDriverContext context;
+	MockSettings &settings = context.GetSettings();
+	if ( !LoadDriverSettings( "hmd_pose_benchmark", settings, pchSettingsPath ) )
+	{
+		return false;
+	}
+	settings.SetInt32( driver_settings_section, "port", nPort );
+	settings.SetFloat( driver_settings_section, "idle_timeout_s", 0.f );
+	context.GetServerDriverHost().SetHmdScript( []( double ) { return MockStandingHmdPose( 1.7f ); } );
+
+	MyDeviceProvider provider;
+	if ( provider.Init( &context ) != vr::VRInitError_None )
+	{
+		fprintf( stderr, "hmd_pose_benchmark: The driver failed to initialize\n" );
+		return false;
+	}
+
+	RunFrameThread run_frame_thread( provider );
+	result = CountHostCalls( context.GetServerDriverHost(), fDurationS );
+	run_frame_thread.Stop();
+
+	context.GetServerDriverHost().DeactivateDevices();
+	provider.Cleanup();
+	return true;
+}
+
+static void RunPerHandFetch( double fDurationS, HostCallResult &result )
+{
+	MockDriverContext context;
+	context.GetServerDriverHost().SetHmdScript( []( double ) { return MockStandingHmdPose( 1.7f ); } );
+	vr::InitServerDriverContext( &context );
+
+	{
+		MyControllerDeviceDriver left( vr::TrackedControllerRole_LeftHand );
+		MyControllerDeviceDriver right( vr::TrackedControllerRole_RightHand );
+
+		std::atomic< bool > is_running{ true };
+		auto PoseUpdateThread = [ &is_running ]( MyControllerDeviceDriver *controller, vr::TrackedDeviceIndex_t unIndex )
+		{
+			while ( is_running )
+			{
+				vr::VRServerDriverHost()->TrackedDevicePoseUpdated( unIndex, controller->GetPose(), sizeof( vr::DriverPose_t ) );
+				std::this_thread::sleep_for( k_PerHandFetchPeriod );
+			}
+		};
+		std::thread left_thread( PoseUpdateThread, &left, 1 );
+		std::thread right_thread( PoseUpdateThread, &right, 2 );
+
+		result = CountHostCalls( context.GetServerDriverHost(), fDurationS );
+
+		is_running = false;
+		left_thread.join();
+		right_thread.join();
+	}
+
+	vr::CleanupDriverContext();
+}
+
+static void PrintResult( const char *pchName, const HostCallResult &result )
+{
+	printf( "\"%s\":{\"host_calls_per_sec\":%.1f,\"poses_per_sec\":%.1f,\"host_calls_per_pose\":%.3f}", pchName, result.host_calls_per_sec,
+		result.poses_per_sec, result.host_calls_per_pose );
+}
+
+int main( int argc, char **argv )
+{
+	double duration_s = 2.0;
+	int port = 65506;
+	const char *settings_path = "resources/settings/default.vrsettings";
+	ToolOptionParser parser( "hmd_pose_benchmark", argc, argv );
+	while ( parser.Next() )
+	{
+		if ( !parser.Value( "--duration-s", duration_s ) && !parser.Value( "--port", port ) && !parser.Value( "--settings", settings_path ) )
+		{
+			parser.Unknown();
+		}
+	}
+	if ( !parser.IsValid() || duration_s <= 0.0 || port <= 0 || port > 65535 )
+	{
+		fprintf( stderr, "usage: hmd_pose_benchmark [--duration-s 2] [--port 65506] [--settings resources/settings/default.vrsettings]\n" );
+		return 2;
+	}
+
+	HostCallResult shared_cache;
+	if ( !RunSharedCache( settings_path, port, duration_s, shared_cache ) )
+	{
+		return 1;
+	}
+	HostCallResult per_hand_fetch;
+	RunPerHandFetch( duration_s, per_hand_fetch );
+
+	printf( "{\"duration_s\":%.1f,", duration_s );
+	PrintResult( "shared_cache", shared_cache );
+	printf( "," );
+	PrintResult( "per_hand_fetch", per_hand_fetch );
+	printf( "}\n" );
+
+	if ( shared_cache.poses_per_sec == 0.0 || per_hand_fetch.poses_per_sec == 0.0 )
+	{
+		fprintf( stderr, "hmd_pose_benchmark: No poses were submitted\n" );
+		return 1;
+	}
+	if ( shared_cache.host_calls_per_pose > 0.6 * per_hand_fetch.host_calls_per_pose )
+	{
+		fprintf( stderr, "hmd_pose_benchmark: %.3f hmd pose requests per pose with the cache, %.3f fetching per hand\n", shared_cache.host_calls_per_pose,
+			per_hand_fetch.host_calls_per_pose );
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,236 @@
+//============ Copyright (c) Valve Corporation, All rights reserved. ============
+// Counts the input updates the controllers send to the host, only sending what changed, against sending every
+// component on every RunFrame() like before. Prints one JSON object:
+//
+//	input_benchmark [--rate-hz 30] [--duration-s 3] [--port 65507] [--settings resources/settings/default.vrsettings]
+//
+// The whole driver runs in-process against MockDriverContext, RunFrame() at 90 Hz, while a synthetic producer sends
+// both hands at --rate-hz. The host counts the updates it gets; the driver counts the ones it held back, so the two
+// together are what sending everything would have been: five components per hand per RunFrame(). Afterwards every
+// update the host got is looked at: the last trigger and grip of each hand have to be the last ones sent, and the
+// time offsets the sample's age, never in the future.
+// Exits non-zero if any of that doesn't hold or if fewer than half of the updates are held back.
+//
+// POSIX only, like driver_benchmark.
+
+#include "device_provider.h"
+#include "driver_clock.h"
+#include "hand_stream_sender.h"
+#include "mock_vr_host.h"
+#include "synthetic_hand_source.h"
+#include "tool_clock.h"
+#include "tool_options.h"
+
+#include <cstdio>
+
+// The components MyRunFrame() updates per hand
+static constexpr uint32_t k_unInputComponents = 5;
+
+struct InputBenchmarkOptions
+{
+	double rate_hz = 30.0;
+	double duration_s = 3.0;
+	int port = 65507;
+	const char *settings_path = "resources/settings/default.vrsettings";
+};
+
+struct InputResult
+{
+	uint64_t run_frames = 0;
+	uint64_t host_updates = 0;
+	uint64_t driver_updates = 0;
+	uint64_t suppressed = 0;
+	uint64_t rejected = 0;
+	uint64_t future_offsets = 0;
+	double mean_age_ms = 0.0;
+	bool last_values_match = true;
+	double elapsed_s = 0.0;
+};
+
+//-----------------------------------------------------------------------------
+// Purpose: The last value the host got for component, false if it never got one
+//-----------------------------------------------------------------------------
+static bool LastInputValue( const MockDriverInput &input, vr::VRInputComponentHandle_t ulComponent, float &fValue )
+{
+	const MockRecordBuffer< MockInputRecord > &updates = input.Updates();
+	for ( size_t i = updates.Size(); i-- > 0; )
+	{
+		if ( updates.At( i ).component == ulComponent )
+		{
+			fValue = updates.At( i ).value;
+			return true;
+		}
+	}
+	return false;
+}
+
+static bool RunInputBenchmark( const InputBenchmarkOptions &options, InputResult &result )
+{
+	MockDriverContext context;
+	MockSettings &settings = context.GetSettings();
+	if ( !LoadDriverSettings( "input_benchmark", settings, options.settings_path ) )
+	{
+		return false;
+	}
+	settings.SetInt32( driver_settings_section, "port", options.port );
+	settings.SetString( driver_settings_section, "transport", "tcp" );
+
+	MyDeviceProvider provider;
+	if ( provider.Init( &context ) != vr::VRInitError_None || provider.MyGetHandTrackingListener() == nullptr )
+	{
+		fprintf( stderr, "input_benchmark: The driver failed to initialize\n" );
+		return false;
+	}
+
+	RunFrameThread run_frame_thread( provider );
+	auto Shutdown = [ & ]()
+	{
+		context.GetServerDriverHost().DeactivateDevices();
+		provider.Cleanup();
+	};
+
+	HandStreamSender sender;
+	if ( !sender.Open( HandTransport_Tcp, HandStreamProtocol_Binary, options.port, nullptr, 1000 ) )
+	{
+		fprintf( stderr, "input_benchmark: Can't connect to the listener (port %d)\n", options.port );
+		run_frame_thread.Stop();
+		Shutdown();
+		return false;
+	}
+
+	SyntheticHandOptions source_options;
+	source_options.frame_rate_hz = options.rate_hz;
+	SyntheticHandSource source( source_options );
+	HandSampleBatch batch{};
+	float last_trigger[ HandId_MAX ] = {};
+	float last_grip[ HandId_MAX ] = {};
+
+	const double period_us = 1000000.0 / options.rate_hz;
+	const int64_t start_time_us = DriverClockUs();
+	const int64_t end_time_us = start_time_us + static_cast< int64_t >( options.duration_s * 1e6 );
+	for ( uint32_t frame = 0;; frame++ )
+	{
+		const int64_t due_time_us = start_time_us + static_cast< int64_t >( frame * period_us );
+		if ( due_time_us >= end_time_us )
+		{
+			break;
+		}
+		SleepUntilUs( due_time_us );
+
+		source.Generate( frame, DriverClockUs(), batch );
+		if ( sender.Send( batch ) )
+		{
+			for ( uint32_t i = 0; i < batch.hand_count; i++ )
+			{
+				last_trigger[ batch.hands[ i ].hand ] = batch.hands[ i ].trigger;
+				last_grip[ batch.hands[ i ].hand ] = batch.hands[ i ].grip;
+			}
+		}
+	}
+	SleepUntilUs( end_time_us + k_unDrainTimeUs );
+	sender.Close();
+
+	// The counters only add up once RunFrame() has stopped, the pipeline stats go with the driver
+	run_frame_thread.Stop();
+	result.elapsed_s = ( DriverClockUs() - start_time_us ) * 1e-6;
+	result.run_frames = run_frame_thread.GetRunFrameCount();
+
+	const MockDriverInput &input = context.GetDriverInput();
+	const PipelineStats &stats = *provider.MyGetPipelineStats();
+	for ( int hand = 0; hand < HandId_MAX; hand++ )
+	{
+		result.driver_updates += stats.Hand( static_cast< HandId >( hand ) ).input_updates.load();
+		result.suppressed += stats.Hand( static_cast< HandId >( hand ) ).input_updates_suppressed.load();
+
+		// The mock hmd is device 0 and the left hand is added first
+		const vr::PropertyContainerHandle_t container = context.GetProperties().TrackedDeviceToPropertyContainer( static_cast< vr::TrackedDeviceIndex_t >( hand + 1 ) );
+		float trigger = -1.f;
+		float grip = -1.f;
+		result.last_values_match &= LastInputValue( input, input.FindComponent( container, "/input/trigger/value" ), trigger ) && trigger == last_trigger[ hand ];
+		result.last_values_match &= LastInputValue( input, input.FindComponent( container, "/input/grip/value" ), grip ) && grip == last_grip[ hand ];
+	}
+	result.host_updates = input.Updates().Count();
+	result.rejected = input.GetRejectedUpdateCount();
+
+	double age_sum_s = 0.0;
+	for ( size_t i = 0; i < input.Updates().Size(); i++ )
+	{
+		const double time_offset = input.Updates().At( i ).time_offset;
+		result.future_offsets += time_offset > 0.0;
+		age_sum_s -= time_offset;
+	}
+	result.mean_age_ms = input.Updates().Size() > 0 ? age_sum_s / input.Updates().Size() * 1e3 : 0.0;
+
+	Shutdown();
+	return true;
+}
+
+static bool ParseOptions( int argc, char **argv, InputBenchmarkOptions &options )
+{
+	ToolOptionParser parser( "input_benchmark", argc, argv );
+	while ( parser.Next() )
+	{
+		if ( !parser.Value( "--rate-hz", options.rate_hz ) && !parser.Value( "--duration-s", options.duration_s ) && !parser.Value( "--port", options.port ) &&
+			 !parser.Value( "--settings", options.settings_path ) )
+		{
+			parser.Unknown();
+		}
+	}
+
+	return parser.IsValid() && options.rate_hz > 0.0 && options.rate_hz <= 1000.0 && options.duration_s > 0.0 && options.port > 0 && options.port <= 65535;
+}
+
+int main( int argc, char **argv )
+{
+	InputBenchmarkOptions options;
+	if ( !ParseOptions( argc, argv, options ) )
+	{
+		fprintf( stderr, "usage: input_benchmark [--rate-hz 30] [--duration-s 3] [--port 65507] [--settings resources/settings/default.vrsettings]\n" );
+		return 2;
+	}
+
+	InputResult result;
+	if ( !RunInputBenchmark( options, result ) )
+	{
+		return 1;
+	}
+
+	const uint64_t send_everything = result.driver_updates + result.suppressed;
+	printf( "{\"rate_hz\":%.1f,\"duration_s\":%.1f,\"run_frames\":%llu,\"change_detection\":{\"host_updates\":%llu,\"host_updates_per_sec\":%.1f,"
+			"\"suppressed\":%llu,\"mean_age_ms\":%.2f},\"send_everything\":{\"host_updates\":%llu,\"host_updates_per_sec\":%.1f},\"reduction\":%.3f}\n",
+		options.rate_hz, options.duration_s, static_cast< unsigned long long >( result.run_frames ), static_cast< unsigned long long >( result.host_updates ),
+		result.host_updates / result.elapsed_s, static_cast< unsigned long long >( result.suppressed ), result.mean_age_ms,
+		static_cast< unsigned long long >( send_everything ), send_everything / result.elapsed_s,
+		send_everything > 0 ? 1.0 - static_cast< double >( result.host_updates ) / send_everything : 0.0 );
+
+	bool passed = true;
+	if ( result.host_updates != result.driver_updates || result.rejected > 0 )
+	{
+		fprintf( stderr, "input_benchmark: The host got %llu updates (%llu rejected), the driver counted %llu\n", static_cast< unsigned long long >( result.host_updates ),
+			static_cast< unsigned long long >( result.rejected ), static_cast< unsigned long long >( result.driver_updates ) );
+		passed = false;
+	}
+	if ( send_everything < result.run_frames * k_unInputComponents * HandId_MAX / 2 )
+	{
+		fprintf( stderr, "input_benchmark: Only %llu updates were looked at in %llu RunFrame() calls\n", static_cast< unsigned long long >( send_everything ),
+			static_cast< unsigned long long >( result.run_frames ) );
+		passed = false;
+	}
+	if ( !result.last_values_match )
+	{
+		fprintf( stderr, "input_benchmark: The host's last trigger or grip isn't the last one sent\n" );
+		passed = false;
+	}
+	if ( result.future_offsets > 0 )
+	{
+		fprintf( stderr, "input_benchmark: %llu updates had a time offset in the future\n", static_cast< unsigned long long >( result.future_offsets ) );
+		passed = false;
+	}
+	if ( result.host_updates * 2 > send_everything )
+	{
+		fprintf( stderr, "input_benchmark: %llu of %llu updates were sent\n", static_cast< unsigned long long >( result.host_updates ),
+			static_cast< unsigned long long >( send_everything ) );
+		passed = false;
+	}
+	return passed ? 0 : 1;
+}
@@ -0,0 +1,1005 @@
+//============ Copyright (c) Valve Corporation, All rights reserved. ============
+#include "mock_vr_host.h"
+
+#include "driver_clock.h"
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+
+vr::TrackedDevicePose_t MockStandingHmdPose( float fHeightM )
+{
+	vr::TrackedDevicePose_t pose{};
+	pose.mDeviceToAbsoluteTracking.m[ 0 ][ 0 ] = 1.f;
+	pose.mDeviceToAbsoluteTracking.m[ 1 ][ 1 ] = 1.f;
+	pose.mDeviceToAbsoluteTracking.m[ 2 ][ 2 ] = 1.f;
+	pose.mDeviceToAbsoluteTracking.m[ 1 ][ 3 ] = fHeightM;
+	pose.eTrackingResult = vr::TrackingResult_Running_OK;
+	pose.bPoseIsValid = true;
+	pose.bDeviceIsConnected = true;
+	return pose;
+}
+
+//-----------------------------------------------------------------------------
+// MockServerDriverHost
+//-----------------------------------------------------------------------------
+MockServerDriverHost::MockServerDriverHost( size_t unPoseCapacity )
+	: start_time_us_( DriverClockUs() )
+	, poses_( unPoseCapacity )
+	, raw_pose_requests_( 0 )
+	, hmd_script_( []( double ) { return MockStandingHmdPose( 1.7f ); } )
+	, frame_period_us_( 0.0 )
+	, is_exiting_( false )
+	, events_{}
+	, event_read_( 0 )
+	, event_count_( 0 )
+{
+	devices_.push_back( MockDevice{ "MockHmd", vr::TrackedDeviceClass_HMD, nullptr } );
+}
+
+void MockServerDriverHost::SetHmdScript( MockHmdScript script )
+{
+	hmd_script_ = std::move( script );
+}
+
+void MockServerDriverHost::SetDisplayFrequency( float fFrequencyHz )
+{
+	frame_period_us_.store( fFrequencyHz > 0.f ? 1000000.0 / fFrequencyHz : 0.0 );
+}
+
+void MockServerDriverHost::SetExiting( bool bIsExiting )
+{
+	is_exiting_.store( bIsExiting );
+}
+
+bool MockServerDriverHost::QueueEvent( const vr::VREvent_t &vrevent )
+{
+	std::lock_guard< std::mutex > lock( event_mutex_ );
+
+	if ( event_count_ == k_unEventQueueSize )
+	{
+		return false;
+	}
+
+	events_[ ( event_read_ + event_count_ ) % k_unEventQueueSize ] = vrevent;
+	event_count_++;
+	return true;
+}
+
+void MockServerDriverHost::DeactivateDevices()
+{
+	std::vector< vr::ITrackedDeviceServerDriver * > drivers;
+	{
+		std::lock_guard< std::mutex > lock( devices_mutex_ );
+		for ( const MockDevice &device : devices_ )
+		{
+			if ( device.driver != nullptr )
+			{
+				drivers.push_back( device.driver );
+			}
+		}
+	}
+
+	// Not under the lock, a device may still call back into the host while it shuts down
+	for ( vr::ITrackedDeviceServerDriver *driver : drivers )
+	{
+		driver->Deactivate();
+	}
+}
+
+vr::ITrackedDeviceServerDriver *MockServerDriverHost::GetDevice( vr::TrackedDeviceIndex_t unDeviceIndex ) const
+{
+	std::lock_guard< std::mutex > lock( devices_mutex_ );
+	return unDeviceIndex < devices_.size() ? devices_[ unDeviceIndex ].driver : nullptr;
+}
+
+vr::TrackedDeviceIndex_t MockServerDriverHost::FindDevice( const char *pchSerialNumber ) const
+{
+	std::lock_guard< std::mutex > lock( devices_mutex_ );
+	for ( size_t i = 0; i < devices_.size(); i++ )
+	{
+		if ( devices_[ i ].serial_number == pchSerialNumber )
+		{
+			return static_cast< vr::TrackedDeviceIndex_t >( i );
+		}
+	}
+	return vr::k_unTrackedDeviceIndexInvalid;
+}
+
+uint32_t MockServerDriverHost::GetDeviceCount() const
+{
+	std::lock_guard< std::mutex > lock( devices_mutex_ );
+	return static_cast< uint32_t >( devices_.size() );
+}
+
+const MockRecordBuffer< MockPoseRecord > &MockServerDriverHost::Poses() const
+{
+	return poses_;
+}
+
+MockRecordBuffer< MockPoseRecord > &MockServerDriverHost::Poses()
+{
+	return poses_;
+}
+
+uint64_t MockServerDriverHost::GetRawPoseRequestCount() const
+{
+	return raw_pose_requests_.load( std::memory_order_relaxed );
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Gives the device the next free index and activates it straight away, where vrserver would do
+// that a little later on its own thread
+//-----------------------------------------------------------------------------
+bool MockServerDriverHost::TrackedDeviceAdded( const char *pchDeviceSerialNumber, vr::ETrackedDeviceClass eDeviceClass, vr::ITrackedDeviceServerDriver *pDriver )
+{
+	if ( pchDeviceSerialNumber == nullptr || pDriver == nullptr )
+	{
+		return false;
+	}
+
+	vr::TrackedDeviceIndex_t device_index;
+	{
+		std::lock_guard< std::mutex > lock( devices_mutex_ );
+		if ( devices_.size() >= vr::k_unMaxTrackedDeviceCount )
+		{
+			return false;
+		}
+
+		for ( const MockDevice &device : devices_ )
+		{
+			if ( device.serial_number == pchDeviceSerialNumber )
+			{
+				return false;
+			}
+		}
+
+		device_index = static_cast< vr::TrackedDeviceIndex_t >( devices_.size() );
+		devices_.push_back( MockDevice{ pchDeviceSerialNumber, eDeviceClass, pDriver } );
+	}
+
+	return pDriver->Activate( device_index ) == vr::VRInitError_None;
+}
+
+void MockServerDriverHost::TrackedDevicePoseUpdated( uint32_t unWhichDevice, const vr::DriverPose_t &newPose, uint32_t unPoseStructSize )
+{
+	if ( unPoseStructSize != sizeof( vr::DriverPose_t ) )
+	{
+		return;
+	}
+
+	poses_.Record( MockPoseRecord{ DriverClockUs(), unWhichDevice, newPose } );
+}
+
+void MockServerDriverHost::VsyncEvent( double vsyncTimeOffsetSeconds )
+{
+}
+
+void MockServerDriverHost::VendorSpecificEvent( uint32_t unWhichDevice, vr::EVREventType eventType, const vr::VREvent_Data_t &eventData, double eventTimeOffset )
+{
+	vr::VREvent_t vrevent{};
+	vrevent.eventType = eventType;
+	vrevent.trackedDeviceIndex = unWhichDevice;
+	vrevent.eventAgeSeconds = static_cast< float >( -eventTimeOffset );
+	vrevent.data = eventData;
+	QueueEvent( vrevent );
+}
+
+bool MockServerDriverHost::IsExiting()
+{
+	return is_exiting_.load();
+}
+
+bool MockServerDriverHost::PollNextEvent( vr::VREvent_t *pEvent, uint32_t uncbVREvent )
+{
+	if ( pEvent == nullptr || uncbVREvent != sizeof( vr::VREvent_t ) )
+	{
+		return false;
+	}
+
+	std::lock_guard< std::mutex > lock( event_mutex_ );
+
+	if ( event_count_ == 0 )
+	{
+		return false;
+	}
+
+	*pEvent = events_[ event_read_ ];
+	event_read_ = ( event_read_ + 1 ) % k_unEventQueueSize;
+	event_count_--;
+	return true;
+}
+
+void MockServerDriverHost::GetRawTrackedDevicePoses( float fPredictedSecondsFromNow, vr::TrackedDevicePose_t *pTrackedDevicePoseArray, uint32_t unTrackedDevicePoseArrayCount )
+{
+	raw_pose_requests_.fetch_add( 1, std::memory_order_relaxed );
+
+	if ( pTrackedDevicePoseArray == nullptr )
+	{
+		return;
+	}
+
+	// Only the hmd is scripted, the devices the driver added know their own poses
+	for ( uint32_t i = 0; i < unTrackedDevicePoseArrayCount; i++ )
+	{
+		pTrackedDevicePoseArray[ i ] = vr::TrackedDevicePose_t{};
+		pTrackedDevicePoseArray[ i ].eTrackingResult = vr::TrackingResult_Uninitialized;
+	}
+
+	if ( unTrackedDevicePoseArrayCount > vr::k_unTrackedDeviceIndex_Hmd )
+	{
+		const double time_s = ( DriverClockUs() - start_time_us_ ) * 1e-6 + fPredictedSecondsFromNow;
+		pTrackedDevicePoseArray[ vr::k_unTrackedDeviceIndex_Hmd ] = hmd_script_( time_s );
+	}
+}
+
+void MockServerDriverHost::RequestRestart( const char *pchLocalizedReason, const char *pchExecutableToStart, const char *pchArguments, const char *pchWorkingDirectory )
+{
+	fprintf( stderr, "MockServerDriverHost: The driver asked for a restart: %s\n", pchLocalizedReason != nullptr ? pchLocalizedReason : "" );
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Frames of a display that has been presenting at the set frequency ever since the host was created,
+// oldest first, the last one started at the most recent vsync
+//-----------------------------------------------------------------------------
+uint32_t MockServerDriverHost::GetFrameTimings( vr::Compositor_FrameTiming *pTiming, uint32_t nFrames )
+{
+	const double frame_period_us = frame_period_us_.load();
+	if ( pTiming == nullptr || nFrames == 0 || pTiming->m_nSize != sizeof( vr::Compositor_FrameTiming ) || frame_period_us <= 0.0 )
+	{
+		return 0;
+	}
+
+	const int64_t now_us = DriverClockUs();
+	const uint64_t newest_frame = static_cast< uint64_t >( std::floor( ( now_us - start_time_us_ ) / frame_period_us ) );
+	const uint32_t frame_count = static_cast< uint32_t >( std::min< uint64_t >( nFrames, newest_frame + 1 ) );
+
+	for ( uint32_t i = 0; i < frame_count; i++ )
+	{
+		const uint64_t frame = newest_frame + 1 - frame_count + i;
+		const double vsync_time_us = start_time_us_ + frame * frame_period_us;
+
+		vr::Compositor_FrameTiming &timing = pTiming[ i ];
+		timing = vr::Compositor_FrameTiming{};
+		timing.m_nSize = sizeof( vr::Compositor_FrameTiming );
+		timing.m_nFrameIndex = static_cast< uint32_t >( frame );
+		timing.m_nNumFramePresents = 1;
+		timing.m_flSystemTimeInSeconds = vsync_time_us * 1e-6;
+		timing.m_HmdPose = hmd_script_( ( vsync_time_us - start_time_us_ ) * 1e-6 );
+	}
+
+	return frame_count;
+}
+
+void MockServerDriverHost::SetDisplayEyeToHead( uint32_t unWhichDevice, const vr::HmdMatrix34_t &eyeToHeadLeft, const vr::HmdMatrix34_t &eyeToHeadRight )
+{
+}
+
+void MockServerDriverHost::SetDisplayProjectionRaw( uint32_t unWhichDevice, const vr::HmdRect2_t &eyeLeft, const vr::HmdRect2_t &eyeRight )
+{
+}
+
+void MockServerDriverHost::SetRecommendedRenderTargetSize( uint32_t unWhichDevice, uint32_t nWidth, uint32_t nHeight )
+{
+}
+
+//-----------------------------------------------------------------------------
+// MockDriverInput
+//-----------------------------------------------------------------------------
+MockDriverInput::MockDriverInput( size_t unUpdateCapacity )
+	: component_count_( 0 )
+	, updates_( unUpdateCapacity )
+	, rejected_updates_( 0 )
+{
+	components_.reserve( k_unMaxComponents );
+}
+
+vr::VRInputComponentHandle_t MockDriverInput::FindComponent( vr::PropertyContainerHandle_t ulContainer, const char *pchName ) const
+{
+	std::lock_guard< std::mutex > lock( create_mutex_ );
+	for ( size_t i = 0; i < components_.size(); i++ )
+	{
+		if ( components_[ i ].container == ulContainer && components_[ i ].name == pchName )
+		{
+			return static_cast< vr::VRInputComponentHandle_t >( i + 1 );
+		}
+	}
+	return vr::k_ulInvalidInputComponentHandle;
+}
+
+const MockRecordBuffer< MockInputRecord > &MockDriverInput::Updates() const
+{
+	return updates_;
+}
+
+MockRecordBuffer< MockInputRecord > &MockDriverInput::Updates()
+{
+	return updates_;
+}
+
+uint64_t MockDriverInput::GetRejectedUpdateCount() const
+{
+	return rejected_updates_.load( std::memory_order_relaxed );
+}
+
+vr::EVRInputError MockDriverInput::CreateComponent( vr::PropertyContainerHandle_t ulContainer, const char *pchName, ComponentType type, vr::VRInputComponentHandle_t *pHandle )
+{
+	if ( pHandle == nullptr )
+	{
+		return vr::VRInputError_InvalidParam;
+	}
+	*pHandle = vr::k_ulInvalidInputComponentHandle;
+
+	if ( ulContainer == vr::k_ulInvalidPropertyContainer || pchName == nullptr || pchName[ 0 ] != '/' )
+	{
+		return vr::VRInputError_InvalidParam;
+	}
+
+	std::lock_guard< std::mutex > lock( create_mutex_ );
+
+	// Past the reserved size the vector would move under the readers
+	if ( components_.size() == k_unMaxComponents )
+	{
+		return vr::VRInputError_InvalidParam;
+	}
+
+	components_.push_back( MockComponent{ ulContainer, pchName, type } );
+	component_count_.store( components_.size(), std::memory_order_release );
+	*pHandle = static_cast< vr::VRInputComponentHandle_t >( components_.size() );
+	return vr::VRInputError_None;
+}
+
+vr::EVRInputError MockDriverInput::RecordUpdate( vr::VRInputComponentHandle_t ulComponent, ComponentType type, float fValue, double fTimeOffset )
+{
+	if ( ulComponent == vr::k_ulInvalidInputComponentHandle || ulComponent > component_count_.load( std::memory_order_acquire ) )
+	{
+		rejected_updates_.fetch_add( 1, std::memory_order_relaxed );
+		return vr::VRInputError_InvalidHandle;
+	}
+
+	if ( components_[ ulComponent - 1 ].type != type )
+	{
+		rejected_updates_.fetch_add( 1, std::memory_order_relaxed );
+		return vr::VRInputError_WrongType;
+	}
+
+	updates_.Record( MockInputRecord{ DriverClockUs(), ulComponent, fValue, fTimeOffset } );
+	return vr::VRInputError_None;
+}
+
+vr::EVRInputError MockDriverInput::CreateBooleanComponent( vr::PropertyContainerHandle_t ulContainer, const char *pchName, vr::VRInputComponentHandle_t *pHandle )
+{
+	return CreateComponent( ulContainer, pchName, ComponentType_Boolean, pHandle );
+}
+
+vr::EVRInputError MockDriverInput::UpdateBooleanComponent( vr::VRInputComponentHandle_t ulComponent, bool bNewValue, double fTimeOffset )
+{
+	return RecordUpdate( ulComponent, ComponentType_Boolean, bNewValue ? 1.f : 0.f, fTimeOffset );
+}
+
+vr::EVRInputError MockDriverInput::CreateScalarComponent( vr::PropertyContainerHandle_t ulContainer, const char *pchName, vr::VRInputComponentHandle_t *pHandle,
+	vr::EVRScalarType eType, vr::EVRScalarUnits eUnits )
+{
+	return CreateComponent( ulContainer, pchName, ComponentType_Scalar, pHandle );
+}
+
+vr::EVRInputError MockDriverInput::UpdateScalarComponent( vr::VRInputComponentHandle_t ulComponent, float fNewValue, double fTimeOffset )
+{
+	return RecordUpdate( ulComponent, ComponentType_Scalar, fNewValue, fTimeOffset );
+}
+
+vr::EVRInputError MockDriverInput::CreateHapticComponent( vr::PropertyContainerHandle_t ulContainer, const char *pchName, vr::VRInputComponentHandle_t *pHandle )
+{
+	return CreateComponent( ulContainer, pchName, ComponentType_Haptic, pHandle );
+}
+
+vr::EVRInputError MockDriverInput::CreateSkeletonComponent( vr::PropertyContainerHandle_t ulContainer, const char *pchName, const char *pchSkeletonPath, const char *pchBasePosePath,
+	vr::EVRSkeletalTrackingLevel eSkeletalTrackingLevel, const vr::VRBoneTransform_t *pGripLimitTransforms, uint32_t unGripLimitTransformCount,
+	vr::VRInputComponentHandle_t *pHandle )
+{
+	return CreateComponent( ulContainer, pchName, ComponentType_Skeleton, pHandle );
+}
+
+vr::EVRInputError MockDriverInput::UpdateSkeletonComponent( vr::VRInputComponentHandle_t ulComponent, vr::EVRSkeletalMotionRange eMotionRange, const vr::VRBoneTransform_t *pTransforms,
+	uint32_t unTransformCount )
+{
+	// Bone transforms aren't kept, the record just says the skeleton was updated with this many bones
+	return RecordUpdate( ulComponent, ComponentType_Skeleton, static_cast< float >( unTransformCount ), 0.0 );
+}
+
+//-----------------------------------------------------------------------------
+// MockProperties
+//-----------------------------------------------------------------------------
+vr::ETrackedPropertyError MockProperties::ReadPropertyBatch( vr::PropertyContainerHandle_t ulContainerHandle, vr::PropertyRead_t *pBatch, uint32_t unBatchEntryCount )
+{
+	if ( ulContainerHandle == vr::k_ulInvalidPropertyContainer || pBatch == nullptr )
+	{
+		return vr::TrackedProp_InvalidContainer;
+	}
+
+	std::lock_guard< std::mutex > lock( mutex_ );
+
+	for ( uint32_t i = 0; i < unBatchEntryCount; i++ )
+	{
+		vr::PropertyRead_t &read = pBatch[ i ];
+		read.unTag = vr::k_unInvalidPropertyTag;
+		read.unRequiredBufferSize = 0;
+
+		const auto it = properties_.find( { ulContainerHandle, read.prop } );
+		if ( it == properties_.end() )
+		{
+			read.eError = vr::TrackedProp_UnknownProperty;
+			continue;
+		}
+
+		const MockProperty &property = it->second;
+		if ( property.error != vr::TrackedProp_Success )
+		{
+			read.eError = property.error;
+			continue;
+		}
+
+		read.unTag = property.tag;
+		read.unRequiredBufferSize = static_cast< uint32_t >( property.value.size() );
+		if ( read.pvBuffer == nullptr || read.unBufferSize < property.value.size() )
+		{
+			read.eError = vr::TrackedProp_BufferTooSmall;
+			continue;
+		}
+
+		if ( !property.value.empty() )
+		{
+			memcpy( read.pvBuffer, property.value.data(), property.value.size() );
+		}
+		read.eError = vr::TrackedProp_Success;
+	}
+
+	return vr::TrackedProp_Success;
+}
+
+vr::ETrackedPropertyError MockProperties::WritePropertyBatch( vr::PropertyContainerHandle_t ulContainerHandle, vr::PropertyWrite_t *pBatch, uint32_t unBatchEntryCount )
+{
+	if ( ulContainerHandle == vr::k_ulInvalidPropertyContainer || pBatch == nullptr )
+	{
+		return vr::TrackedProp_InvalidContainer;
+	}
+
+	std::lock_guard< std::mutex > lock( mutex_ );
+
+	for ( uint32_t i = 0; i < unBatchEntryCount; i++ )
+	{
+		vr::PropertyWrite_t &write = pBatch[ i ];
+		const auto key = std::make_pair( ulContainerHandle, write.prop );
+		write.eError = vr::TrackedProp_Success;
+
+		switch ( write.writeType )
+		{
+			case vr::PropertyWrite_Set:
+			{
+				if ( write.pvBuffer == nullptr && write.unBufferSize > 0 )
+				{
+					write.eError = vr::TrackedProp_InvalidOperation;
+					break;
+				}
+
+				const uint8_t *value = static_cast< const uint8_t * >( write.pvBuffer );
+				properties_[ key ] = MockProperty{ write.unTag, vr::TrackedProp_Success, std::vector< uint8_t >( value, value + write.unBufferSize ) };
+				break;
+			}
+			case vr::PropertyWrite_Erase:
+				properties_.erase( key );
+				break;
+			case vr::PropertyWrite_SetError:
+				properties_[ key ] = MockProperty{ vr::k_unInvalidPropertyTag, write.eSetError, {} };
+				break;
+			default:
+				write.eError = vr::TrackedProp_InvalidOperation;
+				break;
+		}
+	}
+
+	return vr::TrackedProp_Success;
+}
+
+const char *MockProperties::GetPropErrorNameFromEnum( vr::ETrackedPropertyError error )
+{
+	switch ( error )
+	{
+		case vr::TrackedProp_Success:
+			return "TrackedProp_Success";
+		case vr::TrackedProp_WrongDataType:
+			return "TrackedProp_WrongDataType";
+		case vr::TrackedProp_BufferTooSmall:
+			return "TrackedProp_BufferTooSmall";
+		case vr::TrackedProp_UnknownProperty:
+			return "TrackedProp_UnknownProperty";
+		case vr::TrackedProp_InvalidOperation:
+			return "TrackedProp_InvalidOperation";
+		case vr::TrackedProp_InvalidContainer:
+			return "TrackedProp_InvalidContainer";
+		default:
+			return "TrackedProp_Unknown";
+	}
+}
+
+vr::PropertyContainerHandle_t MockProperties::TrackedDeviceToPropertyContainer( vr::TrackedDeviceIndex_t nDevice )
+{
+	return nDevice < vr::k_unMaxTrackedDeviceCount ? static_cast< vr::PropertyContainerHandle_t >( nDevice ) + 1 : vr::k_ulInvalidPropertyContainer;
+}
+
+//-----------------------------------------------------------------------------
+// MockSettings
+//-----------------------------------------------------------------------------
+
+// Just enough JSON for .vrsettings files: an object of objects of strings, numbers and booleans
+class SettingsFileParser
+{
+public:
+	explicit SettingsFileParser( const std::string &text )
+		: text_( text )
+		, offset_( 0 )
+	{
+	}
+
+	template < typename Callback >
+	bool Parse( Callback &&addSetting )
+	{
+		if ( !Consume( '{' ) )
+		{
+			return false;
+		}
+		if ( Consume( '}' ) )
+		{
+			return AtEnd();
+		}
+
+		do
+		{
+			std::string section;
+			if ( !ParseString( &section ) || !Consume( ':' ) || !Consume( '{' ) )
+			{
+				return false;
+			}
+			if ( Consume( '}' ) )
+			{
+				continue;
+			}
+
+			do
+			{
+				std::string key;
+				if ( !ParseString( &key ) || !Consume( ':' ) )
+				{
+					return false;
+				}
+
+				SkipSpace();
+				if ( Peek() == '"' )
+				{
+					std::string value;
+					if ( !ParseString( &value ) )
+					{
+						return false;
+					}
+					addSetting( section, key, value.c_str(), 0.0 );
+				}
+				else if ( ConsumeWord( "true" ) )
+				{
+					addSetting( section, key, nullptr, 1.0 );
+				}
+				else if ( ConsumeWord( "false" ) )
+				{
+					addSetting( section, key, nullptr, 0.0 );
+				}
+				else
+				{
+					const char *start = text_.c_str() + offset_;
+					char *end = nullptr;
+					const double number = strtod( start, &end );
+					if ( end == start )
+					{
+						return false;
+					}
+					offset_ += end - start;
+					addSetting( section, key, nullptr, number );
+				}
+			} while ( Consume( ',' ) );
+
+			if ( !Consume( '}' ) )
+			{
+				return false;
+			}
+		} while ( Consume( ',' ) );
+
+		return Consume( '}' ) && AtEnd();
+	}
+
+private:
+	void SkipSpace()
+	{
+		while ( offset_ < text_.size() && ( text_[ offset_ ] == ' ' || text_[ offset_ ] == '\t' || text_[ offset_ ] == '\r' || text_[ offset_ ] == '\n' ) )
+		{
+			offset_++;
+		}
+	}
+
+	char Peek() const
+	{
+		return offset_ < text_.size() ? text_[ offset_ ] : '\0';
+	}
+
+	bool Consume( char c )
+	{
+		SkipSpace();
+		if ( Peek() != c )
+		{
+			return false;
+		}
+		offset_++;
+		return true;
+	}
+
+	bool ConsumeWord( const char *pchWord )
+	{
+		const size_t length = strlen( pchWord );
+		if ( text_.compare( offset_, length, pchWord ) != 0 )
+		{
+			return false;
+		}
+		offset_ += length;
+		return true;
+	}
+
+	bool AtEnd()
+	{
+		SkipSpace();
+		return offset_ == text_.size();
+	}
+
+	bool ParseString( std::string *pValue )
+	{
+		if ( !Consume( '"' ) )
+		{
+			return false;
+		}
+
+		pValue->clear();
+		while ( offset_ < text_.size() && text_[ offset_ ] != '"' )
+		{
+			if ( text_[ offset_ ] == '\\' && offset_ + 1 < text_.size() )
+			{
+				offset_++;
+			}
+			pValue->push_back( text_[ offset_++ ] );
+		}
+		return Consume( '"' );
+	}
+
+	const std::string &text_;
+	size_t offset_;
+};
+
+bool MockSettings::LoadFile( const char *pchPath )
+{
+	std::ifstream file( pchPath, std::ios::binary );
+	if ( !file )
+	{
+		return false;
+	}
+	const std::string text( ( std::istreambuf_iterator< char >( file ) ), std::istreambuf_iterator< char >() );
+
+	std::map< std::string, std::map< std::string, MockSetting > > sections;
+	const bool is_parsed = SettingsFileParser( text ).Parse( [ &sections ]( const std::string &section, const std::string &key, const char *pchString, double fNumber )
+		{ sections[ section ][ key ] = pchString != nullptr ? MockSetting{ true, 0.0, pchString } : MockSetting{ false, fNumber, {} }; } );
+	if ( !is_parsed )
+	{
+		return false;
+	}
+
+	std::lock_guard< std::mutex > lock( mutex_ );
+	for ( auto &section : sections )
+	{
+		for ( auto &setting : section.second )
+		{
+			sections_[ section.first ][ setting.first ] = std::move( setting.second );
+		}
+	}
+	return true;
+}
+
+const char *MockSettings::GetSettingsErrorNameFromEnum( vr::EVRSettingsError eError )
+{
+	switch ( eError )
+	{
+		case vr::VRSettingsError_None:
+			return "VRSettingsError_None";
+		case vr::VRSettingsError_ReadFailed:
+			return "VRSettingsError_ReadFailed";
+		case vr::VRSettingsError_UnsetSettingHasNoDefault:
+			return "VRSettingsError_UnsetSettingHasNoDefault";
+		default:
+			return "VRSettingsError_Unknown";
+	}
+}
+
+void MockSettings::Set( const char *pchSection, const char *pchSettingsKey, const MockSetting &setting, vr::EVRSettingsError *peError )
+{
+	if ( peError != nullptr )
+	{
+		*peError = vr::VRSettingsError_None;
+	}
+
+	std::lock_guard< std::mutex > lock( mutex_ );
+	sections_[ pchSection ][ pchSettingsKey ] = setting;
+}
+
+bool MockSettings::Get( const char *pchSection, const char *pchSettingsKey, MockSetting *pSetting, vr::EVRSettingsError *peError )
+{
+	vr::EVRSettingsError error = vr::VRSettingsError_UnsetSettingHasNoDefault;
+	{
+		std::lock_guard< std::mutex > lock( mutex_ );
+		const auto section = sections_.find( pchSection );
+		if ( section != sections_.end() )
+		{
+			const auto setting = section->second.find( pchSettingsKey );
+			if ( setting != section->second.end() )
+			{
+				*pSetting = setting->second;
+				error = vr::VRSettingsError_None;
+			}
+		}
+	}
+
+	if ( peError != nullptr )
+	{
+		*peError = error;
+	}
+	return error == vr::VRSettingsError_None;
+}
+
+void MockSettings::SetBool( const char *pchSection, const char *pchSettingsKey, bool bValue, vr::EVRSettingsError *peError )
+{
+	Set( pchSection, pchSettingsKey, MockSetting{ false, bValue ? 1.0 : 0.0, {} }, peError );
+}
+
+void MockSettings::SetInt32( const char *pchSection, const char *pchSettingsKey, int32_t nValue, vr::EVRSettingsError *peError )
+{
+	Set( pchSection, pchSettingsKey, MockSetting{ false, static_cast< double >( nValue ), {} }, peError );
+}
+
+void MockSettings::SetFloat( const char *pchSection, const char *pchSettingsKey, float flValue, vr::EVRSettingsError *peError )
+{
+	Set( pchSection, pchSettingsKey, MockSetting{ false, flValue, {} }, peError );
+}
+
+void MockSettings::SetString( const char *pchSection, const char *pchSettingsKey, const char *pchValue, vr::EVRSettingsError *peError )
+{
+	Set( pchSection, pchSettingsKey, MockSetting{ true, 0.0, pchValue != nullptr ? pchValue : "" }, peError );
+}
+
+bool MockSettings::GetBool( const char *pchSection, const char *pchSettingsKey, vr::EVRSettingsError *peError )
+{
+	MockSetting setting;
+	return Get( pchSection, pchSettingsKey, &setting, peError ) && ( setting.is_string ? setting.string == "true" : setting.number != 0.0 );
+}
+
+int32_t MockSettings::GetInt32( const char *pchSection, const char *pchSettingsKey, vr::EVRSettingsError *peError )
+{
+	MockSetting setting;
+	if ( !Get( pchSection, pchSettingsKey, &setting, peError ) )
+	{
+		return 0;
+	}
+	return setting.is_string ? atoi( setting.string.c_str() ) : static_cast< int32_t >( setting.number );
+}
+
+float MockSettings::GetFloat( const char *pchSection, const char *pchSettingsKey, vr::EVRSettingsError *peError )
+{
+	MockSetting setting;
+	if ( !Get( pchSection, pchSettingsKey, &setting, peError ) )
+	{
+		return 0.f;
+	}
+	return static_cast< float >( setting.is_string ? atof( setting.string.c_str() ) : setting.number );
+}
+
+void MockSettings::GetString( const char *pchSection, const char *pchSettingsKey, char *pchValue, uint32_t unValueLen, vr::EVRSettingsError *peError )
+{
+	if ( pchValue == nullptr || unValueLen == 0 )
+	{
+		return;
+	}
+	pchValue[ 0 ] = '\0';
+
+	MockSetting setting;
+	if ( !Get( pchSection, pchSettingsKey, &setting, peError ) )
+	{
+		return;
+	}
+
+	if ( setting.is_string )
+	{
+		snprintf( pchValue, unValueLen, "%s", setting.string.c_str() );
+	}
+	else
+	{
+		snprintf( pchValue, unValueLen, "%g", setting.number );
+	}
+}
+
+void MockSettings::RemoveSection( const char *pchSection, vr::EVRSettingsError *peError )
+{
+	if ( peError != nullptr )
+	{
+		*peError = vr::VRSettingsError_None;
+	}
+
+	std::lock_guard< std::mutex > lock( mutex_ );
+	sections_.erase( pchSection );
+}
+
+void MockSettings::RemoveKeyInSection( const char *pchSection, const char *pchSettingsKey, vr::EVRSettingsError *peError )
+{
+	if ( peError != nullptr )
+	{
+		*peError = vr::VRSettingsError_None;
+	}
+
+	std::lock_guard< std::mutex > lock( mutex_ );
+	const auto section = sections_.find( pchSection );
+	if ( section != sections_.end() )
+	{
+		section->second.erase( pchSettingsKey );
+	}
+}
+
+//-----------------------------------------------------------------------------
+// MockDriverLog
+//-----------------------------------------------------------------------------
+MockDriverLog::MockDriverLog()
+	: echo_( false )
+{
+}
+
+void MockDriverLog::SetEcho( bool bEcho )
+{
+	echo_.store( bEcho );
+}
+
+std::vector< std::string > MockDriverLog::GetLines() const
+{
+	std::lock_guard< std::mutex > lock( mutex_ );
+	return lines_;
+}
+
+bool MockDriverLog::Contains( const char *pchText ) const
+{
+	std::lock_guard< std::mutex > lock( mutex_ );
+	for ( const std::string &line : lines_ )
+	{
+		if ( line.find( pchText ) != std::string::npos )
+		{
+			return true;
+		}
+	}
+	return false;
+}
+
+void MockDriverLog::Log( const char *pchLogMessage )
+{
+	if ( pchLogMessage == nullptr )
+	{
+		return;
+	}
+
+	std::string line( pchLogMessage );
+	while ( !line.empty() && line.back() == '\n' )
+	{
+		line.pop_back();
+	}
+
+	if ( echo_.load() )
+	{
+		fprintf( stderr, "%s\n", line.c_str() );
+	}
+
+	std::lock_guard< std::mutex > lock( mutex_ );
+	lines_.push_back( std::move( line ) );
+}
+
+//-----------------------------------------------------------------------------
+// MockDriverContext
+//-----------------------------------------------------------------------------
+MockDriverContext::MockDriverContext( size_t unRecordCapacity )
+	: server_driver_host_( unRecordCapacity )
+	, driver_input_( unRecordCapacity )
+{
+}
+
+void MockDriverContext::SetDisplayFrequency( float fFrequencyHz )
+{
+	server_driver_host_.SetDisplayFrequency( fFrequencyHz );
+
+	const vr::PropertyContainerHandle_t hmd_container = properties_.TrackedDeviceToPropertyContainer( vr::k_unTrackedDeviceIndex_Hmd );
+	vr::PropertyWrite_t write{};
+	write.prop = vr::Prop_DisplayFrequency_Float;
+	if ( fFrequencyHz > 0.f )
+	{
+		write.writeType = vr::PropertyWrite_Set;
+		write.pvBuffer = &fFrequencyHz;
+		write.unBufferSize = sizeof( fFrequencyHz );
+		write.unTag = vr::k_unFloatPropertyTag;
+	}
+	else
+	{
+		write.writeType = vr::PropertyWrite_Erase;
+	}
+	properties_.WritePropertyBatch( hmd_container, &write, 1 );
+}
+
+MockServerDriverHost &MockDriverContext::GetServerDriverHost()
+{
+	return server_driver_host_;
+}
+
+MockDriverInput &MockDriverContext::GetDriverInput()
+{
+	return driver_input_;
+}
+
+MockProperties &MockDriverContext::GetProperties()
+{
+	return properties_;
+}
+
+MockSettings &MockDriverContext::GetSettings()
+{
+	return settings_;
+}
+
+MockDriverLog &MockDriverContext::GetDriverLog()
+{
+	return driver_log_;
+}
+
+void *MockDriverContext::GetGenericInterface( const char *pchInterfaceVersion, vr::EVRInitError *peError )
+{
+	void *pInterface = nullptr;
+	if ( pchInterfaceVersion != nullptr )
+	{
+		if ( strcmp( pchInterfaceVersion, vr::IVRServerDriverHost_Version ) == 0 )
+		{
+			pInterface = static_cast< vr::IVRServerDriverHost * >( &server_driver_host_ );
+		}
+		else if ( strcmp( pchInterfaceVersion, vr::IVRDriverInput_Version ) == 0 )
+		{
+			pInterface = static_cast< vr::IVRDriverInput * >( &driver_input_ );
+		}
+		else if ( strcmp( pchInterfaceVersion, vr::IVRProperties_Version ) == 0 )
+		{
+			pInterface = static_cast< vr::IVRProperties * >( &properties_ );
+		}
+		else if ( strcmp( pchInterfaceVersion, vr::IVRSettings_Version ) == 0 )
+		{
+			pInterface = static_cast< vr::IVRSettings * >( &settings_ );
+		}
+		else if ( strcmp( pchInterfaceVersion, vr::IVRDriverLog_Version ) == 0 )
+		{
+			pInterface = static_cast< vr::IVRDriverLog * >( &driver_log_ );
+		}
+	}
+
+	if ( peError != nullptr )
+	{
+		*peError = pInterface != nullptr ? vr::VRInitError_None : vr::VRInitError_Init_InterfaceNotFound;
+	}
+	return pInterface;
+}
+
+vr::DriverHandle_t MockDriverContext::GetDriverHandle()
+{
+	return 1;
+}
@@ -0,0 +1,383 @@
+//============ Copyright (c) Valve Corporation, All rights reserved. ============
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "openvr_driver.h"
+
+//-----------------------------------------------------------------------------
+// Headless stand-in for vrserver, so the driver can be run, measured and regression tested in-process
+// without SteamVR. MockDriverContext hands out a fake of every interface the driver uses through
+// GetGenericInterface(), which is how VR_INIT_SERVER_DRIVER_CONTEXT looks them up:
+//
+//	MockDriverContext context;
+//	context.GetSettings().LoadFile( "resources/settings/default.vrsettings" );
+//	device_provider.Init( &context );
+//	... feed the listener, call device_provider.RunFrame() ...
+//	context.GetServerDriverHost().DeactivateDevices();
+//	device_provider.Cleanup();
+//	... look at context.GetServerDriverHost().Poses() and context.GetDriverInput().Updates() ...
+//
+// Written against the IVRServerDriverHost_006, IVRDriverInput_003, IVRProperties_001, IVRSettings_003
+// and IVRDriverLog_001 interfaces.
+//-----------------------------------------------------------------------------
+
+//-----------------------------------------------------------------------------
+// Purpose: Fixed size ring of records, allocated up front so recording never allocates and costs the
+// driver threads about what a real vrserver call would. Keeps the newest Capacity() records.
+// Any number of threads may record at once. Once the ring has wrapped, two of them can land on the same
+// slot a lap apart, so each slot remembers which lap it's on and a writer waits for the previous lap's
+// record to be in before writing its own; the newer record always ends up in the slot. Read the records
+// once the threads recording have stopped.
+//-----------------------------------------------------------------------------
+template < typename T >
+class MockRecordBuffer
+{
+public:
+	explicit MockRecordBuffer( size_t unCapacity )
+		: slots_( std::max< size_t >( unCapacity, 1 ) )
+		, count_( 0 )
+	{
+	}
+
+	void Record( const T &record )
+	{
+		const uint64_t index = count_.fetch_add( 1, std::memory_order_relaxed );
+		const uint64_t lap = index / slots_.size();
+		Slot &slot = slots_[ index % slots_.size() ];
+
+		// Only waits if the ring wrapped under a writer that hasn't finished. That one may be preempted, so
+		// give it the core rather than spin out the time slice.
+		while ( slot.lap.load( std::memory_order_acquire ) != lap )
+		{
+			std::this_thread::yield();
+		}
+
+		slot.record = record;
+		slot.lap.store( lap + 1, std::memory_order_release );
+	}
+
+	// Everything ever recorded, including the records that have since been overwritten. Any thread.
+	uint64_t Count() const
+	{
+		return count_.load( std::memory_order_relaxed );
+	}
+
+	size_t Capacity() const
+	{
+		return slots_.size();
+	}
+
+	// Records still held, At( 0 ) is the oldest
+	size_t Size() const
+	{
+		return static_cast< size_t >( std::min< uint64_t >( Count(), slots_.size() ) );
+	}
+
+	const T &At( size_t unIndex ) const
+	{
+		return slots_[ ( Count() - Size() + unIndex ) % slots_.size() ].record;
+	}
+
+	// Only while nothing records
+	void Clear()
+	{
+		for ( Slot &slot : slots_ )
+		{
+			slot.lap.store( 0, std::memory_order_relaxed );
+		}
+		count_.store( 0, std::memory_order_relaxed );
+	}
+
+private:
+	struct Slot
+	{
+		std::atomic< uint64_t > lap{ 0 }; // Laps of the ring written to this slot so far
+		T record;
+	};
+
+	std::vector< Slot > slots_;
+	std::atomic< uint64_t > count_;
+};
+
+// One TrackedDevicePoseUpdated() call
+struct MockPoseRecord
+{
+	int64_t time_us; // Driver clock, when the host got it
+	vr::TrackedDeviceIndex_t device_index;
+	vr::DriverPose_t pose;
+};
+
+// One Update*Component() call that named a valid component
+struct MockInputRecord
+{
+	int64_t time_us; // Driver clock, when the host got it
+	vr::VRInputComponentHandle_t component;
+	float value; // Booleans as 0 or 1
+	double time_offset;
+};
+
+// Where the scripted hmd is fTimeS seconds after the host was created
+using MockHmdScript = std::function< vr::TrackedDevicePose_t( double fTimeS ) >;
+
+// A valid hmd pose standing fHeightM meters up, facing -z. The default script.
+vr::TrackedDevicePose_t MockStandingHmdPose( float fHeightM );
+
+//-----------------------------------------------------------------------------
+// Purpose: IVRServerDriverHost. Activates devices as they're added, records their poses, plays the
+// scripted hmd and simulates its vsync, and delivers events queued with QueueEvent().
+//-----------------------------------------------------------------------------
+class MockServerDriverHost : public vr::IVRServerDriverHost
+{
+public:
+	explicit MockServerDriverHost( size_t unPoseCapacity );
+
+	// Setup, call before the driver is started
+	void SetHmdScript( MockHmdScript script );
+	void SetDisplayFrequency( float fFrequencyHz ); // Vsyncs reported by GetFrameTimings(), 0 for none
+	void SetExiting( bool bIsExiting );
+
+	// Posts an event for PollNextEvent(). Returns false if the queue is full. Any thread.
+	bool QueueEvent( const vr::VREvent_t &vrevent );
+
+	// Calls Deactivate() on every added device, as vrserver does before Cleanup()
+	void DeactivateDevices();
+
+	vr::ITrackedDeviceServerDriver *GetDevice( vr::TrackedDeviceIndex_t unDeviceIndex ) const;
+	vr::TrackedDeviceIndex_t FindDevice( const char *pchSerialNumber ) const;
+	uint32_t GetDeviceCount() const;
+
+	const MockRecordBuffer< MockPoseRecord > &Poses() const;
+	MockRecordBuffer< MockPoseRecord > &Poses();
+	uint64_t GetRawPoseRequestCount() const;
+
+	// IVRServerDriverHost
+	bool TrackedDeviceAdded( const char *pchDeviceSerialNumber, vr::ETrackedDeviceClass eDeviceClass, vr::ITrackedDeviceServerDriver *pDriver ) override;
+	void TrackedDevicePoseUpdated( uint32_t unWhichDevice, const vr::DriverPose_t &newPose, uint32_t unPoseStructSize ) override;
+	void VsyncEvent( double vsyncTimeOffsetSeconds ) override;
+	void VendorSpecificEvent( uint32_t unWhichDevice, vr::EVREventType eventType, const vr::VREvent_Data_t &eventData, double eventTimeOffset ) override;
+	bool IsExiting() override;
+	bool PollNextEvent( vr::VREvent_t *pEvent, uint32_t uncbVREvent ) override;
+	void GetRawTrackedDevicePoses( float fPredictedSecondsFromNow, vr::TrackedDevicePose_t *pTrackedDevicePoseArray, uint32_t unTrackedDevicePoseArrayCount ) override;
+	void RequestRestart( const char *pchLocalizedReason, const char *pchExecutableToStart, const char *pchArguments, const char *pchWorkingDirectory ) override;
+	uint32_t GetFrameTimings( vr::Compositor_FrameTiming *pTiming, uint32_t nFrames ) override;
+	void SetDisplayEyeToHead( uint32_t unWhichDevice, const vr::HmdMatrix34_t &eyeToHeadLeft, const vr::HmdMatrix34_t &eyeToHeadRight ) override;
+	void SetDisplayProjectionRaw( uint32_t unWhichDevice, const vr::HmdRect2_t &eyeLeft, const vr::HmdRect2_t &eyeRight ) override;
+	void SetRecommendedRenderTargetSize( uint32_t unWhichDevice, uint32_t nWidth, uint32_t nHeight ) override;
+
+private:
+	struct MockDevice
+	{
+		std::string serial_number;
+		vr::ETrackedDeviceClass device_class;
+		vr::ITrackedDeviceServerDriver *driver;
+	};
+
+	static constexpr size_t k_unEventQueueSize = 256;
+
+	const int64_t start_time_us_;
+
+	MockRecordBuffer< MockPoseRecord > poses_;
+	std::atomic< uint64_t > raw_pose_requests_;
+
+	MockHmdScript hmd_script_;
+	std::atomic< double > frame_period_us_;
+	std::atomic< bool > is_exiting_;
+
+	// Index 0 is the hmd
+	mutable std::mutex devices_mutex_;
+	std::vector< MockDevice > devices_;
+
+	std::mutex event_mutex_;
+	vr::VREvent_t events_[ k_unEventQueueSize ];
+	size_t event_read_;
+	size_t event_count_;
+};
+
+//-----------------------------------------------------------------------------
+// Purpose: IVRDriverInput. Hands out component handles and records every update to one, rejecting
+// unknown handles and updates of the wrong type like vrserver does.
+//-----------------------------------------------------------------------------
+class MockDriverInput : public vr::IVRDriverInput
+{
+public:
+	enum ComponentType
+	{
+		ComponentType_Boolean,
+		ComponentType_Scalar,
+		ComponentType_Haptic,
+		ComponentType_Skeleton,
+	};
+
+	explicit MockDriverInput( size_t unUpdateCapacity );
+
+	// The handle the component pchName of ulContainer was created with, k_ulInvalidInputComponentHandle if none
+	vr::VRInputComponentHandle_t FindComponent( vr::PropertyContainerHandle_t ulContainer, const char *pchName ) const;
+
+	const MockRecordBuffer< MockInputRecord > &Updates() const;
+	MockRecordBuffer< MockInputRecord > &Updates();
+	uint64_t GetRejectedUpdateCount() const;
+
+	// IVRDriverInput
+	vr::EVRInputError CreateBooleanComponent( vr::PropertyContainerHandle_t ulContainer, const char *pchName, vr::VRInputComponentHandle_t *pHandle ) override;
+	vr::EVRInputError UpdateBooleanComponent( vr::VRInputComponentHandle_t ulComponent, bool bNewValue, double fTimeOffset ) override;
+	vr::EVRInputError CreateScalarComponent( vr::PropertyContainerHandle_t ulContainer, const char *pchName, vr::VRInputComponentHandle_t *pHandle, vr::EVRScalarType eType,
+		vr::EVRScalarUnits eUnits ) override;
+	vr::EVRInputError UpdateScalarComponent( vr::VRInputComponentHandle_t ulComponent, float fNewValue, double fTimeOffset ) override;
+	vr::EVRInputError CreateHapticComponent( vr::PropertyContainerHandle_t ulContainer, const char *pchName, vr::VRInputComponentHandle_t *pHandle ) override;
+	vr::EVRInputError CreateSkeletonComponent( vr::PropertyContainerHandle_t ulContainer, const char *pchName, const char *pchSkeletonPath, const char *pchBasePosePath,
+		vr::EVRSkeletalTrackingLevel eSkeletalTrackingLevel, const vr::VRBoneTransform_t *pGripLimitTransforms, uint32_t unGripLimitTransformCount,
+		vr::VRInputComponentHandle_t *pHandle ) override;
+	vr::EVRInputError UpdateSkeletonComponent( vr::VRInputComponentHandle_t ulComponent, vr::EVRSkeletalMotionRange eMotionRange, const vr::VRBoneTransform_t *pTransforms,
+		uint32_t unTransformCount ) override;
+
+private:
+	struct MockComponent
+	{
+		vr::PropertyContainerHandle_t container;
+		std::string name;
+		ComponentType type;
+	};
+
+	// Components are only ever added, there's room for this many so updates can look them up without a lock
+	static constexpr size_t k_unMaxComponents = 1024;
+
+	vr::EVRInputError CreateComponent( vr::PropertyContainerHandle_t ulContainer, const char *pchName, ComponentType type, vr::VRInputComponentHandle_t *pHandle );
+	vr::EVRInputError RecordUpdate( vr::VRInputComponentHandle_t ulComponent, ComponentType type, float fValue, double fTimeOffset );
+
+	mutable std::mutex create_mutex_;
+	std::vector< MockComponent > components_;
+	std::atomic< size_t > component_count_;
+
+	MockRecordBuffer< MockInputRecord > updates_;
+	std::atomic< uint64_t > rejected_updates_;
+};
+
+//-----------------------------------------------------------------------------
+// Purpose: IVRProperties, a store of whatever the driver (or the test) wrote, by container and property.
+// Device n's container is n + 1.
+//-----------------------------------------------------------------------------
+class MockProperties : public vr::IVRProperties
+{
+public:
+	// IVRProperties
+	vr::ETrackedPropertyError ReadPropertyBatch( vr::PropertyContainerHandle_t ulContainerHandle, vr::PropertyRead_t *pBatch, uint32_t unBatchEntryCount ) override;
+	vr::ETrackedPropertyError WritePropertyBatch( vr::PropertyContainerHandle_t ulContainerHandle, vr::PropertyWrite_t *pBatch, uint32_t unBatchEntryCount ) override;
+	const char *GetPropErrorNameFromEnum( vr::ETrackedPropertyError error ) override;
+	vr::PropertyContainerHandle_t TrackedDeviceToPropertyContainer( vr::TrackedDeviceIndex_t nDevice ) override;
+
+private:
+	struct MockProperty
+	{
+		vr::PropertyTypeTag_t tag;
+		vr::ETrackedPropertyError error; // Set with PropertyWrite_SetError
+		std::vector< uint8_t > value;
+	};
+
+	std::mutex mutex_;
+	std::map< std::pair< vr::PropertyContainerHandle_t, vr::ETrackedDeviceProperty >, MockProperty > properties_;
+};
+
+//-----------------------------------------------------------------------------
+// Purpose: IVRSettings, sections of typed values. Values are converted between the numeric types on read
+// like vrserver does; unset keys read as zero with VRSettingsError_UnsetSettingHasNoDefault.
+//-----------------------------------------------------------------------------
+class MockSettings : public vr::IVRSettings
+{
+public:
+	// Adds every value of a .vrsettings file, e.g. the driver's default.vrsettings. Returns false if it can't
+	// be read or isn't an object of sections of strings, numbers and booleans.
+	bool LoadFile( const char *pchPath );
+
+	// IVRSettings
+	const char *GetSettingsErrorNameFromEnum( vr::EVRSettingsError eError ) override;
+	void SetBool( const char *pchSection, const char *pchSettingsKey, bool bValue, vr::EVRSettingsError *peError = nullptr ) override;
+	void SetInt32( const char *pchSection, const char *pchSettingsKey, int32_t nValue, vr::EVRSettingsError *peError = nullptr ) override;
+	void SetFloat( const char *pchSection, const char *pchSettingsKey, float flValue, vr::EVRSettingsError *peError = nullptr ) override;
+	void SetString( const char *pchSection, const char *pchSettingsKey, const char *pchValue, vr::EVRSettingsError *peError = nullptr ) override;
+	bool GetBool( const char *pchSection, const char *pchSettingsKey, vr::EVRSettingsError *peError = nullptr ) override;
+	int32_t GetInt32( const char *pchSection, const char *pchSettingsKey, vr::EVRSettingsError *peError = nullptr ) override;
+	float GetFloat( const char *pchSection, const char *pchSettingsKey, vr::EVRSettingsError *peError = nullptr ) override;
+	void GetString( const char *pchSection, const char *pchSettingsKey, char *pchValue, uint32_t unValueLen, vr::EVRSettingsError *peError = nullptr ) override;
+	void RemoveSection( const char *pchSection, vr::EVRSettingsError *peError = nullptr ) override;
+	void RemoveKeyInSection( const char *pchSection, const char *pchSettingsKey, vr::EVRSettingsError *peError = nullptr ) override;
+
+private:
+	struct MockSetting
+	{
+		bool is_string;
+		double number; // Booleans as 0 or 1
+		std::string string;
+	};
+
+	void Set( const char *pchSection, const char *pchSettingsKey, const MockSetting &setting, vr::EVRSettingsError *peError );
+	bool Get( const char *pchSection, const char *pchSettingsKey, MockSetting *pSetting, vr::EVRSettingsError *peError );
+
+	std::mutex mutex_;
+	std::map< std::string, std::map< std::string, MockSetting > > sections_;
+};
+
+//-----------------------------------------------------------------------------
+// Purpose: IVRDriverLog, keeps every line and optionally echoes it to stderr
+//-----------------------------------------------------------------------------
+class MockDriverLog : public vr::IVRDriverLog
+{
+public:
+	MockDriverLog();
+
+	void SetEcho( bool bEcho );
+
+	std::vector< std::string > GetLines() const;
+
+	// Whether any line logged so far contains pchText
+	bool Contains( const char *pchText ) const;
+
+	// IVRDriverLog
+	void Log( const char *pchLogMessage ) override;
+
+private:
+	std::atomic< bool > echo_;
+
+	mutable std::mutex mutex_;
+	std::vector< std::string > lines_;
+};
+
+//-----------------------------------------------------------------------------
+// Purpose: The context passed to the driver's Init(), owns one of each mock
+//-----------------------------------------------------------------------------
+class MockDriverContext : public vr::IVRDriverContext
+{
+public:
+	// unRecordCapacity is how many pose and input updates are kept, each
+	explicit MockDriverContext( size_t unRecordCapacity = 1 << 16 );
+
+	// The hmd's refresh rate, as Prop_DisplayFrequency_Float and in the host's frame timings. 0 for no hmd.
+	void SetDisplayFrequency( float fFrequencyHz );
+
+	MockServerDriverHost &GetServerDriverHost();
+	MockDriverInput &GetDriverInput();
+	MockProperties &GetProperties();
+	MockSettings &GetSettings();
+	MockDriverLog &GetDriverLog();
+
+	// IVRDriverContext
+	void *GetGenericInterface( const char *pchInterfaceVersion, vr::EVRInitError *peError = nullptr ) override;
+	vr::DriverHandle_t GetDriverHandle() override;
+
+private:
+	MockServerDriverHost server_driver_host_;
+	MockDriverInput driver_input_;
+	MockProperties properties_;
+	MockSettings settings_;
+	MockDriverLog driver_log_;
+};
@@ -0,0 +1,218 @@
+//============ Copyright (c) Valve Corporation, All rights reserved. ============
+// Replays synthetic hand trajectories through HandMotionEstimator offline and reports how far off its prediction
+// is 20, 40 and 60 ms after a sample, against holding the sample still (what SteamVR did without velocities).
+// Prints one JSON object:
+//
+//	prediction_check [--camera-hz 30] [--duration-s 20] [--seed 1] [--min-reduction 0.3]
+//
+// SyntheticHandSource moves one hand at k_unTruthRateHz, which stands in for the real motion. The estimator only
+// sees every camera frame of it, the way MyControllerDeviceDriver does, and after each one the pose it predicts
+// (position + velocity * t, rotation turned by angular velocity * t) is compared with the motion t later.
+// Exits non-zero if on the steady circle prediction doesn't take at least --min-reduction off the mean position
+// and rotation error at every horizon. The random walk and the flick are reported only: there's no velocity to
+// find in noise, and a flick that stops gets overshot.
+
+#include "hand_motion_estimator.h"
+#include "synthetic_hand_source.h"
+#include "tool_options.h"
+#include "tool_stats.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <vector>
+
+// The synthetic motion is sampled this often as the truth, camera rates have to divide it
+static constexpr uint32_t k_unTruthRateHz = 3000;
+
+static constexpr int k_rnHorizonsMs[] = { 20, 40, 60 };
+static constexpr size_t k_unHorizonCount = sizeof( k_rnHorizonsMs ) / sizeof( k_rnHorizonsMs[ 0 ] );
+
+// The estimator needs a few frames before it estimates anything
+static constexpr uint32_t k_unSettleFrames = 8;
+
+struct HorizonErrors
+{
+	std::vector< double > held_mm;
+	std::vector< double > predicted_mm;
+	std::vector< double > held_deg;
+	std::vector< double > predicted_deg;
+};
+
+static double DistanceMm( const float a[ 3 ], const float b[ 3 ] )
+{
+	const double dx = a[ 0 ] - b[ 0 ];
+	const double dy = a[ 1 ] - b[ 1 ];
+	const double dz = a[ 2 ] - b[ 2 ];
+	return std::sqrt( dx * dx + dy * dy + dz * dz ) * 1000.0;
+}
+
+// Angle between two rotations (w, x, y, z), degrees
+static double AngleDeg( const double a[ 4 ], const float b[ 4 ] )
+{
+	const double norm_b = std::sqrt( double( b[ 0 ] ) * b[ 0 ] + double( b[ 1 ] ) * b[ 1 ] + double( b[ 2 ] ) * b[ 2 ] + double( b[ 3 ] ) * b[ 3 ] );
+	const double dot = ( a[ 0 ] * b[ 0 ] + a[ 1 ] * b[ 1 ] + a[ 2 ] * b[ 2 ] + a[ 3 ] * b[ 3 ] ) / std::max( norm_b, 1e-9 );
+	return 2.0 * std::acos( std::min( std::fabs( dot ), 1.0 ) ) * 180.0 / 3.14159265358979323846;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: rotation turned by angular_velocity (rad/s, world frame) for fSeconds: exp( w t / 2 ) * q
+//-----------------------------------------------------------------------------
+static void PredictRotation( const float rotation[ 4 ], const float angular_velocity[ 3 ], double fSeconds, double predicted[ 4 ] )
+{
+	const double rx = angular_velocity[ 0 ] * fSeconds;
+	const double ry = angular_velocity[ 1 ] * fSeconds;
+	const double rz = angular_velocity[ 2 ] * fSeconds;
+	const double angle = std::sqrt( rx * rx + ry * ry + rz * rz );
+	const double scale = angle > 1e-9 ? std::sin( angle / 2.0 ) / angle : 0.5;
+	const double dw = std::cos( angle / 2.0 );
+	const double dx = rx * scale;
+	const double dy = ry * scale;
+	const double dz = rz * scale;
+
+	const double w = rotation[ 0 ];
+	const double x = rotation[ 1 ];
+	const double y = rotation[ 2 ];
+	const double z = rotation[ 3 ];
+	predicted[ 0 ] = dw * w - dx * x - dy * y - dz * z;
+	predicted[ 1 ] = dw * x + dx * w + dy * z - dz * y;
+	predicted[ 2 ] = dw * y - dx * z + dy * w + dz * x;
+	predicted[ 3 ] = dw * z + dx * y - dy * x + dz * w;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: One motion at the truth rate, the estimator fed every unFramesPerCamera'th sample
+//-----------------------------------------------------------------------------
+static void ReplayMotion( SyntheticMotion motion, uint32_t unCameraHz, double fDurationS, uint64_t unSeed, HorizonErrors ( &errors )[ k_unHorizonCount ] )
+{
+	SyntheticHandOptions options;
+	options.motion = motion;
+	options.seed = unSeed;
+	options.frame_rate_hz = k_unTruthRateHz;
+	options.hand_count = 1;
+	SyntheticHandSource source( options );
+
+	const uint32_t frame_count = static_cast< uint32_t >( fDurationS * k_unTruthRateHz );
+	std::vector< HandSample > truth( frame_count );
+	HandSampleBatch batch{};
+	for ( uint32_t frame = 0; frame < frame_count; frame++ )
+	{
+		source.Generate( frame, 0, batch );
+		truth[ frame ] = batch.hands[ 0 ];
+	}
+
+	const uint32_t frames_per_camera = k_unTruthRateHz / unCameraHz;
+	HandMotionEstimator estimator;
+	for ( uint32_t frame = 0, camera_frame = 0; frame < frame_count; frame += frames_per_camera, camera_frame++ )
+	{
+		const HandSample &sample = truth[ frame ];
+		const int64_t time_us = static_cast< int64_t >( frame ) * 1000000 / k_unTruthRateHz;
+		estimator.AddSample( time_us, sample.position, sample.rotation );
+
+		float velocity[ 3 ];
+		float angular_velocity[ 3 ];
+		if ( camera_frame < k_unSettleFrames || !estimator.Estimate( velocity, angular_velocity ) )
+		{
+			continue;
+		}
+
+		for ( size_t horizon = 0; horizon < k_unHorizonCount; horizon++ )
+		{
+			const uint32_t later = frame + k_rnHorizonsMs[ horizon ] * k_unTruthRateHz / 1000;
+			if ( later >= frame_count )
+			{
+				continue;
+			}
+			const HandSample &actual = truth[ later ];
+			const double horizon_s = k_rnHorizonsMs[ horizon ] * 1e-3;
+
+			float predicted_position[ 3 ];
+			for ( int axis = 0; axis < 3; axis++ )
+			{
+				predicted_position[ axis ] = static_cast< float >( sample.position[ axis ] + velocity[ axis ] * horizon_s );
+			}
+			double predicted_rotation[ 4 ];
+			PredictRotation( sample.rotation, angular_velocity, horizon_s, predicted_rotation );
+			const double held_rotation[ 4 ] = { sample.rotation[ 0 ], sample.rotation[ 1 ], sample.rotation[ 2 ], sample.rotation[ 3 ] };
+
+			errors[ horizon ].held_mm.push_back( DistanceMm( sample.position, actual.position ) );
+			errors[ horizon ].predicted_mm.push_back( DistanceMm( predicted_position, actual.position ) );
+			errors[ horizon ].held_deg.push_back( AngleDeg( held_rotation, actual.rotation ) );
+			errors[ horizon ].predicted_deg.push_back( AngleDeg( predicted_rotation, actual.rotation ) );
+		}
+	}
+}
+
+static bool ParseOptions( int argc, char **argv, uint32_t &unCameraHz, double &fDurationS, uint64_t &unSeed, double &fMinReduction )
+{
+	ToolOptionParser parser( "prediction_check", argc, argv );
+	while ( parser.Next() )
+	{
+		if ( !parser.Value( "--camera-hz", unCameraHz ) && !parser.Value( "--duration-s", fDurationS ) && !parser.Value( "--seed", unSeed ) &&
+			 !parser.Value( "--min-reduction", fMinReduction ) )
+		{
+			parser.Unknown();
+		}
+	}
+	if ( !parser.IsValid() )
+	{
+		return false;
+	}
+
+	if ( unCameraHz == 0 || k_unTruthRateHz % unCameraHz != 0 )
+	{
+		fprintf( stderr, "prediction_check: The camera rate has to divide %u\n", k_unTruthRateHz );
+		return false;
+	}
+	return fDurationS >= 1.0 && fMinReduction < 1.0;
+}
+
+int main( int argc, char **argv )
+{
+	uint32_t camera_hz = 30;
+	double duration_s = 20.0;
+	uint64_t seed = 1;
+	double min_reduction = 0.3;
+	if ( !ParseOptions( argc, argv, camera_hz, duration_s, seed, min_reduction ) )
+	{
+		fprintf( stderr, "usage: prediction_check [--camera-hz 30] [--duration-s 20] [--seed 1] [--min-reduction 0.3]\n" );
+		return 2;
+	}
+
+	bool passed = true;
+	printf( "{\"camera_hz\":%u,\"duration_s\":%.1f,\"seed\":%llu", camera_hz, duration_s, static_cast< unsigned long long >( seed ) );
+	for ( int motion = 0; motion < SyntheticMotion_MAX; motion++ )
+	{
+		HorizonErrors errors[ k_unHorizonCount ];
+		ReplayMotion( static_cast< SyntheticMotion >( motion ), camera_hz, duration_s, seed, errors );
+
+		printf( ",\"%s\":{", SyntheticMotionName( static_cast< SyntheticMotion >( motion ) ) );
+		for ( size_t horizon = 0; horizon < k_unHorizonCount; horizon++ )
+		{
+			const HorizonErrors &error = errors[ horizon ];
+			const double held_mm = Mean( error.held_mm );
+			const double predicted_mm = Mean( error.predicted_mm );
+			const double held_deg = Mean( error.held_deg );
+			const double predicted_deg = Mean( error.predicted_deg );
+			printf( "%s\"%dms\":{\"samples\":%zu,\"held_mm\":{\"mean\":%.2f,\"p95\":%.2f},\"predicted_mm\":{\"mean\":%.2f,\"p95\":%.2f},"
+					"\"held_deg\":{\"mean\":%.2f,\"p95\":%.2f},\"predicted_deg\":{\"mean\":%.2f,\"p95\":%.2f}}",
+				horizon > 0 ? "," : "", k_rnHorizonsMs[ horizon ], error.held_mm.size(), held_mm, Percentile95( error.held_mm ), predicted_mm,
+				Percentile95( error.predicted_mm ), held_deg, Percentile95( error.held_deg ), predicted_deg, Percentile95( error.predicted_deg ) );
+
+			if ( motion != SyntheticMotion_Circle )
+			{
+				continue;
+			}
+			if ( error.held_mm.empty() || predicted_mm > held_mm * ( 1.0 - min_reduction ) || predicted_deg > held_deg * ( 1.0 - min_reduction ) )
+			{
+				fprintf( stderr, "prediction_check: At %d ms on the circle prediction is off by %.2f mm and %.2f deg, holding still by %.2f mm and %.2f deg\n",
+					k_rnHorizonsMs[ horizon ], predicted_mm, predicted_deg, held_mm, held_deg );
+				passed = false;
+			}
+		}
+		printf( "}" );
+	}
+	printf( "}\n" );
+
+	return passed ? 0 : 1;
+}
@@ -0,0 +1,354 @@
+//============ Copyright (c) Valve Corporation, All rights reserved. ============
+// Measures the text protocol parser against the one it replaced, and the binary protocol's decoder against the
+// text parser, and prints the result as one JSON object:
+//
+//	protocol_benchmark [--lines 1024] [--iterations 200] [--seed 1] [--min-speedup 1] [--min-binary-speedup 1]
+//
+// --lines single-hand lines from SyntheticHandSource, formatted like hand_data.py's to_protocol_string(), are parsed
+// --iterations times by ParseHandSampleText() and by a copy of the listener's old ParseProtocolString() path.
+// Exits non-zero if the two disagree on any value, if ParseHandSampleText() allocates, or if it isn't at least
+// --min-speedup times faster.
+//
+// The same samples, with their sequence and capture time, are then sent as text lines and as binary frames
+// and decoded as often. Exits non-zero if a frame doesn't decode to the sample it was encoded from, if a frame's
+// fields word carries a bit outside k_unHandFrameFields either way (a send time above all), or if
+// DecodeHandSampleBinary() isn't at least --min-binary-speedup times as fast as ParseHandSampleText().
+
+#include "allocation_counter.h"
+#include "driver_clock.h"
+#include "hand_protocol.h"
+#include "synthetic_hand_source.h"
+#include "tool_options.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+struct ProtocolBenchmarkOptions
+{
+	uint32_t lines = 1024;
+	uint32_t iterations = 200;
+	uint64_t seed = 1;
+	double min_speedup = 1.0;
+	double min_binary_speedup = 1.0;
+};
+
+//-----------------------------------------------------------------------------
+// The listener's parser before ParseHandSampleText(), as it was: the line is copied out of the receive buffer
+// into a std::string, split into a map of key and value strings, and the values converted with std::stof.
+//-----------------------------------------------------------------------------
+static std::map< std::string, std::string > ParseProtocolString( const std::string &data )
+{
+	std::map< std::string, std::string > params;
+	std::istringstream stream( data );
+	std::string token;
+
+	while ( std::getline( stream, token, ',' ) )
+	{
+		size_t colon_pos = token.find( ':' );
+		if ( colon_pos != std::string::npos )
+		{
+			std::string key = token.substr( 0, colon_pos );
+			std::string value = token.substr( colon_pos + 1 );
+			params[ key ] = value;
+		}
+	}
+
+	return params;
+}
+
+// What the old ProcessHandData() took out of the map, written into a HandSample so the two parsers can be compared
+static bool ParseProtocolStringPath( std::string_view line, HandSample &sample )
+{
+	std::map< std::string, std::string > params = ParseProtocolString( std::string( line ) );
+
+	sample.fields = 0;
+	if ( params[ "HAND" ] == "LEFT" )
+	{
+		sample.hand = HandId_Left;
+	}
+	else if ( params[ "HAND" ] == "RIGHT" )
+	{
+		sample.hand = HandId_Right;
+	}
+	else
+	{
+		return false;
+	}
+
+	if ( params.count( "X" ) && params.count( "Y" ) && params.count( "Z" ) )
+	{
+		sample.position[ 0 ] = std::stof( params[ "X" ] );
+		sample.position[ 1 ] = std::stof( params[ "Y" ] );
+		sample.position[ 2 ] = std::stof( params[ "Z" ] );
+		sample.fields |= HandSampleField_Position;
+	}
+
+	if ( params.count( "QW" ) && params.count( "QX" ) && params.count( "QY" ) && params.count( "QZ" ) )
+	{
+		sample.rotation[ 0 ] = std::stof( params[ "QW" ] );
+		sample.rotation[ 1 ] = std::stof( params[ "QX" ] );
+		sample.rotation[ 2 ] = std::stof( params[ "QY" ] );
+		sample.rotation[ 3 ] = std::stof( params[ "QZ" ] );
+		sample.fields |= HandSampleField_Rotation;
+	}
+
+	if ( params.count( "TRIGGER" ) )
+	{
+		sample.trigger = std::stof( params[ "TRIGGER" ] );
+		sample.fields |= HandSampleField_Trigger;
+	}
+
+	if ( params.count( "GRIP" ) )
+	{
+		sample.grip = std::stof( params[ "GRIP" ] );
+		sample.fields |= HandSampleField_Grip;
+	}
+	return true;
+}
+
+// One line the way hand_data.py's to_protocol_string() writes it, without the optional sequence and timestamps
+static std::string FormatProtocolString( const HandSample &sample )
+{
+	char line[ 256 ];
+	snprintf( line, sizeof( line ), "HAND:%s,X:%.4f,Y:%.4f,Z:%.4f,QW:%.4f,QX:%.4f,QY:%.4f,QZ:%.4f,TRIGGER:%.2f,GRIP:%.2f,GESTURE:%s",
+		sample.hand == HandId_Left ? "LEFT" : "RIGHT", sample.position[ 0 ], sample.position[ 1 ], sample.position[ 2 ], sample.rotation[ 0 ], sample.rotation[ 1 ],
+		sample.rotation[ 2 ], sample.rotation[ 3 ], sample.trigger, sample.grip, HandGestureName( sample.gesture ) );
+	return line;
+}
+
+// The same sample as a line with everything a binary frame carries: the sequence and capture time too
+static std::string FormatSequencedProtocolString( const HandSample &sample )
+{
+	char suffix[ 64 ];
+	snprintf( suffix, sizeof( suffix ), ",SEQ:%u,TS:%llu", sample.sequence, static_cast< unsigned long long >( sample.capture_time_us ) );
+	return FormatProtocolString( sample ) + suffix;
+}
+
+static std::string EncodeFrame( const HandSample &sample )
+{
+	uint8_t frame[ k_unHandFrameSize ];
+	EncodeHandSampleBinary( sample, frame );
+	return std::string( reinterpret_cast< const char * >( frame ), sizeof( frame ) );
+}
+
+// Whether a frame decoded to every value of the sample it was encoded from
+static bool SameSample( const HandSample &decoded, const HandSample &sample )
+{
+	return decoded.hand == sample.hand && decoded.fields == sample.fields && decoded.gesture == sample.gesture && decoded.sequence == sample.sequence &&
+		   decoded.capture_time_us == sample.capture_time_us && memcmp( decoded.position, sample.position, sizeof( sample.position ) ) == 0 &&
+		   memcmp( decoded.rotation, sample.rotation, sizeof( sample.rotation ) ) == 0 && decoded.trigger == sample.trigger && decoded.grip == sample.grip;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Whether the fields word of a frame only ever holds the bits a frame carries: encoding a sample with a
+// send time doesn't write its bit, and a frame with every bit set, bit 7 (the send time) included, decodes
+// without a send time
+//-----------------------------------------------------------------------------
+static bool FrameFieldsMasked( HandSample sample )
+{
+	sample.fields |= HandSampleField_SendTime;
+	uint8_t frame[ k_unHandFrameSize ];
+	EncodeHandSampleBinary( sample, frame );
+	if ( ( frame[ 6 ] | ( frame[ 7 ] << 8 ) ) & ~k_unHandFrameFields )
+	{
+		return false;
+	}
+
+	frame[ 6 ] = 0xFF;
+	frame[ 7 ] = 0xFF;
+	HandSample decoded{};
+	size_t frame_size = 0;
+	return DecodeHandSampleBinary( std::string_view( reinterpret_cast< const char * >( frame ), sizeof( frame ) ), decoded, frame_size ) == HandFrameResult_Ok &&
+		   ( decoded.fields & HandSampleField_SendTime ) == 0 && ( decoded.fields & ( HandSampleField_Sequence | HandSampleField_CaptureTime ) ) != 0;
+}
+
+// Whether both parsers took the same values out of a line
+static bool SameValues( const HandSample &sample, const HandSample &reference )
+{
+	static constexpr uint32_t k_unComparedFields = HandSampleField_Position | HandSampleField_Rotation | HandSampleField_Trigger | HandSampleField_Grip;
+	return sample.hand == reference.hand && ( sample.fields & k_unComparedFields ) == reference.fields &&
+		   memcmp( sample.position, reference.position, sizeof( sample.position ) ) == 0 && memcmp( sample.rotation, reference.rotation, sizeof( sample.rotation ) ) == 0 &&
+		   sample.trigger == reference.trigger && sample.grip == reference.grip;
+}
+
+struct ParserResult
+{
+	double ns_per_line;
+	double allocations_per_line;
+	uint64_t checksum; // Keeps the parsing from being optimised away
+};
+
+//-----------------------------------------------------------------------------
+// Purpose: Runs parse over every line, iterations times, and times it. The first pass isn't counted, it
+// warms the caches and the allocator.
+//-----------------------------------------------------------------------------
+template < typename Parse >
+static ParserResult MeasureParser( const std::vector< std::string > &lines, uint32_t unIterations, Parse parse )
+{
+	HandSample sample{};
+	uint64_t checksum = 0;
+	for ( const std::string &line : lines )
+	{
+		checksum += parse( line, sample );
+	}
+
+	const uint64_t allocations_start = AllocationCount();
+	const int64_t start_time_ns = DriverClockNs();
+	for ( uint32_t iteration = 0; iteration < unIterations; iteration++ )
+	{
+		for ( const std::string &line : lines )
+		{
+			checksum += parse( line, sample );
+			checksum += static_cast< uint64_t >( sample.position[ 0 ] * 1000.0f );
+		}
+	}
+	const int64_t elapsed_ns = DriverClockNs() - start_time_ns;
+	const uint64_t allocations = AllocationCount() - allocations_start;
+
+	const double line_count = static_cast< double >( lines.size() ) * unIterations;
+	return ParserResult{ elapsed_ns / line_count, allocations / line_count, checksum };
+}
+
+static bool ParseOptions( int argc, char **argv, ProtocolBenchmarkOptions &options )
+{
+	ToolOptionParser parser( "protocol_benchmark", argc, argv );
+	while ( parser.Next() )
+	{
+		if ( !parser.Value( "--lines", options.lines ) && !parser.Value( "--iterations", options.iterations ) && !parser.Value( "--seed", options.seed ) &&
+			 !parser.Value( "--min-speedup", options.min_speedup ) && !parser.Value( "--min-binary-speedup", options.min_binary_speedup ) )
+		{
+			parser.Unknown();
+		}
+	}
+	return parser.IsValid() && options.lines > 0 && options.iterations > 0;
+}
+
+int main( int argc, char **argv )
+{
+	ProtocolBenchmarkOptions options;
+	if ( !ParseOptions( argc, argv, options ) )
+	{
+		fprintf( stderr, "usage: protocol_benchmark [--lines 1024] [--iterations 200] [--seed 1] [--min-speedup 1] [--min-binary-speedup 1]\n" );
+		return 2;
+	}
+
+	// Every hand Camera.py would have sent, one line each
+	SyntheticHandOptions source_options;
+	source_options.motion = SyntheticMotion_RandomWalk;
+	source_options.seed = options.seed;
+	SyntheticHandSource source( source_options );
+
+	std::vector< std::string > lines;
+	std::vector< std::string > sequenced_lines;
+	std::vector< std::string > frames;
+	std::vector< HandSample > samples;
+	HandSampleBatch batch{};
+	for ( uint32_t frame = 0; lines.size() < options.lines; frame++ )
+	{
+		source.Generate( frame, 1000000 + frame * 16667, batch );
+		for ( uint32_t i = 0; i < batch.hand_count && lines.size() < options.lines; i++ )
+		{
+			// What the binary protocol carries, so both formats hold the same values
+			HandSample &sample = batch.hands[ i ];
+			sample.fields &= ~HandSampleField_SendTime;
+
+			lines.push_back( FormatProtocolString( sample ) );
+			sequenced_lines.push_back( FormatSequencedProtocolString( sample ) );
+			frames.push_back( EncodeFrame( sample ) );
+			samples.push_back( sample );
+		}
+	}
+
+	size_t mismatches = 0;
+	for ( const std::string &line : lines )
+	{
+		HandSample sample{};
+		HandSample reference{};
+		if ( !ParseHandSampleText( line, sample ) || !ParseProtocolStringPath( line, reference ) || !SameValues( sample, reference ) )
+		{
+			if ( mismatches++ == 0 )
+			{
+				fprintf( stderr, "protocol_benchmark: The parsers disagree on %s\n", line.c_str() );
+			}
+		}
+	}
+
+	const ParserResult parser = MeasureParser( lines, options.iterations, []( std::string_view line, HandSample &sample ) { return ParseHandSampleText( line, sample ); } );
+	const ParserResult reference = MeasureParser( lines, options.iterations, []( std::string_view line, HandSample &sample ) { return ParseProtocolStringPath( line, sample ); } );
+	const double speedup = reference.ns_per_line / std::max( parser.ns_per_line, 1e-3 );
+
+	size_t frame_mismatches = 0;
+	size_t text_bytes = 0;
+	size_t binary_bytes = 0;
+	for ( size_t i = 0; i < frames.size(); i++ )
+	{
+		HandSample decoded{};
+		size_t frame_size = 0;
+		if ( DecodeHandSampleBinary( frames[ i ], decoded, frame_size ) != HandFrameResult_Ok || frame_size != frames[ i ].size() || !SameSample( decoded, samples[ i ] ) )
+		{
+			frame_mismatches++;
+		}
+		text_bytes += sequenced_lines[ i ].size() + 1; // And its newline
+		binary_bytes += frames[ i ].size();
+	}
+
+	const bool fields_masked = FrameFieldsMasked( samples.front() );
+
+	const ParserResult text = MeasureParser( sequenced_lines, options.iterations, []( std::string_view line, HandSample &sample ) { return ParseHandSampleText( line, sample ); } );
+	const ParserResult binary = MeasureParser( frames, options.iterations,
+		[]( std::string_view frame, HandSample &sample )
+		{
+			size_t frame_size;
+			return DecodeHandSampleBinary( frame, sample, frame_size ) == HandFrameResult_Ok;
+		} );
+	const double binary_speedup = text.ns_per_line / std::max( binary.ns_per_line, 1e-3 );
+
+	printf( "{\"lines\":%zu,\"iterations\":%u,\"mismatches\":%zu,"
+			"\"parse_hand_sample_text\":{\"ns_per_line\":%.1f,\"allocations_per_line\":%.3f},"
+			"\"parse_protocol_string\":{\"ns_per_line\":%.1f,\"allocations_per_line\":%.3f},\"speedup\":%.2f,"
+			"\"text\":{\"ns_per_sample\":%.1f,\"bytes_per_sample\":%.1f},\"binary\":{\"ns_per_sample\":%.1f,\"bytes_per_sample\":%.1f,\"mismatches\":%zu},"
+			"\"binary_speedup\":%.2f,\"checksum\":%llu}\n",
+		lines.size(), options.iterations, mismatches, parser.ns_per_line, parser.allocations_per_line, reference.ns_per_line, reference.allocations_per_line, speedup,
+		text.ns_per_line, static_cast< double >( text_bytes ) / frames.size(), binary.ns_per_line, static_cast< double >( binary_bytes ) / frames.size(), frame_mismatches,
+		binary_speedup, static_cast< unsigned long long >( parser.checksum + reference.checksum + text.checksum + binary.checksum ) );
+
+	bool passed = true;
+	if ( mismatches > 0 )
+	{
+		fprintf( stderr, "protocol_benchmark: %zu of %zu lines parsed differently\n", mismatches, lines.size() );
+		passed = false;
+	}
+	if ( parser.allocations_per_line > 0.0 )
+	{
+		fprintf( stderr, "protocol_benchmark: ParseHandSampleText() allocated %.3f times per line\n", parser.allocations_per_line );
+		passed = false;
+	}
+	if ( speedup < options.min_speedup )
+	{
+		fprintf( stderr, "protocol_benchmark: ParseHandSampleText() is only %.2f times as fast as ParseProtocolString(), expected %.2f\n", speedup, options.min_speedup );
+		passed = false;
+	}
+	if ( frame_mismatches > 0 )
+	{
+		fprintf( stderr, "protocol_benchmark: %zu of %zu binary frames didn't decode to the sample they were encoded from\n", frame_mismatches, frames.size() );
+		passed = false;
+	}
+	if ( !fields_masked )
+	{
+		fprintf( stderr, "protocol_benchmark: A binary frame carried field bits it has no values for\n" );
+		passed = false;
+	}
+	if ( binary_speedup < options.min_binary_speedup )
+	{
+		fprintf( stderr, "protocol_benchmark: DecodeHandSampleBinary() is only %.2f times as fast as ParseHandSampleText(), expected %.2f\n", binary_speedup,
+			options.min_binary_speedup );
+		passed = false;
+	}
+	return passed ? 0 : 1;
+}
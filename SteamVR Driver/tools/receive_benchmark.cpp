@@ -0,0 +1,404 @@
+//============ Copyright (c) Valve Corporation, All rights reserved. ============
+// Compares HandTrackingListener's receive backends, syscalls and CPU time per sample, and prints the result as one
+// JSON object:
+//
+//	receive_benchmark [--transports tcp,udp] [--backends socket,io_uring] [--rate-hz 1000] [--burst 4] [--duration-s 2]
+//		[--warmup-s 0.2] [--port 65504]
+//
+// A local stand-in producer sends bursts of --burst binary samples back to back, the way several cameras finishing
+// the same frame would, and waits until the listener has decoded all of them before the next burst is due.
+//
+// The listener's syscalls are counted by wrapping recv, recvfrom, epoll_wait and syscall (io_uring_enter, futex) at
+// link time, see CMakeLists.txt. Calls from this thread, the producer's sends, aren't counted. Everything but this
+// thread is the listener, so the process's CPU time less ours is the listener's.
+//
+// Exits non-zero if a sample goes missing, or if io_uring doesn't take fewer syscalls per sample than the socket
+// backend on a transport where both were measured. Where io_uring isn't available (older kernels, containers that
+// block it) the listener falls back to sockets; that's reported and nothing is compared.
+//
+// Linux only, the wrapping needs GNU ld or lld.
+
+#include "driver_clock.h"
+#include "hand_stream_sender.h"
+#include "hand_tracking_listener.h"
+#include "mock_vr_host.h"
+#include "tool_clock.h"
+#include "tool_options.h"
+
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cstdarg>
+#include <cstdio>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+enum SyscallKind
+{
+	SyscallKind_Recv,
+	SyscallKind_RecvFrom,
+	SyscallKind_EpollWait,
+	SyscallKind_IoUringEnter,
+	SyscallKind_Other,
+	SyscallKind_MAX,
+};
+
+static const char *const k_rchSyscallNames[ SyscallKind_MAX ] = { "recv", "recvfrom", "epoll_wait", "io_uring_enter", "other" };
+
+static std::atomic< bool > g_bCountSyscalls{ false };
+static std::atomic< uint64_t > g_rSyscallCounts[ SyscallKind_MAX ];
+static std::atomic< bool > g_bIoUringSetUp{ false };
+
+// The producer's own sends and waits aren't the listener's
+static thread_local bool t_bProducerThread = false;
+
+static void CountSyscall( SyscallKind kind )
+{
+	if ( !t_bProducerThread && g_bCountSyscalls.load( std::memory_order_relaxed ) )
+	{
+		g_rSyscallCounts[ kind ].fetch_add( 1, std::memory_order_relaxed );
+	}
+}
+
+extern "C"
+{
+	ssize_t __real_recv( int socket, void *buffer, size_t length, int flags );
+	ssize_t __real_recvfrom( int socket, void *buffer, size_t length, int flags, struct sockaddr *address, socklen_t *address_length );
+	int __real_epoll_wait( int epoll_fd, struct epoll_event *events, int max_events, int timeout );
+	long __real_syscall( long number, ... );
+
+	ssize_t __wrap_recv( int socket, void *buffer, size_t length, int flags )
+	{
+		CountSyscall( SyscallKind_Recv );
+		return __real_recv( socket, buffer, length, flags );
+	}
+
+	ssize_t __wrap_recvfrom( int socket, void *buffer, size_t length, int flags, struct sockaddr *address, socklen_t *address_length )
+	{
+		CountSyscall( SyscallKind_RecvFrom );
+		return __real_recvfrom( socket, buffer, length, flags, address, address_length );
+	}
+
+	int __wrap_epoll_wait( int epoll_fd, struct epoll_event *events, int max_events, int timeout )
+	{
+		CountSyscall( SyscallKind_EpollWait );
+		return __real_epoll_wait( epoll_fd, events, max_events, timeout );
+	}
+
+	// syscall() takes up to six register sized arguments, forwarding all six is what glibc's own wrapper does
+	long __wrap_syscall( long number, ... )
+	{
+		va_list args;
+		va_start( args, number );
+		long arguments[ 6 ];
+		for ( long &argument : arguments )
+		{
+			argument = va_arg( args, long );
+		}
+		va_end( args );
+
+		CountSyscall( number == __NR_io_uring_enter ? SyscallKind_IoUringEnter : SyscallKind_Other );
+		const long result = __real_syscall( number, arguments[ 0 ], arguments[ 1 ], arguments[ 2 ], arguments[ 3 ], arguments[ 4 ], arguments[ 5 ] );
+		if ( number == __NR_io_uring_setup && result >= 0 )
+		{
+			g_bIoUringSetUp = true;
+		}
+		return result;
+	}
+}
+
+// A burst the listener hasn't decoded by then is counted as lost
+static constexpr int64_t k_unReceiveTimeoutUs = 100000;
+
+// Most samples per burst, one batch each
+static constexpr uint32_t k_unMaxBurst = 64;
+
+struct ReceiveBenchmarkOptions
+{
+	std::vector< HandTransport > transports = { HandTransport_Tcp, HandTransport_Udp };
+	std::vector< HandReceiveBackend > backends = { HandReceiveBackend_Socket, HandReceiveBackend_IoUring };
+	double rate_hz = 1000.0;
+	uint32_t burst = 4;
+	double duration_s = 2.0;
+	double warmup_s = 0.2;
+	int port = 65504;
+};
+
+struct ReceiveResult
+{
+	HandTransport transport;
+	HandReceiveBackend backend;
+	bool io_uring_active = false;
+	uint64_t sent = 0;
+	uint64_t received = 0;
+	uint64_t send_failures = 0;
+	uint64_t syscalls[ SyscallKind_MAX ] = {};
+	double listener_cpu_ns = 0.0;
+
+	uint64_t Syscalls() const
+	{
+		uint64_t total = 0;
+		for ( uint64_t count : syscalls )
+		{
+			total += count;
+		}
+		return total;
+	}
+};
+
+static const char *BackendName( HandReceiveBackend backend )
+{
+	return backend == HandReceiveBackend_IoUring ? "io_uring" : "socket";
+}
+
+static uint64_t ReceivedSamples( const HandTrackingListener &listener )
+{
+	return listener.GetStreamCounters( HandId_Left ).received + listener.GetStreamCounters( HandId_Right ).received;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Starts a listener with the result's transport and backend, streams bursts to it for the configured
+// duration and counts its syscalls and CPU time after the warmup. The listener has no controllers to update.
+//-----------------------------------------------------------------------------
+static bool RunBackend( const ReceiveBenchmarkOptions &options, ReceiveResult &result )
+{
+	g_bIoUringSetUp = false;
+
+	HandTrackingListener listener( nullptr, nullptr );
+	listener.SetReceiveBackend( result.backend );
+	if ( !listener.Start( options.port, result.transport ) )
+	{
+		fprintf( stderr, "receive_benchmark: The listener didn't start (%s, port %d)\n", HandTransportName( result.transport ), options.port );
+		return false;
+	}
+	result.io_uring_active = result.backend == HandReceiveBackend_IoUring && g_bIoUringSetUp;
+
+	HandStreamSender sender;
+	if ( !sender.Open( result.transport, HandStreamProtocol_Binary, options.port, "", 1000 ) )
+	{
+		fprintf( stderr, "receive_benchmark: Can't connect to the listener (%s, port %d)\n", HandTransportName( result.transport ), options.port );
+		listener.Stop();
+		return false;
+	}
+
+	HandSampleBatch batch{};
+	batch.hand_count = 1;
+	HandSample &sample = batch.hands[ 0 ];
+	sample.fields = HandSampleField_Position | HandSampleField_Rotation | HandSampleField_Sequence;
+	sample.rotation[ 0 ] = 1.0f;
+
+	const double period_us = 1000000.0 * options.burst / options.rate_hz;
+	const int64_t start_time_us = DriverClockUs() + 10000;
+	const int64_t measure_time_us = start_time_us + static_cast< int64_t >( options.warmup_s * 1e6 );
+	const int64_t end_time_us = start_time_us + static_cast< int64_t >( options.duration_s * 1e6 );
+
+	int64_t process_cpu_start_ns = 0;
+	int64_t main_cpu_start_ns = 0;
+	uint32_t sequence = 0;
+
+	for ( uint32_t burst = 0;; burst++ )
+	{
+		const int64_t due_time_us = start_time_us + static_cast< int64_t >( burst * period_us );
+		if ( due_time_us >= end_time_us )
+		{
+			break;
+		}
+		SleepUntilUs( due_time_us );
+
+		const bool measuring = due_time_us >= measure_time_us;
+		if ( measuring && !g_bCountSyscalls )
+		{
+			for ( std::atomic< uint64_t > &count : g_rSyscallCounts )
+			{
+				count = 0;
+			}
+			process_cpu_start_ns = CpuTimeNs( CLOCK_PROCESS_CPUTIME_ID );
+			main_cpu_start_ns = CpuTimeNs( CLOCK_THREAD_CPUTIME_ID );
+			g_bCountSyscalls = true;
+		}
+
+		const uint64_t received_before = ReceivedSamples( listener );
+		uint32_t sent = 0;
+		for ( uint32_t i = 0; i < options.burst; i++ )
+		{
+			sample.hand = i % 2 == 0 ? HandId_Left : HandId_Right;
+			sample.sequence = sequence++;
+			sample.position[ 0 ] = static_cast< float >( sequence ) * 1e-4f;
+			if ( sender.Send( batch ) )
+			{
+				sent++;
+			}
+			else if ( measuring )
+			{
+				result.send_failures++;
+			}
+		}
+
+		// Yield rather than spin, the listener may need this core to run at all
+		const int64_t send_time_us = DriverClockUs();
+		while ( ReceivedSamples( listener ) - received_before < sent && DriverClockUs() - send_time_us < k_unReceiveTimeoutUs )
+		{
+			std::this_thread::yield();
+		}
+
+		if ( measuring )
+		{
+			result.sent += sent;
+			result.received += ReceivedSamples( listener ) - received_before;
+		}
+	}
+
+	g_bCountSyscalls = false;
+	const int64_t process_cpu_ns = CpuTimeNs( CLOCK_PROCESS_CPUTIME_ID ) - process_cpu_start_ns;
+	const int64_t main_cpu_ns = CpuTimeNs( CLOCK_THREAD_CPUTIME_ID ) - main_cpu_start_ns;
+	result.listener_cpu_ns = static_cast< double >( process_cpu_ns - main_cpu_ns );
+	for ( int kind = 0; kind < SyscallKind_MAX; kind++ )
+	{
+		result.syscalls[ kind ] = g_rSyscallCounts[ kind ];
+	}
+
+	sender.Close();
+	listener.Stop();
+	return true;
+}
+
+static bool BackendFromName( const char *pchName, HandReceiveBackend &backend )
+{
+	if ( strcmp( pchName, "socket" ) == 0 )
+	{
+		backend = HandReceiveBackend_Socket;
+		return true;
+	}
+	if ( strcmp( pchName, "io_uring" ) == 0 )
+	{
+		backend = HandReceiveBackend_IoUring;
+		return true;
+	}
+	return false;
+}
+
+static bool ParseOptions( int argc, char **argv, ReceiveBenchmarkOptions &options )
+{
+	ToolOptionParser parser( "receive_benchmark", argc, argv );
+	while ( parser.Next() )
+	{
+		const char *list = nullptr;
+		if ( parser.Value( "--transports", list ) )
+		{
+			// The shared memory reader has no sockets to receive from
+			if ( list != nullptr && ( !ParseList( list, options.transports, HandTransportFromName ) ||
+										std::find( options.transports.begin(), options.transports.end(), HandTransport_SharedMemory ) != options.transports.end() ) )
+			{
+				parser.Invalid( "tcp or udp" );
+			}
+		}
+		else if ( parser.Value( "--backends", list ) )
+		{
+			if ( list != nullptr && !ParseList( list, options.backends, BackendFromName ) )
+			{
+				parser.Invalid( "socket or io_uring" );
+			}
+		}
+		else if ( !parser.Value( "--rate-hz", options.rate_hz ) && !parser.Value( "--burst", options.burst ) && !parser.Value( "--duration-s", options.duration_s ) &&
+				  !parser.Value( "--warmup-s", options.warmup_s ) && !parser.Value( "--port", options.port ) )
+		{
+			parser.Unknown();
+		}
+	}
+
+	return parser.IsValid() && options.rate_hz > 0.0 && options.rate_hz <= 20000.0 && options.burst >= 1 && options.burst <= k_unMaxBurst && options.duration_s > 0.0 &&
+		   options.warmup_s >= 0.0 && options.warmup_s < options.duration_s && options.port > 0 && options.port <= 65535;
+}
+
+int main( int argc, char **argv )
+{
+	ReceiveBenchmarkOptions options;
+	if ( !ParseOptions( argc, argv, options ) )
+	{
+		fprintf( stderr, "usage: receive_benchmark [--transports tcp,udp] [--backends socket,io_uring] [--rate-hz 1000] [--burst 4] [--duration-s 2]\n"
+						 "                         [--warmup-s 0.2] [--port 65504]\n" );
+		return 2;
+	}
+	t_bProducerThread = true;
+
+	// The listener logs through the driver context
+	MockDriverContext context;
+	vr::InitServerDriverContext( &context );
+
+	std::vector< ReceiveResult > results;
+	bool passed = true;
+	for ( HandTransport transport : options.transports )
+	{
+		for ( HandReceiveBackend backend : options.backends )
+		{
+			results.emplace_back();
+			results.back().transport = transport;
+			results.back().backend = backend;
+			passed &= RunBackend( options, results.back() );
+		}
+	}
+
+	printf( "{\"rate_hz\":%.1f,\"burst\":%u,\"duration_s\":%.1f,\"results\":[", options.rate_hz, options.burst, options.duration_s );
+	for ( size_t i = 0; i < results.size(); i++ )
+	{
+		const ReceiveResult &result = results[ i ];
+		const double samples = static_cast< double >( std::max< uint64_t >( result.received, 1 ) );
+		printf( "%s{\"transport\":\"%s\",\"backend\":\"%s\",\"io_uring_active\":%s,\"sent\":%llu,\"received\":%llu,\"send_failures\":%llu,"
+				"\"syscalls_per_sample\":%.3f,\"cpu_ns_per_sample\":%.0f,\"syscalls\":{",
+			i > 0 ? "," : "", HandTransportName( result.transport ), BackendName( result.backend ), result.io_uring_active ? "true" : "false",
+			static_cast< unsigned long long >( result.sent ), static_cast< unsigned long long >( result.received ),
+			static_cast< unsigned long long >( result.send_failures ), result.Syscalls() / samples, result.listener_cpu_ns / samples );
+		for ( int kind = 0; kind < SyscallKind_MAX; kind++ )
+		{
+			printf( "%s\"%s\":%llu", kind > 0 ? "," : "", k_rchSyscallNames[ kind ], static_cast< unsigned long long >( result.syscalls[ kind ] ) );
+		}
+		printf( "}}" );
+
+		if ( result.sent == 0 || result.received != result.sent || result.send_failures > 0 )
+		{
+			fprintf( stderr, "receive_benchmark: %s with %s received %llu of %llu samples, %llu failed to send\n", HandTransportName( result.transport ),
+				BackendName( result.backend ), static_cast< unsigned long long >( result.received ), static_cast< unsigned long long >( result.sent ),
+				static_cast< unsigned long long >( result.send_failures ) );
+			passed = false;
+		}
+	}
+	printf( "]}\n" );
+
+	// io_uring against sockets on the same transport
+	for ( const ReceiveResult &uring : results )
+	{
+		if ( uring.backend != HandReceiveBackend_IoUring )
+		{
+			continue;
+		}
+		if ( !uring.io_uring_active )
+		{
+			fprintf( stderr, "receive_benchmark: io_uring isn't available here, the %s listener fell back to sockets\n", HandTransportName( uring.transport ) );
+			continue;
+		}
+
+		for ( const ReceiveResult &socket : results )
+		{
+			if ( socket.backend != HandReceiveBackend_Socket || socket.transport != uring.transport )
+			{
+				continue;
+			}
+
+			const double uring_per_sample = static_cast< double >( uring.Syscalls() ) / std::max< uint64_t >( uring.received, 1 );
+			const double socket_per_sample = static_cast< double >( socket.Syscalls() ) / std::max< uint64_t >( socket.received, 1 );
+			if ( uring_per_sample >= socket_per_sample )
+			{
+				fprintf( stderr, "receive_benchmark: io_uring took %.3f syscalls per sample over %s, sockets %.3f\n", uring_per_sample,
+					HandTransportName( uring.transport ), socket_per_sample );
+				passed = false;
+			}
+		}
+	}
+
+	vr::CleanupDriverContext();
+	return passed ? 0 : 1;
+}
@@ -0,0 +1,229 @@
+//============ Copyright (c) Valve Corporation, All rights reserved. ============
+// Compares the shared PoseScheduler with the thread per device model it replaced: wakeups, context switches and
+// CPU time per second for the same number of devices submitting poses. Prints one JSON object:
+//
+//	scheduler_benchmark [--devices 2,8] [--rate-hz 200] [--duration-s 2]
+//
+// Both submit every device's pose to MockDriverContext's host at --rate-hz, each fetching the hmd pose it builds
+// on like the driver does. The reference is MyPoseUpdateThread as it was: one thread per device, a raw hmd pose
+// fetch and a submit, then sleep_for( period ). The shared scheduler fetches the hmd pose once per tick for every
+// device due. Wakeups are the scheduler's own count and the reference threads' loop iterations; context switches
+// come from getrusage() and CPU is the process's less this thread's, which only sleeps.
+// Exits non-zero if the scheduler wakes up as often as the reference for two or more devices, or doesn't keep
+// every device at 90% of its rate.
+//
+// POSIX only, like driver_benchmark.
+
+#include "driver_clock.h"
+#include "hmd_pose_cache.h"
+#include "mock_vr_host.h"
+#include "pose_scheduler.h"
+#include "tool_clock.h"
+#include "tool_options.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <memory>
+#include <thread>
+#include <vector>
+
+// Most devices, vrserver has 64 tracked device slots
+static constexpr uint32_t k_unMaxDevices = 32;
+
+struct SchedulerResult
+{
+	double wakeups_per_sec = 0.0;
+	double context_switches_per_sec = 0.0;
+	double poses_per_sec = 0.0;
+	double cpu_percent = 0.0;
+};
+
+static vr::DriverPose_t PoseFromHmd( const HmdPose &hmd_pose )
+{
+	vr::DriverPose_t pose = {};
+	pose.qWorldFromDriverRotation.w = 1.0;
+	pose.qDriverFromHeadRotation.w = 1.0;
+	pose.qRotation = hmd_pose.orientation;
+	for ( int i = 0; i < 3; i++ )
+	{
+		pose.vecPosition[ i ] = hmd_pose.position.v[ i ];
+	}
+	pose.poseIsValid = true;
+	pose.deviceIsConnected = true;
+	pose.result = vr::TrackingResult_Running_OK;
+	return pose;
+}
+
+// What a controller does with its turn, with the hmd pose the scheduler fetched for the tick
+class BenchmarkDevice : public IScheduledPoseDevice
+{
+public:
+	explicit BenchmarkDevice( uint32_t unDeviceIndex )
+		: device_index_( unDeviceIndex )
+	{
+	}
+
+	void SubmitScheduledPose( const HmdPose &hmd_pose, int64_t nLateUs ) override
+	{
+		vr::VRServerDriverHost()->TrackedDevicePoseUpdated( device_index_, PoseFromHmd( hmd_pose ), sizeof( vr::DriverPose_t ) );
+	}
+
+	void SubmitIdlePose( const HmdPose &hmd_pose ) override
+	{
+	}
+
+private:
+	uint32_t device_index_;
+};
+
+//-----------------------------------------------------------------------------
+// Purpose: Measures whatever is submitting poses for fDurationS, after a moment to get going: its wakeups as
+// counted by wakeups(), the poses the host got, and the process's CPU time and context switches.
+//-----------------------------------------------------------------------------
+template < typename Wakeups >
+static SchedulerResult Measure( MockDriverContext &context, double fDurationS, Wakeups wakeups )
+{
+	std::this_thread::sleep_for( std::chrono::milliseconds( 100 ) );
+
+	const MockRecordBuffer< MockPoseRecord > &poses = context.GetServerDriverHost().Poses();
+	const uint64_t wakeups_start = wakeups();
+	const uint64_t switches_start = ContextSwitches();
+	const uint64_t poses_start = poses.Count();
+	const int64_t process_cpu_start_ns = CpuTimeNs( CLOCK_PROCESS_CPUTIME_ID );
+	const int64_t main_cpu_start_ns = CpuTimeNs( CLOCK_THREAD_CPUTIME_ID );
+	const int64_t start_us = DriverClockUs();
+
+	std::this_thread::sleep_for( std::chrono::duration< double >( fDurationS ) );
+
+	const double elapsed_s = ( DriverClockUs() - start_us ) * 1e-6;
+	const double cpu_ns = static_cast< double >( ( CpuTimeNs( CLOCK_PROCESS_CPUTIME_ID ) - process_cpu_start_ns ) - ( CpuTimeNs( CLOCK_THREAD_CPUTIME_ID ) - main_cpu_start_ns ) );
+
+	SchedulerResult result;
+	result.wakeups_per_sec = ( wakeups() - wakeups_start ) / elapsed_s;
+	result.context_switches_per_sec = ( ContextSwitches() - switches_start ) / elapsed_s;
+	result.poses_per_sec = ( poses.Count() - poses_start ) / elapsed_s;
+	result.cpu_percent = cpu_ns / ( elapsed_s * 1e7 );
+	return result;
+}
+
+static SchedulerResult RunSharedScheduler( MockDriverContext &context, uint32_t unDevices, double fRateHz, double fDurationS )
+{
+	std::vector< std::unique_ptr< BenchmarkDevice > > devices;
+	PoseScheduler scheduler;
+	for ( uint32_t i = 0; i < unDevices; i++ )
+	{
+		devices.push_back( std::make_unique< BenchmarkDevice >( i + 1 ) );
+		scheduler.AddDevice( devices.back().get(), static_cast< int64_t >( 1e6 / fRateHz ), false );
+	}
+
+	scheduler.Start();
+	const SchedulerResult result = Measure( context, fDurationS, [ &scheduler ]() { return scheduler.GetWakeupCount(); } );
+	scheduler.Stop();
+	return result;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: MyControllerDeviceDriver::MyPoseUpdateThread before the shared scheduler, one of these per device
+//-----------------------------------------------------------------------------
+static void ReferencePoseThread( uint32_t unDeviceIndex, double fRateHz, const std::atomic< bool > &is_running, std::atomic< uint64_t > &wakeups )
+{
+	const auto period = std::chrono::microseconds( static_cast< int64_t >( 1e6 / fRateHz ) );
+	while ( is_running )
+	{
+		vr::VRServerDriverHost()->TrackedDevicePoseUpdated( unDeviceIndex, PoseFromHmd( FetchHmdPose() ), sizeof( vr::DriverPose_t ) );
+
+		std::this_thread::sleep_for( period );
+		wakeups.fetch_add( 1, std::memory_order_relaxed );
+	}
+}
+
+static SchedulerResult RunThreadPerDevice( MockDriverContext &context, uint32_t unDevices, double fRateHz, double fDurationS )
+{
+	std::atomic< bool > is_running{ true };
+	std::atomic< uint64_t > wakeups{ 0 };
+	std::vector< std::thread > threads;
+	for ( uint32_t i = 0; i < unDevices; i++ )
+	{
+		threads.emplace_back( ReferencePoseThread, i + 1, fRateHz, std::cref( is_running ), std::ref( wakeups ) );
+	}
+
+	const SchedulerResult result = Measure( context, fDurationS, [ &wakeups ]() { return wakeups.load(); } );
+
+	is_running = false;
+	for ( std::thread &thread : threads )
+	{
+		thread.join();
+	}
+	return result;
+}
+
+static void PrintResult( const char *pchName, const SchedulerResult &result )
+{
+	printf( "\"%s\":{\"wakeups_per_sec\":%.1f,\"context_switches_per_sec\":%.1f,\"poses_per_sec\":%.1f,\"cpu_percent\":%.3f}", pchName,
+		result.wakeups_per_sec, result.context_switches_per_sec, result.poses_per_sec, result.cpu_percent );
+}
+
+int main( int argc, char **argv )
+{
+	std::vector< uint32_t > device_counts = { 2, 8 };
+	double rate_hz = 200.0;
+	double duration_s = 2.0;
+	ToolOptionParser parser( "scheduler_benchmark", argc, argv );
+	while ( parser.Next() )
+	{
+		const char *devices = nullptr;
+		if ( parser.Value( "--devices", devices ) )
+		{
+			if ( devices != nullptr && !ParseCountList( devices, k_unMaxDevices, device_counts ) )
+			{
+				parser.Invalid( "device counts from 1 to 32" );
+			}
+		}
+		else if ( !parser.Value( "--rate-hz", rate_hz ) && !parser.Value( "--duration-s", duration_s ) )
+		{
+			parser.Unknown();
+		}
+	}
+	if ( !parser.IsValid() || rate_hz <= 0.0 || rate_hz > 2000.0 || duration_s <= 0.0 )
+	{
+		fprintf( stderr, "usage: scheduler_benchmark [--devices 2,8] [--rate-hz 200] [--duration-s 2]\n" );
+		return 2;
+	}
+
+	// The devices submit to the mock host and fetch the hmd pose from it
+	MockDriverContext context;
+	vr::InitServerDriverContext( &context );
+
+	bool passed = true;
+	printf( "{\"rate_hz\":%.1f,\"duration_s\":%.1f,\"results\":[", rate_hz, duration_s );
+	for ( size_t i = 0; i < device_counts.size(); i++ )
+	{
+		const uint32_t devices = device_counts[ i ];
+		const SchedulerResult shared = RunSharedScheduler( context, devices, rate_hz, duration_s );
+		const SchedulerResult reference = RunThreadPerDevice( context, devices, rate_hz, duration_s );
+
+		printf( "%s{\"devices\":%u,", i > 0 ? "," : "", devices );
+		PrintResult( "shared_scheduler", shared );
+		printf( "," );
+		PrintResult( "thread_per_device", reference );
+		printf( "}" );
+
+		if ( devices >= 2 && shared.wakeups_per_sec >= reference.wakeups_per_sec )
+		{
+			fprintf( stderr, "scheduler_benchmark: With %u devices the scheduler woke up %.1f times a second, the thread per device model %.1f\n", devices,
+				shared.wakeups_per_sec, reference.wakeups_per_sec );
+			passed = false;
+		}
+		if ( shared.poses_per_sec < 0.9 * devices * rate_hz )
+		{
+			fprintf( stderr, "scheduler_benchmark: With %u devices the scheduler submitted %.1f poses a second, expected %.1f\n", devices,
+				shared.poses_per_sec, devices * rate_hz );
+			passed = false;
+		}
+	}
+	printf( "]}\n" );
+
+	vr::CleanupDriverContext();
+	return passed ? 0 : 1;
+}
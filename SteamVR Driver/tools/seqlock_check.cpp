@@ -0,0 +1,301 @@
+//============ Copyright (c) Valve Corporation, All rights reserved. ============
+// Stress test for torn reads of the hand state, prints the result as one JSON object:
+//
+//	seqlock_check [--duration-s 2] [--readers 2]
+//
+// One writer thread publishes numbered values as fast as it can while reader threads load them, and every value
+// read is checked to be a single write's: all of its fields derived from the same number, and never older than what
+// the same reader saw before. Three cases, each for --duration-s:
+//
+//	seqlock              Seqlock<> directly, a 64 byte value of 16 words
+//	controller           MyControllerDeviceDriver::UpdateHandSample() against GetPose(), position and rotation
+//	independent_atomics  The layout the controller used to have, nine std::atomic<float> stored and loaded one by one
+//
+// The last one is the control, it shows the check can see a torn read: it's expected to have some, how many depends
+// on the machine. Exits non-zero if the seqlock or the controller ever hand out a torn or an older value.
+
+#include "controller_device_driver.h"
+#include "mock_vr_host.h"
+#include "seqlock.h"
+#include "tool_options.h"
+
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <thread>
+#include <vector>
+
+// Most reader threads
+static constexpr uint32_t k_unMaxReaders = 16;
+
+struct StressResult
+{
+	uint64_t writes = 0;
+	uint64_t reads = 0;
+	uint64_t torn = 0;		// Fields from more than one write
+	uint64_t backwards = 0; // Older than the reader's previous read
+};
+
+//-----------------------------------------------------------------------------
+// Purpose: Runs write( n ) for n = 1, 2, ... on one thread and read( n ) on unReaders others, for fDurationS.
+// read returns whether the value it got was consistent and sets n to the number it was written with.
+// Numbers compare modulo unNumberMask + 1, the controller case can only carry 20 bits of them.
+//-----------------------------------------------------------------------------
+template < typename Write, typename Read >
+static StressResult RunStress( double fDurationS, uint32_t unReaders, uint32_t unNumberMask, Write write, Read read )
+{
+	std::atomic< bool > is_running{ true };
+	std::atomic< uint64_t > writes{ 0 };
+	std::atomic< uint64_t > reads{ 0 };
+	std::atomic< uint64_t > torn{ 0 };
+	std::atomic< uint64_t > backwards{ 0 };
+
+	// Readers never see the initial state
+	write( 0 );
+
+	std::thread writer( [ & ]()
+	{
+		uint64_t count = 0;
+		while ( is_running.load( std::memory_order_relaxed ) )
+		{
+			count++;
+			write( static_cast< uint32_t >( count ) & unNumberMask );
+		}
+		writes = count;
+	} );
+
+	std::vector< std::thread > readers;
+	for ( uint32_t i = 0; i < unReaders; i++ )
+	{
+		readers.emplace_back( [ & ]()
+		{
+			uint64_t reader_reads = 0;
+			uint64_t reader_torn = 0;
+			uint64_t reader_backwards = 0;
+			uint32_t last_number = 0;
+
+			while ( is_running.load( std::memory_order_relaxed ) )
+			{
+				uint32_t number = 0;
+				if ( !read( number ) )
+				{
+					reader_torn++;
+				}
+				else
+				{
+					// Further back than forward, modulo the mask
+					if ( ( ( number - last_number ) & unNumberMask ) > unNumberMask / 2 )
+					{
+						reader_backwards++;
+					}
+					last_number = number;
+				}
+				reader_reads++;
+			}
+
+			reads += reader_reads;
+			torn += reader_torn;
+			backwards += reader_backwards;
+		} );
+	}
+
+	std::this_thread::sleep_for( std::chrono::duration< double >( fDurationS ) );
+	is_running = false;
+	writer.join();
+	for ( std::thread &reader : readers )
+	{
+		reader.join();
+	}
+
+	StressResult result;
+	result.writes = writes;
+	result.reads = reads;
+	result.torn = torn;
+	result.backwards = backwards;
+	return result;
+}
+
+// A cache line of words that all follow from the first
+struct StressValue
+{
+	uint32_t number;
+	uint32_t words[ 15 ];
+};
+
+static uint32_t StressWord( uint32_t unNumber, uint32_t unIndex )
+{
+	return unNumber * ( unIndex + 2 ) + unIndex * 0x9e3779b9u;
+}
+
+static StressResult StressSeqlock( double fDurationS, uint32_t unReaders )
+{
+	Seqlock< StressValue > seqlock;
+
+	return RunStress( fDurationS, unReaders, UINT32_MAX,
+		[ & ]( uint32_t unNumber )
+		{
+			StressValue value;
+			value.number = unNumber;
+			for ( uint32_t i = 0; i < 15; i++ )
+			{
+				value.words[ i ] = StressWord( unNumber, i );
+			}
+			seqlock.Store( value );
+		},
+		[ & ]( uint32_t &unNumber )
+		{
+			const StressValue value = seqlock.Load();
+			unNumber = value.number;
+			for ( uint32_t i = 0; i < 15; i++ )
+			{
+				if ( value.words[ i ] != StressWord( value.number, i ) )
+				{
+					return false;
+				}
+			}
+			return true;
+		} );
+}
+
+// Positions stay whole numbers of metres a float holds exactly, and the rotation's x a multiple of 2^-20
+static constexpr uint32_t k_unControllerNumberMask = ( 1u << 20 ) - 1;
+static constexpr double k_flRotationStep = 1.0 / ( 1u << 20 );
+
+//-----------------------------------------------------------------------------
+// Purpose: The listener's side and vrserver's side of a controller. With the hmd standing at the origin and no
+// pose scheduler, GetPose() hands back the sample's position and rotation as they were written.
+//-----------------------------------------------------------------------------
+static StressResult StressController( double fDurationS, uint32_t unReaders )
+{
+	MyControllerDeviceDriver controller( vr::TrackedControllerRole_LeftHand );
+
+	return RunStress( fDurationS, unReaders, k_unControllerNumberMask,
+		[ & ]( uint32_t unNumber )
+		{
+			HandSample sample = {};
+			sample.hand = HandId_Left;
+			sample.fields = HandSampleField_Position | HandSampleField_Rotation;
+			sample.position[ 0 ] = static_cast< float >( unNumber );
+			sample.position[ 1 ] = static_cast< float >( 2 * unNumber );
+			sample.position[ 2 ] = -static_cast< float >( unNumber );
+			sample.rotation[ 0 ] = 1.0f;
+			sample.rotation[ 1 ] = static_cast< float >( unNumber * k_flRotationStep );
+			controller.UpdateHandSample( sample );
+		},
+		[ & ]( uint32_t &unNumber )
+		{
+			const vr::DriverPose_t pose = controller.GetPose();
+			const double number = pose.vecPosition[ 0 ];
+			unNumber = static_cast< uint32_t >( std::lround( number ) );
+			return std::fabs( number - unNumber ) < 0.25 && std::fabs( pose.vecPosition[ 1 ] - 2.0 * unNumber ) < 0.5 &&
+				   std::fabs( pose.vecPosition[ 2 ] + unNumber ) < 0.5 && std::fabs( pose.qRotation.w - 1.0 ) < 1e-6 &&
+				   std::fabs( pose.qRotation.x - unNumber * k_flRotationStep ) < k_flRotationStep / 2;
+		} );
+}
+
+// MyControllerDeviceDriver's hand data before the seqlock: x, y, z, qw, qx, qy, qz, trigger, grip
+struct IndependentAtomics
+{
+	std::atomic< float > values[ 9 ];
+};
+
+static StressResult StressIndependentAtomics( double fDurationS, uint32_t unReaders )
+{
+	IndependentAtomics atomics;
+	for ( std::atomic< float > &value : atomics.values )
+	{
+		value = 0.0f;
+	}
+
+	return RunStress( fDurationS, unReaders, k_unControllerNumberMask,
+		[ & ]( uint32_t unNumber )
+		{
+			for ( std::atomic< float > &value : atomics.values )
+			{
+				value.store( static_cast< float >( unNumber ), std::memory_order_relaxed );
+			}
+		},
+		[ & ]( uint32_t &unNumber )
+		{
+			float values[ 9 ];
+			for ( int i = 0; i < 9; i++ )
+			{
+				values[ i ] = atomics.values[ i ].load( std::memory_order_relaxed );
+			}
+
+			unNumber = static_cast< uint32_t >( values[ 0 ] );
+			for ( float value : values )
+			{
+				if ( value != values[ 0 ] )
+				{
+					return false;
+				}
+			}
+			return true;
+		} );
+}
+
+static void PrintResult( const char *pchName, const StressResult &result, bool bLast )
+{
+	printf( "\"%s\":{\"writes\":%llu,\"reads\":%llu,\"torn\":%llu,\"backwards\":%llu}%s", pchName, static_cast< unsigned long long >( result.writes ),
+		static_cast< unsigned long long >( result.reads ), static_cast< unsigned long long >( result.torn ), static_cast< unsigned long long >( result.backwards ),
+		bLast ? "" : "," );
+}
+
+static bool Passed( const char *pchName, const StressResult &result )
+{
+	if ( result.writes == 0 || result.reads == 0 )
+	{
+		fprintf( stderr, "seqlock_check: %s didn't get to run, %llu writes and %llu reads\n", pchName, static_cast< unsigned long long >( result.writes ),
+			static_cast< unsigned long long >( result.reads ) );
+		return false;
+	}
+	if ( result.torn > 0 || result.backwards > 0 )
+	{
+		fprintf( stderr, "seqlock_check: %s handed out %llu torn and %llu older values in %llu reads\n", pchName, static_cast< unsigned long long >( result.torn ),
+			static_cast< unsigned long long >( result.backwards ), static_cast< unsigned long long >( result.reads ) );
+		return false;
+	}
+	return true;
+}
+
+int main( int argc, char **argv )
+{
+	double duration_s = 2.0;
+	uint32_t readers = 2;
+	ToolOptionParser parser( "seqlock_check", argc, argv );
+	while ( parser.Next() )
+	{
+		if ( !parser.Value( "--duration-s", duration_s ) && !parser.Value( "--readers", readers ) )
+		{
+			parser.Unknown();
+		}
+	}
+	if ( !parser.IsValid() || duration_s <= 0.0 || readers < 1 || readers > k_unMaxReaders )
+	{
+		fprintf( stderr, "usage: seqlock_check [--duration-s 2] [--readers 2]\n" );
+		return 2;
+	}
+
+	// The controller reads its settings and the hmd pose through the driver context
+	MockDriverContext context;
+	context.GetServerDriverHost().SetHmdScript( []( double ) { return MockStandingHmdPose( 0.0f ); } );
+	vr::InitServerDriverContext( &context );
+
+	const StressResult seqlock = StressSeqlock( duration_s, readers );
+	const StressResult controller = StressController( duration_s, readers );
+	const StressResult independent_atomics = StressIndependentAtomics( duration_s, readers );
+
+	printf( "{\"duration_s\":%.1f,\"readers\":%u,", duration_s, readers );
+	PrintResult( "seqlock", seqlock, false );
+	PrintResult( "controller", controller, false );
+	PrintResult( "independent_atomics", independent_atomics, true );
+	printf( "}\n" );
+
+	bool passed = Passed( "Seqlock", seqlock );
+	passed &= Passed( "The controller", controller );
+
+	vr::CleanupDriverContext();
+	return passed ? 0 : 1;
+}
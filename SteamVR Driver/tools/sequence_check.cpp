@@ -0,0 +1,210 @@
+//============ Copyright (c) Valve Corporation, All rights reserved. ============
+// Checks the listener's sequence accounting, which samples it applies and which it drops:
+//
+//	sequence_check [--port 65502]
+//
+// Numbered text messages are replayed into a listener that was never started, with made up receive times, and the
+// per hand counters are compared with what should have happened. Then two producers stream the same hand at once,
+// over loopback TCP (port) and UDP (port + 1). Prints every case and exits non-zero if one fails.
+//
+// POSIX only, like driver_benchmark.
+
+#include "driver_clock.h"
+#include "hand_capture.h"
+#include "hand_stream_sender.h"
+#include "hand_tracking_listener.h"
+#include "mock_vr_host.h"
+#include "tool_options.h"
+
+#include <chrono>
+#include <cinttypes>
+#include <cstdio>
+#include <thread>
+
+// Camera.py's frame period
+static constexpr int64_t k_unFramePeriodUs = 16667;
+
+// How long the listener gets to receive what the producers sent
+static constexpr int64_t k_unDrainTimeoutUs = 2000000;
+
+struct SequenceCheck
+{
+	HandTrackingListener listener{ nullptr, nullptr };
+	int64_t time_us = 1000000;
+	HandStreamCounters before{};
+};
+
+// Replays one left hand sample numbered unSequence, nAfterUs after the previous one
+static void Send( SequenceCheck &check, uint32_t unSequence, int64_t nAfterUs = k_unFramePeriodUs )
+{
+	char message[ 160 ];
+	snprintf( message, sizeof( message ), "HAND:LEFT,X:0.1,Y:0.2,Z:-0.3,QW:1,QX:0,QY:0,QZ:0,TRIGGER:0,GRIP:0,GESTURE:OPEN,SEQ:%" PRIu32, unSequence );
+	check.time_us += nAfterUs;
+	check.listener.ReplayMessage( HandCaptureFormat_Text, message, check.time_us );
+}
+
+static void SendRun( SequenceCheck &check, uint32_t unFirst, uint32_t unCount )
+{
+	for ( uint32_t i = 0; i < unCount; i++ )
+	{
+		Send( check, unFirst + i );
+	}
+}
+
+static bool Report( const char *pchCase, uint64_t received, uint64_t lost, uint64_t reordered, uint64_t duplicates,
+	uint64_t unReceived, uint64_t unLost, uint64_t unReordered, uint64_t unDuplicates )
+{
+	const bool passed = received == unReceived && lost == unLost && reordered == unReordered && duplicates == unDuplicates;
+	printf( "%s %s: received %" PRIu64 " lost %" PRIu64 " reordered %" PRIu64 " duplicates %" PRIu64 "\n", passed ? "ok  " : "FAIL", pchCase, received, lost, reordered, duplicates );
+	if ( !passed )
+	{
+		printf( "     expected received %" PRIu64 " lost %" PRIu64 " reordered %" PRIu64 " duplicates %" PRIu64 "\n", unReceived, unLost, unReordered, unDuplicates );
+	}
+	return passed;
+}
+
+// Compares what the counters did since the last case with what was expected
+static bool Expect( SequenceCheck &check, const char *pchCase, uint64_t unReceived, uint64_t unLost, uint64_t unReordered, uint64_t unDuplicates )
+{
+	const HandStreamCounters now = check.listener.GetStreamCounters( HandId_Left );
+	const HandStreamCounters before = check.before;
+	check.before = now;
+
+	return Report( pchCase, now.received - before.received, now.lost - before.lost, now.reordered - before.reordered, now.duplicates - before.duplicates,
+		unReceived, unLost, unReordered, unDuplicates );
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Two producers numbering the left hand on their own, far enough apart that one would look like the other's
+// late samples. The second one starts while the first is streaming, then they take turns. Every sample has to be applied.
+//-----------------------------------------------------------------------------
+static bool CheckConcurrentProducers( HandTransport transport, int nPort )
+{
+	static constexpr uint32_t k_unSamplesEach = 100;
+	static constexpr uint32_t k_unFirstStart = 500;
+
+	char check_case[ 64 ];
+	snprintf( check_case, sizeof( check_case ), "two producers over %s", HandTransportName( transport ) );
+
+	HandTrackingListener listener( nullptr, nullptr );
+	if ( !listener.Start( nPort, transport ) )
+	{
+		printf( "FAIL %s: the listener didn't start on port %d\n", check_case, nPort );
+		return false;
+	}
+
+	HandSampleBatch batch = {};
+	batch.hand_count = 1;
+	HandSample &sample = batch.hands[ 0 ];
+	sample.hand = HandId_Left;
+	sample.fields = HandSampleField_Position | HandSampleField_Rotation | HandSampleField_Sequence;
+	sample.rotation[ 0 ] = 1.0f;
+
+	HandStreamSender first;
+	HandStreamSender second;
+	bool sent = first.Open( transport, HandStreamProtocol_Binary, nPort, "", 1000 );
+	for ( uint32_t i = 0; sent && i < k_unSamplesEach / 2; i++ )
+	{
+		sample.sequence = k_unFirstStart + i;
+		sent = first.Send( batch );
+	}
+
+	sent = sent && second.Open( transport, HandStreamProtocol_Binary, nPort, "", 1000 );
+	for ( uint32_t i = 0; sent && i < k_unSamplesEach; i++ )
+	{
+		if ( i < k_unSamplesEach / 2 )
+		{
+			sample.sequence = k_unFirstStart + k_unSamplesEach / 2 + i;
+			sent = first.Send( batch );
+		}
+		sample.sequence = i;
+		sent = sent && second.Send( batch );
+	}
+
+	if ( !sent )
+	{
+		printf( "FAIL %s: couldn't send to port %d\n", check_case, nPort );
+		listener.Stop();
+		return false;
+	}
+
+	HandStreamCounters counters = listener.GetStreamCounters( HandId_Left );
+	for ( const int64_t start_us = DriverClockUs(); counters.received < 2 * k_unSamplesEach && DriverClockUs() - start_us < k_unDrainTimeoutUs; )
+	{
+		std::this_thread::sleep_for( std::chrono::milliseconds( 10 ) );
+		counters = listener.GetStreamCounters( HandId_Left );
+	}
+
+	first.Close();
+	second.Close();
+	listener.Stop();
+
+	return Report( check_case, counters.received, counters.lost, counters.reordered, counters.duplicates, 2 * k_unSamplesEach, 0, 0, 0 );
+}
+
+int main( int argc, char **argv )
+{
+	int port = 65502;
+	ToolOptionParser parser( "sequence_check", argc, argv );
+	while ( parser.Next() )
+	{
+		if ( !parser.Value( "--port", port ) )
+		{
+			parser.Unknown();
+		}
+	}
+	if ( !parser.IsValid() )
+	{
+		fprintf( stderr, "usage: sequence_check [--port 65502]\n" );
+		return 2;
+	}
+
+	// The listener logs through the driver context
+	MockDriverContext context;
+	vr::InitServerDriverContext( &context );
+
+	SequenceCheck check;
+	bool passed = true;
+
+	SendRun( check, 5000, 100 );
+	passed &= Expect( check, "in order", 100, 0, 0, 0 );
+
+	Send( check, 5101 );
+	Send( check, 5101, 1000 );
+	Send( check, 5100, 1000 );
+	Send( check, 5102 );
+	passed &= Expect( check, "late and duplicate samples are dropped", 4, 1, 1, 1 );
+
+	Send( check, 5110 );
+	passed &= Expect( check, "gap", 1, 7, 0, 0 );
+
+	// Camera.py restarted, counting from 0 again well within the restart distance of where it was.
+	// Only the first sample of the new run may differ from an in order stream.
+	Send( check, 0, 2000000 );
+	SendRun( check, 1, 99 );
+	passed &= Expect( check, "producer restarted after a pause", 100, 0, 0, 0 );
+
+	// Restarted and quickly caught up to exactly where the old run stopped
+	Send( check, 99, 2000000 );
+	Send( check, 100 );
+	passed &= Expect( check, "producer restarted on its last sequence", 2, 0, 0, 0 );
+
+	// A pause on its own doesn't make a late sample acceptable once the stream is going again
+	Send( check, 120, 2000000 );
+	Send( check, 119, 1000 );
+	passed &= Expect( check, "late sample after a pause", 2, 19, 1, 0 );
+
+	// Far behind is a restart even without a pause
+	Send( check, 100000 );
+	Send( check, 5 );
+	Send( check, 6 );
+	passed &= Expect( check, "big jump backwards", 3, 99879, 0, 0 );
+
+	passed &= CheckConcurrentProducers( HandTransport_Tcp, port );
+	passed &= CheckConcurrentProducers( HandTransport_Udp, port + 1 );
+
+	vr::CleanupDriverContext();
+
+	printf( "sequence_check: %s\n", passed ? "passed" : "FAILED" );
+	return passed ? 0 : 1;
+}
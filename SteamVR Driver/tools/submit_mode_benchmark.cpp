@@ -0,0 +1,242 @@
+//============ Copyright (c) Valve Corporation, All rights reserved. ============
+// Compares the pose submit modes on a slow camera: how long a sample waits between arriving at the listener and
+// going out with TrackedDevicePoseUpdated(), how many poses that takes and what it costs. Prints one JSON object:
+//
+//	submit_mode_benchmark [--rate-hz 30] [--duration-s 3] [--warmup-s 0.5] [--transport tcp|udp|shm] [--port 65505]
+//		[--settings resources/settings/default.vrsettings]
+//
+// The whole driver runs in-process against MockDriverContext, once with pose_submit_mode fixed and once with
+// on_sample, everything else from the settings file. A synthetic producer sends both hands at --rate-hz. The
+// receive to submit latency is the driver's own (PipelineStats), taken right after the TrackedDevicePoseUpdated()
+// that first carried a sample, over the whole run like driver_benchmark's. Poses per second are counted in the mock
+// host's record and the driver's CPU time is the process's less this thread's, both after the warmup.
+// Exits non-zero if a sample goes missing or if on_sample's median latency isn't lower than fixed's for either hand.
+//
+// POSIX only, like driver_benchmark.
+
+#include "device_provider.h"
+#include "driver_clock.h"
+#include "hand_stream_sender.h"
+#include "mock_vr_host.h"
+#include "synthetic_hand_source.h"
+#include "tool_clock.h"
+#include "tool_options.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <iterator>
+#include <memory>
+
+// Our own ring, so a driver running on the same machine isn't disturbed
+static const char *submit_mode_benchmark_shm_name = "handcameradriver_submit_mode_benchmark";
+
+static const char *const k_rchSubmitModes[] = { "fixed", "on_sample" };
+
+struct SubmitModeBenchmarkOptions
+{
+	double rate_hz = 30.0;
+	double duration_s = 3.0;
+	double warmup_s = 0.5;
+	HandTransport transport = HandTransport_Tcp;
+	int port = 65505;
+	const char *settings_path = "resources/settings/default.vrsettings";
+};
+
+struct SubmitModeResult
+{
+	uint64_t sent = 0;
+	uint64_t received = 0;
+	double poses_per_sec = 0.0;
+	double driver_cpu_percent = 0.0;
+	uint64_t submitted[ HandId_MAX ] = {};
+	double latency_mean_us[ HandId_MAX ] = {};
+	int64_t latency_p50_us[ HandId_MAX ] = {};
+	int64_t latency_p99_us[ HandId_MAX ] = {};
+};
+
+//-----------------------------------------------------------------------------
+// Purpose: Runs the driver with pchSubmitMode, producing from this thread for the configured duration.
+// A fresh context each time, so the modes don't share a pose record or settings.
+//-----------------------------------------------------------------------------
+static bool RunSubmitMode( const SubmitModeBenchmarkOptions &options, const char *pchSubmitMode, SubmitModeResult &result )
+{
+	std::unique_ptr< MockDriverContext > context = std::make_unique< MockDriverContext >();
+	MockSettings &settings = context->GetSettings();
+	if ( !LoadDriverSettings( "submit_mode_benchmark", settings, options.settings_path ) )
+	{
+		return false;
+	}
+	settings.SetInt32( driver_settings_section, "port", options.port );
+	settings.SetString( driver_settings_section, "transport", HandTransportName( options.transport ) );
+	settings.SetString( driver_settings_section, "shm_name", submit_mode_benchmark_shm_name );
+	settings.SetString( driver_settings_section, "pose_submit_mode", pchSubmitMode );
+
+	MyDeviceProvider provider;
+	if ( provider.Init( context.get() ) != vr::VRInitError_None || provider.MyGetHandTrackingListener() == nullptr )
+	{
+		fprintf( stderr, "submit_mode_benchmark: The driver failed to initialize (%s)\n", pchSubmitMode );
+		return false;
+	}
+
+	RunFrameThread run_frame_thread( provider );
+	auto Shutdown = [ & ]()
+	{
+		run_frame_thread.Stop();
+		context->GetServerDriverHost().DeactivateDevices();
+		provider.Cleanup();
+	};
+
+	HandStreamSender sender;
+	if ( !sender.Open( options.transport, HandStreamProtocol_Binary, options.port, submit_mode_benchmark_shm_name, 1000 ) )
+	{
+		fprintf( stderr, "submit_mode_benchmark: Can't connect to the listener (%s, port %d)\n", HandTransportName( options.transport ), options.port );
+		Shutdown();
+		return false;
+	}
+
+	SyntheticHandOptions source_options;
+	source_options.frame_rate_hz = options.rate_hz;
+	SyntheticHandSource source( source_options );
+	HandSampleBatch batch{};
+
+	const HandTrackingListener &listener = *provider.MyGetHandTrackingListener();
+	PipelineStats &stats = *provider.MyGetPipelineStats();
+
+	const double period_us = 1000000.0 / options.rate_hz;
+	const int64_t start_time_us = DriverClockUs();
+	const int64_t measure_time_us = start_time_us + static_cast< int64_t >( options.warmup_s * 1e6 );
+	const int64_t end_time_us = start_time_us + static_cast< int64_t >( options.duration_s * 1e6 );
+
+	int64_t process_cpu_start_ns = 0;
+	int64_t main_cpu_start_ns = 0;
+
+	for ( uint32_t frame = 0;; frame++ )
+	{
+		const int64_t due_time_us = start_time_us + static_cast< int64_t >( frame * period_us );
+		if ( due_time_us >= end_time_us )
+		{
+			break;
+		}
+		SleepUntilUs( due_time_us );
+
+		if ( due_time_us >= measure_time_us && process_cpu_start_ns == 0 )
+		{
+			process_cpu_start_ns = CpuTimeNs( CLOCK_PROCESS_CPUTIME_ID );
+			main_cpu_start_ns = CpuTimeNs( CLOCK_THREAD_CPUTIME_ID );
+		}
+
+		source.Generate( frame, DriverClockUs(), batch );
+		if ( sender.Send( batch ) )
+		{
+			result.sent += batch.hand_count;
+		}
+	}
+	const int64_t window_start_us = measure_time_us;
+
+	SleepUntilUs( end_time_us + k_unDrainTimeUs );
+	const double window_s = ( DriverClockUs() - window_start_us ) * 1e-6;
+	const double driver_cpu_ns = static_cast< double >( ( CpuTimeNs( CLOCK_PROCESS_CPUTIME_ID ) - process_cpu_start_ns ) - ( CpuTimeNs( CLOCK_THREAD_CPUTIME_ID ) - main_cpu_start_ns ) );
+	result.driver_cpu_percent = driver_cpu_ns / ( window_s * 1e7 );
+
+	for ( int hand = 0; hand < HandId_MAX; hand++ )
+	{
+		const LatencyHistogram &latency = stats.Hand( static_cast< HandId >( hand ) ).latency_us[ LatencyStage_ReceiveToSubmit ];
+		result.received += listener.GetStreamCounters( static_cast< HandId >( hand ) ).received;
+		result.submitted[ hand ] = latency.Count();
+		result.latency_mean_us[ hand ] = latency.Mean();
+		result.latency_p50_us[ hand ] = latency.Percentile( 0.5 );
+		result.latency_p99_us[ hand ] = latency.Percentile( 0.99 );
+	}
+
+	const MockRecordBuffer< MockPoseRecord > &poses = context->GetServerDriverHost().Poses();
+	uint64_t pose_count = 0;
+	for ( size_t i = 0; i < poses.Size(); i++ )
+	{
+		pose_count += poses.At( i ).time_us >= window_start_us && poses.At( i ).time_us < end_time_us;
+	}
+	result.poses_per_sec = pose_count / std::max( ( end_time_us - window_start_us ) * 1e-6, 1e-6 );
+
+	sender.Close();
+	Shutdown();
+	return true;
+}
+
+static bool ParseOptions( int argc, char **argv, SubmitModeBenchmarkOptions &options )
+{
+	ToolOptionParser parser( "submit_mode_benchmark", argc, argv );
+	while ( parser.Next() )
+	{
+		const char *transport = nullptr;
+		if ( parser.Value( "--transport", transport ) )
+		{
+			if ( transport != nullptr && !HandTransportFromName( transport, options.transport ) )
+			{
+				parser.Invalid( "tcp, udp or shm" );
+			}
+		}
+		else if ( !parser.Value( "--rate-hz", options.rate_hz ) && !parser.Value( "--duration-s", options.duration_s ) && !parser.Value( "--warmup-s", options.warmup_s ) &&
+				  !parser.Value( "--port", options.port ) && !parser.Value( "--settings", options.settings_path ) )
+		{
+			parser.Unknown();
+		}
+	}
+
+	return parser.IsValid() && options.rate_hz > 0.0 && options.rate_hz <= 1000.0 && options.duration_s > 0.0 && options.warmup_s >= 0.0 && options.warmup_s < options.duration_s &&
+		   options.port > 0 && options.port <= 65535;
+}
+
+int main( int argc, char **argv )
+{
+	SubmitModeBenchmarkOptions options;
+	if ( !ParseOptions( argc, argv, options ) )
+	{
+		fprintf( stderr, "usage: submit_mode_benchmark [--rate-hz 30] [--duration-s 3] [--warmup-s 0.5] [--transport tcp|udp|shm] [--port 65505]\n"
+						 "                             [--settings resources/settings/default.vrsettings]\n" );
+		return 2;
+	}
+
+	SubmitModeResult results[ std::size( k_rchSubmitModes ) ];
+	bool passed = true;
+	for ( size_t mode = 0; mode < std::size( k_rchSubmitModes ); mode++ )
+	{
+		passed &= RunSubmitMode( options, k_rchSubmitModes[ mode ], results[ mode ] );
+	}
+
+	printf( "{\"rate_hz\":%.1f,\"duration_s\":%.1f,\"transport\":\"%s\"", options.rate_hz, options.duration_s, HandTransportName( options.transport ) );
+	for ( size_t mode = 0; mode < std::size( k_rchSubmitModes ); mode++ )
+	{
+		const SubmitModeResult &result = results[ mode ];
+		printf( ",\"%s\":{\"sent\":%llu,\"received\":%llu,\"poses_per_sec\":%.1f,\"driver_cpu_percent\":%.2f", k_rchSubmitModes[ mode ],
+			static_cast< unsigned long long >( result.sent ), static_cast< unsigned long long >( result.received ), result.poses_per_sec, result.driver_cpu_percent );
+		for ( int hand = 0; hand < HandId_MAX; hand++ )
+		{
+			printf( ",\"%s\":{\"submitted\":%llu,\"receive_to_submit_us\":{\"mean\":%.1f,\"p50\":%lld,\"p99\":%lld}}", hand == HandId_Left ? "left" : "right",
+				static_cast< unsigned long long >( result.submitted[ hand ] ), result.latency_mean_us[ hand ], static_cast< long long >( result.latency_p50_us[ hand ] ),
+				static_cast< long long >( result.latency_p99_us[ hand ] ) );
+		}
+		printf( "}" );
+
+		if ( result.sent == 0 || result.received != result.sent )
+		{
+			fprintf( stderr, "submit_mode_benchmark: %s received %llu of %llu samples\n", k_rchSubmitModes[ mode ],
+				static_cast< unsigned long long >( result.received ), static_cast< unsigned long long >( result.sent ) );
+			passed = false;
+		}
+	}
+	printf( "}\n" );
+
+	const SubmitModeResult &fixed = results[ 0 ];
+	const SubmitModeResult &on_sample = results[ 1 ];
+	for ( int hand = 0; passed && hand < HandId_MAX; hand++ )
+	{
+		if ( on_sample.latency_p50_us[ hand ] >= fixed.latency_p50_us[ hand ] )
+		{
+			fprintf( stderr, "submit_mode_benchmark: on_sample's median receive to submit latency for the %s hand is %lld us, fixed's %lld us\n",
+				hand == HandId_Left ? "left" : "right", static_cast< long long >( on_sample.latency_p50_us[ hand ] ),
+				static_cast< long long >( fixed.latency_p50_us[ hand ] ) );
+			passed = false;
+		}
+	}
+
+	return passed ? 0 : 1;
+}
@@ -0,0 +1,547 @@
+//============ Copyright (c) Valve Corporation, All rights reserved. ============
+#include "synthetic_hand_source.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+
+static constexpr double k_fPi = 3.14159265358979323846;
+
+// Camera intrinsics in normalized image units, a 640x480 webcam with about a 60 degree field of view
+static constexpr double k_fFocalX = 0.9;
+static constexpr double k_fFocalY = 1.2;
+
+// Random walk: how far the hand wanders (1 sigma) and how quickly it's pulled back to rest
+static constexpr double k_fWalkPositionSigmaM = 0.06;
+static constexpr double k_fWalkAngleSigma = 0.3;
+static constexpr double k_fWalkTimeConstantS = 0.8;
+
+// Flick: out in 60 ms, held, back in 300 ms. Peaks at about 6 m/s.
+static constexpr double k_fFlickDistanceM = 0.25;
+static constexpr double k_fFlickOutS = 0.06;
+static constexpr double k_fFlickHoldS = 0.2;
+static constexpr double k_fFlickBackS = 0.3;
+static constexpr double k_fFlickS = k_fFlickOutS + k_fFlickHoldS + k_fFlickBackS;
+
+// How long the fingers take to form the next gesture
+static constexpr double k_fGestureChangeS = 0.15;
+
+// The hand model, meters, of a right hand with the palm towards the camera (+z) and the fingers up (+y).
+// Points 1 - 4 are the thumb, then four per finger from the knuckle (MCP) to the tip.
+static const double k_pfFingerBases[ 5 ][ 3 ] = {
+	{ 0.022, 0.020, 0.005 }, // Thumb CMC
+	{ 0.025, 0.085, 0.0 },	 // Index MCP
+	{ 0.004, 0.090, 0.0 },	 // Middle MCP
+	{ -0.016, 0.084, 0.0 },	 // Ring MCP
+	{ -0.034, 0.074, 0.0 },	 // Pinky MCP
+};
+static const double k_pfSegmentLengths[ 5 ][ 3 ] = {
+	{ 0.035, 0.030, 0.025 },
+	{ 0.040, 0.025, 0.020 },
+	{ 0.045, 0.028, 0.022 },
+	{ 0.040, 0.026, 0.021 },
+	{ 0.032, 0.020, 0.018 },
+};
+
+// Joint angles of a fully curled thumb and finger, radians
+static const double k_pfThumbCurl[ 3 ] = { 0.5, 0.7, 0.6 };
+static const double k_pfFingerCurl[ 3 ] = { 1.4, 1.6, 1.0 };
+
+// Curl of thumb, index, middle, ring and pinky per gesture, 0 straight and 1 curled
+static const float k_pfGestureCurls[ HandGesture_MAX ][ 5 ] = {
+	{ 0.f, 0.f, 0.f, 0.f, 0.f },		// Unknown
+	{ 0.f, 0.f, 0.f, 0.f, 0.f },		// Open
+	{ 1.f, 1.f, 1.f, 1.f, 1.f },		// Fist
+	{ 1.f, 0.f, 1.f, 1.f, 1.f },		// Point
+	{ 0.f, 1.f, 1.f, 1.f, 1.f },		// ThumbsUp
+	{ 1.f, 0.f, 0.f, 1.f, 1.f },		// Peace
+	{ 0.5f, 0.5f, 0.2f, 0.2f, 0.2f }, // Pinch
+};
+
+bool SyntheticMotionFromName( const char *pchName, SyntheticMotion &motion )
+{
+	for ( int i = 0; i < SyntheticMotion_MAX; i++ )
+	{
+		if ( strcmp( pchName, SyntheticMotionName( static_cast< SyntheticMotion >( i ) ) ) == 0 )
+		{
+			motion = static_cast< SyntheticMotion >( i );
+			return true;
+		}
+	}
+	return false;
+}
+
+const char *SyntheticMotionName( SyntheticMotion motion )
+{
+	switch ( motion )
+	{
+	case SyntheticMotion_Circle:
+		return "circle";
+	case SyntheticMotion_RandomWalk:
+		return "random_walk";
+	case SyntheticMotion_Flick:
+		return "flick";
+	default:
+		return "unknown";
+	}
+}
+
+static double SmoothStep( double fT )
+{
+	fT = std::clamp( fT, 0.0, 1.0 );
+	return fT * fT * ( 3.0 - 2.0 * fT );
+}
+
+static double Distance( const float a[ 3 ], const float b[ 3 ] )
+{
+	const double dx = a[ 0 ] - b[ 0 ], dy = a[ 1 ] - b[ 1 ], dz = a[ 2 ] - b[ 2 ];
+	return std::sqrt( dx * dx + dy * dy + dz * dz );
+}
+
+static void Cross( const double a[ 3 ], const double b[ 3 ], double out[ 3 ] )
+{
+	out[ 0 ] = a[ 1 ] * b[ 2 ] - a[ 2 ] * b[ 1 ];
+	out[ 1 ] = a[ 2 ] * b[ 0 ] - a[ 0 ] * b[ 2 ];
+	out[ 2 ] = a[ 0 ] * b[ 1 ] - a[ 1 ] * b[ 0 ];
+}
+
+static bool Normalize( double v[ 3 ] )
+{
+	const double length = std::sqrt( v[ 0 ] * v[ 0 ] + v[ 1 ] * v[ 1 ] + v[ 2 ] * v[ 2 ] );
+	if ( length <= 0.0 )
+	{
+		return false;
+	}
+	v[ 0 ] /= length;
+	v[ 1 ] /= length;
+	v[ 2 ] /= length;
+	return true;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: The palm orientation from landmarks, the same as GestureDetector.calculate_hand_orientation()
+// in gesture_detector.py, so the driver sees the rotations Camera.py would send
+//-----------------------------------------------------------------------------
+static void HandOrientation( const HandLandmarks &landmarks, float rotation[ 4 ] )
+{
+	const float *wrist = landmarks.points[ 0 ];
+	const float *index_mcp = landmarks.points[ 5 ];
+	const float *middle_mcp = landmarks.points[ 9 ];
+
+	double forward[ 3 ] = { middle_mcp[ 0 ] - wrist[ 0 ], middle_mcp[ 1 ] - wrist[ 1 ], middle_mcp[ 2 ] - wrist[ 2 ] };
+	if ( !Normalize( forward ) )
+	{
+		rotation[ 0 ] = 1.f;
+		rotation[ 1 ] = rotation[ 2 ] = rotation[ 3 ] = 0.f;
+		return;
+	}
+
+	double right[ 3 ] = { middle_mcp[ 0 ] - index_mcp[ 0 ], middle_mcp[ 1 ] - index_mcp[ 1 ], middle_mcp[ 2 ] - index_mcp[ 2 ] };
+	if ( !Normalize( right ) )
+	{
+		right[ 0 ] = 1.0;
+		right[ 1 ] = right[ 2 ] = 0.0;
+	}
+
+	double up[ 3 ];
+	Cross( forward, right, up );
+	if ( !Normalize( up ) )
+	{
+		up[ 0 ] = up[ 2 ] = 0.0;
+		up[ 1 ] = 1.0;
+	}
+	Cross( up, forward, right );
+
+	// Rows of the matrix are right, up, forward
+	const double m00 = right[ 0 ], m01 = right[ 1 ], m02 = right[ 2 ];
+	const double m10 = up[ 0 ], m11 = up[ 1 ], m12 = up[ 2 ];
+	const double m20 = forward[ 0 ], m21 = forward[ 1 ], m22 = forward[ 2 ];
+
+	double q[ 4 ];
+	const double trace = m00 + m11 + m22;
+	if ( trace > 0.0 )
+	{
+		const double s = 0.5 / std::sqrt( trace + 1.0 );
+		q[ 0 ] = 0.25 / s;
+		q[ 1 ] = ( m21 - m12 ) * s;
+		q[ 2 ] = ( m02 - m20 ) * s;
+		q[ 3 ] = ( m10 - m01 ) * s;
+	}
+	else if ( m00 > m11 && m00 > m22 )
+	{
+		const double s = 2.0 * std::sqrt( 1.0 + m00 - m11 - m22 );
+		q[ 0 ] = ( m21 - m12 ) / s;
+		q[ 1 ] = 0.25 * s;
+		q[ 2 ] = ( m01 + m10 ) / s;
+		q[ 3 ] = ( m02 + m20 ) / s;
+	}
+	else if ( m11 > m22 )
+	{
+		const double s = 2.0 * std::sqrt( 1.0 + m11 - m00 - m22 );
+		q[ 0 ] = ( m02 - m20 ) / s;
+		q[ 1 ] = ( m01 + m10 ) / s;
+		q[ 2 ] = 0.25 * s;
+		q[ 3 ] = ( m12 + m21 ) / s;
+	}
+	else
+	{
+		const double s = 2.0 * std::sqrt( 1.0 + m22 - m00 - m11 );
+		q[ 0 ] = ( m10 - m01 ) / s;
+		q[ 1 ] = ( m02 + m20 ) / s;
+		q[ 2 ] = ( m12 + m21 ) / s;
+		q[ 3 ] = 0.25 * s;
+	}
+
+	for ( int i = 0; i < 4; i++ )
+	{
+		rotation[ i ] = static_cast< float >( q[ i ] );
+	}
+}
+
+uint64_t SyntheticHandSource::Random::Next()
+{
+	uint64_t z = ( state += 0x9e3779b97f4a7c15ull );
+	z = ( z ^ ( z >> 30 ) ) * 0xbf58476d1ce4e5b9ull;
+	z = ( z ^ ( z >> 27 ) ) * 0x94d049bb133111ebull;
+	return z ^ ( z >> 31 );
+}
+
+double SyntheticHandSource::Random::Uniform()
+{
+	return static_cast< double >( Next() >> 11 ) * ( 1.0 / 9007199254740992.0 );
+}
+
+double SyntheticHandSource::Random::Normal()
+{
+	// Box-Muller, 1 - Uniform() keeps the log away from 0
+	return std::sqrt( -2.0 * std::log( 1.0 - Uniform() ) ) * std::cos( 2.0 * k_fPi * Uniform() );
+}
+
+double SyntheticHandSource::Random::Exponential( double fMean )
+{
+	return -fMean * std::log( 1.0 - Uniform() );
+}
+
+SyntheticHandSource::SyntheticHandSource( const SyntheticHandOptions &options )
+	: options_( options )
+	, random_{ options.seed }
+	, hands_{}
+	, sequence_{}
+	, last_time_s_( 0.0 )
+	, swap_start_s_( std::numeric_limits< double >::infinity() )
+	, swap_end_s_( 0.0 )
+	, dropout_count_( 0 )
+	, swap_count_( 0 )
+{
+	options_.hand_count = std::clamp< uint32_t >( options_.hand_count, 1, k_unHandBatchMaxHands );
+	options_.frame_rate_hz = options_.frame_rate_hz > 0.0 ? options_.frame_rate_hz : 60.0;
+
+	for ( uint32_t i = 0; i < options_.hand_count; i++ )
+	{
+		SimulatedHand &hand = hands_[ i ];
+		hand.hand = i % 2 == 0 ? HandId_Left : HandId_Right;
+		hand.random.state = random_.Next();
+
+		// Left and right of the head at chest height, anyone else's hands further back
+		const uint32_t person = i / 2;
+		hand.rest[ 0 ] = hand.hand == HandId_Left ? -0.15 : 0.15;
+		hand.rest[ 1 ] = -0.05 + 0.08 * person;
+		hand.rest[ 2 ] = -0.5 - 0.15 * person;
+
+		// As if a flick just ended, the first real one comes within a second
+		hand.flick_start_s = -k_fFlickS;
+		hand.gesture = HandGesture_Open;
+		hand.previous_gesture = HandGesture_Open;
+		hand.gesture_start_s = -k_fGestureChangeS;
+		hand.gesture_hold_s = 0.4 + 1.2 * hand.random.Uniform();
+		hand.dropout_start_s = std::numeric_limits< double >::infinity();
+		hand.dropout_end_s = 0.0;
+	}
+}
+
+void SyntheticHandSource::Generate( uint32_t unFrame, int64_t nSendTimeUs, HandSampleBatch &batch )
+{
+	const double time_s = unFrame / options_.frame_rate_hz;
+	const double delta_s = std::max( time_s - last_time_s_, 0.0 );
+	last_time_s_ = time_s;
+
+	// Hand detection took this long, every hand of the frame was captured at the same time
+	const double processing_ms = std::max( options_.processing_ms + options_.processing_jitter_ms * ( 2.0 * random_.Uniform() - 1.0 ), 0.0 );
+	const int64_t capture_time_us = nSendTimeUs - static_cast< int64_t >( processing_ms * 1000.0 );
+
+	const bool is_swapped = IsSwapped( time_s );
+
+	batch.frame = unFrame;
+	batch.hand_count = 0;
+	for ( uint32_t i = 0; i < options_.hand_count; i++ )
+	{
+		SimulatedHand &hand = hands_[ i ];
+
+		// The hand keeps moving while it's not seen
+		double position[ 3 ];
+		double angles[ 3 ];
+		float curls[ 5 ];
+		Move( hand, time_s, delta_s, position, angles );
+		const HandGesture gesture = Pose( hand, time_s, curls );
+		BuildLandmarks( hand, position, angles, curls );
+
+		if ( IsDroppedOut( hand, time_s ) )
+		{
+			dropout_count_++;
+			continue;
+		}
+
+		HandSample &sample = batch.hands[ batch.hand_count++ ];
+		FillSample( hand, gesture, sample );
+		if ( is_swapped )
+		{
+			sample.hand = sample.hand == HandId_Left ? HandId_Right : HandId_Left;
+			swap_count_++;
+		}
+		sample.sequence = sequence_[ sample.hand ]++;
+		sample.capture_time_us = static_cast< uint64_t >( capture_time_us );
+		sample.send_time_us = static_cast< uint64_t >( nSendTimeUs );
+	}
+}
+
+const HandLandmarks &SyntheticHandSource::GetLandmarks( uint32_t unHand ) const
+{
+	return hands_[ std::min( unHand, options_.hand_count - 1 ) ].landmarks;
+}
+
+uint64_t SyntheticHandSource::GetDropoutCount() const
+{
+	return dropout_count_;
+}
+
+uint64_t SyntheticHandSource::GetSwapCount() const
+{
+	return swap_count_;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Where the wrist is (camera space, meters) and how the hand is turned (pitch, yaw, roll) at fTimeS
+//-----------------------------------------------------------------------------
+void SyntheticHandSource::Move( SimulatedHand &hand, double fTimeS, double fDeltaS, double position[ 3 ], double angles[ 3 ] )
+{
+	double offset[ 3 ] = {};
+	angles[ 0 ] = angles[ 1 ] = angles[ 2 ] = 0.0;
+
+	switch ( options_.motion )
+	{
+	case SyntheticMotion_Circle:
+	{
+		const double phase = 2.0 * k_fPi * 0.5 * fTimeS + ( hand.hand == HandId_Left ? 0.0 : k_fPi );
+		offset[ 0 ] = 0.1 * std::cos( phase );
+		offset[ 1 ] = 0.1 * std::sin( phase );
+		angles[ 0 ] = 0.15 * std::sin( phase );
+		angles[ 1 ] = 0.2 * std::cos( phase );
+		angles[ 2 ] = 0.3 * std::sin( phase );
+		break;
+	}
+
+	case SyntheticMotion_RandomWalk:
+	{
+		// Ornstein-Uhlenbeck, so the hand wanders but never leaves the camera's view for long
+		const double pull = fDeltaS / k_fWalkTimeConstantS;
+		const double kick = std::sqrt( 2.0 * pull );
+		for ( int axis = 0; axis < 3; axis++ )
+		{
+			const double sigma_m = axis == 2 ? k_fWalkPositionSigmaM * 0.6 : k_fWalkPositionSigmaM;
+			hand.walk_position[ axis ] += -hand.walk_position[ axis ] * pull + sigma_m * kick * hand.random.Normal();
+			hand.walk_angles[ axis ] += -hand.walk_angles[ axis ] * pull + k_fWalkAngleSigma * kick * hand.random.Normal();
+			offset[ axis ] = hand.walk_position[ axis ];
+			angles[ axis ] = hand.walk_angles[ axis ];
+		}
+		break;
+	}
+
+	case SyntheticMotion_Flick:
+	{
+		while ( fTimeS >= hand.flick_start_s + k_fFlickS )
+		{
+			hand.flick_start_s += k_fFlickS + 0.4 + 0.6 * hand.random.Uniform();
+			const double direction = 2.0 * k_fPi * hand.random.Uniform();
+			hand.flick_direction[ 0 ] = std::cos( direction );
+			hand.flick_direction[ 1 ] = std::sin( direction );
+			hand.flick_snap = ( hand.random.Uniform() < 0.5 ? -1.0 : 1.0 ) * ( 0.8 + 0.6 * hand.random.Uniform() );
+		}
+
+		const double t = fTimeS - hand.flick_start_s;
+		double extent = 0.0;
+		if ( t >= 0.0 )
+		{
+			extent = t < k_fFlickOutS ? SmoothStep( t / k_fFlickOutS ) : 1.0 - SmoothStep( ( t - k_fFlickOutS - k_fFlickHoldS ) / k_fFlickBackS );
+		}
+		offset[ 0 ] = k_fFlickDistanceM * extent * hand.flick_direction[ 0 ];
+		offset[ 1 ] = k_fFlickDistanceM * extent * hand.flick_direction[ 1 ];
+		angles[ 1 ] = hand.flick_snap * extent;
+		break;
+	}
+
+	default:
+		break;
+	}
+
+	for ( int axis = 0; axis < 3; axis++ )
+	{
+		position[ axis ] = hand.rest[ axis ] + offset[ axis ];
+	}
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Finger curls at fTimeS, and the gesture Camera.py would report for them. Gestures are held for
+// a random while, the fingers move into the next one over k_fGestureChangeS and it's reported halfway through.
+//-----------------------------------------------------------------------------
+HandGesture SyntheticHandSource::Pose( SimulatedHand &hand, double fTimeS, float curls[ 5 ] )
+{
+	while ( fTimeS >= hand.gesture_start_s + hand.gesture_hold_s )
+	{
+		hand.gesture_start_s += hand.gesture_hold_s;
+		hand.gesture_hold_s = 0.4 + 1.2 * hand.random.Uniform();
+		hand.previous_gesture = hand.gesture;
+
+		// Any of the known gestures but the current one
+		const int next = HandGesture_Open + static_cast< int >( hand.random.Uniform() * ( HandGesture_MAX - HandGesture_Open - 1 ) );
+		hand.gesture = static_cast< HandGesture >( next >= hand.gesture ? next + 1 : next );
+	}
+
+	const double change = SmoothStep( ( fTimeS - hand.gesture_start_s ) / k_fGestureChangeS );
+	for ( int finger = 0; finger < 5; finger++ )
+	{
+		const float from = k_pfGestureCurls[ hand.previous_gesture ][ finger ];
+		const float to = k_pfGestureCurls[ hand.gesture ][ finger ];
+		curls[ finger ] = static_cast< float >( from + ( to - from ) * change );
+	}
+
+	return change < 0.5 ? hand.previous_gesture : hand.gesture;
+}
+
+bool SyntheticHandSource::IsDroppedOut( SimulatedHand &hand, double fTimeS )
+{
+	if ( options_.dropout_rate_hz <= 0.0 )
+	{
+		return false;
+	}
+
+	while ( fTimeS >= hand.dropout_end_s )
+	{
+		hand.dropout_start_s = hand.dropout_end_s + hand.random.Exponential( 1.0 / options_.dropout_rate_hz );
+		hand.dropout_end_s = hand.dropout_start_s + options_.dropout_duration_s * ( 0.5 + hand.random.Uniform() );
+	}
+	return fTimeS >= hand.dropout_start_s;
+}
+
+bool SyntheticHandSource::IsSwapped( double fTimeS )
+{
+	if ( options_.swap_interval_s <= 0.0 )
+	{
+		return false;
+	}
+
+	while ( fTimeS >= swap_end_s_ )
+	{
+		swap_start_s_ = swap_end_s_ + options_.swap_interval_s * ( 0.5 + random_.Uniform() );
+		swap_end_s_ = swap_start_s_ + options_.swap_duration_s * ( 0.5 + random_.Uniform() );
+	}
+	return fTimeS >= swap_start_s_;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Poses the hand model, places it in front of the camera and projects it into the image
+//-----------------------------------------------------------------------------
+void SyntheticHandSource::BuildLandmarks( SimulatedHand &hand, const double position[ 3 ], const double angles[ 3 ], const float curls[ 5 ] )
+{
+	// The model is a right hand, a left one is its mirror image
+	const double mirror = hand.hand == HandId_Left ? -1.0 : 1.0;
+
+	double model[ k_unHandLandmarkCount ][ 3 ] = {};
+	for ( int finger = 0; finger < 5; finger++ )
+	{
+		const size_t base = 1 + 4 * finger;
+		double point[ 3 ] = { k_pfFingerBases[ finger ][ 0 ], k_pfFingerBases[ finger ][ 1 ], k_pfFingerBases[ finger ][ 2 ] };
+		memcpy( model[ base ], point, sizeof( point ) );
+
+		// Every joint bends the rest of the finger further towards the palm
+		double bend = 0.0;
+		for ( int segment = 0; segment < 3; segment++ )
+		{
+			double direction[ 3 ];
+			if ( finger == 0 )
+			{
+				// The thumb points out and up, and curls across the palm
+				bend += k_pfThumbCurl[ segment ] * curls[ finger ] * 1.5;
+				direction[ 0 ] = 0.8 * std::cos( bend ) - 0.5 * std::sin( bend );
+				direction[ 1 ] = 0.6 * std::cos( bend );
+				direction[ 2 ] = 0.6 * std::sin( bend );
+				Normalize( direction );
+			}
+			else
+			{
+				bend += k_pfFingerCurl[ segment ] * curls[ finger ];
+				direction[ 0 ] = 0.0;
+				direction[ 1 ] = std::cos( bend );
+				direction[ 2 ] = std::sin( bend );
+			}
+
+			for ( int axis = 0; axis < 3; axis++ )
+			{
+				point[ axis ] += k_pfSegmentLengths[ finger ][ segment ] * direction[ axis ];
+			}
+			memcpy( model[ base + 1 + segment ], point, sizeof( point ) );
+		}
+	}
+
+	// Pitch about x, then yaw about y, then roll about z
+	const double cp = std::cos( angles[ 0 ] ), sp = std::sin( angles[ 0 ] );
+	const double cy = std::cos( angles[ 1 ] ), sy = std::sin( angles[ 1 ] );
+	const double cr = std::cos( angles[ 2 ] ), sr = std::sin( angles[ 2 ] );
+
+	const double wrist_depth = -position[ 2 ];
+	for ( size_t i = 0; i < k_unHandLandmarkCount; i++ )
+	{
+		const double x0 = model[ i ][ 0 ] * mirror, y0 = model[ i ][ 1 ], z0 = model[ i ][ 2 ];
+
+		const double y1 = cp * y0 - sp * z0, z1 = sp * y0 + cp * z0;
+		const double x2 = cy * x0 + sy * z1, z2 = -sy * x0 + cy * z1;
+		const double x3 = cr * x2 - sr * y1, y3 = sr * x2 + cr * y1;
+
+		const double camera_x = position[ 0 ] + x3;
+		const double camera_y = position[ 1 ] + y3;
+		const double camera_z = position[ 2 ] + z2;
+		const double depth = std::max( -camera_z, 0.05 );
+
+		hand.landmarks.points[ i ][ 0 ] = static_cast< float >( 0.5 + k_fFocalX * camera_x / depth );
+		hand.landmarks.points[ i ][ 1 ] = static_cast< float >( 0.5 - k_fFocalY * camera_y / depth );
+		hand.landmarks.points[ i ][ 2 ] = static_cast< float >( -( camera_z - position[ 2 ] ) * k_fFocalX / wrist_depth );
+	}
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: What Camera.py's process_hand_landmarks() makes of the landmarks, with the default calibration
+//-----------------------------------------------------------------------------
+void SyntheticHandSource::FillSample( const SimulatedHand &hand, HandGesture gesture, HandSample &sample )
+{
+	const HandLandmarks &landmarks = hand.landmarks;
+	const float *wrist = landmarks.points[ 0 ];
+
+	// Bigger in the image is closer to the camera
+	const double palm_size = ( Distance( wrist, landmarks.points[ 5 ] ) + Distance( wrist, landmarks.points[ 17 ] ) +
+								 Distance( landmarks.points[ 5 ], landmarks.points[ 17 ] ) ) /
+							 3.0;
+
+	sample = {};
+	sample.hand = hand.hand;
+	sample.fields = HandSampleField_Position | HandSampleField_Rotation | HandSampleField_Trigger | HandSampleField_Grip | HandSampleField_Gesture |
+					HandSampleField_Sequence | HandSampleField_CaptureTime | HandSampleField_SendTime;
+	sample.position[ 0 ] = ( wrist[ 0 ] - 0.5f ) * 2.f;
+	sample.position[ 1 ] = -( wrist[ 1 ] - 0.5f ) * 2.f;
+	sample.position[ 2 ] = static_cast< float >( -0.5 - palm_size * 2.0 );
+	HandOrientation( landmarks, sample.rotation );
+
+	// gesture_detector.py's get_trigger_value() and get_grip_value()
+	sample.gesture = gesture;
+	sample.trigger = gesture == HandGesture_Pinch ? 1.f : gesture == HandGesture_Point ? 0.8f : 0.f;
+	sample.grip = gesture == HandGesture_Fist ? 1.f : gesture == HandGesture_Pinch ? 0.5f : 0.f;
+}
@@ -0,0 +1,138 @@
+//============ Copyright (c) Valve Corporation, All rights reserved. ============
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include "hand_protocol.h"
+
+// How the synthetic hands move
+enum SyntheticMotion
+{
+	SyntheticMotion_Circle,		// Steady 10 cm circles, one every two seconds
+	SyntheticMotion_RandomWalk, // Wandering around a rest position, like a hand held up in front of the camera
+	SyntheticMotion_Flick,		// Still, with a fast 25 cm swipe and wrist snap about once a second
+
+	SyntheticMotion_MAX
+};
+
+// "circle", "random_walk" or "flick". False for anything else.
+bool SyntheticMotionFromName( const char *pchName, SyntheticMotion &motion );
+const char *SyntheticMotionName( SyntheticMotion motion );
+
+struct SyntheticHandOptions
+{
+	SyntheticMotion motion = SyntheticMotion_Circle;
+	uint64_t seed = 1;
+
+	// Camera frames per second, the motion is sampled at frame / frame_rate_hz
+	double frame_rate_hz = 60.0;
+
+	// Hands in view, 1 - k_unHandBatchMaxHands. Alternately left and right, past two they're other people's hands.
+	uint32_t hand_count = 2;
+
+	// On average every 1 / dropout_rate_hz seconds a hand isn't found for around dropout_duration_s. 0 never drops.
+	double dropout_rate_hz = 0.0;
+	double dropout_duration_s = 0.3;
+
+	// About every swap_interval_s the tracker mistakes left for right for around swap_duration_s. 0 never swaps.
+	double swap_interval_s = 0.0;
+	double swap_duration_s = 0.2;
+
+	// How long before it's sent a frame was captured (hand detection time), and by how much that varies
+	double processing_ms = 0.0;
+	double processing_jitter_ms = 0.0;
+};
+
+// MediaPipe's hand model
+static constexpr size_t k_unHandLandmarkCount = 21;
+
+// Normalized image coordinates the way MediaPipe reports them: x and y 0 - 1 across the image, y down,
+// z the depth relative to the wrist on roughly the scale of x, negative towards the camera
+struct HandLandmarks
+{
+	float points[ k_unHandLandmarkCount ][ 3 ];
+};
+
+//-----------------------------------------------------------------------------
+// Purpose: Deterministic stand-in for Camera.py. Every frame it moves and poses a 21 point hand model per hand,
+// projects it into the image like the camera would, and turns the landmarks into samples with Camera.py's own
+// math (position from the wrist and palm size, orientation from the palm, trigger and grip from the gesture).
+// The same options and frame numbers always give the same samples; only the timestamps come from the caller.
+//-----------------------------------------------------------------------------
+class SyntheticHandSource
+{
+public:
+	explicit SyntheticHandSource( const SyntheticHandOptions &options );
+
+	// Fills batch with the hands seen in camera frame unFrame, sent at nSendTimeUs. Call with increasing frame numbers.
+	// A frame where every hand dropped out has a hand_count of 0, Camera.py sends nothing then.
+	void Generate( uint32_t unFrame, int64_t nSendTimeUs, HandSampleBatch &batch );
+
+	// The landmarks behind hand unHand (0 - hand_count - 1) of the last Generate(), whether or not it was seen
+	const HandLandmarks &GetLandmarks( uint32_t unHand ) const;
+
+	// Frames a hand was missing from, and samples sent with the wrong handedness, so far
+	uint64_t GetDropoutCount() const;
+	uint64_t GetSwapCount() const;
+
+private:
+	// splitmix64, the same numbers on every platform
+	struct Random
+	{
+		uint64_t state;
+
+		uint64_t Next();
+		double Uniform(); // [0, 1)
+		double Normal();
+		double Exponential( double fMean );
+	};
+
+	struct SimulatedHand
+	{
+		HandId hand;
+		Random random;
+
+		// Where the hand returns to, meters in camera space (x right, y up, looking down -z)
+		double rest[ 3 ];
+
+		// Random walk state, offsets from rest and euler angles
+		double walk_position[ 3 ];
+		double walk_angles[ 3 ];
+
+		// Current flick: when it starts, its direction and wrist snap
+		double flick_start_s;
+		double flick_direction[ 2 ];
+		double flick_snap;
+
+		// Gesture being formed, and the one before, with when the change started
+		HandGesture gesture;
+		HandGesture previous_gesture;
+		double gesture_start_s;
+		double gesture_hold_s;
+
+		double dropout_start_s;
+		double dropout_end_s;
+
+		HandLandmarks landmarks;
+	};
+
+	void Move( SimulatedHand &hand, double fTimeS, double fDeltaS, double position[ 3 ], double angles[ 3 ] );
+	HandGesture Pose( SimulatedHand &hand, double fTimeS, float curls[ 5 ] );
+	bool IsDroppedOut( SimulatedHand &hand, double fTimeS );
+	bool IsSwapped( double fTimeS );
+	void BuildLandmarks( SimulatedHand &hand, const double position[ 3 ], const double angles[ 3 ], const float curls[ 5 ] );
+	void FillSample( const SimulatedHand &hand, HandGesture gesture, HandSample &sample );
+
+	SyntheticHandOptions options_;
+	Random random_;
+	SimulatedHand hands_[ k_unHandBatchMaxHands ];
+	uint32_t sequence_[ HandId_MAX ];
+	double last_time_s_;
+
+	double swap_start_s_;
+	double swap_end_s_;
+
+	uint64_t dropout_count_;
+	uint64_t swap_count_;
+};
@@ -0,0 +1,67 @@
+//============ Copyright (c) Valve Corporation, All rights reserved. ============
+#include "tool_clock.h"
+
+#include "driver_clock.h"
+
+#include <sys/resource.h>
+
+#include <cerrno>
+
+void SleepUntilUs( int64_t nWakeTimeUs )
+{
+	// The driver clock is steady_clock, which is CLOCK_MONOTONIC
+	struct timespec wake_time;
+	wake_time.tv_sec = static_cast< time_t >( nWakeTimeUs / 1000000 );
+	wake_time.tv_nsec = static_cast< long >( ( nWakeTimeUs % 1000000 ) * 1000 );
+	while ( clock_nanosleep( CLOCK_MONOTONIC, TIMER_ABSTIME, &wake_time, nullptr ) == EINTR )
+	{
+	}
+}
+
+int64_t CpuTimeNs( clockid_t clock )
+{
+	struct timespec time;
+	if ( clock_gettime( clock, &time ) != 0 )
+	{
+		return 0;
+	}
+	return static_cast< int64_t >( time.tv_sec ) * 1000000000 + time.tv_nsec;
+}
+
+uint64_t ContextSwitches()
+{
+	struct rusage usage;
+	if ( getrusage( RUSAGE_SELF, &usage ) != 0 )
+	{
+		return 0;
+	}
+	return static_cast< uint64_t >( usage.ru_nvcsw + usage.ru_nivcsw );
+}
+
+RunFrameThread::RunFrameThread( vr::IServerTrackedDeviceProvider &provider )
+	: is_running_( true )
+	, run_frame_count_( 0 )
+{
+	thread_ = std::thread( [ this, &provider ]()
+		{
+			for ( int64_t due_time_us = DriverClockUs(); is_running_.load(); due_time_us += k_unRunFramePeriodUs )
+			{
+				provider.RunFrame();
+				run_frame_count_.fetch_add( 1, std::memory_order_relaxed );
+				SleepUntilUs( due_time_us + k_unRunFramePeriodUs );
+			} } );
+}
+
+RunFrameThread::~RunFrameThread()
+{
+	Stop();
+}
+
+void RunFrameThread::Stop()
+{
+	is_running_ = false;
+	if ( thread_.joinable() )
+	{
+		thread_.join();
+	}
+}
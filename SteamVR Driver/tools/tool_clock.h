@@ -0,0 +1,48 @@
+//============ Copyright (c) Valve Corporation, All rights reserved. ============
+#pragma once
+
+#include <time.h>
+
+#include <atomic>
+#include <cstdint>
+#include <thread>
+
+#include <openvr_driver.h>
+
+// Timing the tools have in common. POSIX only, like the tools.
+
+// vrserver calls RunFrame() about once per display frame
+static constexpr int64_t k_unRunFramePeriodUs = 11111;
+
+// How long the driver gets to pass on the last samples before a tool reads its counters
+static constexpr int64_t k_unDrainTimeUs = 200000;
+
+// Sleeps until nWakeTimeUs on the driver clock. Absolute, so a loop stepping its deadline by a period doesn't drift.
+void SleepUntilUs( int64_t nWakeTimeUs );
+
+// CPU time used so far on clock, eg. CLOCK_PROCESS_CPUTIME_ID or CLOCK_THREAD_CPUTIME_ID. 0 if it can't be read.
+int64_t CpuTimeNs( clockid_t clock );
+
+// Voluntary and involuntary context switches of the whole process so far
+uint64_t ContextSwitches();
+
+//-----------------------------------------------------------------------------
+// Purpose: Calls RunFrame() on a provider every k_unRunFramePeriodUs from its own thread, the way vrserver does,
+// from construction until Stop().
+//-----------------------------------------------------------------------------
+class RunFrameThread
+{
+public:
+	explicit RunFrameThread( vr::IServerTrackedDeviceProvider &provider );
+	~RunFrameThread();
+
+	// Waits for the RunFrame() in progress. The provider can be cleaned up afterwards.
+	void Stop();
+
+	uint64_t GetRunFrameCount() const { return run_frame_count_.load( std::memory_order_relaxed ); }
+
+private:
+	std::atomic< bool > is_running_;
+	std::atomic< uint64_t > run_frame_count_;
+	std::thread thread_;
+};
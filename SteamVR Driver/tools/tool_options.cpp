@@ -0,0 +1,162 @@
+//============ Copyright (c) Valve Corporation, All rights reserved. ============
+#include "tool_options.h"
+
+#include "mock_vr_host.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+const char *const driver_settings_section = "driver_hand_camera_tracking";
+
+bool LoadDriverSettings( const char *pchTool, MockSettings &settings, const char *pchPath )
+{
+	if ( !settings.LoadFile( pchPath ) )
+	{
+		fprintf( stderr, "%s: Can't read the driver settings from %s\n", pchTool, pchPath );
+		return false;
+	}
+	return true;
+}
+
+bool ParseCountList( const char *pchList, uint32_t unMax, std::vector< uint32_t > &counts )
+{
+	counts.clear();
+	for ( const char *start = pchList; *start != '\0'; )
+	{
+		char *end = nullptr;
+		const long count = strtol( start, &end, 10 );
+		if ( end == start || count < 1 || count > static_cast< long >( unMax ) || ( *end != ',' && *end != '\0' ) )
+		{
+			return false;
+		}
+		counts.push_back( static_cast< uint32_t >( count ) );
+		start = *end == ',' ? end + 1 : end;
+	}
+	return !counts.empty();
+}
+
+ToolOptionParser::ToolOptionParser( const char *pchTool, int argc, char **argv )
+	: tool_( pchTool )
+	, argc_( argc )
+	, argv_( argv )
+	, index_( 0 )
+	, option_index_( 0 )
+	, is_valid_( true )
+{
+}
+
+bool ToolOptionParser::Next()
+{
+	if ( !is_valid_ || index_ >= argc_ )
+	{
+		return false;
+	}
+	option_index_ = ++index_;
+	return index_ < argc_;
+}
+
+bool ToolOptionParser::Positional( const char *&pchValue )
+{
+	if ( strncmp( argv_[ index_ ], "--", 2 ) == 0 )
+	{
+		return false;
+	}
+	pchValue = argv_[ index_ ];
+	return true;
+}
+
+bool ToolOptionParser::Flag( const char *pchName, bool &bValue )
+{
+	if ( strcmp( argv_[ index_ ], pchName ) != 0 )
+	{
+		return false;
+	}
+	bValue = true;
+	return true;
+}
+
+bool ToolOptionParser::Value( const char *pchName, const char *&pchValue )
+{
+	if ( strcmp( argv_[ index_ ], pchName ) != 0 )
+	{
+		return false;
+	}
+	if ( index_ + 1 >= argc_ )
+	{
+		fprintf( stderr, "%s: %s needs a value\n", tool_, pchName );
+		is_valid_ = false;
+		return true;
+	}
+	pchValue = argv_[ ++index_ ];
+	return true;
+}
+
+bool ToolOptionParser::Value( const char *pchName, double &fValue )
+{
+	const char *value = nullptr;
+	if ( !Value( pchName, value ) )
+	{
+		return false;
+	}
+	if ( value != nullptr )
+	{
+		fValue = atof( value );
+	}
+	return true;
+}
+
+bool ToolOptionParser::Value( const char *pchName, int &nValue )
+{
+	const char *value = nullptr;
+	if ( !Value( pchName, value ) )
+	{
+		return false;
+	}
+	if ( value != nullptr )
+	{
+		nValue = atoi( value );
+	}
+	return true;
+}
+
+bool ToolOptionParser::Value( const char *pchName, uint32_t &unValue )
+{
+	const char *value = nullptr;
+	if ( !Value( pchName, value ) )
+	{
+		return false;
+	}
+	if ( value != nullptr )
+	{
+		unValue = static_cast< uint32_t >( atoi( value ) );
+	}
+	return true;
+}
+
+bool ToolOptionParser::Value( const char *pchName, uint64_t &ulValue )
+{
+	const char *value = nullptr;
+	if ( !Value( pchName, value ) )
+	{
+		return false;
+	}
+	if ( value != nullptr )
+	{
+		// Seeds are often written in hex
+		ulValue = strtoull( value, nullptr, 0 );
+	}
+	return true;
+}
+
+void ToolOptionParser::Unknown()
+{
+	fprintf( stderr, "%s: Unknown option %s\n", tool_, argv_[ index_ ] );
+	is_valid_ = false;
+}
+
+void ToolOptionParser::Invalid( const char *pchExpected )
+{
+	fprintf( stderr, "%s: %s takes %s, not %s\n", tool_, argv_[ option_index_ ], pchExpected, argv_[ index_ ] );
+	is_valid_ = false;
+}
@@ -0,0 +1,100 @@
+//============ Copyright (c) Valve Corporation, All rights reserved. ============
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+class MockSettings;
+
+// The driver's settings section, the one the tools override port, transport and the like in
+extern const char *const driver_settings_section;
+
+// Loads the driver settings at pchPath into settings. On failure says so on stderr, prefixed with pchTool.
+bool LoadDriverSettings( const char *pchTool, MockSettings &settings, const char *pchPath );
+
+// Splits a comma separated list, calling parse on every name. False if one isn't known or the list is empty.
+template < typename T, typename ParseName >
+bool ParseList( const char *pchList, std::vector< T > &values, ParseName parse )
+{
+	values.clear();
+	char name[ 16 ];
+	for ( const char *start = pchList; *start != '\0'; )
+	{
+		const char *end = strchr( start, ',' );
+		const size_t length = end != nullptr ? static_cast< size_t >( end - start ) : strlen( start );
+		if ( length >= sizeof( name ) )
+		{
+			return false;
+		}
+		memcpy( name, start, length );
+		name[ length ] = '\0';
+
+		T value;
+		if ( !parse( name, value ) )
+		{
+			return false;
+		}
+		values.push_back( value );
+		start += length + ( end != nullptr ? 1 : 0 );
+	}
+	return !values.empty();
+}
+
+// A comma separated list of counts from 1 to unMax, eg. "2,8,32". False if one isn't or the list is empty.
+bool ParseCountList( const char *pchList, uint32_t unMax, std::vector< uint32_t > &counts );
+
+//-----------------------------------------------------------------------------
+// Purpose: Walks a tool's command line of "--name value" options and "--name" flags. Every tool's loop is
+//
+//	ToolOptionParser parser( "input_benchmark", argc, argv );
+//	while ( parser.Next() )
+//	{
+//		if ( !parser.Value( "--rate-hz", options.rate_hz ) && !parser.Value( "--port", options.port ) )
+//		{
+//			parser.Unknown();
+//		}
+//	}
+//	return parser.IsValid() && <its range checks>;
+//
+// What's wrong goes to stderr prefixed with the tool's name and ends the walk. Numbers are read like atof() and
+// atoi() read them, anything after the number is ignored.
+//-----------------------------------------------------------------------------
+class ToolOptionParser
+{
+public:
+	ToolOptionParser( const char *pchTool, int argc, char **argv );
+
+	// Moves on to the next option. False once every option has been read or one was wrong.
+	bool Next();
+
+	// True if the current argument isn't an option but a plain one, eg. a file, which is then pchValue
+	bool Positional( const char *&pchValue );
+
+	// True if the current option is pchName. A flag takes no value, it's set when given.
+	bool Flag( const char *pchName, bool &bValue );
+
+	// True if the current option is pchName, which then takes the next argument as its value.
+	// A missing value is an error, the value is left alone.
+	bool Value( const char *pchName, const char *&pchValue );
+	bool Value( const char *pchName, double &fValue );
+	bool Value( const char *pchName, int &nValue );
+	bool Value( const char *pchName, uint32_t &unValue );
+	bool Value( const char *pchName, uint64_t &ulValue );
+
+	// The current option isn't one of the tool's
+	void Unknown();
+
+	// The current option's value isn't one the tool takes, pchExpected says what is, eg. "tcp, udp or shm"
+	void Invalid( const char *pchExpected );
+
+	bool IsValid() const { return is_valid_; }
+
+private:
+	const char *tool_;
+	int argc_;
+	char **argv_;
+	int index_;
+	int option_index_; // The current option, index_ moves on to its value
+	bool is_valid_;
+};
@@ -0,0 +1,30 @@
+//============ Copyright (c) Valve Corporation, All rights reserved. ============
+#include "tool_stats.h"
+
+#include <algorithm>
+
+double Mean( const std::vector< double > &values )
+{
+	double sum = 0.0;
+	for ( double value : values )
+	{
+		sum += value;
+	}
+	return values.empty() ? 0.0 : sum / values.size();
+}
+
+double Percentile95( std::vector< double > values )
+{
+	if ( values.empty() )
+	{
+		return 0.0;
+	}
+	const size_t index = static_cast< size_t >( 0.95 * ( values.size() - 1 ) );
+	std::nth_element( values.begin(), values.begin() + index, values.end() );
+	return values[ index ];
+}
+
+double Max( const std::vector< double > &values )
+{
+	return values.empty() ? 0.0 : *std::max_element( values.begin(), values.end() );
+}
@@ -0,0 +1,13 @@
+//============ Copyright (c) Valve Corporation, All rights reserved. ============
+#pragma once
+
+#include <vector>
+
+// Summaries of a tool's measurements, all 0 for none
+
+double Mean( const std::vector< double > &values );
+
+// The value 95% of the way from the smallest to the largest, not interpolated
+double Percentile95( std::vector< double > values );
+
+double Max( const std::vector< double > &values );
@@ -0,0 +1,330 @@
+//============ Copyright (c) Valve Corporation, All rights reserved. ============
+// Measures how long a sample takes from the producer to HandTrackingListener over each transport, what the
+// listener's event loop costs per sample and how quickly it starts and stops, and prints the result as one JSON object:
+//
+//	transport_benchmark [--transports tcp,udp,shm] [--producers 2] [--rate-hz 500] [--duration-s 2] [--warmup-s 0.2]
+//		[--port 65503] [--shm-spin] [--min-shm-speedup 1] [--max-stop-ms 100]
+//
+// Local stand-in producers (one for shared memory, which has a single writer) take turns sending one binary sample
+// at a time, on absolute deadlines, and wait until the listener has decoded it (its received counter moves) before
+// the next one is due. The time in between is the transport's send to receive latency: the send, the listener's
+// wakeup and the decode. Shared memory frames carry no send time, so this is timed on the producer's side, the same
+// way for every transport.
+//
+// Everything but this thread is the listener, so the process's CPU time less ours is the listener's. Per sample,
+// less the parse time it records itself, that's the dispatch overhead: waking up, finding the readable connection
+// and reading it. Start() and Stop() are timed too, Stop() with every producer still connected.
+//
+// Exits non-zero if a sample goes missing, if Stop() takes longer than --max-stop-ms, if a sample comes out of the
+// shared memory ring with a send time, or if shared memory's median isn't at least --min-shm-speedup times lower
+// than TCP's when both are measured.
+//
+// POSIX only, like driver_benchmark.
+
+#include "driver_clock.h"
+#include "hand_stream_sender.h"
+#include "hand_tracking_listener.h"
+#include "latency_histogram.h"
+#include "mock_vr_host.h"
+#include "pipeline_stats.h"
+#include "shared_memory_ring.h"
+#include "tool_clock.h"
+#include "tool_options.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <memory>
+#include <thread>
+#include <vector>
+
+// Our own ring, so a driver running on the same machine isn't disturbed
+static const char *transport_benchmark_shm_name = "handcameradriver_transport_benchmark";
+
+// A sample the listener hasn't decoded by then is counted as lost
+static constexpr int64_t k_unReceiveTimeoutNs = 100000000;
+
+struct TransportBenchmarkOptions
+{
+	std::vector< HandTransport > transports = { HandTransport_Tcp, HandTransport_Udp, HandTransport_SharedMemory };
+	uint32_t producers = 2;
+	double rate_hz = 500.0;
+	double duration_s = 2.0;
+	double warmup_s = 0.2;
+	int port = 65503;
+	bool shm_spin_wait = false;
+	double min_shm_speedup = 1.0;
+	double max_stop_ms = 100.0;
+};
+
+// Most stand-in producers, the listener serves up to 8 clients and 8 UDP sources
+static constexpr uint32_t k_unMaxProducers = 8;
+
+struct TransportResult
+{
+	HandTransport transport;
+	uint32_t producers = 0;
+	uint64_t sent = 0;
+	uint64_t received = 0;
+	uint64_t send_failures = 0;
+	LatencyHistogram send_to_receive_ns;
+
+	int64_t start_us = 0; // How long Start() took
+	int64_t stop_us = 0;  // How long Stop() took
+	double listener_cpu_ns_per_sample = 0.0;
+	double parse_ns_per_sample = 0.0;
+};
+
+//-----------------------------------------------------------------------------
+// Purpose: Whether a sample with a send time comes out of the shared memory ring without one, into a sample that
+// held a send time before, like the listener's reused batch slot
+//-----------------------------------------------------------------------------
+static bool ShmRingDropsSendTime()
+{
+	SharedMemoryRing reader;
+	SharedMemoryRing writer;
+	if ( !reader.Open( transport_benchmark_shm_name, true ) || !writer.Open( transport_benchmark_shm_name, false ) )
+	{
+		return false;
+	}
+
+	HandSample sample = {};
+	sample.hand = HandId_Left;
+	sample.fields = HandSampleField_Position | HandSampleField_Rotation | HandSampleField_SendTime;
+	sample.rotation[ 0 ] = 1.f;
+	sample.send_time_us = static_cast< uint64_t >( DriverClockUs() );
+	writer.Write( sample );
+
+	HandSample read = sample;
+	return reader.Read( read ) && ( read.fields & HandSampleField_SendTime ) == 0 && read.send_time_us == 0;
+}
+
+static uint64_t ReceivedSamples( const HandTrackingListener &listener )
+{
+	return listener.GetStreamCounters( HandId_Left ).received + listener.GetStreamCounters( HandId_Right ).received;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Starts a listener on transport, streams to it for the configured duration and times every sample
+// after the warmup. The listener has no controllers to update, only its own receive path is measured.
+//-----------------------------------------------------------------------------
+static bool RunTransport( const TransportBenchmarkOptions &options, TransportResult &result )
+{
+	std::unique_ptr< PipelineStats > stats = std::make_unique< PipelineStats >();
+	HandTrackingListener listener( nullptr, nullptr );
+	listener.SetPipelineStats( stats.get() );
+	listener.SetSharedMemoryOptions( transport_benchmark_shm_name, options.shm_spin_wait );
+
+	const int64_t start_begin_us = DriverClockUs();
+	if ( !listener.Start( options.port, result.transport ) )
+	{
+		fprintf( stderr, "transport_benchmark: The listener didn't start (%s, port %d)\n", HandTransportName( result.transport ), options.port );
+		return false;
+	}
+	result.start_us = DriverClockUs() - start_begin_us;
+
+	// The ring has a single writer
+	result.producers = result.transport == HandTransport_SharedMemory ? 1 : options.producers;
+	HandStreamSender senders[ k_unMaxProducers ];
+	for ( uint32_t producer = 0; producer < result.producers; producer++ )
+	{
+		if ( !senders[ producer ].Open( result.transport, HandStreamProtocol_Binary, options.port, transport_benchmark_shm_name, 1000 ) )
+		{
+			fprintf( stderr, "transport_benchmark: Can't connect to the listener (%s, port %d)\n", HandTransportName( result.transport ), options.port );
+			listener.Stop();
+			return false;
+		}
+	}
+
+	HandSampleBatch batch{};
+	batch.hand_count = 1;
+	HandSample &sample = batch.hands[ 0 ];
+	sample.fields = HandSampleField_Position | HandSampleField_Rotation | HandSampleField_Sequence | HandSampleField_CaptureTime;
+	sample.rotation[ 0 ] = 1.0f;
+
+	const double period_us = 1000000.0 / options.rate_hz;
+	const int64_t start_time_us = DriverClockUs() + 10000;
+	const int64_t measure_time_us = start_time_us + static_cast< int64_t >( options.warmup_s * 1e6 );
+	const int64_t end_time_us = start_time_us + static_cast< int64_t >( options.duration_s * 1e6 );
+
+	int64_t process_cpu_start_ns = 0;
+	int64_t main_cpu_start_ns = 0;
+	uint64_t received_start = 0;
+	uint64_t parsed_start = 0;
+	double parse_ns_start = 0.0;
+
+	for ( uint32_t frame = 0;; frame++ )
+	{
+		const int64_t due_time_us = start_time_us + static_cast< int64_t >( frame * period_us );
+		if ( due_time_us >= end_time_us )
+		{
+			break;
+		}
+		SleepUntilUs( due_time_us );
+
+		if ( due_time_us >= measure_time_us && process_cpu_start_ns == 0 )
+		{
+			process_cpu_start_ns = CpuTimeNs( CLOCK_PROCESS_CPUTIME_ID );
+			main_cpu_start_ns = CpuTimeNs( CLOCK_THREAD_CPUTIME_ID );
+			received_start = ReceivedSamples( listener );
+			parsed_start = stats->ParseTimeNs().Count();
+			parse_ns_start = stats->ParseTimeNs().Mean() * static_cast< double >( parsed_start );
+		}
+
+		// Every producer numbers its samples on its own, the listener keeps their sequences apart
+		const uint32_t producer = frame % result.producers;
+		sample.hand = ( frame / result.producers ) % 2 == 0 ? HandId_Left : HandId_Right;
+		sample.sequence = frame;
+		sample.position[ 0 ] = static_cast< float >( frame ) * 1e-4f;
+
+		const uint64_t received_before = ReceivedSamples( listener );
+		const int64_t send_time_ns = DriverClockNs();
+		sample.capture_time_us = static_cast< uint64_t >( send_time_ns / 1000 );
+		if ( !senders[ producer ].Send( batch ) )
+		{
+			result.send_failures++;
+			continue;
+		}
+
+		// Yield rather than spin, the listener may need this core to run at all
+		int64_t receive_time_ns = DriverClockNs();
+		while ( ReceivedSamples( listener ) == received_before && receive_time_ns - send_time_ns < k_unReceiveTimeoutNs )
+		{
+			std::this_thread::yield();
+			receive_time_ns = DriverClockNs();
+		}
+
+		if ( due_time_us < measure_time_us )
+		{
+			continue;
+		}
+		result.sent++;
+		if ( ReceivedSamples( listener ) != received_before )
+		{
+			result.received++;
+			result.send_to_receive_ns.Record( receive_time_ns - send_time_ns );
+		}
+	}
+
+	const int64_t process_cpu_ns = CpuTimeNs( CLOCK_PROCESS_CPUTIME_ID ) - process_cpu_start_ns;
+	const int64_t main_cpu_ns = CpuTimeNs( CLOCK_THREAD_CPUTIME_ID ) - main_cpu_start_ns;
+	const uint64_t received = std::max< uint64_t >( ReceivedSamples( listener ) - received_start, 1 );
+	const uint64_t parsed = stats->ParseTimeNs().Count() - parsed_start;
+	const double parse_ns = stats->ParseTimeNs().Mean() * static_cast< double >( stats->ParseTimeNs().Count() ) - parse_ns_start;
+	result.listener_cpu_ns_per_sample = static_cast< double >( process_cpu_ns - main_cpu_ns ) / received;
+	result.parse_ns_per_sample = parsed > 0 ? parse_ns / parsed : 0.0;
+
+	// With the producers still connected, the event loop has to be woken to notice
+	const int64_t stop_begin_us = DriverClockUs();
+	listener.Stop();
+	result.stop_us = DriverClockUs() - stop_begin_us;
+
+	for ( uint32_t producer = 0; producer < result.producers; producer++ )
+	{
+		senders[ producer ].Close();
+	}
+	return true;
+}
+
+static bool ParseOptions( int argc, char **argv, TransportBenchmarkOptions &options )
+{
+	ToolOptionParser parser( "transport_benchmark", argc, argv );
+	while ( parser.Next() )
+	{
+		const char *transports = nullptr;
+		if ( parser.Value( "--transports", transports ) )
+		{
+			if ( transports != nullptr && !ParseList( transports, options.transports, HandTransportFromName ) )
+			{
+				parser.Invalid( "tcp, udp or shm" );
+			}
+		}
+		else if ( !parser.Flag( "--shm-spin", options.shm_spin_wait ) && !parser.Value( "--producers", options.producers ) && !parser.Value( "--rate-hz", options.rate_hz ) &&
+				  !parser.Value( "--duration-s", options.duration_s ) && !parser.Value( "--warmup-s", options.warmup_s ) && !parser.Value( "--port", options.port ) &&
+				  !parser.Value( "--min-shm-speedup", options.min_shm_speedup ) && !parser.Value( "--max-stop-ms", options.max_stop_ms ) )
+		{
+			parser.Unknown();
+		}
+	}
+
+	return parser.IsValid() && options.producers >= 1 && options.producers <= k_unMaxProducers && options.rate_hz > 0.0 && options.rate_hz <= 10000.0 && options.duration_s > 0.0 && options.warmup_s >= 0.0 && options.warmup_s < options.duration_s &&
+		   options.port > 0 && options.port <= 65535;
+}
+
+int main( int argc, char **argv )
+{
+	TransportBenchmarkOptions options;
+	if ( !ParseOptions( argc, argv, options ) )
+	{
+		fprintf( stderr, "usage: transport_benchmark [--transports tcp,udp,shm] [--producers 2] [--rate-hz 500] [--duration-s 2] [--warmup-s 0.2]\n"
+						 "                           [--port 65503] [--shm-spin] [--min-shm-speedup 1] [--max-stop-ms 100]\n" );
+		return 2;
+	}
+
+	// The listener logs through the driver context
+	MockDriverContext context;
+	vr::InitServerDriverContext( &context );
+
+	// Histograms are too big for the stack
+	std::vector< std::unique_ptr< TransportResult > > results;
+	bool passed = true;
+	for ( HandTransport transport : options.transports )
+	{
+		results.push_back( std::make_unique< TransportResult >() );
+		results.back()->transport = transport;
+		passed &= RunTransport( options, *results.back() );
+	}
+
+	if ( std::find( options.transports.begin(), options.transports.end(), HandTransport_SharedMemory ) != options.transports.end() && !ShmRingDropsSendTime() )
+	{
+		fprintf( stderr, "transport_benchmark: A sample came out of the shared memory ring with a send time\n" );
+		passed = false;
+	}
+
+	printf( "{\"rate_hz\":%.1f,\"duration_s\":%.1f,\"shm_spin_wait\":%s,\"transports\":[", options.rate_hz, options.duration_s, options.shm_spin_wait ? "true" : "false" );
+	const TransportResult *tcp = nullptr;
+	const TransportResult *shm = nullptr;
+	for ( size_t i = 0; i < results.size(); i++ )
+	{
+		const TransportResult &result = *results[ i ];
+		const LatencyHistogram &latency = result.send_to_receive_ns;
+		printf( "%s{\"transport\":\"%s\",\"producers\":%u,\"sent\":%llu,\"received\":%llu,\"send_failures\":%llu,"
+				"\"send_to_receive_ns\":{\"mean\":%.0f,\"p50\":%lld,\"p99\":%lld,\"max\":%lld},"
+				"\"listener_cpu_ns_per_sample\":%.0f,\"parse_ns_per_sample\":%.0f,\"dispatch_ns_per_sample\":%.0f,\"start_us\":%lld,\"stop_us\":%lld}",
+			i > 0 ? "," : "", HandTransportName( result.transport ), result.producers, static_cast< unsigned long long >( result.sent ),
+			static_cast< unsigned long long >( result.received ), static_cast< unsigned long long >( result.send_failures ), latency.Mean(),
+			static_cast< long long >( latency.Percentile( 0.5 ) ), static_cast< long long >( latency.Percentile( 0.99 ) ), static_cast< long long >( latency.Max() ),
+			result.listener_cpu_ns_per_sample, result.parse_ns_per_sample, result.listener_cpu_ns_per_sample - result.parse_ns_per_sample,
+			static_cast< long long >( result.start_us ), static_cast< long long >( result.stop_us ) );
+
+		if ( result.sent == 0 || result.received != result.sent || result.send_failures > 0 )
+		{
+			fprintf( stderr, "transport_benchmark: %s received %llu of %llu samples, %llu failed to send\n", HandTransportName( result.transport ),
+				static_cast< unsigned long long >( result.received ), static_cast< unsigned long long >( result.sent ),
+				static_cast< unsigned long long >( result.send_failures ) );
+			passed = false;
+		}
+		if ( result.stop_us > static_cast< int64_t >( options.max_stop_ms * 1000.0 ) )
+		{
+			fprintf( stderr, "transport_benchmark: Stopping the %s listener took %.1f ms, expected at most %.1f\n", HandTransportName( result.transport ),
+				result.stop_us / 1000.0, options.max_stop_ms );
+			passed = false;
+		}
+		tcp = result.transport == HandTransport_Tcp ? &result : tcp;
+		shm = result.transport == HandTransport_SharedMemory ? &result : shm;
+	}
+	printf( "]}\n" );
+
+	if ( tcp != nullptr && shm != nullptr )
+	{
+		const double shm_speedup = static_cast< double >( tcp->send_to_receive_ns.Percentile( 0.5 ) ) / std::max< int64_t >( shm->send_to_receive_ns.Percentile( 0.5 ), 1 );
+		if ( shm_speedup < options.min_shm_speedup )
+		{
+			fprintf( stderr, "transport_benchmark: Shared memory's median latency is only %.2f times lower than TCP's, expected %.2f\n", shm_speedup,
+				options.min_shm_speedup );
+			passed = false;
+		}
+	}
+
+	vr::CleanupDriverContext();
+	return passed ? 0 : 1;
+}
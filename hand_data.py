@@ -1,10 +1,44 @@
 """
 Data class for hand tracking information.
 """
+import struct
 from typing import Tuple, List, Optional
 from dataclasses import dataclass
 
 
+# Binary frame layout, must match hand_protocol.h in the driver:
+# magic, version, size, hand, gesture, fields, sequence, capture time (us),
+# position x/y/z, rotation w/x/y/z, trigger, grip. All little-endian.
+BINARY_FRAME_FORMAT = '<HBBBBHIQ3f4fff'
+BINARY_FRAME_MAGIC = 0xB1C5
+BINARY_FRAME_VERSION = 1
+BINARY_FRAME_SIZE = struct.calcsize(BINARY_FRAME_FORMAT)
+
+# Every value group is present in frames we produce (position, rotation, trigger, grip, gesture)
+BINARY_FRAME_FIELDS = 0x1F
+
+HAND_IDS = {'left': 0, 'right': 1}
+
+GESTURE_CODES = {
+    'UNKNOWN': 0,
+    'OPEN': 1,
+    'FIST': 2,
+    'POINT': 3,
+    'THUMBS_UP': 4,
+    'PEACE': 5,
+    'PINCH': 6,
+}
+
+# Batch header, followed by one binary frame per hand: magic, version, header size, camera frame number, hand count,
+# send time (us)
+BATCH_HEADER_FORMAT = '<HBBIB3xQ'
+BATCH_MAGIC = 0xB2C5
+BATCH_HEADER_SIZE = struct.calcsize(BATCH_HEADER_FORMAT)
+
+_binary_frame = struct.Struct(BINARY_FRAME_FORMAT)
+_batch_header = struct.Struct(BATCH_HEADER_FORMAT)
+
+
 @dataclass
 class HandData:
     """Encapsulates all data for a tracked hand."""
@@ -17,12 +51,27 @@ class HandData:
     grip_value: float  # 0.0-1.0
     landmarks: List[Tuple[float, float, float]]  # 21 hand landmarks
     is_detected: bool = True
+    sequence: Optional[int] = None  # Per hand sample counter
+    capture_time_us: Optional[int] = None  # When the camera frame was captured (driver clock once synced)
     
-    def to_protocol_string(self) -> str:
+    def to_protocol_string(self, sequence: Optional[int] = None,
+                           capture_time_us: Optional[int] = None,
+                           send_time_us: Optional[int] = None) -> str:
         """
         Convert hand data to protocol string for socket transmission.
         Format: HAND:LEFT,X:0.5,Y:0.3,Z:-0.2,QW:1.0,QX:0.0,QY:0.0,QZ:0.0,TRIGGER:0.8,GRIP:0.0,GESTURE:POINT
+        The sequence number, capture time and send time are appended as ,SEQ:n,TS:us,SENT:us when
+        given. The sequence number defaults to the one stored in the hand data.
         """
+        if sequence is None:
+            sequence = self.sequence
+        suffix = ""
+        if sequence is not None:
+            suffix += f",SEQ:{sequence & 0xFFFFFFFF}"
+        if capture_time_us is not None:
+            suffix += f",TS:{capture_time_us}"
+        if send_time_us is not None:
+            suffix += f",SENT:{send_time_us}"
         return (
             f"HAND:{self.hand_type.upper()},"
             f"X:{self.position[0]:.4f},"
@@ -35,8 +84,67 @@ class HandData:
             f"TRIGGER:{self.trigger_value:.2f},"
             f"GRIP:{self.grip_value:.2f},"
             f"GESTURE:{self.gesture}"
+            f"{suffix}"
         )
     
+    def to_binary_frame(self, sequence: Optional[int] = None, capture_time_us: Optional[int] = None) -> bytes:
+        """
+        Convert hand data to a binary frame for socket transmission.
+        The driver detects this format from the first byte of the connection.
+        
+        Args:
+            sequence: Producer frame counter, defaults to the hand data's
+            capture_time_us: Capture time in microseconds (monotonic clock), defaults to the hand data's
+        
+        Returns:
+            Frame bytes (BINARY_FRAME_SIZE long)
+        """
+        if sequence is None:
+            sequence = self.sequence or 0
+        if capture_time_us is None:
+            capture_time_us = self.capture_time_us or 0
+        return _binary_frame.pack(
+            BINARY_FRAME_MAGIC,
+            BINARY_FRAME_VERSION,
+            BINARY_FRAME_SIZE,
+            HAND_IDS.get(self.hand_type.lower(), 0),
+            GESTURE_CODES.get(self.gesture, 0),
+            BINARY_FRAME_FIELDS,
+            sequence & 0xFFFFFFFF,
+            capture_time_us,
+            self.position[0], self.position[1], self.position[2],
+            self.rotation[0], self.rotation[1], self.rotation[2], self.rotation[3],
+            self.trigger_value,
+            self.grip_value
+        )
+    
+    @staticmethod
+    def to_batch(hands: List['HandData'], frame_number: int, capture_time_us: int,
+                 send_time_us: int, binary: bool = False):
+        """
+        Encode every hand seen in one camera frame as a single message.
+        Text: FRAME:n,TS:us,SENT:us;HAND:LEFT,...,SEQ:s;HAND:RIGHT,...,SEQ:s
+        Binary: batch header followed by one binary frame per hand.
+        
+        Args:
+            hands: Hand data, each carrying its own sequence number
+            frame_number: Camera frame counter
+            capture_time_us: Capture time in microseconds, shared by all hands
+            send_time_us: Send time in microseconds, on the same clock as the capture time
+            binary: Encode as binary instead of text
+        
+        Returns:
+            Message bytes (binary) or protocol string (text)
+        """
+        if binary:
+            header = _batch_header.pack(BATCH_MAGIC, BINARY_FRAME_VERSION, BATCH_HEADER_SIZE,
+                                        frame_number & 0xFFFFFFFF, len(hands), send_time_us)
+            return header + b''.join(hand.to_binary_frame(capture_time_us=capture_time_us) for hand in hands)
+        
+        # The hands take the batch's TS: and SENT:
+        return ';'.join([f"FRAME:{frame_number & 0xFFFFFFFF},TS:{capture_time_us},SENT:{send_time_us}"] +
+                        [hand.to_protocol_string() for hand in hands])
+    
     @staticmethod
     def create_default(hand_type: str) -> 'HandData':
         """Create a default HandData object with neutral values."""
@@ -3,5 +3,6 @@ Utility modules for HandCameraDriver.
 """
 from .camera_utils import CameraCapture
 from .socket_client import SocketClient
+from .shm_client import SharedMemoryClient
 
-__all__ = ['CameraCapture', 'SocketClient']
\ No newline at end of file
+__all__ = ['CameraCapture', 'SocketClient', 'SharedMemoryClient']
\ No newline at end of file
@@ -0,0 +1,120 @@
+"""
+Clock sync with the SteamVR driver.
+The driver answers pings with the times it received and answered them on its own monotonic
+clock. From the round trip we work out the offset between the two clocks (NTP style), so
+capture and send times can be stamped on the driver's clock and its latency numbers hold up
+across processes. Message layout in "SteamVR Driver/src/hand_protocol.h".
+"""
+import struct
+import time
+from typing import List, Optional, Tuple
+
+
+# Binary ping: magic, version, size, id, producer time, driver receive time, driver send time (us)
+CLOCK_PING_FORMAT = '<HBBIQQQ'
+CLOCK_PING_MAGIC = 0xB3C5
+CLOCK_PING_VERSION = 1
+CLOCK_PING_SIZE = struct.calcsize(CLOCK_PING_FORMAT)
+
+_clock_ping = struct.Struct(CLOCK_PING_FORMAT)
+
+
+def monotonic_us() -> int:
+    """Our own monotonic clock in microseconds (the same clock as the driver's on one machine)."""
+    return time.monotonic_ns() // 1000
+
+
+class ClockSync:
+    """Estimates the offset from our monotonic clock to the driver's. feed() may be called from another thread than the rest."""
+
+    def __init__(self, interval: float = 1.0, window: int = 8):
+        """
+        Initialize clock sync.
+
+        Args:
+            interval: Seconds between pings
+            window: Number of recent exchanges the estimate is picked from
+        """
+        self.interval = interval
+        self.window = window
+        self.offset_us = 0  # Driver clock minus ours
+        self.round_trip_us: Optional[int] = None
+        self.synced = False
+        self._next_id = 0
+        self._last_ping = None
+        self._exchanges: List[Tuple[int, int]] = []  # (round trip, offset)
+        self._buffer = b''
+
+    def now_us(self) -> int:
+        """Current time on the driver's clock, or on ours until the first reply arrives."""
+        return monotonic_us() + self.offset_us
+
+    def ping_due(self) -> bool:
+        """Whether it's time to send another ping."""
+        return self._last_ping is None or time.monotonic() - self._last_ping >= self.interval
+
+    def make_ping(self, binary: bool = False):
+        """
+        Build the next ping.
+
+        Args:
+            binary: Binary record instead of a text line, must match the connection's protocol
+
+        Returns:
+            Message bytes (binary) or protocol string (text)
+        """
+        self._last_ping = time.monotonic()
+        ping_id = self._next_id & 0xFFFFFFFF
+        self._next_id += 1
+
+        if binary:
+            return _clock_ping.pack(CLOCK_PING_MAGIC, CLOCK_PING_VERSION, CLOCK_PING_SIZE,
+                                    ping_id, monotonic_us(), 0, 0)
+        return f"PING:{ping_id},T:{monotonic_us()}\n"
+
+    def feed(self, data: bytes):
+        """Hand over whatever was received from the driver, replies may be split or combined."""
+        received_us = monotonic_us()
+        self._buffer += data
+
+        while self._buffer:
+            if self._buffer[0] == CLOCK_PING_MAGIC & 0xFF:
+                if len(self._buffer) < CLOCK_PING_SIZE:
+                    return
+                magic, _, size, _, sent_us, rx_us, tx_us = _clock_ping.unpack_from(self._buffer)
+                self._buffer = self._buffer[max(size, CLOCK_PING_SIZE):]
+                if magic == CLOCK_PING_MAGIC:
+                    self._add_exchange(sent_us, rx_us, tx_us, received_us)
+                continue
+
+            newline = self._buffer.find(b'\n')
+            if newline < 0:
+                return
+            line = self._buffer[:newline].decode('utf-8', errors='replace')
+            self._buffer = self._buffer[newline + 1:]
+            self._parse_pong(line, received_us)
+
+    def reset(self):
+        """Forget partial replies, eg. after reconnecting. The offset is kept until new replies arrive."""
+        self._buffer = b''
+        self._last_ping = None
+
+    def _parse_pong(self, line: str, received_us: int):
+        if not line.startswith("PONG:"):
+            return
+        try:
+            values = dict(token.split(':', 1) for token in line.strip().split(','))
+            self._add_exchange(int(values['T']), int(values['RX']), int(values['TX']), received_us)
+        except (KeyError, ValueError):
+            pass
+
+    def _add_exchange(self, sent_us: int, rx_us: int, tx_us: int, received_us: int):
+        round_trip = (received_us - sent_us) - (tx_us - rx_us)
+        offset = ((rx_us - sent_us) + (tx_us - received_us)) // 2
+
+        self._exchanges.append((round_trip, offset))
+        del self._exchanges[:-self.window]
+
+        # The exchange with the shortest round trip waited in the fewest queues, so its offset is the most accurate
+        self.round_trip_us, self.offset_us = min(self._exchanges)
+        self.synced = True
@@ -0,0 +1,175 @@
+"""
+Shared memory client for communication with the SteamVR driver on the same machine.
+Writes binary hand frames into the seqlock ring the driver creates under /dev/shm
+(layout in "SteamVR Driver/src/shared_memory_ring.h").
+"""
+import ctypes
+import mmap
+import os
+import platform
+import struct
+from typing import Optional
+
+from hand_data import BINARY_FRAME_SIZE
+from utils.clock_sync import monotonic_us
+
+
+RING_MAGIC = 0x4D534348  # "HCSM"
+RING_VERSION = 1
+RING_HEADER_SIZE = 64
+RING_SLOT_SIZE = 64
+RING_SLOT_COUNT = 64
+
+# Header field offsets
+_READER_WAITING_OFFSET = 12
+_WRITE_INDEX_OFFSET = 16
+_WAKE_WORD_OFFSET = 24
+
+# Slot layout: seqlock counter, then the binary frame
+_SLOT_FRAME_OFFSET = 4
+
+_FUTEX_WAKE = 1
+_SYS_FUTEX = {'x86_64': 202, 'aarch64': 98, 'i386': 240, 'i686': 240}
+
+
+class SharedMemoryClient:
+    """Publishes binary hand frames into the driver's shared memory ring."""
+
+    def __init__(self, name: str = "handcameradriver", wake: bool = True):
+        """
+        Initialize shared memory client.
+
+        Args:
+            name: Ring name, the file is /dev/shm/<name> (must match the driver's shm_name)
+            wake: Wake the driver with a futex when it is sleeping. Turn off if the
+                driver is set to spin wait.
+        """
+        self.name = name
+        self.wake = wake
+        self.path = os.path.join("/dev/shm", name)
+        self.mapping: Optional[mmap.mmap] = None
+        self.connected = False
+        self._libc = None
+        self._futex_address = 0
+        self._sys_futex = _SYS_FUTEX.get(platform.machine())
+
+    def connect(self) -> bool:
+        """
+        Attach to the ring the driver created.
+
+        Returns:
+            True if attached successfully, False otherwise
+        """
+        try:
+            if self.mapping:
+                self.close()
+
+            size = RING_HEADER_SIZE + RING_SLOT_COUNT * RING_SLOT_SIZE
+            fd = os.open(self.path, os.O_RDWR)
+            try:
+                self.mapping = mmap.mmap(fd, size, mmap.MAP_SHARED, mmap.PROT_READ | mmap.PROT_WRITE)
+            finally:
+                os.close(fd)
+
+            magic, version, slot_size, slot_count = struct.unpack_from('<IHHI', self.mapping, 0)
+            if (magic != RING_MAGIC or version != RING_VERSION or
+                    slot_size != RING_SLOT_SIZE or slot_count != RING_SLOT_COUNT):
+                print(f"Shared memory ring {self.path} has an unexpected layout")
+                self.close()
+                return False
+
+            if self.wake and self._sys_futex is not None:
+                self._libc = ctypes.CDLL(None, use_errno=True)
+                buffer = (ctypes.c_char * len(self.mapping)).from_buffer(self.mapping)
+                self._futex_address = ctypes.addressof(buffer) + _WAKE_WORD_OFFSET
+                del buffer
+
+            self.connected = True
+            print(f"Attached to SteamVR driver shared memory ring {self.path}")
+            return True
+
+        except Exception as e:
+            print(f"Failed to attach to shared memory ring {self.path}: {e}")
+            self.connected = False
+            return False
+
+    def send(self, data) -> bool:
+        """
+        Publish one or more back to back binary frames.
+
+        Args:
+            data: Binary frames (bytes), see HandData.to_binary_frame()
+
+        Returns:
+            True if published, False otherwise
+        """
+        if not self.connected or not isinstance(data, (bytes, bytearray)):
+            return False
+
+        for offset in range(0, len(data) - BINARY_FRAME_SIZE + 1, BINARY_FRAME_SIZE):
+            self._write_slot(data[offset:offset + BINARY_FRAME_SIZE])
+        return True
+
+    def send_frame(self, messages: list) -> bool:
+        """
+        Publish every binary frame produced for one camera frame.
+
+        Args:
+            messages: Binary frames (bytes)
+
+        Returns:
+            True if published, False otherwise
+        """
+        return self.send(b''.join(messages))
+
+    def _write_slot(self, frame: bytes):
+        """Seqlock write of one frame, see SharedMemoryRing::Write()."""
+        mapping = self.mapping
+        index = struct.unpack_from('<Q', mapping, _WRITE_INDEX_OFFSET)[0]
+        slot = RING_HEADER_SIZE + (index % RING_SLOT_COUNT) * RING_SLOT_SIZE
+
+        # Odd while writing, then the value that tells the reader this slot holds sample 'index'
+        struct.pack_into('<I', mapping, slot, (index * 2 + 1) & 0xFFFFFFFF)
+        mapping[slot + _SLOT_FRAME_OFFSET:slot + _SLOT_FRAME_OFFSET + BINARY_FRAME_SIZE] = frame
+        struct.pack_into('<I', mapping, slot, (index * 2 + 2) & 0xFFFFFFFF)
+        struct.pack_into('<Q', mapping, _WRITE_INDEX_OFFSET, index + 1)
+
+        wake_word = struct.unpack_from('<I', mapping, _WAKE_WORD_OFFSET)[0]
+        struct.pack_into('<I', mapping, _WAKE_WORD_OFFSET, (wake_word + 1) & 0xFFFFFFFF)
+
+        # Only make the syscall when the driver is actually asleep
+        if self._libc is not None and struct.unpack_from('<I', mapping, _READER_WAITING_OFFSET)[0]:
+            self._libc.syscall(self._sys_futex, ctypes.c_void_p(self._futex_address),
+                               _FUTEX_WAKE, 1, None, None, 0)
+
+    def now_us(self) -> int:
+        """
+        Current time in microseconds for capture timestamps. The ring is one way, so there is no
+        clock ping, but the driver on this machine reads the same monotonic clock.
+        """
+        return monotonic_us()
+
+    def close(self):
+        """Detach from the ring."""
+        if self.mapping:
+            try:
+                self.mapping.close()
+            except:
+                pass
+            self.mapping = None
+        self._libc = None
+        self.connected = False
+        print("Shared memory ring closed")
+
+    def is_connected(self) -> bool:
+        """Check if attached to the ring."""
+        return self.connected
+
+    def __enter__(self):
+        """Context manager entry."""
+        self.connect()
+        return self
+
+    def __exit__(self, exc_type, exc_val, exc_tb):
+        """Context manager exit."""
+        self.close()
@@ -1,16 +1,24 @@
 """
 Socket client for communication with SteamVR driver.
 """
+import select
 import socket
+import threading
 import time
 from typing import Optional
 
+from utils.clock_sync import ClockSync
+
 
 class SocketClient:
     """Handles socket communication with the SteamVR driver."""
     
+    # Longest the clock reply reader takes to notice the socket is being closed, in seconds
+    CLOCK_READER_POLL = 0.1
+    
     def __init__(self, host: str = "127.0.0.1", port: int = 65432, 
-                 auto_reconnect: bool = True, reconnect_interval: float = 5.0):
+                 auto_reconnect: bool = True, reconnect_interval: float = 5.0,
+                 transport: str = "tcp", protocol: str = "text", clock_sync: bool = True):
         """
         Initialize socket client.
         
@@ -19,14 +27,23 @@ class SocketClient:
             port: Server port
             auto_reconnect: Whether to automatically reconnect on connection loss
             reconnect_interval: Seconds between reconnection attempts
+            transport: "tcp" for a stream connection, or "udp" to send one
+                datagram per camera frame (must match the driver's setting)
+            protocol: "text" or "binary", what the data passed to send() is encoded as
+            clock_sync: Ping the driver to line our clock up with its clock, see now_us()
         """
         self.host = host
         self.port = port
+        self.transport = transport
         self.auto_reconnect = auto_reconnect
         self.reconnect_interval = reconnect_interval
         self.socket: Optional[socket.socket] = None
         self.connected = False
         self.last_reconnect_attempt = 0.0
+        self.protocol = protocol
+        self.clock = ClockSync() if clock_sync else None
+        self._clock_reader: Optional[threading.Thread] = None
+        self._clock_reader_stop = threading.Event()
         
     def connect(self) -> bool:
         """
@@ -39,11 +56,20 @@ class SocketClient:
             if self.socket:
                 self.close()
             
-            self.socket = socket.socket(socket.AF_INET, socket.SOCK_STREAM)
-            self.socket.settimeout(5.0)
+            if self.transport == "udp":
+                # Connecting a datagram socket only fixes the destination, nothing is sent
+                self.socket = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+            else:
+                self.socket = socket.socket(socket.AF_INET, socket.SOCK_STREAM)
+                self.socket.settimeout(5.0)
+                # Every write is a complete message that should go out right away
+                self.socket.setsockopt(socket.IPPROTO_TCP, socket.TCP_NODELAY, 1)
             self.socket.connect((self.host, self.port))
             self.connected = True
-            print(f"Connected to SteamVR driver at {self.host}:{self.port}")
+            if self.clock:
+                self.clock.reset()
+                self._start_clock_reader()
+            print(f"Connected to SteamVR driver at {self.host}:{self.port} ({self.transport.upper()})")
             return True
             
         except Exception as e:
@@ -51,12 +77,12 @@ class SocketClient:
             self.connected = False
             return False
     
-    def send(self, data: str) -> bool:
+    def send(self, data) -> bool:
         """
         Send data to the server.
         
         Args:
-            data: String data to send
+            data: Protocol string, or an already encoded binary frame (bytes)
         
         Returns:
             True if sent successfully, False otherwise
@@ -73,20 +99,109 @@ class SocketClient:
                 return False
         
         try:
-            # Ensure data ends with newline for easier parsing
-            if not data.endswith('\n'):
-                data += '\n'
+            if isinstance(data, str):
+                # Ensure data ends with newline for easier parsing
+                if not data.endswith('\n'):
+                    data += '\n'
+                data = data.encode('utf-8')
             
-            self.socket.sendall(data.encode('utf-8'))
+            ping = self._next_ping()
+            if ping and self.transport != "udp":
+                # Same write as the data, a stream message never arrives split over two
+                data = ping + data
+                ping = None
+            
+            if self.transport == "udp":
+                if ping:
+                    self.socket.send(ping)
+                self.socket.send(data)
+            else:
+                self.socket.sendall(data)
             return True
             
+        except ConnectionRefusedError:
+            # UDP: nothing is listening on the driver side (yet). The socket stays usable.
+            if self.transport == "udp":
+                return False
+            print("Error sending data: connection refused")
+            self.connected = False
+            return False
         except Exception as e:
             print(f"Error sending data: {e}")
             self.connected = False
             return False
     
+    def send_frame(self, messages: list) -> bool:
+        """
+        Send every message produced for one camera frame at once.
+        Over UDP this is a single datagram, over TCP a single write.
+        
+        Args:
+            messages: Protocol strings, or binary frames (bytes)
+        
+        Returns:
+            True if sent successfully, False otherwise
+        """
+        if not messages:
+            return True
+        
+        if isinstance(messages[0], str):
+            return self.send(''.join(m if m.endswith('\n') else m + '\n' for m in messages))
+        return self.send(b''.join(messages))
+    
+    def now_us(self) -> int:
+        """
+        Current time in microseconds for capture and send timestamps.
+        On the driver's clock once it has answered a ping, on our monotonic clock before that.
+        """
+        if self.clock:
+            return self.clock.now_us()
+        return time.monotonic_ns() // 1000
+    
+    def _next_ping(self) -> Optional[bytes]:
+        """The clock ping to send along with the next message, if one is due."""
+        if not self.clock or not self.clock.ping_due():
+            return None
+        ping = self.clock.make_ping(binary=self.protocol == "binary")
+        return ping.encode('utf-8') if isinstance(ping, str) else ping
+    
+    def _start_clock_reader(self):
+        """
+        Read the driver's clock replies on a thread of their own, so each is timestamped as it arrives
+        without the camera loop waiting for it. Stopped by close().
+        """
+        self._clock_reader_stop.clear()
+        self._clock_reader = threading.Thread(target=self._read_clock_replies, args=(self.socket,),
+                                              name="clock-replies", daemon=True)
+        self._clock_reader.start()
+    
+    def _stop_clock_reader(self):
+        """Wait for the clock reply reader to let go of the socket."""
+        if self._clock_reader:
+            self._clock_reader_stop.set()
+            self._clock_reader.join()
+            self._clock_reader = None
+    
+    def _read_clock_replies(self, sock: socket.socket):
+        """Hand whatever the driver sends back to the clock sync until stopped or the connection ends."""
+        while not self._clock_reader_stop.is_set():
+            try:
+                if not select.select([sock], [], [], self.CLOCK_READER_POLL)[0]:
+                    continue
+                data = sock.recv(4096)
+            except (BlockingIOError, socket.timeout, ConnectionRefusedError):
+                # UDP: the driver wasn't listening when a ping arrived, the next ping tries again
+                continue
+            except (OSError, ValueError):
+                # Reset or closed under us, send() notices and reconnects
+                return
+            if not data:
+                return
+            self.clock.feed(data)
+    
     def close(self):
         """Close the socket connection."""
+        self._stop_clock_reader()
         if self.socket:
             try:
                 self.socket.close()